@@ -0,0 +1,177 @@
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+
+
+static constexpr uint64_t MAX_ITERATIONS = 1000000000ull;
+
+
+bool BenchmarkState::running() {
+    if(!m_started) {
+        m_started = true;
+        m_allocations = allocation_count();
+        m_allocation_bytes = allocated_bytes();
+        m_start = std::chrono::steady_clock::now();
+    }
+    if(m_done < m_target) {
+        m_done += 1;
+        return true;
+    }
+    m_end = std::chrono::steady_clock::now();
+    m_allocations = allocation_count() - m_allocations;
+    m_allocation_bytes = allocated_bytes() - m_allocation_bytes;
+    return false;
+}
+ 
+void BenchmarkState::set_counter(const std::string& name, double value) {
+    for(auto& counter : m_counters) {
+        if(counter.first == name) {
+            counter.second = value;
+            return;
+        }
+    }
+    m_counters.emplace_back(name, value);
+}
+ 
+void BenchmarkRunner::add(const std::string& name, BenchmarkFunction function) {
+    m_benchmarks.push_back(Entry{name, std::move(function)});
+}
+ 
+std::vector<BenchmarkResult> BenchmarkRunner::run(const std::string& filter, double min_seconds) const {
+    std::vector<BenchmarkResult> results;
+    for(const auto& entry : m_benchmarks) {
+        if(entry.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(run_one(entry, min_seconds));
+    }
+    return results;
+}
+ 
+void BenchmarkRunner::list(std::ostream& stream) const {
+    for(const auto& entry : m_benchmarks) {
+        stream << entry.name << "\n";
+    }
+}
+ 
+BenchmarkResult BenchmarkRunner::run_one(const Entry& entry, double min_seconds) const {
+    BenchmarkResult result;
+    result.name = entry.name;
+
+    // Start from a single iteration, which doubles as warm up, and scale the
+    // count from the measured time until a run is long enough to trust.
+    uint64_t iterations = 1;
+    while(true) {
+        BenchmarkState state(iterations);
+        entry.function(state);
+        if(!state.skip_reason().empty()) {
+            result.skip_reason = state.skip_reason();
+            return result;
+        }
+
+        double seconds = state.seconds();
+        if(seconds >= min_seconds || iterations >= MAX_ITERATIONS) {
+            double count = static_cast<double>(state.iterations());
+            result.iterations = state.iterations();
+            result.ns_per_iteration = seconds * 1e9 / count;
+            result.items_per_second = state.items_per_iteration() * count / seconds;
+            result.bytes_per_second = state.bytes_per_iteration() * count / seconds;
+            result.allocations_per_iteration = state.allocations() / count;
+            result.allocated_bytes_per_iteration = state.allocation_bytes() / count;
+            result.counters = state.counters();
+            return result;
+        }
+
+        double scale = seconds > 0.0 ? min_seconds * 1.4 / seconds : 10.0;
+        scale = std::clamp(scale, 2.0, 10.0);
+        iterations = std::min(MAX_ITERATIONS, static_cast<uint64_t>(iterations * scale));
+    }
+}
+ 
+void write_console(std::ostream& stream, const std::vector<BenchmarkResult>& results) {
+    std::size_t width = 9;
+    for(const auto& result : results) {
+        width = std::max(width, result.name.size());
+    }
+
+    stream << std::left << std::setw(width + 2) << "Benchmark" << std::right
+        << std::setw(14) << "ns/iter" << std::setw(12) << "iters" << std::setw(14) << "items/s"
+        << std::setw(12) << "MB/s" << std::setw(12) << "allocs/it" << std::setw(12) << "bytes/it" << "\n";
+    for(const auto& result : results) {
+        stream << std::left << std::setw(width + 2) << result.name << std::right;
+        if(!result.skip_reason.empty()) {
+            stream << "skipped: " << result.skip_reason << "\n";
+            continue;
+        }
+        stream << std::fixed << std::setprecision(1)
+            << std::setw(14) << result.ns_per_iteration << std::setw(12) << result.iterations
+            << std::setw(14) << std::setprecision(0) << result.items_per_second
+            << std::setw(12) << std::setprecision(1) << result.bytes_per_second / (1024.0 * 1024.0)
+            << std::setw(12) << std::setprecision(2) << result.allocations_per_iteration
+            << std::setw(12) << std::setprecision(0) << result.allocated_bytes_per_iteration;
+        stream << std::defaultfloat << std::setprecision(4);
+        for(const auto& counter : result.counters) {
+            stream << "  " << counter.first << "=" << counter.second;
+        }
+        stream << "\n";
+    }
+}
+ 
+static void write_json_string(std::ostream& stream, const std::string& value) {
+    stream << '"';
+    for(char c : value) {
+        switch(c) {
+            case '"': stream << "\\\""; break;
+            case '\\': stream << "\\\\"; break;
+            case '\n': stream << "\\n"; break;
+            case '\t': stream << "\\t"; break;
+            default:
+                if(static_cast<unsigned char>(c) < 0x20) {
+                    stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c)
+                        << std::dec << std::setfill(' ');
+                } else {
+                    stream << c;
+                }
+        }
+    }
+    stream << '"';
+}
+ 
+void write_json(std::ostream& stream, const BenchmarkContext& context, const std::vector<BenchmarkResult>& results) {
+    stream << std::setprecision(10);
+    stream << "{\n  \"context\": {\n    \"date\": ";
+    write_json_string(stream, context.date);
+    stream << ",\n    \"device\": ";
+    write_json_string(stream, context.device);
+    stream << ",\n    \"min_time_s\": " << context.min_seconds << "\n  },\n  \"benchmarks\": [";
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        const auto& result = results[i];
+        stream << (i == 0 ? "\n" : ",\n") << "    {\"name\": ";
+        write_json_string(stream, result.name);
+        if(!result.skip_reason.empty()) {
+            stream << ", \"skipped\": ";
+            write_json_string(stream, result.skip_reason);
+            stream << "}";
+            continue;
+        }
+        stream << ", \"iterations\": " << result.iterations
+            << ", \"ns_per_iteration\": " << result.ns_per_iteration
+            << ", \"items_per_second\": " << result.items_per_second
+            << ", \"bytes_per_second\": " << result.bytes_per_second
+            << ", \"allocations_per_iteration\": " << result.allocations_per_iteration
+            << ", \"allocated_bytes_per_iteration\": " << result.allocated_bytes_per_iteration;
+        if(!result.counters.empty()) {
+            stream << ", \"counters\": {";
+            for(std::size_t j = 0; j < result.counters.size(); ++j) {
+                stream << (j == 0 ? "" : ", ");
+                write_json_string(stream, result.counters[j].first);
+                stream << ": " << result.counters[j].second;
+            }
+            stream << "}";
+        }
+        stream << "}";
+    }
+    stream << "\n  ]\n}\n";
+}
@@ -0,0 +1,131 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "AllocationCounter.h"
+
+// Keeps the compiler from discarding a value whose computation is being
+// measured.
+template <typename T>
+inline void do_not_optimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+
+// Handed to every benchmark function. The function does its setup, then
+// loops on running(); only the loop is timed and has its allocations
+// counted.
+//
+//     runner.add("thing/work", [](BenchmarkState& state) {
+//         Thing thing;
+//         while(state.running()) {
+//             do_not_optimize(thing.work());
+//         }
+//         state.set_items_per_iteration(1);
+//     });
+class BenchmarkState {
+public:
+    explicit BenchmarkState(uint64_t iterations): m_target(iterations) { }
+    ~BenchmarkState() = default;
+
+    BenchmarkState(const BenchmarkState& other) = delete;
+    BenchmarkState(BenchmarkState&& other) noexcept = delete;
+    BenchmarkState& operator =(const BenchmarkState& other) = delete;
+    BenchmarkState& operator =(BenchmarkState&& other) noexcept = delete;
+
+    bool running();
+
+    void set_items_per_iteration(uint64_t items) { m_items = items; }
+    void set_bytes_per_iteration(uint64_t bytes) { m_bytes = bytes; }
+    // Extra figures reported next to the timings, e.g. a compression ratio.
+    void set_counter(const std::string& name, double value);
+    // Marks the benchmark as not runnable here, e.g. no Vulkan device.
+    void skip(const std::string& reason) { m_skip_reason = reason; }
+
+    uint64_t iterations() const { return m_done; }
+    uint64_t items_per_iteration() const { return m_items; }
+    uint64_t bytes_per_iteration() const { return m_bytes; }
+    uint64_t allocations() const { return m_allocations; }
+    uint64_t allocation_bytes() const { return m_allocation_bytes; }
+    double seconds() const { return std::chrono::duration<double>(m_end - m_start).count(); }
+    const std::string& skip_reason() const { return m_skip_reason; }
+    const std::vector<std::pair<std::string, double>>& counters() const { return m_counters; }
+
+private:
+    uint64_t m_target;
+    uint64_t m_done = 0;
+    bool m_started = false;
+    std::chrono::steady_clock::time_point m_start;
+    std::chrono::steady_clock::time_point m_end;
+    uint64_t m_allocations = 0;
+    uint64_t m_allocation_bytes = 0;
+    uint64_t m_items = 0;
+    uint64_t m_bytes = 0;
+    std::string m_skip_reason;
+    std::vector<std::pair<std::string, double>> m_counters;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string skip_reason;
+    uint64_t iterations = 0;
+    double ns_per_iteration = 0.0;
+    double items_per_second = 0.0;
+    double bytes_per_second = 0.0;
+    double allocations_per_iteration = 0.0;
+    double allocated_bytes_per_iteration = 0.0;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+class BenchmarkRunner {
+public:
+    using BenchmarkFunction = std::function<void(BenchmarkState& state)>;
+
+    BenchmarkRunner() = default;
+    ~BenchmarkRunner() = default;
+
+    BenchmarkRunner(const BenchmarkRunner& other) = delete;
+    BenchmarkRunner(BenchmarkRunner&& other) noexcept = delete;
+    BenchmarkRunner& operator =(const BenchmarkRunner& other) = delete;
+    BenchmarkRunner& operator =(BenchmarkRunner&& other) noexcept = delete;
+
+    void add(const std::string& name, BenchmarkFunction function);
+
+    // Runs every benchmark whose name contains filter, growing the iteration
+    // count until one run takes at least min_seconds.
+    std::vector<BenchmarkResult> run(const std::string& filter, double min_seconds) const;
+    void list(std::ostream& stream) const;
+
+private:
+    struct Entry {
+        std::string name;
+        BenchmarkFunction function;
+    };
+
+    BenchmarkResult run_one(const Entry& entry, double min_seconds) const;
+
+    std::vector<Entry> m_benchmarks;
+};
+
+struct BenchmarkContext {
+    std::string date;
+    std::string device;
+    double min_seconds = 0.0;
+};
+
+void write_console(std::ostream& stream, const std::vector<BenchmarkResult>& results);
+void write_json(std::ostream& stream, const BenchmarkContext& context, const std::vector<BenchmarkResult>& results);
+
+#endif
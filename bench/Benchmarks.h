@@ -0,0 +1,16 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+#include "Benchmark.h"
+
+void register_device_query_benchmarks(BenchmarkRunner& runner);
+void register_transform_benchmarks(BenchmarkRunner& runner);
+void register_terrain_benchmarks(BenchmarkRunner& runner);
+void register_command_recording_benchmarks(BenchmarkRunner& runner);
+void register_codec_benchmarks(BenchmarkRunner& runner);
+void register_job_benchmarks(BenchmarkRunner& runner);
+void register_frame_arena_benchmarks(BenchmarkRunner& runner);
+void register_scene_benchmarks(BenchmarkRunner& runner);
+void register_raycast_benchmarks(BenchmarkRunner& runner);
+
+#endif
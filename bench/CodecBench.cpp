@@ -0,0 +1,112 @@
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "Heightmap.h"
+#include "MeshCodec.h"
+#include "TerrainGenerator.h"
+
+
+// Same tile and heightmap sizes as the streamed and heightmap terrain.
+static constexpr uint32_t TILE_RESOLUTION = 33;
+static constexpr uint32_t HEIGHTMAP_SAMPLES = 16 * (TILE_RESOLUTION - 1) + 1;
+
+
+struct CodecTile {
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<std::byte> encoded;
+
+    std::size_t raw_size() const { return vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint16_t); }
+};
+
+
+static CodecTile build_tile() {
+    TerrainGenerator generator;
+    CodecTile tile;
+    generator.build_patch(glm::vec2(3.0f, 5.0f), 1.0f, TILE_RESOLUTION, tile.vertices, tile.indices);
+    MeshCodec::encode_mesh(tile.vertices, tile.indices, TILE_RESOLUTION, tile.encoded);
+    return tile;
+}
+ 
+static void decode_tile(BenchmarkState& state, bool simd) {
+    if(simd && !MeshCodec::simd_supported()) {
+        state.skip("no SSE2");
+        return;
+    }
+    CodecTile tile = build_tile();
+    MeshCodec codec(simd);
+    // One decode outside the loop sizes the codec's scratch memory.
+    std::vector<Vertex> vertices(tile.vertices.size());
+    std::vector<uint16_t> indices(tile.indices.size());
+    codec.decode_mesh(tile.encoded.data(), tile.encoded.size(), vertices.data(), vertices.size(),
+        indices.data(), indices.size());
+
+    while(state.running()) {
+        codec.decode_mesh(tile.encoded.data(), tile.encoded.size(), vertices.data(), vertices.size(),
+            indices.data(), indices.size());
+        do_not_optimize(vertices.data());
+        do_not_optimize(indices.data());
+    }
+    state.set_items_per_iteration(vertices.size());
+    state.set_bytes_per_iteration(tile.raw_size());
+    state.set_counter("ratio", static_cast<double>(tile.raw_size()) / tile.encoded.size());
+}
+ 
+static void decode_heightfield(BenchmarkState& state, bool simd) {
+    if(simd && !MeshCodec::simd_supported()) {
+        state.skip("no SSE2");
+        return;
+    }
+    TerrainGenerator generator;
+    Heightmap heightmap(generator, glm::vec2(-8.0f), 1.0f / (TILE_RESOLUTION - 1), HEIGHTMAP_SAMPLES,
+        HEIGHTMAP_SAMPLES, VK_FORMAT_R16_UNORM);
+    std::vector<uint16_t> samples(heightmap.data().size() / sizeof(uint16_t));
+    std::memcpy(samples.data(), heightmap.data().data(), heightmap.data().size());
+    std::vector<std::byte> encoded;
+    MeshCodec::encode_heightfield(samples.data(), heightmap.width(), heightmap.height(), encoded);
+
+    MeshCodec codec(simd);
+    std::vector<uint16_t> decoded(samples.size());
+    codec.decode_heightfield(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+    while(state.running()) {
+        codec.decode_heightfield(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+        do_not_optimize(decoded.data());
+    }
+    state.set_items_per_iteration(samples.size());
+    state.set_bytes_per_iteration(samples.size() * sizeof(uint16_t));
+    state.set_counter("ratio", static_cast<double>(samples.size() * sizeof(uint16_t)) / encoded.size());
+}
+ 
+void register_codec_benchmarks(BenchmarkRunner& runner) {
+    runner.add("codec/encode_tile", [](BenchmarkState& state) {
+        CodecTile tile = build_tile();
+        std::vector<std::byte> encoded;
+        encoded.reserve(tile.raw_size());
+        while(state.running()) {
+            encoded.clear();
+            MeshCodec::encode_mesh(tile.vertices, tile.indices, TILE_RESOLUTION, encoded);
+            do_not_optimize(encoded.data());
+        }
+        state.set_items_per_iteration(tile.vertices.size());
+        state.set_bytes_per_iteration(tile.raw_size());
+        state.set_counter("ratio", static_cast<double>(tile.raw_size()) / tile.encoded.size());
+    });
+
+    // Bytes are decoded bytes, i.e. what ends up in staging memory.
+    runner.add("codec/decode_tile", [](BenchmarkState& state) {
+        decode_tile(state, true);
+    });
+    runner.add("codec/decode_tile_scalar", [](BenchmarkState& state) {
+        decode_tile(state, false);
+    });
+    runner.add("codec/decode_heightfield", [](BenchmarkState& state) {
+        decode_heightfield(state, true);
+    });
+    runner.add("codec/decode_heightfield_scalar", [](BenchmarkState& state) {
+        decode_heightfield(state, false);
+    });
+}
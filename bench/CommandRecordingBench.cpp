@@ -0,0 +1,610 @@
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "HeadlessContext.h"
+#include "PipelineManager.h"
+#include "RenderGraph.h"
+#include "RenderTypes.h"
+#include "SceneFrame.h"
+#include "TerrainGenerator.h"
+#include "TileCache.h"
+
+
+static constexpr VkExtent2D TARGET_SIZE = {1920, 1080};
+static constexpr VkFormat TARGET_FORMAT = VK_FORMAT_B8G8R8A8_UNORM;
+static constexpr uint32_t TILE_RESOLUTION = 33;
+static constexpr std::size_t MAX_TILES = 21 * 21;
+static constexpr std::size_t MAX_OBJECTS = 16;
+static constexpr uint32_t TERRAIN_OBJECT = 1;
+
+
+// Offscreen stand-in for the swapchain renderer: one color target and render
+// pass, with the scene pipeline, frame descriptors and tile draws recorded
+// by the same PipelineManager, FrameDescriptors and TileCache code. Several
+// views get one target layer each and are rendered like Simulation does,
+// by one multiview pass or by one pass per view.
+class RecordingScene {
+public:
+    RecordingScene(HeadlessContext& context, const ViewLayout& views);
+    ~RecordingScene();
+
+    RecordingScene(const RecordingScene& other) = delete;
+    RecordingScene(RecordingScene&& other) noexcept = delete;
+    RecordingScene& operator =(const RecordingScene& other) = delete;
+    RecordingScene& operator =(RecordingScene&& other) noexcept = delete;
+
+    std::unique_ptr<RenderGraph> build_graph(std::size_t tiles);
+    // Writes the sets of all view passes and returns the first one.
+    VkDescriptorSet write_descriptors();
+    void record(const RenderGraph& graph);
+    // Submits the last recording and waits for it to complete.
+    void submit();
+
+private:
+    void create_target();
+    void create_render_pass();
+    void create_pipeline();
+    void create_buffers();
+    void write_frame_data();
+    void record_scene_pass(VkCommandBuffer command_buffer, std::size_t tiles);
+
+    HeadlessContext& m_context;
+    VkDevice m_device;
+    ViewLayout m_views;
+
+    VkImage m_target;
+    VkDeviceMemory m_target_mem;
+    // One per view pass, like the framebuffers.
+    std::vector<VkImageView> m_target_views;
+    VkRenderPass m_render_pass;
+    std::vector<VkFramebuffer> m_framebuffers;
+
+    std::unique_ptr<DescriptorLayoutCache> m_layout_cache;
+    std::unique_ptr<DescriptorAllocator> m_descriptors;
+    VkDescriptorSetLayout m_desc_set_layout;
+    VkPipelineLayout m_pipeline_layout;
+    std::unique_ptr<PipelineManager> m_pipelines;
+    VkPipeline m_pipeline;
+
+    VkBuffer m_ubo;
+    VkDeviceMemory m_ubo_mem;
+    VkDeviceSize m_ubo_stride;
+    std::vector<VkDescriptorSet> m_frame_sets;
+    VkBuffer m_object_buffer;
+    VkDeviceMemory m_object_buffer_mem;
+    std::unique_ptr<TileCache> m_tiles;
+    std::vector<TileCoord> m_tile_coords;
+
+    VkCommandBuffer m_command_buffer;
+    VkFence m_fence;
+};
+
+
+RecordingScene::RecordingScene(HeadlessContext& context, const ViewLayout& views):
+    m_context(context),
+    m_device(context.device()),
+    m_views(views)
+{
+    create_target();
+    create_render_pass();
+    create_pipeline();
+    create_buffers();
+    write_frame_data();
+
+    m_descriptors = std::make_unique<DescriptorAllocator>(m_device, std::vector<DescriptorPoolRatio>{
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+    }, 4);
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = m_context.command_pool();
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+    if(vkAllocateCommandBuffers(m_device, &allocInfo, &m_command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate command buffers!");
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    if(vkCreateFence(m_device, &fenceInfo, nullptr, &m_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create fence!");
+    }
+}
+ 
+RecordingScene::~RecordingScene() {
+    vkDestroyFence(m_device, m_fence, nullptr);
+    vkFreeCommandBuffers(m_device, m_context.command_pool(), 1, &m_command_buffer);
+    m_tiles.reset();
+    vkDestroyBuffer(m_device, m_object_buffer, nullptr);
+    vkFreeMemory(m_device, m_object_buffer_mem, nullptr);
+    vkDestroyBuffer(m_device, m_ubo, nullptr);
+    vkFreeMemory(m_device, m_ubo_mem, nullptr);
+    m_descriptors.reset();
+    m_pipelines.reset();
+    vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+    m_layout_cache.reset();
+    for(VkFramebuffer framebuffer : m_framebuffers) {
+        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+    }
+    vkDestroyRenderPass(m_device, m_render_pass, nullptr);
+    for(VkImageView view : m_target_views) {
+        vkDestroyImageView(m_device, view, nullptr);
+    }
+    vkDestroyImage(m_device, m_target, nullptr);
+    vkFreeMemory(m_device, m_target_mem, nullptr);
+}
+ 
+void RecordingScene::create_target() {
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = TARGET_FORMAT;
+    imageInfo.extent = {TARGET_SIZE.width, TARGET_SIZE.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = m_views.count;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(m_device, &imageInfo, nullptr, &m_target) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create render target!");
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(m_device, m_target, &requirements);
+    m_target_mem = m_context.allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(m_device, m_target, m_target_mem, 0);
+
+    // A multiview pass renders to all layers through one view, separate
+    // passes to one layer each.
+    uint32_t layers = m_views.count / m_views.passes();
+    for(uint32_t pass = 0; pass < m_views.passes(); ++pass) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_target;
+        viewInfo.viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = TARGET_FORMAT;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.levelCount = 1;
+        viewInfo.subresourceRange.baseArrayLayer = pass;
+        viewInfo.subresourceRange.layerCount = layers;
+        VkImageView view;
+        if(vkCreateImageView(m_device, &viewInfo, nullptr, &view) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create image view!");
+        }
+        m_target_views.push_back(view);
+    }
+}
+ 
+void RecordingScene::create_render_pass() {
+    VkAttachmentDescription colorAttachment = {};
+    colorAttachment.format = TARGET_FORMAT;
+    colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorAttachmentRef = {};
+    colorAttachmentRef.attachment = 0;
+    colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass = {};
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorAttachmentRef;
+
+    VkRenderPassCreateInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = 1;
+    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+
+    // As in Simulation::setup_render_pass.
+    uint32_t view_mask = (1u << m_views.count) - 1;
+    VkRenderPassMultiviewCreateInfo multiviewInfo = {};
+    multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiviewInfo.subpassCount = 1;
+    multiviewInfo.pViewMasks = &view_mask;
+    multiviewInfo.correlationMaskCount = 1;
+    multiviewInfo.pCorrelationMasks = &view_mask;
+    if(m_views.count > 1 && !m_views.separate) {
+        renderPassInfo.pNext = &multiviewInfo;
+    }
+    if(vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_render_pass) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create render pass!");
+    }
+
+    for(VkImageView& view : m_target_views) {
+        VkFramebufferCreateInfo framebufferInfo = {};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_render_pass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.pAttachments = &view;
+        framebufferInfo.width = TARGET_SIZE.width;
+        framebufferInfo.height = TARGET_SIZE.height;
+        framebufferInfo.layers = 1;
+        VkFramebuffer framebuffer;
+        if(vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create a framebuffer!");
+        }
+        m_framebuffers.push_back(framebuffer);
+    }
+}
+ 
+void RecordingScene::create_pipeline() {
+    m_layout_cache = std::make_unique<DescriptorLayoutCache>(m_device);
+    m_desc_set_layout = m_layout_cache->get({
+        Uniforms::binding_desc(),
+        ObjectTransforms::binding_desc(),
+    });
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_desc_set_layout;
+    if(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipeline_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline layout!");
+    }
+
+    // The scene state of Simulation::create_pipeline; the target has no
+    // depth attachment.
+    m_pipelines = std::make_unique<PipelineManager>(m_device, PipelineManager::load_shader_file, 1);
+    m_pipelines->set_target(m_render_pass, m_pipeline_layout);
+    PipelineState state;
+    state.vertex_shader = "../src/glsl/vert.spv";
+    state.fragment_shader = "../src/glsl/frag.spv";
+    state.depth_test = false;
+    state.depth_write = false;
+    m_pipeline = m_pipelines->prepare(state);
+}
+ 
+void RecordingScene::create_buffers() {
+    constexpr VkMemoryPropertyFlags HOST_MEMORY = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
+        | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_context.physical_device(), &properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_ubo_stride = (sizeof(Uniforms) + alignment - 1) / alignment * alignment;
+    std::tie(m_ubo, m_ubo_mem) = m_context.make_buffer(m_ubo_stride * m_views.passes(), 
+        VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, HOST_MEMORY);
+    std::tie(m_object_buffer, m_object_buffer_mem) = m_context.make_buffer(MAX_OBJECTS * sizeof(glm::mat4), 
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, HOST_MEMORY);
+
+    TerrainGenerator generator;
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    generator.build_patch(glm::vec2(0.0f), 1.0f, TILE_RESOLUTION, vertices, indices);
+    VkDeviceSize vertex_bytes = vertices.size() * sizeof(Vertex);
+    VkDeviceSize index_bytes = indices.size() * sizeof(uint16_t);
+
+    m_tiles = std::make_unique<TileCache>(MAX_TILES * (vertex_bytes + index_bytes), 
+        [this](VkDeviceSize size) {
+            TileAllocation allocation;
+            std::tie(allocation.buffer, allocation.memory) = m_context.make_buffer(size, 
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, HOST_MEMORY);
+            allocation.capacity = size;
+            return allocation;
+        },
+        [this](const TileAllocation& allocation) {
+            vkDestroyBuffer(m_device, allocation.buffer, nullptr);
+            vkFreeMemory(m_device, allocation.memory, nullptr);
+        });
+    for(std::size_t i = 0; i < MAX_TILES; ++i) {
+        TileCoord coord = {static_cast<int32_t>(i % 21), static_cast<int32_t>(i / 21)};
+        ResidentTile& tile = m_tiles->insert(coord, vertex_bytes + index_bytes);
+        void* data;
+        vkMapMemory(m_device, tile.allocation.memory, 0, vertex_bytes + index_bytes, 0, &data);
+        std::memcpy(data, vertices.data(), vertex_bytes);
+        std::memcpy(static_cast<char*>(data) + vertex_bytes, indices.data(), index_bytes);
+        vkUnmapMemory(m_device, tile.allocation.memory);
+        tile.index_offset = vertex_bytes;
+        tile.index_count = static_cast<uint32_t>(indices.size());
+        m_tile_coords.push_back(coord);
+    }
+}
+ 
+void RecordingScene::write_frame_data() {
+    // Every tile is the same patch at the origin, drawn as the terrain
+    // object with the views spread around the camera as Simulation does.
+    Camera camera;
+    camera.look_at(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    camera.set_perspective(45.0f, static_cast<float>(TARGET_SIZE.width) / TARGET_SIZE.height, 0.1f, 10.0f);
+
+    void* data;
+    vkMapMemory(m_device, m_ubo_mem, 0, VK_WHOLE_SIZE, 0, &data);
+    SceneUpdate update;
+    update.write_uniforms(camera, m_views, data, m_ubo_stride);
+    vkUnmapMemory(m_device, m_ubo_mem);
+
+    vkMapMemory(m_device, m_object_buffer_mem, 0, VK_WHOLE_SIZE, 0, &data);
+    static_cast<glm::mat4*>(data)[TERRAIN_OBJECT] = camera.view_projection();
+    vkUnmapMemory(m_device, m_object_buffer_mem);
+}
+ 
+std::unique_ptr<RenderGraph> RecordingScene::build_graph(std::size_t tiles) {
+    auto graph = std::make_unique<RenderGraph>(m_device, 
+        [this](VkDeviceSize size, uint32_t type_filter) {
+            VkMemoryRequirements requirements = {size, 1, type_filter};
+            return m_context.allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        },
+        [this](VkDeviceMemory memory) {
+            vkFreeMemory(m_device, memory, nullptr);
+        });
+
+    RenderGraphImageDesc target_desc;
+    target_desc.format = TARGET_FORMAT;
+    target_desc.extent = TARGET_SIZE;
+    target_desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    target_desc.layers = m_views.count;
+    auto target = graph->import_image("target", m_target, m_target_views.front(), target_desc, 
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+
+    graph->add_pass("scene")
+        .write(target, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+        .execute([this, tiles](VkCommandBuffer command_buffer) {
+            record_scene_pass(command_buffer, tiles);
+        });
+
+    graph->compile();
+    return graph;
+}
+ 
+VkDescriptorSet RecordingScene::write_descriptors() {
+    m_descriptors->reset();
+    m_frame_sets.clear();
+    for(uint32_t pass = 0; pass < m_views.passes(); ++pass) {
+        VkDescriptorSet set = m_descriptors->allocate(m_desc_set_layout);
+
+        FrameDescriptors descriptors;
+        descriptors.uniforms.buffer = m_ubo;
+        descriptors.uniforms.offset = pass * m_ubo_stride;
+        descriptors.uniforms.range = sizeof(Uniforms);
+        descriptors.objects.buffer = m_object_buffer;
+        descriptors.objects.range = VK_WHOLE_SIZE;
+        descriptors.write(m_device, set);
+        m_frame_sets.push_back(set);
+    }
+    return m_frame_sets.front();
+}
+ 
+void RecordingScene::record(const RenderGraph& graph) {
+    vkResetCommandBuffer(m_command_buffer, 0);
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    if(vkBeginCommandBuffer(m_command_buffer, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+    graph.execute(m_command_buffer);
+    if(vkEndCommandBuffer(m_command_buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+ 
+void RecordingScene::submit() {
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &m_command_buffer;
+    if(vkQueueSubmit(m_context.queue(), 1, &submitInfo, m_fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit draw command buffer!");
+    }
+    vkWaitForFences(m_device, 1, &m_fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+    vkResetFences(m_device, 1, &m_fence);
+}
+ 
+void RecordingScene::record_scene_pass(VkCommandBuffer command_buffer, std::size_t tiles) {
+    write_descriptors();
+    for(uint32_t pass = 0; pass < m_views.passes(); ++pass) {
+        VkRenderPassBeginInfo renderPassInfo = {};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderPassInfo.renderPass = m_render_pass;
+        renderPassInfo.framebuffer = m_framebuffers[pass];
+        renderPassInfo.renderArea.extent = TARGET_SIZE;
+        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
+        renderPassInfo.clearValueCount = 1;
+        renderPassInfo.pClearValues = &clearColor;
+        vkCmdBeginRenderPass(command_buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport = {0.0f, 0.0f, (float) TARGET_SIZE.width, (float) TARGET_SIZE.height, 0.0f, 1.0f};
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        VkRect2D scissor = {{0, 0}, TARGET_SIZE};
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, 
+            &m_frame_sets[pass], 0, nullptr);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
+        m_tiles->record_draws(command_buffer, m_tile_coords.data(), tiles, TERRAIN_OBJECT);
+
+        vkCmdEndRenderPass(command_buffer);
+    }
+}
+ 
+// The scene is expensive to set up on a CPU device (pipeline compilation),
+// so one per view layout is shared by every benchmark and every calibration
+// run. The context is fetched first so that it outlives the scenes at exit.
+static RecordingScene* shared_scene(BenchmarkState& state, const ViewLayout& views = ViewLayout()) {
+    std::string context_error;
+    HeadlessContext* context = HeadlessContext::get(context_error);
+    if(!context) {
+        state.skip(context_error);
+        return nullptr;
+    }
+
+    static std::array<std::unique_ptr<RecordingScene>, MAX_VIEWS * 2> scenes;
+    static std::array<std::string, MAX_VIEWS * 2> errors;
+    std::size_t layout = (views.count - 1) * 2 + (views.separate ? 1 : 0);
+    auto& scene = scenes[layout];
+    auto& error = errors[layout];
+    if(!scene && error.empty()) {
+        try {
+            scene = std::make_unique<RecordingScene>(*context, views);
+        } catch(const std::exception& e) {
+            error = e.what();
+        }
+    }
+    if(!scene) {
+        state.skip(error);
+    }
+    return scene.get();
+}
+ 
+static void record_frame(BenchmarkState& state, std::size_t tiles) {
+    RecordingScene* scene = shared_scene(state);
+    if(!scene) {
+        return;
+    }
+    auto graph = scene->build_graph(tiles);
+    while(state.running()) {
+        scene->record(*graph);
+    }
+    state.set_items_per_iteration(tiles);
+}
+ 
+// Frame time of drawing every view, recorded, executed and waited for: one
+// multiview pass against one pass per view. Lavapipe runs the vertex and
+// fragment work on the CPU, so the time covers both sides of the trade.
+static void render_views(BenchmarkState& state, const ViewLayout& views) {
+    RecordingScene* scene = shared_scene(state, views);
+    if(!scene) {
+        return;
+    }
+    auto graph = scene->build_graph(MAX_TILES);
+    while(state.running()) {
+        scene->record(*graph);
+        scene->submit();
+    }
+    state.set_items_per_iteration(MAX_TILES * views.count);
+    state.set_counter("passes", views.passes());
+}
+ 
+// Three layered targets, each read only by the pass after the one writing
+// it, the way a post processing chain ping-pongs: the first and the last
+// have disjoint lifetimes and should share memory. A second graph sharing
+// the transients, like the one of another swapchain image, should allocate
+// nothing.
+static std::unique_ptr<RenderGraph> build_chain_graph(HeadlessContext& context, const RenderGraph* shared) {
+    VkDevice device = context.device();
+    auto graph = std::make_unique<RenderGraph>(device, 
+        [&context](VkDeviceSize size, uint32_t type_filter) {
+            VkMemoryRequirements requirements = {size, 1, type_filter};
+            return context.allocate_memory(requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        },
+        [device](VkDeviceMemory memory) {
+            vkFreeMemory(device, memory, nullptr);
+        });
+
+    RenderGraphImageDesc desc;
+    desc.format = TARGET_FORMAT;
+    desc.extent = TARGET_SIZE;
+    desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    desc.layers = 2;
+    std::array<RenderGraph::Resource, 3> targets = {
+        graph->create_image("first", desc),
+        graph->create_image("second", desc),
+        graph->create_image("third", desc),
+    };
+    for(std::size_t t = 0; t < targets.size(); ++t) {
+        auto pass = graph->add_pass("write " + std::to_string(t));
+        if(t > 0) {
+            pass.read(targets[t - 1], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+        pass.write(targets[t], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+    }
+    graph->add_pass("present")
+        .read(targets.back(), VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+        .side_effects();
+
+    graph->compile(shared);
+    return graph;
+}
+ 
+static void graph_transient_aliasing(BenchmarkState& state) {
+    std::string error;
+    HeadlessContext* context = HeadlessContext::get(error);
+    if(!context) {
+        state.skip(error);
+        return;
+    }
+
+    auto graph = build_chain_graph(*context, nullptr);
+    const auto& stats = graph->stats();
+    if(stats.transient_images != 3 || stats.allocated_bytes >= stats.transient_bytes) {
+        throw std::runtime_error("Render graph did not alias transients with disjoint lifetimes!");
+    }
+    if(build_chain_graph(*context, graph.get())->stats().allocated_bytes != 0) {
+        throw std::runtime_error("Render graph allocated transients it shares!");
+    }
+
+    while(state.running()) {
+        auto sharing = build_chain_graph(*context, graph.get());
+        do_not_optimize(sharing.get());
+    }
+    state.set_items_per_iteration(1);
+    state.set_counter("transient_kb", stats.transient_bytes / 1024.0);
+    state.set_counter("allocated_kb", stats.allocated_bytes / 1024.0);
+}
+ 
+void register_command_recording_benchmarks(BenchmarkRunner& runner) {
+    runner.add("record/frame_49_tiles", [](BenchmarkState& state) {
+        record_frame(state, 7 * 7);
+    });
+    runner.add("record/frame_441_tiles", [](BenchmarkState& state) {
+        record_frame(state, MAX_TILES);
+    });
+
+    runner.add("record/frame_descriptors", [](BenchmarkState& state) {
+        RecordingScene* scene = shared_scene(state);
+        if(!scene) {
+            return;
+        }
+        while(state.running()) {
+            do_not_optimize(scene->write_descriptors());
+        }
+        state.set_items_per_iteration(1);
+    });
+
+    runner.add("record/graph_build_compile", [](BenchmarkState& state) {
+        RecordingScene* scene = shared_scene(state);
+        if(!scene) {
+            return;
+        }
+        while(state.running()) {
+            auto graph = scene->build_graph(7 * 7);
+            do_not_optimize(graph.get());
+        }
+        state.set_items_per_iteration(1);
+    });
+    runner.add("record/graph_transient_aliasing", graph_transient_aliasing);
+
+    for(bool separate : {false, true}) {
+        ViewLayout views;
+        views.count = 2;
+        views.separate = separate;
+        runner.add(separate ? "record/render_2_views_separate" : "record/render_2_views_multiview", 
+            [views](BenchmarkState& state) {
+                render_views(state, views);
+            });
+    }
+}
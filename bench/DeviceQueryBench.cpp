@@ -0,0 +1,102 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "Extensions.h"
+#include "Layers.h"
+
+
+// Sizes of a typical desktop driver with the SDK installed: a couple of
+// dozen layers and a couple of hundred device extensions.
+static constexpr std::size_t LAYER_COUNT = 24;
+static constexpr std::size_t EXTENSION_COUNT = 200;
+
+
+static LayerSet make_layers() {
+    std::vector<VkLayerProperties> layers(LAYER_COUNT);
+    for(std::size_t i = 0; i < layers.size(); ++i) {
+        std::snprintf(layers[i].layerName, sizeof(layers[i].layerName), "VK_LAYER_VENDOR_layer_%zu", i);
+        layers[i].implementationVersion = 1;
+    }
+    std::strcpy(layers.back().layerName, "VK_LAYER_KHRONOS_validation");
+    return LayerSet(std::move(layers));
+}
+ 
+static ExtensionSet make_extensions() {
+    std::vector<VkExtensionProperties> extensions(EXTENSION_COUNT);
+    for(std::size_t i = 0; i < extensions.size(); ++i) {
+        std::snprintf(extensions[i].extensionName, sizeof(extensions[i].extensionName), "VK_VENDOR_extension_%zu", i);
+        extensions[i].specVersion = 1;
+    }
+    std::strcpy(extensions[EXTENSION_COUNT / 2].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    std::strcpy(extensions.back().extensionName, "VK_EXT_memory_budget");
+    return ExtensionSet(std::move(extensions));
+}
+ 
+void register_device_query_benchmarks(BenchmarkRunner& runner) {
+    runner.add("layers/contains_hit", [](BenchmarkState& state) {
+        LayerSet layers = make_layers();
+        while(state.running()) {
+            do_not_optimize(layers.contains("VK_LAYER_KHRONOS_validation"));
+        }
+        state.set_items_per_iteration(1);
+    });
+
+    runner.add("layers/contains_miss", [](BenchmarkState& state) {
+        LayerSet layers = make_layers();
+        while(state.running()) {
+            do_not_optimize(layers.contains("VK_LAYER_LUNARG_api_dump"));
+        }
+        state.set_items_per_iteration(1);
+    });
+
+    runner.add("layers/difference", [](BenchmarkState& state) {
+        LayerSet layers = make_layers();
+        std::vector<const char*> wanted = {"VK_LAYER_KHRONOS_validation", "VK_LAYER_LUNARG_api_dump", 
+            "VK_LAYER_VENDOR_layer_3"};
+        while(state.running()) {
+            auto missing = layers.difference(wanted);
+            do_not_optimize(missing.data());
+        }
+        state.set_items_per_iteration(wanted.size());
+    });
+
+    runner.add("extensions/contains_hit", [](BenchmarkState& state) {
+        ExtensionSet extensions = make_extensions();
+        while(state.running()) {
+            do_not_optimize(extensions.contains("VK_EXT_memory_budget"));
+        }
+        state.set_items_per_iteration(1);
+    });
+
+    runner.add("extensions/contains_miss", [](BenchmarkState& state) {
+        ExtensionSet extensions = make_extensions();
+        while(state.running()) {
+            do_not_optimize(extensions.contains("VK_EXT_descriptor_indexing"));
+        }
+        state.set_items_per_iteration(1);
+    });
+
+    runner.add("extensions/contains_all", [](BenchmarkState& state) {
+        ExtensionSet extensions = make_extensions();
+        std::vector<const char*> wanted = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, "VK_EXT_memory_budget", 
+            "VK_VENDOR_extension_7", "VK_VENDOR_extension_150"};
+        while(state.running()) {
+            do_not_optimize(extensions.contains_all(wanted));
+        }
+        state.set_items_per_iteration(wanted.size());
+    });
+
+    runner.add("extensions/difference", [](BenchmarkState& state) {
+        ExtensionSet extensions = make_extensions();
+        std::vector<const char*> wanted = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, "VK_EXT_memory_budget", 
+            "VK_EXT_descriptor_indexing", "VK_KHR_timeline_semaphore"};
+        while(state.running()) {
+            auto missing = extensions.difference(wanted);
+            do_not_optimize(missing.data());
+        }
+        state.set_items_per_iteration(wanted.size());
+    });
+}
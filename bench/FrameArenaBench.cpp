@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "FrameArena.h"
+
+
+static constexpr std::size_t VALUES_PER_FRAME = 4096;
+
+
+// FrameArena.h promises that a most recent allocation freed right away is
+// reclaimed, and nothing more: a growing vector frees its old buffer after
+// allocating the new one, so that buffer stays used until reset().
+static void check_arena_reclaim() {
+    FrameArena arena;
+    void* memory = arena.allocate(100, 64);
+    arena.deallocate(memory, 100);
+    if(arena.used() != 0) {
+        throw std::runtime_error("FrameArena did not reclaim the freed last allocation!");
+    }
+
+    std::size_t grown;
+    std::size_t buffer;
+    {
+        ArenaVector<uint32_t> values{ArenaAllocator<uint32_t>(arena)};
+        for(uint32_t i = 0; i < 1000; ++i) {
+            values.push_back(i);
+        }
+        grown = arena.used();
+        buffer = values.capacity() * sizeof(uint32_t);
+        if(grown <= buffer) {
+            throw std::runtime_error("FrameArena reclaimed a buffer the vector grew out of!");
+        }
+    }
+    // The final buffer is the last allocation when the vector is destroyed.
+    if(arena.used() != grown - buffer) {
+        throw std::runtime_error("FrameArena did not reclaim the destroyed vector's buffer!");
+    }
+}
+
+// A frame's worth of growing arena vectors, the way visible_terrain_chunks
+// and the jobs use them, against the same on the heap.
+static void arena_vectors(BenchmarkState& state) {
+    check_arena_reclaim();
+    FrameArena arena;
+    while(state.running()) {
+        ArenaVector<uint64_t> values{ArenaAllocator<uint64_t>(arena)};
+        for(std::size_t i = 0; i < VALUES_PER_FRAME; ++i) {
+            values.push_back(i);
+        }
+        do_not_optimize(values.data());
+        values.clear();
+        values.shrink_to_fit();
+        arena.reset();
+    }
+    state.set_items_per_iteration(VALUES_PER_FRAME);
+    state.set_counter("high_water_kb", arena.high_water() / 1024.0);
+    state.set_counter("blocks", static_cast<double>(arena.block_allocations()));
+}
+
+static void heap_vectors(BenchmarkState& state) {
+    while(state.running()) {
+        std::vector<uint64_t> values;
+        for(std::size_t i = 0; i < VALUES_PER_FRAME; ++i) {
+            values.push_back(i);
+        }
+        do_not_optimize(values.data());
+    }
+    state.set_items_per_iteration(VALUES_PER_FRAME);
+}
+
+void register_frame_arena_benchmarks(BenchmarkRunner& runner) {
+    runner.add("frame_arena/vector_growth", arena_vectors);
+    runner.add("frame_arena/heap_vector_growth", heap_vectors);
+}
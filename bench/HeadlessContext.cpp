@@ -0,0 +1,177 @@
+#include "HeadlessContext.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+
+
+HeadlessContext::HeadlessContext() {
+    VkApplicationInfo appInfo = {};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = "Landscape benchmarks";
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = "No Engine";
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.apiVersion = VK_API_VERSION_1_1;
+
+    VkInstanceCreateInfo instanceInfo = {};
+    instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instanceInfo.pApplicationInfo = &appInfo;
+    if(vkCreateInstance(&instanceInfo, nullptr, &m_instance) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create Vulkan instance!");
+    }
+
+    m_physical_device = select_physical_device();
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+    m_device_name = properties.deviceName;
+    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_memory_properties);
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &family_count, nullptr);
+    std::vector<VkQueueFamilyProperties> families(family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physical_device, &family_count, families.data());
+    m_queue_idx = UINT32_MAX;
+    for(uint32_t i = 0; i < family_count; ++i) {
+        if(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            m_queue_idx = i;
+            break;
+        }
+    }
+    if(m_queue_idx == UINT32_MAX) {
+        throw std::runtime_error("Device has no graphics queue!");
+    }
+
+    float priority = 1.0f;
+    VkDeviceQueueCreateInfo queueInfo = {};
+    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueInfo.queueFamilyIndex = m_queue_idx;
+    queueInfo.queueCount = 1;
+    queueInfo.pQueuePriorities = &priority;
+
+    // The scene vertex shader indexes its view matrices with gl_ViewIndex.
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {};
+    multiviewFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    multiviewFeatures.multiview = VK_TRUE;
+
+    VkDeviceCreateInfo deviceInfo = {};
+    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext = &multiviewFeatures;
+    deviceInfo.queueCreateInfoCount = 1;
+    deviceInfo.pQueueCreateInfos = &queueInfo;
+    if(vkCreateDevice(m_physical_device, &deviceInfo, nullptr, &m_device) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create logical device!");
+    }
+    vkGetDeviceQueue(m_device, m_queue_idx, 0, &m_queue);
+
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.queueFamilyIndex = m_queue_idx;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    if(vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_command_pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create command pool!");
+    }
+}
+ 
+HeadlessContext::~HeadlessContext() {
+    if(m_device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(m_device);
+        vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+        vkDestroyDevice(m_device, nullptr);
+    }
+    if(m_instance != VK_NULL_HANDLE) {
+        vkDestroyInstance(m_instance, nullptr);
+    }
+}
+ 
+HeadlessContext* HeadlessContext::get(std::string& error) {
+    static std::unique_ptr<HeadlessContext> context;
+    static std::string creation_error;
+    static bool attempted = false;
+    if(!attempted) {
+        attempted = true;
+        try {
+            context = std::make_unique<HeadlessContext>();
+        } catch(const std::exception& e) {
+            creation_error = e.what();
+        }
+    }
+    error = creation_error;
+    return context.get();
+}
+ 
+VkPhysicalDevice HeadlessContext::select_physical_device() {
+    uint32_t device_count = 0;
+    vkEnumeratePhysicalDevices(m_instance, &device_count, nullptr);
+    std::vector<VkPhysicalDevice> devices(device_count);
+    vkEnumeratePhysicalDevices(m_instance, &device_count, devices.data());
+    if(devices.empty()) {
+        throw std::runtime_error("No Vulkan devices found!");
+    }
+
+    const char* wanted = std::getenv("LANDSCAPE_BENCH_DEVICE");
+    VkPhysicalDevice fallback = VK_NULL_HANDLE;
+    for(auto device : devices) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if(wanted) {
+            if(std::strstr(properties.deviceName, wanted)) {
+                return device;
+            }
+        } else if(properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU) {
+            return device;
+        } else if(fallback == VK_NULL_HANDLE) {
+            fallback = device;
+        }
+    }
+    if(wanted || fallback == VK_NULL_HANDLE) {
+        throw std::runtime_error("No matching Vulkan device found!");
+    }
+    return fallback;
+}
+ 
+VkDeviceMemory HeadlessContext::allocate_memory(const VkMemoryRequirements& requirements,
+        VkMemoryPropertyFlags properties) {
+    uint32_t type = UINT32_MAX;
+    for(uint32_t i = 0; i < m_memory_properties.memoryTypeCount; ++i) {
+        if((requirements.memoryTypeBits & (1u << i))
+                && (m_memory_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            type = i;
+            break;
+        }
+    }
+    if(type == UINT32_MAX) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = requirements.size;
+    allocInfo.memoryTypeIndex = type;
+    VkDeviceMemory memory;
+    if(vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate memory!");
+    }
+    return memory;
+}
+ 
+std::tuple<VkBuffer, VkDeviceMemory> HeadlessContext::make_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties) {
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkBuffer buffer;
+    if(vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+        throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+    VkDeviceMemory memory = allocate_memory(requirements, properties);
+    vkBindBufferMemory(m_device, buffer, memory, 0);
+    return {buffer, memory};
+}
@@ -0,0 +1,53 @@
+#ifndef HEADLESS_CONTEXT_H_
+#define HEADLESS_CONTEXT_H_
+
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Vulkan instance and device without a window or surface, for benchmarks
+// that need real driver objects. A CPU device (lavapipe) is preferred so
+// results are comparable across machines and runs need no display; set
+// LANDSCAPE_BENCH_DEVICE to a substring of another device's name to use it
+// instead.
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext& other) = delete;
+    HeadlessContext(HeadlessContext&& other) noexcept = delete;
+    HeadlessContext& operator =(const HeadlessContext& other) = delete;
+    HeadlessContext& operator =(HeadlessContext&& other) noexcept = delete;
+
+    // Shared context, created on first use. Returns nullptr and fills error
+    // when no Vulkan device is available.
+    static HeadlessContext* get(std::string& error);
+
+    VkDevice device() const { return m_device; }
+    VkPhysicalDevice physical_device() const { return m_physical_device; }
+    VkQueue queue() const { return m_queue; }
+    VkCommandPool command_pool() const { return m_command_pool; }
+    const std::string& device_name() const { return m_device_name; }
+
+    VkDeviceMemory allocate_memory(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
+    std::tuple<VkBuffer, VkDeviceMemory> make_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
+        VkMemoryPropertyFlags properties);
+
+private:
+    VkPhysicalDevice select_physical_device();
+
+    VkInstance m_instance = VK_NULL_HANDLE;
+    VkPhysicalDevice m_physical_device = VK_NULL_HANDLE;
+    VkDevice m_device = VK_NULL_HANDLE;
+    uint32_t m_queue_idx = 0;
+    VkQueue m_queue = VK_NULL_HANDLE;
+    VkCommandPool m_command_pool = VK_NULL_HANDLE;
+    std::string m_device_name;
+    VkPhysicalDeviceMemoryProperties m_memory_properties;
+};
+
+#endif
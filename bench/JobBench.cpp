@@ -0,0 +1,99 @@
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "JobSystem.h"
+
+
+static constexpr std::size_t JOBS_PER_ITERATION = 1024;
+
+
+// Steals, contended deque locks and sleeps per iteration, i.e. how much the
+// threads got in each other's way.
+static void set_contention_counters(BenchmarkState& state, const JobStats& before, const JobStats& after) {
+    double iterations = static_cast<double>(state.iterations());
+    state.set_counter("stolen", (after.stolen - before.stolen) / iterations);
+    state.set_counter("contended", (after.contended - before.contended) / iterations);
+    state.set_counter("sleeps", (after.sleeps - before.sleeps) / iterations);
+}
+
+// Empty jobs started and waited for by the main thread, which measures the
+// scheduler's own overhead.
+static void empty_jobs(BenchmarkState& state, std::size_t thread_count) {
+    JobSystem jobs(thread_count);
+    JobCounter counter;
+    JobStats before = jobs.stats();
+    while(state.running()) {
+        for(std::size_t i = 0; i < JOBS_PER_ITERATION; ++i) {
+            jobs.run([]() { }, &counter);
+        }
+        jobs.wait(counter);
+    }
+    set_contention_counters(state, before, jobs.stats());
+    state.set_items_per_iteration(JOBS_PER_ITERATION);
+}
+
+// Jobs that each start more jobs, so every thread pushes to its own deque
+// and the others have to steal.
+static void nested_jobs(BenchmarkState& state, std::size_t thread_count) {
+    static constexpr std::size_t PARENTS = 32;
+    JobSystem jobs(thread_count);
+    JobCounter counter;
+    JobStats before = jobs.stats();
+    while(state.running()) {
+        for(std::size_t i = 0; i < PARENTS; ++i) {
+            jobs.run([&jobs, &counter]() {
+                for(std::size_t j = 0; j < JOBS_PER_ITERATION / PARENTS - 1; ++j) {
+                    jobs.run([]() { }, &counter);
+                }
+            }, &counter);
+        }
+        jobs.wait(counter);
+    }
+    set_contention_counters(state, before, jobs.stats());
+    state.set_items_per_iteration(JOBS_PER_ITERATION);
+}
+
+static void parallel_sum(BenchmarkState& state, std::size_t thread_count) {
+    static constexpr std::size_t COUNT = 1 << 20;
+    static constexpr std::size_t GRAIN = 16 * 1024;
+    JobSystem jobs(thread_count);
+    std::vector<float> values(COUNT, 1.0f);
+    std::vector<float> sums(COUNT / GRAIN);
+    JobStats before = jobs.stats();
+    while(state.running()) {
+        jobs.parallel_for(0, COUNT, GRAIN, [&](std::size_t begin, std::size_t end) {
+            float sum = 0.0f;
+            for(std::size_t i = begin; i < end; ++i) {
+                sum += values[i];
+            }
+            sums[begin / GRAIN] = sum;
+        });
+        do_not_optimize(sums.data());
+    }
+    set_contention_counters(state, before, jobs.stats());
+    state.set_items_per_iteration(COUNT);
+    state.set_bytes_per_iteration(COUNT * sizeof(float));
+}
+
+void register_job_benchmarks(BenchmarkRunner& runner) {
+    std::vector<std::size_t> thread_counts = {1, 2, 4};
+    std::size_t all = JobSystem::default_thread_count();
+    if(all > 4) {
+        thread_counts.push_back(all);
+    }
+
+    for(std::size_t threads : thread_counts) {
+        std::string suffix = "/threads_" + std::to_string(threads);
+        runner.add("jobs/empty" + suffix, [threads](BenchmarkState& state) {
+            empty_jobs(state, threads);
+        });
+        runner.add("jobs/nested" + suffix, [threads](BenchmarkState& state) {
+            nested_jobs(state, threads);
+        });
+        runner.add("jobs/parallel_sum" + suffix, [threads](BenchmarkState& state) {
+            parallel_sum(state, threads);
+        });
+    }
+}
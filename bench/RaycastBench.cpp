@@ -0,0 +1,160 @@
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "HeightPyramid.h"
+#include "Heightmap.h"
+#include "JobSystem.h"
+#include "TerrainGenerator.h"
+
+
+// A 4097 by 4097 heightfield over the terrain's 16 by 16 area, 4096 cells a
+// side, and the rays cast at it per iteration.
+static constexpr uint32_t PYRAMID_SAMPLES = 4097;
+static constexpr std::size_t RAYS_PER_SIDE = 64;
+static constexpr std::size_t RAY_COUNT = RAYS_PER_SIDE * RAYS_PER_SIDE;
+// Side of the block update replaces, the size of one streamed tile at this
+// resolution.
+static constexpr uint32_t UPDATE_SAMPLES = 257;
+
+
+// Built once; generating the heights takes longer than any of the runs.
+static const HeightPyramid& pyramid() {
+    static std::unique_ptr<HeightPyramid> pyramid;
+    if(!pyramid) {
+        JobSystem jobs;
+        float spacing = 16.0f / (PYRAMID_SAMPLES - 1);
+        Heightmap heightmap(TerrainGenerator(), glm::vec2(-8.0f), spacing, PYRAMID_SAMPLES, PYRAMID_SAMPLES,
+            VK_FORMAT_R32_SFLOAT, &jobs);
+        pyramid = std::make_unique<HeightPyramid>(heightmap);
+    }
+    return *pyramid;
+}
+ 
+// A 64 by 64 pixel picking region of a camera looking across the terrain
+// from one corner: one origin, neighbouring directions.
+static std::vector<TerrainRay> picking_rays(const HeightPyramid& terrain) {
+    uint32_t top = terrain.level_count() - 1;
+    glm::vec2 heights = terrain.range(top, 0, 0);
+    glm::vec3 eye(-6.0f, -6.0f, heights.y + 0.5f);
+    glm::vec3 forward = glm::normalize(glm::vec3(0.0f, 0.0f, heights.x) - eye);
+    glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 0.0f, 1.0f)));
+    glm::vec3 up = glm::cross(right, forward);
+    // About a 60 degree field of view over 1080 pixels.
+    float pixel = 0.001f;
+    std::vector<TerrainRay> rays(RAY_COUNT);
+    for(std::size_t y = 0; y < RAYS_PER_SIDE; ++y) {
+        for(std::size_t x = 0; x < RAYS_PER_SIDE; ++x) {
+            float dx = (static_cast<float>(x) - RAYS_PER_SIDE / 2.0f) * pixel;
+            float dy = (static_cast<float>(y) - RAYS_PER_SIDE / 2.0f) * pixel;
+            auto& ray = rays[y * RAYS_PER_SIDE + x];
+            ray.origin = eye;
+            ray.direction = forward + dx * right + dy * up;
+        }
+    }
+    return rays;
+}
+ 
+// Rays from anywhere above the terrain to anywhere on it, which share no
+// nodes beyond the top few levels.
+static std::vector<TerrainRay> scattered_rays(const HeightPyramid& terrain) {
+    uint32_t top = terrain.level_count() - 1;
+    glm::vec2 heights = terrain.range(top, 0, 0);
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> position(-8.0f, 8.0f);
+    std::vector<TerrainRay> rays(RAY_COUNT);
+    for(auto& ray : rays) {
+        ray.origin = glm::vec3(position(random), position(random), heights.y + 0.5f);
+        glm::vec3 target(position(random), position(random), heights.x);
+        ray.direction = target - ray.origin;
+    }
+    return rays;
+}
+ 
+static std::size_t count_hits(const std::vector<TerrainHit>& hits) {
+    std::size_t count = 0;
+    for(const auto& hit : hits) {
+        count += hit.hit;
+    }
+    return count;
+}
+ 
+static void raycast_single(BenchmarkState& state, const std::vector<TerrainRay>& rays) {
+    const auto& terrain = pyramid();
+    std::vector<TerrainHit> hits(rays.size());
+    while(state.running()) {
+        for(std::size_t i = 0; i < rays.size(); ++i) {
+            hits[i] = terrain.raycast(rays[i]);
+        }
+        do_not_optimize(hits.data());
+    }
+    state.set_items_per_iteration(rays.size());
+    state.set_counter("hits", static_cast<double>(count_hits(hits)));
+}
+ 
+static void raycast_batched(BenchmarkState& state, const std::vector<TerrainRay>& rays) {
+    const auto& terrain = pyramid();
+    std::vector<TerrainHit> hits(rays.size());
+    while(state.running()) {
+        terrain.raycast(rays.data(), rays.size(), hits.data());
+        do_not_optimize(hits.data());
+    }
+    state.set_items_per_iteration(rays.size());
+    state.set_counter("hits", static_cast<double>(count_hits(hits)));
+}
+ 
+static void raycast_cells(BenchmarkState& state, const std::vector<TerrainRay>& rays) {
+    const auto& terrain = pyramid();
+    std::vector<TerrainHit> hits(rays.size());
+    while(state.running()) {
+        for(std::size_t i = 0; i < rays.size(); ++i) {
+            hits[i] = terrain.raycast_cells(rays[i]);
+        }
+        do_not_optimize(hits.data());
+    }
+    state.set_items_per_iteration(rays.size());
+    state.set_counter("hits", static_cast<double>(count_hits(hits)));
+}
+ 
+void register_raycast_benchmarks(BenchmarkRunner& runner) {
+    // Rays per second, traced one at a time, four at a time and cell by cell.
+    runner.add("raycast/4k_picking_single", [](BenchmarkState& state) {
+        raycast_single(state, picking_rays(pyramid()));
+    });
+    runner.add("raycast/4k_picking_batched", [](BenchmarkState& state) {
+        raycast_batched(state, picking_rays(pyramid()));
+    });
+    runner.add("raycast/4k_picking_cells", [](BenchmarkState& state) {
+        raycast_cells(state, picking_rays(pyramid()));
+    });
+    runner.add("raycast/4k_scattered_single", [](BenchmarkState& state) {
+        raycast_single(state, scattered_rays(pyramid()));
+    });
+    runner.add("raycast/4k_scattered_batched", [](BenchmarkState& state) {
+        raycast_batched(state, scattered_rays(pyramid()));
+    });
+    runner.add("raycast/4k_scattered_cells", [](BenchmarkState& state) {
+        raycast_cells(state, scattered_rays(pyramid()));
+    });
+
+    // Replaces one tile's worth of samples and refreshes the nodes above it.
+    runner.add("raycast/4k_update_tile", [](BenchmarkState& state) {
+        HeightPyramid terrain = pyramid();
+        std::vector<float> heights(std::size_t{UPDATE_SAMPLES} * UPDATE_SAMPLES);
+        for(uint32_t y = 0; y < UPDATE_SAMPLES; ++y) {
+            for(uint32_t x = 0; x < UPDATE_SAMPLES; ++x) {
+                heights[std::size_t{y} * UPDATE_SAMPLES + x] = terrain.height_at(1024 + x, 1024 + y) + 0.01f;
+            }
+        }
+        while(state.running()) {
+            terrain.update(1024, 1024, UPDATE_SAMPLES, UPDATE_SAMPLES, heights.data());
+            do_not_optimize(terrain.range(1, 512, 512));
+        }
+        state.set_items_per_iteration(std::size_t{UPDATE_SAMPLES} * UPDATE_SAMPLES);
+        state.set_bytes_per_iteration(std::size_t{UPDATE_SAMPLES} * UPDATE_SAMPLES * sizeof(float));
+    });
+}
@@ -0,0 +1,136 @@
+#include <cmath>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "Camera.h"
+#include "SceneDatabase.h"
+
+
+static constexpr std::size_t SCENE_ENTITIES = 200000;
+// Every STATIC_STRIDE-th entity is static, so bulk moves skip some lanes.
+static constexpr std::size_t STATIC_STRIDE = 8;
+
+
+// The array-of-structs baseline: the same fields, one entity after another.
+struct AosEntity {
+    SceneEntity entity;
+    uint32_t slot;
+};
+
+
+static Camera make_camera() {
+    Camera camera;
+    camera.look_at(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    camera.set_perspective(45.0f, 16.0f / 9.0f, 0.1f, 10.0f);
+    return camera;
+}
+ 
+// Spread over the terrain's 16 by 16 area, a few percent of it in view.
+static SceneEntity make_entity(std::size_t i) {
+    float f = static_cast<float>(i);
+    SceneEntity entity;
+    entity.position = glm::vec3(std::fmod(f * 0.731f, 16.0f) - 8.0f, std::fmod(f * 0.377f, 16.0f) - 8.0f,
+        std::fmod(f * 0.113f, 1.0f));
+    entity.radius = 0.05f;
+    entity.extent = glm::vec3(0.035f);
+    entity.mesh = static_cast<uint32_t>(i % 7);
+    entity.material = static_cast<uint32_t>(i % 3);
+    entity.flags = i % STATIC_STRIDE == 0 ? static_cast<uint32_t>(SCENE_FLAG_STATIC) : 0u;
+    entity.instance = static_cast<uint32_t>(i);
+    return entity;
+}
+ 
+static void fill_soa(SceneDatabase& scene) {
+    scene.reserve(SCENE_ENTITIES);
+    for(std::size_t i = 0; i < SCENE_ENTITIES; ++i) {
+        scene.add(make_entity(i));
+    }
+}
+ 
+static void fill_aos(std::vector<AosEntity>& scene) {
+    scene.reserve(SCENE_ENTITIES);
+    for(std::size_t i = 0; i < SCENE_ENTITIES; ++i) {
+        scene.push_back({make_entity(i), static_cast<uint32_t>(i)});
+    }
+}
+ 
+static void aos_translate(std::vector<AosEntity>& scene, const glm::vec3& offset) {
+    for(auto& object : scene) {
+        float moves = (object.entity.flags & SCENE_FLAG_STATIC) ? 0.0f : 1.0f;
+        object.entity.position += offset * moves;
+    }
+}
+ 
+// Same test and mask layout as SceneDatabase::cull.
+static std::size_t aos_cull(const std::vector<AosEntity>& scene, const glm::mat4& view_projection,
+        std::vector<uint64_t>& visible) {
+    auto planes = SceneDatabase::frustum_planes(view_projection);
+    visible.assign((scene.size() + SceneChunk::SIZE - 1) / SceneChunk::SIZE, 0);
+    std::size_t visible_count = 0;
+    for(std::size_t i = 0; i < scene.size(); ++i) {
+        const auto& entity = scene[i].entity;
+        bool inside = (entity.flags & SCENE_FLAG_HIDDEN) == 0;
+        for(const auto& plane : planes) {
+            inside &= glm::dot(glm::vec3(plane), entity.position) + plane.w >= -entity.radius;
+        }
+        visible[i / SceneChunk::SIZE] |= static_cast<uint64_t>(inside) << (i % SceneChunk::SIZE);
+        visible_count += inside;
+    }
+    return visible_count;
+}
+ 
+void register_scene_benchmarks(BenchmarkRunner& runner) {
+    runner.add("scene/200k_soa_translate", [](BenchmarkState& state) {
+        SceneDatabase scene;
+        fill_soa(scene);
+        float sign = 1.0f;
+        while(state.running()) {
+            scene.translate(glm::vec3(0.001f * sign, 0.0f, 0.0f));
+            sign = -sign;
+            do_not_optimize(scene.chunk(0));
+        }
+        state.set_items_per_iteration(SCENE_ENTITIES);
+        state.set_bytes_per_iteration(SCENE_ENTITIES * (3 * sizeof(float) + sizeof(uint32_t)));
+    });
+    runner.add("scene/200k_aos_translate", [](BenchmarkState& state) {
+        std::vector<AosEntity> scene;
+        fill_aos(scene);
+        float sign = 1.0f;
+        while(state.running()) {
+            aos_translate(scene, glm::vec3(0.001f * sign, 0.0f, 0.0f));
+            sign = -sign;
+            do_not_optimize(scene.data());
+        }
+        state.set_items_per_iteration(SCENE_ENTITIES);
+        state.set_bytes_per_iteration(SCENE_ENTITIES * sizeof(AosEntity));
+    });
+
+    runner.add("scene/200k_soa_cull", [](BenchmarkState& state) {
+        Camera camera = make_camera();
+        SceneDatabase scene;
+        fill_soa(scene);
+        std::vector<uint64_t> visible;
+        std::size_t visible_count = 0;
+        while(state.running()) {
+            visible_count = scene.cull(camera.view_projection(), visible);
+            do_not_optimize(visible.data());
+        }
+        state.set_items_per_iteration(SCENE_ENTITIES);
+        state.set_bytes_per_iteration(SCENE_ENTITIES * (5 * sizeof(float)));
+        state.set_counter("visible", static_cast<double>(visible_count));
+    });
+    runner.add("scene/200k_aos_cull", [](BenchmarkState& state) {
+        Camera camera = make_camera();
+        std::vector<AosEntity> scene;
+        fill_aos(scene);
+        std::vector<uint64_t> visible;
+        std::size_t visible_count = 0;
+        while(state.running()) {
+            visible_count = aos_cull(scene, camera.view_projection(), visible);
+            do_not_optimize(visible.data());
+        }
+        state.set_items_per_iteration(SCENE_ENTITIES);
+        state.set_bytes_per_iteration(SCENE_ENTITIES * sizeof(AosEntity));
+        state.set_counter("visible", static_cast<double>(visible_count));
+    });
+}
@@ -0,0 +1,99 @@
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "StagingPacker.h"
+#include "TerrainGenerator.h"
+#include "TileFile.h"
+
+
+// Same layout create_tile_streaming generates, and the same staging size
+// and alignment upload_tiles packs into.
+static constexpr uint32_t TILE_RESOLUTION = 33;
+static constexpr uint32_t TILES_PER_SIDE = 16;
+static constexpr VkDeviceSize STAGING_SIZE = 4ull * 1024 * 1024;
+static constexpr VkDeviceSize STAGING_ALIGNMENT = 4;
+
+
+static void build_patch(BenchmarkState& state, uint32_t resolution) {
+    TerrainGenerator generator;
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    float x = 0.0f;
+    while(state.running()) {
+        generator.build_patch(glm::vec2(x, 0.0f), 1.0f, resolution, vertices, indices);
+        do_not_optimize(vertices.data());
+        do_not_optimize(indices.data());
+        x += 1.0f;
+    }
+    state.set_items_per_iteration(vertices.size());
+    state.set_bytes_per_iteration(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(uint16_t));
+}
+ 
+static std::string write_tile_file() {
+    auto path = (std::filesystem::temp_directory_path() / "landscape_bench.tiles").string();
+    TerrainGenerator generator;
+    TileFileHeader layout = {};
+    layout.tiles_x = TILES_PER_SIDE;
+    layout.tiles_y = TILES_PER_SIDE;
+    layout.tile_resolution = TILE_RESOLUTION;
+    layout.tile_extent = 1.0f;
+    TileFile::write(path, layout, [&](TileCoord coord, auto& vertices, auto& indices) {
+        glm::vec2 origin = {coord.x * layout.tile_extent, coord.y * layout.tile_extent};
+        generator.build_patch(origin, layout.tile_extent, layout.tile_resolution, vertices, indices);
+    });
+    return path;
+}
+ 
+void register_terrain_benchmarks(BenchmarkRunner& runner) {
+    runner.add("terrain/build_patch_33", [](BenchmarkState& state) {
+        build_patch(state, 33);
+    });
+    runner.add("terrain/build_patch_129", [](BenchmarkState& state) {
+        build_patch(state, 129);
+    });
+
+    // Packs every tile of the file into staging memory the way upload_tiles
+    // does, starting over whenever the staging buffer fills up.
+    runner.add("upload/pack_tiles", [](BenchmarkState& state) {
+        std::string path = write_tile_file();
+        TileFile file(path);
+        std::vector<std::byte> staging_memory(STAGING_SIZE);
+        StagingPacker staging(staging_memory.data(), STAGING_SIZE);
+
+        std::vector<TileCoord> coords;
+        uint64_t bytes = 0;
+        for(uint32_t y = 0; y < TILES_PER_SIDE; ++y) {
+            for(uint32_t x = 0; x < TILES_PER_SIDE; ++x) {
+                TileCoord coord = {static_cast<int32_t>(x), static_cast<int32_t>(y)};
+                coords.push_back(coord);
+                bytes += file.entry(coord).size;
+            }
+        }
+        std::vector<VkBufferCopy> regions;
+        regions.reserve(coords.size());
+
+        while(state.running()) {
+            regions.clear();
+            staging.reset();
+            for(const auto& coord : coords) {
+                const auto& entry = file.entry(coord);
+                VkDeviceSize offset;
+                if(!staging.pack(file.tile_data(coord), entry.size, STAGING_ALIGNMENT, offset)) {
+                    staging.reset();
+                    staging.pack(file.tile_data(coord), entry.size, STAGING_ALIGNMENT, offset);
+                }
+                regions.push_back(VkBufferCopy{offset, 0, entry.size});
+            }
+            do_not_optimize(regions.data());
+            do_not_optimize(staging_memory.data());
+        }
+        state.set_items_per_iteration(coords.size());
+        state.set_bytes_per_iteration(bytes);
+
+        std::filesystem::remove(path);
+    });
+}
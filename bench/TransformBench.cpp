@@ -0,0 +1,120 @@
+#include <glm/gtc/quaternion.hpp>
+
+#include <cmath>
+#include <vector>
+
+#include "Benchmarks.h"
+#include "Camera.h"
+#include "RenderTypes.h"
+#include "SceneDatabase.h"
+#include "SceneFrame.h"
+#include "TransformSystem.h"
+
+
+static constexpr std::size_t LARGE_SCENE_OBJECTS = 100000;
+
+
+static Camera make_camera() {
+    Camera camera;
+    camera.look_at(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    camera.set_perspective(45.0f, 16.0f / 9.0f, 0.1f, 10.0f);
+    return camera;
+}
+ 
+static void fill_scene(TransformSystem& transforms, std::size_t count) {
+    transforms.reserve(count);
+    for(std::size_t i = 0; i < count; ++i) {
+        float f = static_cast<float>(i);
+        transforms.add(glm::vec3(std::fmod(f, 317.0f), std::fmod(f * 0.37f, 211.0f), 0.0f),
+            glm::angleAxis(f, glm::vec3(0.0f, 0.0f, 1.0f)));
+    }
+}
+ 
+// Simulation::update_ubo without the uniform buffer mapping: spin the quad,
+// rewrite the uniforms when the camera moved, refresh the object transforms
+// and cull the scene.
+static void frame_update(BenchmarkState& state, bool camera_moves) {
+    Camera camera = make_camera();
+    TransformSystem transforms;
+    uint32_t quad = transforms.add(glm::vec3(0.0f));
+    transforms.add(glm::vec3(0.0f));
+    std::vector<float> object_buffer(transforms.capacity() * 16);
+    Uniforms mapped_ubo;
+
+    SceneDatabase scene;
+    SceneEntity entity;
+    entity.position = glm::vec3(0.0f, 0.0f, 1.0f);
+    entity.radius = glm::length(glm::vec2(0.5f));
+    entity.extent = glm::vec3(entity.radius, entity.radius, 0.0f);
+    entity.instance = quad;
+    scene.add(entity);
+    std::vector<uint64_t> visible;
+
+    SceneUpdate update;
+    ViewLayout views;
+    float time = 0.0f;
+    while(state.running()) {
+        time += 1.0f / 60.0f;
+        if(camera_moves) {
+            camera.look_at(glm::vec3(2.0f * std::cos(time), 2.0f * std::sin(time), 2.0f), glm::vec3(0.0f), 
+                glm::vec3(0.0f, 0.0f, 1.0f));
+        }
+        bool camera_changed = update.animate(time, camera, transforms, quad);
+        if(camera_changed) {
+            update.write_uniforms(camera, views, &mapped_ubo, sizeof(mapped_ubo));
+        }
+        update.update_objects(camera, views, camera_changed, transforms, object_buffer.data(), scene, visible);
+        do_not_optimize(object_buffer.data());
+        do_not_optimize(mapped_ubo);
+        do_not_optimize(visible.data());
+    }
+    state.set_items_per_iteration(1);
+}
+ 
+// Batch transform update over a large scene, with moved_stride selecting
+// how many objects move per frame (0 for none).
+static void large_scene_update(BenchmarkState& state, bool camera_moves, std::size_t moved_stride) {
+    Camera camera = make_camera();
+    TransformSystem transforms;
+    fill_scene(transforms, LARGE_SCENE_OBJECTS);
+    std::vector<float> clip(transforms.capacity() * 16);
+    transforms.update(camera.view_projection(), true, clip.data());
+
+    float time = 0.0f;
+    std::size_t written = 0;
+    while(state.running()) {
+        time += 1.0f / 60.0f;
+        if(camera_moves) {
+            camera.look_at(glm::vec3(2.0f * std::cos(time), 2.0f * std::sin(time), 2.0f), glm::vec3(0.0f), 
+                glm::vec3(0.0f, 0.0f, 1.0f));
+        }
+        if(moved_stride > 0) {
+            for(std::size_t i = 0; i < LARGE_SCENE_OBJECTS; i += moved_stride) {
+                transforms.set_position(static_cast<uint32_t>(i), glm::vec3(time, 0.0f, 0.0f));
+            }
+        }
+        written = transforms.update(camera.view_projection(), camera_moves, clip.data());
+        do_not_optimize(clip.data());
+    }
+    state.set_items_per_iteration(written);
+    state.set_bytes_per_iteration(written * 16 * sizeof(float));
+}
+ 
+void register_transform_benchmarks(BenchmarkRunner& runner) {
+    runner.add("update_ubo/static_camera", [](BenchmarkState& state) {
+        frame_update(state, false);
+    });
+    runner.add("update_ubo/moving_camera", [](BenchmarkState& state) {
+        frame_update(state, true);
+    });
+
+    runner.add("transforms/100k_moving_camera", [](BenchmarkState& state) {
+        large_scene_update(state, true, 0);
+    });
+    runner.add("transforms/100k_one_percent_moved", [](BenchmarkState& state) {
+        large_scene_update(state, false, 100);
+    });
+    runner.add("transforms/100k_all_moved", [](BenchmarkState& state) {
+        large_scene_update(state, false, 1);
+    });
+}
@@ -0,0 +1,79 @@
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "Benchmarks.h"
+#include "HeadlessContext.h"
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [--filter SUBSTRING] [--min-time SECONDS] [--json FILE] [--list]\n"
+        << "\tResults go to stdout as a table; --json also writes them as JSON (- for stdout).\n";
+}
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string json_file;
+    double min_seconds = 0.5;
+    bool list = false;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if(std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_seconds = std::atof(argv[++i]);
+        } else if(std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--list") == 0) {
+            list = true;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner;
+    register_device_query_benchmarks(runner);
+    register_transform_benchmarks(runner);
+    register_terrain_benchmarks(runner);
+    register_command_recording_benchmarks(runner);
+    register_codec_benchmarks(runner);
+    register_job_benchmarks(runner);
+    register_frame_arena_benchmarks(runner);
+    register_scene_benchmarks(runner);
+    register_raycast_benchmarks(runner);
+
+    if(list) {
+        runner.list(std::cout);
+        return 0;
+    }
+
+    auto results = runner.run(filter, min_seconds);
+
+    BenchmarkContext context;
+    char date[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    context.date = date;
+    context.min_seconds = min_seconds;
+    std::string error;
+    if(HeadlessContext* device = HeadlessContext::get(error)) {
+        context.device = device->device_name();
+    }
+
+    if(json_file == "-") {
+        write_json(std::cout, context, results);
+        return 0;
+    }
+    write_console(std::cout, results);
+    if(!json_file.empty()) {
+        std::ofstream json(json_file);
+        if(!json) {
+            std::cerr << "Failed to open " << json_file << "\n";
+            return 1;
+        }
+        write_json(json, context, results);
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "AllocationCounter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+static std::atomic<uint64_t> g_allocation_count{0};
+static std::atomic<uint64_t> g_allocated_bytes{0};
+static thread_local uint64_t t_allocation_count = 0;
+
+
+static void* counted_allocate(std::size_t size, std::size_t alignment) {
+    g_allocation_count.fetch_add(1, std::memory_order_relaxed);
+    g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    t_allocation_count += 1;
+    size = std::max<std::size_t>(size, 1);
+    void* memory;
+    if(alignment <= alignof(std::max_align_t)) {
+        memory = std::malloc(size);
+    } else {
+        memory = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    }
+    if(!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+ 
+void* operator new(std::size_t size) {
+    return counted_allocate(size, alignof(std::max_align_t));
+}
+ 
+void* operator new[](std::size_t size) {
+    return counted_allocate(size, alignof(std::max_align_t));
+}
+ 
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+ 
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return counted_allocate(size, static_cast<std::size_t>(alignment));
+}
+ 
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return counted_allocate(size, alignof(std::max_align_t));
+    } catch(...) {
+        return nullptr;
+    }
+}
+ 
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return counted_allocate(size, alignof(std::max_align_t));
+    } catch(...) {
+        return nullptr;
+    }
+}
+ 
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+ 
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+ 
+uint64_t allocation_count() {
+    return g_allocation_count.load(std::memory_order_relaxed);
+}
+ 
+uint64_t allocated_bytes() {
+    return g_allocated_bytes.load(std::memory_order_relaxed);
+}
+ 
+uint64_t thread_allocation_count() {
+    return t_allocation_count;
+}
@@ -0,0 +1,14 @@
+#ifndef ALLOCATION_COUNTER_H_
+#define ALLOCATION_COUNTER_H_
+
+#include <cstdint>
+
+// Heap allocations made through operator new since program start, counted
+// by the replacement operators in AllocationCounter.cpp. They are linked in
+// with everything that calls one of these.
+uint64_t allocation_count();
+uint64_t allocated_bytes();
+// Allocations made by the calling thread.
+uint64_t thread_allocation_count();
+
+#endif
@@ -0,0 +1,130 @@
+#include "BindlessTable.h"
+
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+
+bool BindlessTable::supported(VkPhysicalDevice physical_device) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, extensions.data());
+
+    bool has_extension = false;
+    for(const auto& extension : extensions) {
+        if(std::strcmp(extension.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0) {
+            has_extension = true;
+        }
+    }
+    if(!has_extension) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing = {};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &indexing;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+
+    // The vertex shader indexes the buffer array with a push constant.
+    return features.features.shaderStorageBufferArrayDynamicIndexing && 
+        indexing.runtimeDescriptorArray && indexing.descriptorBindingPartiallyBound &&
+        indexing.descriptorBindingStorageBufferUpdateAfterBind && indexing.descriptorBindingSampledImageUpdateAfterBind;
+}
+ 
+VkPhysicalDeviceDescriptorIndexingFeatures BindlessTable::required_features() {
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing = {};
+    indexing.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    indexing.runtimeDescriptorArray = VK_TRUE;
+    indexing.descriptorBindingPartiallyBound = VK_TRUE;
+    indexing.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    indexing.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    return indexing;
+}
+ 
+BindlessTable::BindlessTable(VkDevice device, DescriptorLayoutCache& layouts, uint32_t max_buffers, uint32_t max_images,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_allocator(device, {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, static_cast<float>(max_buffers)},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<float>(max_images)},
+    }, 1, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT, host_allocator),
+    m_max_buffers(max_buffers),
+    m_max_images(max_images)
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    bindings[0].binding = STORAGE_BUFFER_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[0].descriptorCount = max_buffers;
+    bindings[0].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+    bindings[1].binding = SAMPLED_IMAGE_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[1].descriptorCount = max_images;
+    bindings[1].stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS;
+
+    std::array<VkDescriptorBindingFlags, 2> binding_flags = {
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+    };
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = {};
+    flagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flagsInfo.bindingCount = static_cast<uint32_t>(binding_flags.size());
+    flagsInfo.pBindingFlags = binding_flags.data();
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = &flagsInfo;
+    layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    m_layout = layouts.get(layoutInfo);
+    m_set = m_allocator.allocate(m_layout);
+}
+ 
+uint32_t BindlessTable::add_storage_buffer(const VkDescriptorBufferInfo& info) {
+    uint32_t slot = take_slot(m_free_buffers, m_next_buffer, m_max_buffers);
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_set;
+    descriptorWrite.dstBinding = STORAGE_BUFFER_BINDING;
+    descriptorWrite.dstArrayElement = slot;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pBufferInfo = &info;
+
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+    return slot;
+}
+ 
+uint32_t BindlessTable::add_sampled_image(const VkDescriptorImageInfo& info) {
+    uint32_t slot = take_slot(m_free_images, m_next_image, m_max_images);
+
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = m_set;
+    descriptorWrite.dstBinding = SAMPLED_IMAGE_BINDING;
+    descriptorWrite.dstArrayElement = slot;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &info;
+
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+    return slot;
+}
+ 
+uint32_t BindlessTable::take_slot(std::vector<uint32_t>& free, uint32_t& next, uint32_t max) {
+    if(!free.empty()) {
+        uint32_t slot = free.back();
+        free.pop_back();
+        return slot;
+    }
+    if(next >= max) {
+        throw std::runtime_error("Bindless descriptor table is full!");
+    }
+    return next++;
+}
+ 
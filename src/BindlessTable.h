@@ -0,0 +1,61 @@
+#ifndef BINDLESS_TABLE_H_
+#define BINDLESS_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+
+// One global descriptor set holding every storage buffer and image the
+// renderer uses, addressed by slot index from shaders (descriptor indexing).
+// The set is bound once per command buffer; draws select their resources
+// through push constants instead of rebinding descriptor sets.
+//
+// Slots are written with update-after-bind, so resources can be added while
+// command buffers referencing the set are pending, as long as the slot being
+// written is not in use by them.
+class BindlessTable {
+public:
+    static constexpr uint32_t STORAGE_BUFFER_BINDING = 0;
+    static constexpr uint32_t SAMPLED_IMAGE_BINDING = 1;
+
+    static bool supported(VkPhysicalDevice physical_device);
+    static VkPhysicalDeviceDescriptorIndexingFeatures required_features();
+
+    BindlessTable(VkDevice device, DescriptorLayoutCache& layouts, uint32_t max_buffers, uint32_t max_images,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    ~BindlessTable() = default;
+
+    BindlessTable(const BindlessTable& other) = delete;
+    BindlessTable(BindlessTable&& other) noexcept = delete;
+    BindlessTable& operator =(const BindlessTable& other) = delete;
+    BindlessTable& operator =(BindlessTable&& other) noexcept = delete;
+
+    uint32_t add_storage_buffer(const VkDescriptorBufferInfo& info);
+    uint32_t add_sampled_image(const VkDescriptorImageInfo& info);
+    void remove_storage_buffer(uint32_t slot) { m_free_buffers.push_back(slot); }
+    void remove_sampled_image(uint32_t slot) { m_free_images.push_back(slot); }
+
+    VkDescriptorSetLayout layout() const { return m_layout; }
+    VkDescriptorSet set() const { return m_set; }
+
+private:
+    static uint32_t take_slot(std::vector<uint32_t>& free, uint32_t& next, uint32_t max);
+
+    VkDevice m_device;
+    VkDescriptorSetLayout m_layout;
+    DescriptorAllocator m_allocator;
+    VkDescriptorSet m_set;
+
+    uint32_t m_max_buffers;
+    uint32_t m_max_images;
+    uint32_t m_next_buffer = 0;
+    uint32_t m_next_image = 0;
+    std::vector<uint32_t> m_free_buffers;
+    std::vector<uint32_t> m_free_images;
+};
+
+#endif
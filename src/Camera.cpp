@@ -0,0 +1,54 @@
+#include "Camera.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+
+void Camera::look_at(const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up) {
+    if(eye == m_eye && target == m_target && up == m_up) {
+        return;
+    }
+    m_eye = eye;
+    m_target = target;
+    m_up = up;
+    m_revision += 1;
+}
+ 
+void Camera::set_perspective(float fov_y, float aspect, float near_plane, float far_plane) {
+    if(fov_y == m_fov_y && aspect == m_aspect && near_plane == m_near && far_plane == m_far) {
+        return;
+    }
+    m_fov_y = fov_y;
+    m_aspect = aspect;
+    m_near = near_plane;
+    m_far = far_plane;
+    m_revision += 1;
+}
+ 
+void Camera::set_aspect(float aspect) {
+    set_perspective(m_fov_y, aspect, m_near, m_far);
+}
+ 
+const glm::mat4& Camera::view() const {
+    rebuild();
+    return m_view;
+}
+ 
+const glm::mat4& Camera::projection() const {
+    rebuild();
+    return m_projection;
+}
+ 
+const glm::mat4& Camera::view_projection() const {
+    rebuild();
+    return m_view_projection;
+}
+ 
+void Camera::rebuild() const {
+    if(m_built_revision == m_revision) {
+        return;
+    }
+    m_view = glm::lookAt(m_eye, m_target, m_up);
+    m_projection = glm::perspective(m_fov_y, m_aspect, m_near, m_far);
+    m_view_projection = m_projection * m_view;
+    m_built_revision = m_revision;
+}
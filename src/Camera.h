@@ -0,0 +1,57 @@
+#ifndef CAMERA_H_
+#define CAMERA_H_
+
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Perspective camera that only rebuilds its matrices when one of its inputs
+// changed. revision() increases on every change so consumers can skip work
+// (uniform uploads, transform batches) while the camera is still.
+class Camera {
+public:
+    Camera() = default;
+    ~Camera() = default;
+
+    Camera(const Camera& other) = default;
+    Camera(Camera&& other) noexcept = default;
+    Camera& operator =(const Camera& other) = default;
+    Camera& operator =(Camera&& other) noexcept = default;
+
+    void look_at(const glm::vec3& eye, const glm::vec3& target, const glm::vec3& up);
+    void set_perspective(float fov_y, float aspect, float near_plane, float far_plane);
+    void set_aspect(float aspect);
+
+    const glm::vec3& position() const { return m_eye; }
+    const glm::vec3& target() const { return m_target; }
+    const glm::vec3& up() const { return m_up; }
+    float fov_y() const { return m_fov_y; }
+    float aspect() const { return m_aspect; }
+    float near_plane() const { return m_near; }
+    float far_plane() const { return m_far; }
+
+    const glm::mat4& view() const;
+    const glm::mat4& projection() const;
+    const glm::mat4& view_projection() const;
+
+    uint64_t revision() const { return m_revision; }
+
+private:
+    void rebuild() const;
+
+    glm::vec3 m_eye = glm::vec3(0.0f, 0.0f, 1.0f);
+    glm::vec3 m_target = glm::vec3(0.0f);
+    glm::vec3 m_up = glm::vec3(0.0f, 0.0f, 1.0f);
+    float m_fov_y = glm::radians(45.0f);
+    float m_aspect = 1.0f;
+    float m_near = 0.1f;
+    float m_far = 10.0f;
+
+    uint64_t m_revision = 1;
+    mutable uint64_t m_built_revision = 0;
+    mutable glm::mat4 m_view;
+    mutable glm::mat4 m_projection;
+    mutable glm::mat4 m_view_projection;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "CommandSegments.h"
+
+#include <stdexcept>
+#include <utility>
+
+
+CommandSegments::CommandSegments(VkDevice device, VkCommandPool command_pool, std::vector<std::string> names):
+    m_device(device),
+    m_command_pool(command_pool),
+    m_names(std::move(names)),
+    m_totals(m_names.size())
+{ }
+ 
+CommandSegments::~CommandSegments() {
+    free_command_buffers();
+}
+ 
+void CommandSegments::reset(std::size_t image_count) {
+    free_command_buffers();
+    m_image_count = image_count;
+    m_segments.assign(m_names.size() * image_count, Segment());
+
+    std::vector<VkCommandBuffer> commands(m_segments.size());
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = m_command_pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commands.size());
+    if(!commands.empty() && vkAllocateCommandBuffers(m_device, &allocInfo, commands.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate secondary command buffers!");
+    }
+    for(std::size_t i = 0; i < commands.size(); ++i) {
+        m_segments[i].commands = commands[i];
+    }
+}
+ 
+std::vector<uint64_t>& CommandSegments::inputs() {
+    m_inputs.clear();
+    return m_inputs;
+}
+ 
+bool CommandSegments::update(uint32_t segment, std::size_t image, const VkCommandBufferInheritanceInfo& inheritance,
+        const RecordFunction& record) {
+    auto& slot = m_segments[segment * m_image_count + image];
+    if(slot.valid && slot.inputs == m_inputs) {
+        m_frame.reused += 1;
+        m_totals[segment].reused += 1;
+        return false;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    beginInfo.pInheritanceInfo = &inheritance;
+    if(vkBeginCommandBuffer(slot.commands, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command segment!");
+    }
+    record(slot.commands);
+    if(vkEndCommandBuffer(slot.commands) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record command segment!");
+    }
+
+    // Swapped so that both lists keep their storage.
+    slot.inputs.swap(m_inputs);
+    slot.valid = true;
+    m_frame.recorded += 1;
+    m_totals[segment].recorded += 1;
+    return true;
+}
+ 
+VkCommandBuffer CommandSegments::get(uint32_t segment, std::size_t image) const {
+    return m_segments[segment * m_image_count + image].commands;
+}
+ 
+void CommandSegments::end_frame() {
+    if(m_frame.recorded > 0) {
+        m_recording_frames += 1;
+    }
+    m_frames += 1;
+    m_frame = {};
+}
+ 
+void CommandSegments::report(std::ostream& stream) const {
+    CommandSegmentStats total;
+    for(const auto& stats : m_totals) {
+        total.recorded += stats.recorded;
+        total.reused += stats.reused;
+    }
+    uint64_t updates = total.recorded + total.reused;
+    stream << "Command segments: " << total.recorded << " recorded, " << total.reused << " reused ("
+        << (updates > 0 ? 100.0 * total.reused / updates : 0.0) << "%), re-recorded in " << m_recording_frames
+        << " of " << m_frames << " frames\n";
+    for(std::size_t i = 0; i < m_names.size(); ++i) {
+        stream << "\t|> " << m_names[i] << ": " << m_totals[i].recorded << " recorded, " << m_totals[i].reused
+            << " reused\n";
+    }
+}
+ 
+void CommandSegments::free_command_buffers() {
+    for(auto& segment : m_segments) {
+        vkFreeCommandBuffers(m_device, m_command_pool, 1, &segment.commands);
+    }
+    m_segments.clear();
+}
@@ -0,0 +1,85 @@
+#ifndef COMMAND_SEGMENTS_H_
+#define COMMAND_SEGMENTS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct CommandSegmentStats {
+    uint64_t recorded = 0;
+    uint64_t reused = 0;
+};
+
+// Secondary command buffers, one per segment and swapchain image, that are
+// kept across frames and only re-recorded when what they were recorded from
+// changes. The caller lists everything a segment's commands depend on as 64
+// bit words (handles, sizes, the draw list) into inputs() before each
+// update(); comparing them with the words of the last recording is the diff.
+// Anything left out of the inputs is assumed to be constant until reset().
+//
+// A primary command buffer that executes a segment becomes invalid when the
+// segment is re-recorded, so it has to be recorded again whenever update()
+// returns true.
+//
+// Not thread safe.
+class CommandSegments {
+public:
+    using RecordFunction = std::function<void(VkCommandBuffer)>;
+
+    CommandSegments(VkDevice device, VkCommandPool command_pool, std::vector<std::string> names);
+    // The segments must not be pending any more.
+    ~CommandSegments();
+
+    CommandSegments(const CommandSegments& other) = delete;
+    CommandSegments(CommandSegments&& other) noexcept = delete;
+    CommandSegments& operator =(const CommandSegments& other) = delete;
+    CommandSegments& operator =(CommandSegments&& other) noexcept = delete;
+
+    // Replaces the command buffers with unrecorded ones for image_count
+    // images; the counters carry over. The segments must not be pending.
+    void reset(std::size_t image_count);
+
+    // Emptied scratch list for the inputs of the next update().
+    std::vector<uint64_t>& inputs();
+    // Records the segment for image with record, inside the render pass of
+    // inheritance, unless inputs() matches its last recording. Returns
+    // whether it was recorded.
+    bool update(uint32_t segment, std::size_t image, const VkCommandBufferInheritanceInfo& inheritance,
+        const RecordFunction& record);
+    VkCommandBuffer get(uint32_t segment, std::size_t image) const;
+
+    // Of the updates since the last end_frame().
+    const CommandSegmentStats& frame_stats() const { return m_frame; }
+    void end_frame();
+
+    void report(std::ostream& stream) const;
+
+private:
+    struct Segment {
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        std::vector<uint64_t> inputs;
+        bool valid = false;
+    };
+
+    void free_command_buffers();
+
+    VkDevice m_device;
+    VkCommandPool m_command_pool;
+    std::vector<std::string> m_names;
+    std::size_t m_image_count = 0;
+
+    // Segment-major, image_count entries per segment.
+    std::vector<Segment> m_segments;
+    std::vector<uint64_t> m_inputs;
+    std::vector<CommandSegmentStats> m_totals;
+    CommandSegmentStats m_frame;
+    uint64_t m_frames = 0;
+    uint64_t m_recording_frames = 0;
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include "DeletionQueue.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+template <typename T>
+static T handle_of(uint64_t handle) {
+    return reinterpret_cast<T>(handle);
+}
+
+
+DeletionQueue::DeletionQueue(VkDevice device, QueueSync& sync, ReleaseMemoryFunction release_memory,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_sync(sync),
+    m_release_memory(std::move(release_memory)),
+    m_host_allocator(host_allocator)
+{ }
+ 
+DeletionQueue::~DeletionQueue() {
+    flush();
+}
+ 
+void DeletionQueue::submitted(SyncPoint point) {
+    std::size_t submitted = m_batches.empty() ? 0 : m_batches.back().end;
+    if(m_entries.size() == submitted) {
+        return;
+    }
+    m_batches.push_back({point, m_entries.size()});
+}
+ 
+void DeletionQueue::collect() {
+    // Batches are gated by points on one queue, which are reached in order,
+    // so the first batch still running ends the search.
+    std::size_t completed = 0;
+    while(completed < m_batches.size() && m_sync.reached(m_batches[completed].point)) {
+        completed += 1;
+    }
+    if(completed == 0) {
+        return;
+    }
+
+    std::size_t end = m_batches[completed - 1].end;
+    destroy_front(end);
+    m_batches.erase(m_batches.begin(), m_batches.begin() + completed);
+    for(auto& batch : m_batches) {
+        batch.end -= end;
+    }
+}
+ 
+void DeletionQueue::flush() {
+    destroy_front(m_entries.size());
+    m_batches.clear();
+}
+ 
+void DeletionQueue::report(std::ostream& stream) const {
+    stream << "Deferred deletions: " << m_destroyed << " objects destroyed, peak " << m_peak_pending 
+        << " pending\n";
+}
+ 
+void DeletionQueue::push(VkObjectType type, uint64_t handle) {
+    m_entries.push_back({type, handle});
+    m_peak_pending = std::max(m_peak_pending, m_entries.size());
+}
+ 
+void DeletionQueue::destroy(const Entry& entry) {
+    switch(entry.type) {
+        case VK_OBJECT_TYPE_BUFFER:
+            vkDestroyBuffer(m_device, handle_of<VkBuffer>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_IMAGE:
+            vkDestroyImage(m_device, handle_of<VkImage>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_IMAGE_VIEW:
+            vkDestroyImageView(m_device, handle_of<VkImageView>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_SAMPLER:
+            vkDestroySampler(m_device, handle_of<VkSampler>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_DEVICE_MEMORY:
+            m_release_memory(handle_of<VkDeviceMemory>(entry.handle));
+            break;
+        case VK_OBJECT_TYPE_FRAMEBUFFER:
+            vkDestroyFramebuffer(m_device, handle_of<VkFramebuffer>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_RENDER_PASS:
+            vkDestroyRenderPass(m_device, handle_of<VkRenderPass>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE:
+            vkDestroyPipeline(m_device, handle_of<VkPipeline>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_PIPELINE_LAYOUT:
+            vkDestroyPipelineLayout(m_device, handle_of<VkPipelineLayout>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_QUERY_POOL:
+            vkDestroyQueryPool(m_device, handle_of<VkQueryPool>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_SEMAPHORE:
+            vkDestroySemaphore(m_device, handle_of<VkSemaphore>(entry.handle), m_host_allocator);
+            break;
+        case VK_OBJECT_TYPE_SHADER_MODULE:
+            vkDestroyShaderModule(m_device, handle_of<VkShaderModule>(entry.handle), m_host_allocator);
+            break;
+        default:
+            throw std::runtime_error("Deletion queue cannot destroy this object type!");
+    }
+}
+ 
+void DeletionQueue::destroy_front(std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        destroy(m_entries[i]);
+    }
+    m_entries.erase(m_entries.begin(), m_entries.begin() + count);
+    m_destroyed += count;
+}
@@ -0,0 +1,176 @@
+#ifndef DELETION_QUEUE_H_
+#define DELETION_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "QueueSync.h"
+
+// Handles of non-dispatchable objects are only distinct types on 64 bit
+// platforms, which the type mapping below relies on.
+static_assert(sizeof(void*) == 8, "Device object handles need 64 bit pointers!");
+
+template <typename T>
+struct DeviceObjectType;
+
+template <> struct DeviceObjectType<VkBuffer> { static constexpr VkObjectType value = VK_OBJECT_TYPE_BUFFER; };
+template <> struct DeviceObjectType<VkImage> { static constexpr VkObjectType value = VK_OBJECT_TYPE_IMAGE; };
+template <> struct DeviceObjectType<VkImageView> { static constexpr VkObjectType value = VK_OBJECT_TYPE_IMAGE_VIEW; };
+template <> struct DeviceObjectType<VkSampler> { static constexpr VkObjectType value = VK_OBJECT_TYPE_SAMPLER; };
+template <> struct DeviceObjectType<VkDeviceMemory> {
+    static constexpr VkObjectType value = VK_OBJECT_TYPE_DEVICE_MEMORY;
+};
+template <> struct DeviceObjectType<VkFramebuffer> { static constexpr VkObjectType value = VK_OBJECT_TYPE_FRAMEBUFFER; };
+template <> struct DeviceObjectType<VkRenderPass> { static constexpr VkObjectType value = VK_OBJECT_TYPE_RENDER_PASS; };
+template <> struct DeviceObjectType<VkPipeline> { static constexpr VkObjectType value = VK_OBJECT_TYPE_PIPELINE; };
+template <> struct DeviceObjectType<VkPipelineLayout> {
+    static constexpr VkObjectType value = VK_OBJECT_TYPE_PIPELINE_LAYOUT;
+};
+template <> struct DeviceObjectType<VkQueryPool> { static constexpr VkObjectType value = VK_OBJECT_TYPE_QUERY_POOL; };
+template <> struct DeviceObjectType<VkSemaphore> { static constexpr VkObjectType value = VK_OBJECT_TYPE_SEMAPHORE; };
+template <> struct DeviceObjectType<VkShaderModule> {
+    static constexpr VkObjectType value = VK_OBJECT_TYPE_SHADER_MODULE;
+};
+
+// Destroys device objects once the GPU is done with them instead of waiting
+// for the device to idle. Objects retired between two submissions form a
+// batch that is gated by the sync point of the next submission: a point is
+// reached only after everything submitted to its queue before it has
+// completed, so the batch covers every frame that could still use its
+// objects.
+//
+// Memory goes back through release_memory so that its accounting stays with
+// whoever allocated it; within a batch objects are destroyed in the order
+// they were retired, so retire an image before the memory bound to it.
+//
+// Not thread safe. All submissions that may use retired objects have to go
+// to the queue whose points close the batches.
+class DeletionQueue {
+public:
+    using ReleaseMemoryFunction = std::function<void(VkDeviceMemory memory)>;
+
+    DeletionQueue(VkDevice device, QueueSync& sync, ReleaseMemoryFunction release_memory,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    // Destroys whatever is still queued, so the device has to be idle.
+    ~DeletionQueue();
+
+    DeletionQueue(const DeletionQueue& other) = delete;
+    DeletionQueue(DeletionQueue&& other) noexcept = delete;
+    DeletionQueue& operator =(const DeletionQueue& other) = delete;
+    DeletionQueue& operator =(DeletionQueue&& other) noexcept = delete;
+
+    template <typename T>
+    void retire(T handle) {
+        if(handle != VK_NULL_HANDLE) {
+            push(DeviceObjectType<T>::value, reinterpret_cast<uint64_t>(handle));
+        }
+    }
+
+    // Closes the batch of objects retired so far, to be destroyed once
+    // point, which has to come from a submission after their last use, is
+    // reached.
+    void submitted(SyncPoint point);
+    // Destroys the batches whose point was reached. Never blocks.
+    void collect();
+    // Destroys everything, submitted or not; only once the device is idle.
+    void flush();
+
+    std::size_t pending() const { return m_entries.size(); }
+    uint64_t destroyed() const { return m_destroyed; }
+
+    void report(std::ostream& stream) const;
+
+private:
+    struct Entry {
+        VkObjectType type;
+        uint64_t handle;
+    };
+
+    // Entries before end belong to the batch; earlier batches end earlier.
+    struct Batch {
+        SyncPoint point;
+        std::size_t end;
+    };
+
+    void push(VkObjectType type, uint64_t handle);
+    void destroy(const Entry& entry);
+    void destroy_front(std::size_t count);
+
+    VkDevice m_device;
+    QueueSync& m_sync;
+    ReleaseMemoryFunction m_release_memory;
+    const VkAllocationCallbacks* m_host_allocator;
+
+    // Oldest first; entries after the last batch's end wait for a submission.
+    std::vector<Entry> m_entries;
+    std::vector<Batch> m_batches;
+    std::size_t m_peak_pending = 0;
+    uint64_t m_destroyed = 0;
+};
+
+// Move-only owner of a device object. Dropping or replacing it retires the
+// object to a DeletionQueue, which destroys it once no submitted frame can
+// use it any more.
+template <typename T>
+class DeviceHandle {
+public:
+    DeviceHandle() = default;
+    DeviceHandle(DeletionQueue& queue, T handle): m_queue(&queue), m_handle(handle) { }
+    ~DeviceHandle() { reset(); }
+
+    DeviceHandle(const DeviceHandle& other) = delete;
+    DeviceHandle(DeviceHandle&& other) noexcept:
+        m_queue(other.m_queue),
+        m_handle(other.release())
+    { }
+    DeviceHandle& operator =(const DeviceHandle& other) = delete;
+    DeviceHandle& operator =(DeviceHandle&& other) noexcept {
+        if(this != &other) {
+            reset();
+            m_queue = other.m_queue;
+            m_handle = other.release();
+        }
+        return *this;
+    }
+
+    T get() const { return m_handle; }
+    explicit operator bool() const { return m_handle != VK_NULL_HANDLE; }
+
+    // Gives up ownership without retiring the object.
+    T release() {
+        T handle = m_handle;
+        m_handle = VK_NULL_HANDLE;
+        return handle;
+    }
+
+    void reset() {
+        if(m_handle != VK_NULL_HANDLE) {
+            m_queue->retire(m_handle);
+            m_handle = VK_NULL_HANDLE;
+        }
+    }
+
+private:
+    DeletionQueue* m_queue = nullptr;
+    T m_handle = VK_NULL_HANDLE;
+};
+
+using BufferHandle = DeviceHandle<VkBuffer>;
+using ImageHandle = DeviceHandle<VkImage>;
+using ImageViewHandle = DeviceHandle<VkImageView>;
+using SamplerHandle = DeviceHandle<VkSampler>;
+using MemoryHandle = DeviceHandle<VkDeviceMemory>;
+using FramebufferHandle = DeviceHandle<VkFramebuffer>;
+using RenderPassHandle = DeviceHandle<VkRenderPass>;
+using PipelineHandle = DeviceHandle<VkPipeline>;
+using PipelineLayoutHandle = DeviceHandle<VkPipelineLayout>;
+using QueryPoolHandle = DeviceHandle<VkQueryPool>;
+using SemaphoreHandle = DeviceHandle<VkSemaphore>;
+using ShaderModuleHandle = DeviceHandle<VkShaderModule>;
+
+#endif
@@ -0,0 +1,101 @@
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, std::vector<DescriptorPoolRatio> ratios, 
+        uint32_t initial_sets, VkDescriptorPoolCreateFlags flags, const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_host_allocator(host_allocator),
+    m_ratios(std::move(ratios)),
+    m_flags(flags),
+    m_sets_per_pool(std::max(initial_sets, 1u))
+{ }
+ 
+DescriptorAllocator::~DescriptorAllocator() {
+    for(auto pool : m_full_pools) {
+        vkDestroyDescriptorPool(m_device, pool, m_host_allocator);
+    }
+    for(auto pool : m_ready_pools) {
+        vkDestroyDescriptorPool(m_device, pool, m_host_allocator);
+    }
+}
+ 
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const void* next) {
+    VkDescriptorPool pool = take_pool();
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = next;
+    allocInfo.descriptorPool = pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkDescriptorSet set;
+    VkResult result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+    if(result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        m_full_pools.push_back(pool);
+        pool = take_pool();
+        allocInfo.descriptorPool = pool;
+        result = vkAllocateDescriptorSets(m_device, &allocInfo, &set);
+    }
+    if(result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate descriptor set!");
+    }
+
+    m_ready_pools.push_back(pool);
+    m_allocated_sets += 1;
+    return set;
+}
+ 
+void DescriptorAllocator::reset() {
+    for(auto pool : m_ready_pools) {
+        vkResetDescriptorPool(m_device, pool, 0);
+    }
+    for(auto pool : m_full_pools) {
+        vkResetDescriptorPool(m_device, pool, 0);
+        m_ready_pools.push_back(pool);
+    }
+    m_full_pools.clear();
+    m_allocated_sets = 0;
+}
+ 
+VkDescriptorPool DescriptorAllocator::take_pool() {
+    if(!m_ready_pools.empty()) {
+        VkDescriptorPool pool = m_ready_pools.back();
+        m_ready_pools.pop_back();
+        return pool;
+    }
+
+    VkDescriptorPool pool = create_pool(m_sets_per_pool);
+    m_sets_per_pool = std::min(m_sets_per_pool * 2, MAX_SETS_PER_POOL);
+    return pool;
+}
+ 
+VkDescriptorPool DescriptorAllocator::create_pool(uint32_t set_count) {
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    poolSizes.reserve(m_ratios.size());
+    for(const auto& ratio : m_ratios) {
+        VkDescriptorPoolSize poolSize = {};
+        poolSize.type = ratio.type;
+        poolSize.descriptorCount = std::max(1u, static_cast<uint32_t>(std::ceil(ratio.ratio * set_count)));
+        poolSizes.push_back(poolSize);
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = m_flags;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = set_count;
+
+    VkDescriptorPool pool;
+    if (vkCreateDescriptorPool(m_device, &poolInfo, m_host_allocator, &pool) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor pool!");
+    }
+    return pool;
+}
+ 
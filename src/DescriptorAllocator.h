@@ -0,0 +1,54 @@
+#ifndef DESCRIPTOR_ALLOCATOR_H_
+#define DESCRIPTOR_ALLOCATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Number of descriptors of a type reserved per set in each pool.
+struct DescriptorPoolRatio {
+    VkDescriptorType type;
+    float ratio;
+};
+
+// Hands out descriptor sets from a chain of pools. When the current pool
+// runs out a new one is created, each twice the size of the previous up to
+// MAX_SETS_PER_POOL, so callers never have to size pools by hand. reset()
+// returns every set at once and keeps the pools for reuse, which makes one
+// allocator per frame the cheap way to handle transient sets.
+class DescriptorAllocator {
+public:
+    static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+    DescriptorAllocator(VkDevice device, std::vector<DescriptorPoolRatio> ratios, uint32_t initial_sets = 16,
+        VkDescriptorPoolCreateFlags flags = 0, const VkAllocationCallbacks* host_allocator = nullptr);
+    ~DescriptorAllocator();
+
+    DescriptorAllocator(const DescriptorAllocator& other) = delete;
+    DescriptorAllocator(DescriptorAllocator&& other) noexcept = delete;
+    DescriptorAllocator& operator =(const DescriptorAllocator& other) = delete;
+    DescriptorAllocator& operator =(DescriptorAllocator&& other) noexcept = delete;
+
+    VkDescriptorSet allocate(VkDescriptorSetLayout layout, const void* next = nullptr);
+    void reset();
+
+    std::size_t pool_count() const { return m_full_pools.size() + m_ready_pools.size(); }
+    uint64_t allocated_sets() const { return m_allocated_sets; }
+
+private:
+    VkDescriptorPool take_pool();
+    VkDescriptorPool create_pool(uint32_t set_count);
+
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_host_allocator;
+    std::vector<DescriptorPoolRatio> m_ratios;
+    VkDescriptorPoolCreateFlags m_flags;
+    uint32_t m_sets_per_pool;
+    uint64_t m_allocated_sets = 0;
+
+    std::vector<VkDescriptorPool> m_full_pools;
+    std::vector<VkDescriptorPool> m_ready_pools;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "DescriptorLayoutCache.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+
+DescriptorLayoutCache::DescriptorLayoutCache(VkDevice device, const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_host_allocator(host_allocator)
+{ }
+ 
+DescriptorLayoutCache::~DescriptorLayoutCache() {
+    for(const auto& [key, layout] : m_layouts) {
+        vkDestroyDescriptorSetLayout(m_device, layout, m_host_allocator);
+    }
+}
+ 
+VkDescriptorSetLayout DescriptorLayoutCache::get(const VkDescriptorSetLayoutCreateInfo& info) {
+    LayoutKey key = make_key(info);
+    auto it = m_layouts.find(key);
+    if(it != m_layouts.end()) {
+        return it->second;
+    }
+
+    VkDescriptorSetLayout layout;
+    if(vkCreateDescriptorSetLayout(m_device, &info, m_host_allocator, &layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create descriptor set layout!");
+    }
+    m_layouts.emplace(std::move(key), layout);
+    return layout;
+}
+ 
+VkDescriptorSetLayout DescriptorLayoutCache::get(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+
+    return get(layoutInfo);
+}
+ 
+DescriptorLayoutCache::LayoutKey DescriptorLayoutCache::make_key(const VkDescriptorSetLayoutCreateInfo& info) {
+    const VkDescriptorBindingFlags* binding_flags = nullptr;
+    for(auto* next = static_cast<const VkBaseInStructure*>(info.pNext); next; next = next->pNext) {
+        if(next->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO) {
+            auto* flags_info = reinterpret_cast<const VkDescriptorSetLayoutBindingFlagsCreateInfo*>(next);
+            if(flags_info->bindingCount == info.bindingCount) {
+                binding_flags = flags_info->pBindingFlags;
+            }
+        }
+    }
+
+    std::vector<uint32_t> order(info.bindingCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return info.pBindings[a].binding < info.pBindings[b].binding;
+    });
+
+    LayoutKey key;
+    key.flags = info.flags;
+    key.bindings.reserve(info.bindingCount);
+    key.binding_flags.reserve(info.bindingCount);
+    for(uint32_t i : order) {
+        key.bindings.push_back(info.pBindings[i]);
+        key.binding_flags.push_back(binding_flags ? binding_flags[i] : 0);
+    }
+    return key;
+}
+ 
+bool DescriptorLayoutCache::LayoutKey::operator ==(const LayoutKey& other) const {
+    if(flags != other.flags || bindings.size() != other.bindings.size() || binding_flags != other.binding_flags) {
+        return false;
+    }
+    for(std::size_t i = 0; i < bindings.size(); ++i) {
+        const auto& a = bindings[i];
+        const auto& b = other.bindings[i];
+        if(a.binding != b.binding || a.descriptorType != b.descriptorType || a.descriptorCount != b.descriptorCount ||
+                a.stageFlags != b.stageFlags || a.pImmutableSamplers != b.pImmutableSamplers) {
+            return false;
+        }
+    }
+    return true;
+}
+ 
+std::size_t DescriptorLayoutCache::LayoutKeyHash::operator()(const LayoutKey& key) const {
+    auto combine = [](std::size_t seed, uint64_t value) {
+        return seed ^ (std::hash<uint64_t>()(value) + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    };
+
+    std::size_t seed = combine(0, key.flags);
+    for(std::size_t i = 0; i < key.bindings.size(); ++i) {
+        const auto& binding = key.bindings[i];
+        uint64_t packed = (static_cast<uint64_t>(binding.binding) << 32) |
+            (static_cast<uint64_t>(binding.descriptorType) << 24) | binding.stageFlags;
+        seed = combine(seed, packed);
+        seed = combine(seed, (static_cast<uint64_t>(binding.descriptorCount) << 32) | key.binding_flags[i]);
+    }
+    return seed;
+}
+ 
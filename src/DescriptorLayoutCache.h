@@ -0,0 +1,50 @@
+#ifndef DESCRIPTOR_LAYOUT_CACHE_H_
+#define DESCRIPTOR_LAYOUT_CACHE_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Deduplicates descriptor set layouts by their binding description. Two
+// create infos that list the same bindings (in any order) with the same
+// flags, including per-binding flags chained through
+// VkDescriptorSetLayoutBindingFlagsCreateInfo, share one layout handle.
+// Layouts live until the cache is destroyed.
+class DescriptorLayoutCache {
+public:
+    explicit DescriptorLayoutCache(VkDevice device, const VkAllocationCallbacks* host_allocator = nullptr);
+    ~DescriptorLayoutCache();
+
+    DescriptorLayoutCache(const DescriptorLayoutCache& other) = delete;
+    DescriptorLayoutCache(DescriptorLayoutCache&& other) noexcept = delete;
+    DescriptorLayoutCache& operator =(const DescriptorLayoutCache& other) = delete;
+    DescriptorLayoutCache& operator =(DescriptorLayoutCache&& other) noexcept = delete;
+
+    VkDescriptorSetLayout get(const VkDescriptorSetLayoutCreateInfo& info);
+    VkDescriptorSetLayout get(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+
+    std::size_t size() const { return m_layouts.size(); }
+
+private:
+    struct LayoutKey {
+        VkDescriptorSetLayoutCreateFlags flags = 0;
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        std::vector<VkDescriptorBindingFlags> binding_flags;
+
+        bool operator ==(const LayoutKey& other) const;
+    };
+
+    struct LayoutKeyHash {
+        std::size_t operator()(const LayoutKey& key) const;
+    };
+
+    static LayoutKey make_key(const VkDescriptorSetLayoutCreateInfo& info);
+
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_host_allocator;
+    std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> m_layouts;
+};
+
+#endif
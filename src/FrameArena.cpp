@@ -0,0 +1,97 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+
+
+static std::byte* align_up(std::byte* pointer, std::size_t alignment) {
+    auto address = reinterpret_cast<uintptr_t>(pointer);
+    return pointer + ((alignment - address % alignment) % alignment);
+}
+
+
+FrameArena::FrameArena(std::size_t block_size):
+    m_block_size(std::max<std::size_t>(block_size, 1024))
+{ }
+ 
+void* FrameArena::allocate(std::size_t size, std::size_t alignment) {
+    std::byte* memory = m_cursor ? align_up(m_cursor, alignment) : nullptr;
+    if(!memory || memory + size > m_end) {
+        // The unused rest of the current block is skipped rather than kept
+        // track of; reset() sizes the next frame's block to fit anyway.
+        add_block(std::max(m_block_size, size + alignment));
+        memory = align_up(m_cursor, alignment);
+    }
+    m_used += static_cast<std::size_t>(memory + size - m_cursor);
+    m_high_water = std::max(m_high_water, m_used);
+    m_last = memory;
+    m_last_start = m_cursor;
+    m_cursor = memory + size;
+    return memory;
+}
+ 
+void FrameArena::deallocate(void* memory, std::size_t size) {
+    auto* bytes = static_cast<std::byte*>(memory);
+    if(bytes == m_last && bytes + size == m_cursor) {
+        m_used -= static_cast<std::size_t>(m_cursor - m_last_start);
+        m_cursor = m_last_start;
+        m_last = nullptr;
+    }
+}
+ 
+void FrameArena::reset() {
+    // Only the newest block is in use by now when they were all merged.
+    if(m_blocks.size() > 1 || (!m_blocks.empty() && m_blocks.back().size < m_high_water)) {
+        std::size_t size = m_high_water + m_high_water / 2;
+        m_blocks.clear();
+        add_block(std::max(m_block_size, size));
+    }
+    if(!m_blocks.empty()) {
+        m_cursor = m_blocks.back().memory.get();
+        m_end = m_cursor + m_blocks.back().size;
+    }
+    m_last = nullptr;
+    m_used = 0;
+}
+ 
+std::size_t FrameArena::capacity() const {
+    std::size_t total = 0;
+    for(const auto& block : m_blocks) {
+        total += block.size;
+    }
+    return total;
+}
+ 
+void FrameArena::add_block(std::size_t size) {
+    Block block;
+    block.memory.reset(new std::byte[size]);
+    block.size = size;
+    m_cursor = block.memory.get();
+    m_end = m_cursor + size;
+    m_blocks.push_back(std::move(block));
+    m_block_allocations += 1;
+}
+ 
+FrameArenas::FrameArenas(std::size_t thread_count, std::size_t block_size) {
+    for(std::size_t i = 0; i < std::max<std::size_t>(thread_count, 1); ++i) {
+        m_arenas.emplace_back(block_size);
+    }
+}
+ 
+void FrameArenas::reset() {
+    for(auto& arena : m_arenas) {
+        arena.reset();
+    }
+}
+ 
+void FrameArenas::report(std::ostream& stream) const {
+    std::size_t high_water = 0;
+    std::size_t capacity = 0;
+    uint64_t blocks = 0;
+    for(const auto& arena : m_arenas) {
+        high_water = std::max(high_water, arena.high_water());
+        capacity += arena.capacity();
+        blocks += arena.block_allocations();
+    }
+    stream << "Frame arenas: " << m_arenas.size() << " threads, " << capacity / 1024 << " KB reserved, "
+        << "largest frame " << high_water / 1024.0 << " KB, " << blocks << " blocks allocated\n";
+}
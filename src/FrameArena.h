@@ -0,0 +1,114 @@
+#ifndef FRAME_ARENA_H_
+#define FRAME_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Bump allocator for data that only lives until the end of a frame. Memory
+// comes from large blocks and is handed back all at once by reset(), which
+// replaces the blocks by a single one big enough for the frame that used the
+// most, so after a few frames the arena stops touching the heap.
+//
+// Not thread safe; every thread gets its own arena.
+class FrameArena {
+public:
+    static constexpr std::size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+    explicit FrameArena(std::size_t block_size = DEFAULT_BLOCK_SIZE);
+    ~FrameArena() = default;
+
+    FrameArena(const FrameArena& other) = delete;
+    FrameArena(FrameArena&& other) noexcept = default;
+    FrameArena& operator =(const FrameArena& other) = delete;
+    FrameArena& operator =(FrameArena&& other) noexcept = default;
+
+    void* allocate(std::size_t size, std::size_t alignment);
+    // Only the most recent allocation is given back, when it is freed before
+    // anything else is allocated; anything else waits for reset(). A growing
+    // vector frees its old buffer after allocating the new one, so that
+    // buffer is not reused.
+    void deallocate(void* memory, std::size_t size);
+    void reset();
+
+    std::size_t used() const { return m_used; }
+    std::size_t high_water() const { return m_high_water; }
+    std::size_t capacity() const;
+    // Blocks taken from the heap since construction.
+    uint64_t block_allocations() const { return m_block_allocations; }
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> memory;
+        std::size_t size = 0;
+    };
+
+    void add_block(std::size_t size);
+
+    std::size_t m_block_size;
+    std::vector<Block> m_blocks;
+    std::byte* m_cursor = nullptr;
+    std::byte* m_end = nullptr;
+    // The most recent allocation and where it started, its alignment
+    // padding included, for deallocate().
+    std::byte* m_last = nullptr;
+    std::byte* m_last_start = nullptr;
+    std::size_t m_used = 0;
+    std::size_t m_high_water = 0;
+    uint64_t m_block_allocations = 0;
+};
+
+// Standard allocator handing out FrameArena memory, e.g. for containers
+// that are built and dropped within a frame. Containers using it must not
+// outlive the arena's next reset().
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(FrameArena& arena): m_arena(&arena) { }
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other): m_arena(other.arena()) { }
+
+    T* allocate(std::size_t count) { return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T* memory, std::size_t count) { m_arena->deallocate(memory, count * sizeof(T)); }
+
+    FrameArena* arena() const { return m_arena; }
+
+private:
+    FrameArena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator ==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() == b.arena(); }
+
+template <typename T, typename U>
+bool operator !=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena() != b.arena(); }
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// One arena per thread of a JobSystem, indexed by worker_index(), all reset
+// together once the frame using them has completed on the GPU.
+class FrameArenas {
+public:
+    FrameArenas(std::size_t thread_count, std::size_t block_size = FrameArena::DEFAULT_BLOCK_SIZE);
+    ~FrameArenas() = default;
+
+    FrameArenas(const FrameArenas& other) = delete;
+    FrameArenas(FrameArenas&& other) noexcept = default;
+    FrameArenas& operator =(const FrameArenas& other) = delete;
+    FrameArenas& operator =(FrameArenas&& other) noexcept = default;
+
+    FrameArena& thread(std::size_t index) { return m_arenas[index]; }
+    void reset();
+
+    void report(std::ostream& stream) const;
+
+private:
+    std::vector<FrameArena> m_arenas;
+};
+
+#endif
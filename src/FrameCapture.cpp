@@ -0,0 +1,116 @@
+#include "FrameCapture.h"
+
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+
+static constexpr char CAPTURE_MAGIC[8] = {'L', 'S', 'C', 'A', 'P', 'T', 'R', '\0'};
+static constexpr uint32_t CAPTURE_VERSION = 1;
+
+
+CaptureWriter::CaptureWriter(const std::string& filename):
+    m_file(filename, std::ios::binary | std::ios::out | std::ios::trunc)
+{
+    if(!m_file.is_open()) {
+        throw std::runtime_error("Failed to open capture file: " + filename);
+    }
+    CaptureFileHeader header = {};
+    std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    header.version = CAPTURE_VERSION;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+ 
+CaptureWriter::~CaptureWriter() {
+    close();
+}
+ 
+void CaptureWriter::write(const CapturedFrame& frame) {
+    bool draws_unchanged = m_frame_count > 0 && frame.draws == m_previous_draws;
+
+    CaptureFrameRecord record = {};
+    record.time = frame.time;
+    record.width = frame.width;
+    record.height = frame.height;
+    for(int i = 0; i < 3; ++i) {
+        record.camera_position[i] = frame.camera_position[i];
+        record.camera_target[i] = frame.camera_target[i];
+    }
+    record.flags = draws_unchanged ? CaptureFrameRecord::DRAWS_UNCHANGED : 0;
+    record.input_count = static_cast<uint32_t>(frame.input.size());
+    record.upload_count = static_cast<uint32_t>(frame.uploads.size());
+    record.draw_count = draws_unchanged ? 0 : static_cast<uint32_t>(frame.draws.size());
+
+    m_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    m_file.write(reinterpret_cast<const char*>(frame.input.data()), frame.input.size() * sizeof(InputEvent));
+    m_file.write(reinterpret_cast<const char*>(frame.uploads.data()), frame.uploads.size() * sizeof(TileCoord));
+    if(!draws_unchanged) {
+        m_file.write(reinterpret_cast<const char*>(frame.draws.data()), frame.draws.size() * sizeof(TileCoord));
+        m_previous_draws = frame.draws;
+    }
+    m_frame_count += 1;
+}
+ 
+void CaptureWriter::close() {
+    if(!m_file.is_open()) {
+        return;
+    }
+    m_file.seekp(offsetof(CaptureFileHeader, frame_count));
+    m_file.write(reinterpret_cast<const char*>(&m_frame_count), sizeof(m_frame_count));
+    m_file.close();
+}
+ 
+CaptureReader::CaptureReader(const std::string& filename):
+    m_file(filename)
+{
+    if(m_file.size() < sizeof(CaptureFileHeader)) {
+        throw std::runtime_error("Capture file is truncated!");
+    }
+    CaptureFileHeader header;
+    std::memcpy(&header, m_file.data(), sizeof(header));
+    if(std::memcmp(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0) {
+        throw std::runtime_error("Not a capture file: " + filename);
+    }
+    if(header.version != CAPTURE_VERSION) {
+        throw std::runtime_error("Unsupported capture file version!");
+    }
+    m_frame_count = header.frame_count;
+    m_offset = sizeof(header);
+}
+ 
+bool CaptureReader::next(CapturedFrame& frame) {
+    if(m_frames_read >= m_frame_count) {
+        return false;
+    }
+    if(m_offset + sizeof(CaptureFrameRecord) > m_file.size()) {
+        throw std::runtime_error("Capture file is truncated!");
+    }
+    CaptureFrameRecord record;
+    std::memcpy(&record, m_file.data() + m_offset, sizeof(record));
+    m_offset += sizeof(record);
+
+    frame.time = record.time;
+    frame.width = record.width;
+    frame.height = record.height;
+    frame.camera_position = glm::vec3(record.camera_position[0], record.camera_position[1], record.camera_position[2]);
+    frame.camera_target = glm::vec3(record.camera_target[0], record.camera_target[1], record.camera_target[2]);
+    read_array(frame.input, record.input_count);
+    read_array(frame.uploads, record.upload_count);
+    if(!(record.flags & CaptureFrameRecord::DRAWS_UNCHANGED)) {
+        read_array(frame.draws, record.draw_count);
+    }
+
+    m_frames_read += 1;
+    return true;
+}
+ 
+template <typename T>
+void CaptureReader::read_array(std::vector<T>& output, uint32_t count) {
+    std::size_t bytes = std::size_t{count} * sizeof(T);
+    if(m_offset + bytes > m_file.size()) {
+        throw std::runtime_error("Capture file is truncated!");
+    }
+    output.resize(count);
+    std::memcpy(output.data(), m_file.data() + m_offset, bytes);
+    m_offset += bytes;
+}
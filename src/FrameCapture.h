@@ -0,0 +1,106 @@
+#ifndef FRAME_CAPTURE_H_
+#define FRAME_CAPTURE_H_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+#include "TileFile.h"
+
+struct InputEvent {
+    int32_t key;
+    int32_t action;
+};
+
+// Everything that drives one frame of the renderer: the animation clock,
+// input, camera, swapchain extent, the tiles uploaded and the tiles drawn.
+struct CapturedFrame {
+    double time = 0.0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    glm::vec3 camera_position = glm::vec3(0.0f);
+    glm::vec3 camera_target = glm::vec3(0.0f);
+    std::vector<InputEvent> input;
+    std::vector<TileCoord> uploads;
+    std::vector<TileCoord> draws;
+};
+
+// Capture file layout, all little endian:
+//   CaptureFileHeader
+//   frame_count records of
+//     CaptureFrameRecord
+//     input_count InputEvents
+//     upload_count TileCoords
+//     draw_count TileCoords, or none if DRAWS_UNCHANGED is set
+struct CaptureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t frame_count;
+};
+
+struct CaptureFrameRecord {
+    static constexpr uint32_t DRAWS_UNCHANGED = 1;
+
+    double time;
+    uint32_t width;
+    uint32_t height;
+    float camera_position[3];
+    float camera_target[3];
+    uint32_t flags;
+    uint32_t input_count;
+    uint32_t upload_count;
+    uint32_t draw_count;
+};
+
+class CaptureWriter {
+public:
+    explicit CaptureWriter(const std::string& filename);
+    ~CaptureWriter();
+
+    CaptureWriter(const CaptureWriter& other) = delete;
+    CaptureWriter(CaptureWriter&& other) noexcept = delete;
+    CaptureWriter& operator =(const CaptureWriter& other) = delete;
+    CaptureWriter& operator =(CaptureWriter&& other) noexcept = delete;
+
+    void write(const CapturedFrame& frame);
+    void close();
+
+    uint32_t frame_count() const { return m_frame_count; }
+
+private:
+    std::ofstream m_file;
+    uint32_t m_frame_count = 0;
+    std::vector<TileCoord> m_previous_draws;
+};
+
+class CaptureReader {
+public:
+    explicit CaptureReader(const std::string& filename);
+    ~CaptureReader() = default;
+
+    CaptureReader(const CaptureReader& other) = delete;
+    CaptureReader(CaptureReader&& other) noexcept = delete;
+    CaptureReader& operator =(const CaptureReader& other) = delete;
+    CaptureReader& operator =(CaptureReader&& other) noexcept = delete;
+
+    // Fills frame with the next captured frame, returns false at the end.
+    bool next(CapturedFrame& frame);
+
+    uint32_t frame_count() const { return m_frame_count; }
+    uint32_t frames_read() const { return m_frames_read; }
+
+private:
+    template <typename T>
+    void read_array(std::vector<T>& output, uint32_t count);
+
+    MappedFile m_file;
+    std::size_t m_offset = 0;
+    uint32_t m_frame_count = 0;
+    uint32_t m_frames_read = 0;
+};
+
+#endif
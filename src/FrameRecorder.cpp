@@ -0,0 +1,384 @@
+#include "FrameRecorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+
+static constexpr VkDeviceSize BYTES_PER_PIXEL = 4;
+
+
+// Full range BT.601 in 8 bit fixed point, as Y4M's C420jpeg expects.
+static uint8_t luma(int r, int g, int b) {
+    return static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+}
+
+// Pure blue and red round up to 256.
+static uint8_t chroma_blue(int r, int g, int b) {
+    return static_cast<uint8_t>(std::min((-43 * r - 85 * g + 128 * b + 32768 + 128) >> 8, 255));
+}
+
+static uint8_t chroma_red(int r, int g, int b) {
+    return static_cast<uint8_t>(std::min((128 * r - 107 * g - 21 * b + 32768 + 128) >> 8, 255));
+}
+
+
+FrameRecorder::FrameRecorder(VkDevice device, VkCommandPool command_pool, QueueSync& sync,
+        const std::string& video_file, uint32_t frame_rate, AllocateFunction allocate, ReleaseFunction release,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_command_pool(command_pool),
+    m_sync(sync),
+    m_allocate(std::move(allocate)),
+    m_release(std::move(release)),
+    m_host_allocator(host_allocator),
+    m_recording_video(!video_file.empty()),
+    m_video_file(video_file),
+    m_frame_rate(frame_rate)
+{
+    if(m_recording_video) {
+        m_video.open(video_file, std::ios::binary);
+        if(!m_video) {
+            throw std::runtime_error("Failed to open video file " + video_file + "!");
+        }
+    }
+
+    std::array<VkCommandBuffer, RING_SIZE> command_buffers;
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = m_command_pool;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(RING_SIZE);
+    if(vkAllocateCommandBuffers(m_device, &allocInfo, command_buffers.data()) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to allocate readback command buffers!");
+    }
+    for(std::size_t i = 0; i < RING_SIZE; ++i) {
+        m_slots[i].commands = command_buffers[i];
+    }
+    m_in_flight.reserve(RING_SIZE);
+    m_encode_queue.reserve(RING_SIZE);
+    m_encoder = std::thread(&FrameRecorder::encoder_main, this);
+}
+ 
+FrameRecorder::~FrameRecorder() {
+    // The device is idle, so every submitted copy has completed.
+    for(std::size_t index : m_in_flight) {
+        queue_for_encoding(index);
+    }
+    m_in_flight.clear();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_encoder.join();
+
+    for(auto& slot : m_slots) {
+        release_slot(slot);
+        vkFreeCommandBuffers(m_device, m_command_pool, 1, &slot.commands);
+    }
+}
+ 
+bool FrameRecorder::supports_format(VkFormat format) {
+    switch(format) {
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            return true;
+        default:
+            return false;
+    }
+}
+ 
+VkCommandBuffer FrameRecorder::record(VkImage image, VkFormat format, VkExtent2D extent) {
+    if(!supports_format(format)) {
+        throw std::runtime_error("Frame recorder cannot read back this swapchain format!");
+    }
+
+    std::size_t index = RING_SIZE;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(std::size_t i = 0; i < RING_SIZE; ++i) {
+            std::size_t candidate = (m_next_slot + i) % RING_SIZE;
+            if(m_slots[candidate].state == SlotState::Free) {
+                index = candidate;
+                break;
+            }
+        }
+        if(index == RING_SIZE) {
+            // A pending screenshot stays requested for the next frame.
+            m_dropped += 1;
+            m_pending_repeats += m_recording_video ? 1 : 0;
+            return VK_NULL_HANDLE;
+        }
+        m_slots[index].state = SlotState::Recorded;
+    }
+    m_next_slot = (index + 1) % RING_SIZE;
+
+    // Free slots are neither read by the GPU nor by the encoder.
+    Slot& slot = m_slots[index];
+    resize_slot(slot, VkDeviceSize{extent.width} * extent.height * BYTES_PER_PIXEL);
+    slot.extent = extent;
+    slot.bgra = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    slot.video = m_recording_video;
+    slot.screenshot = m_screenshot_requested;
+    slot.repeat = 1 + m_pending_repeats;
+    slot.frame = m_frame++;
+    m_screenshot_requested = false;
+    m_pending_repeats = 0;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    if(vkBeginCommandBuffer(slot.commands, &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording readback commands!");
+    }
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(slot.commands, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {extent.width, extent.height, 1};
+    vkCmdCopyImageToBuffer(slot.commands, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &region);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkBufferMemoryBarrier host_barrier = {};
+    host_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    host_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    host_barrier.buffer = slot.buffer;
+    host_barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(slot.commands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &host_barrier,
+        1, &barrier);
+
+    if(vkEndCommandBuffer(slot.commands) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to record readback commands!");
+    }
+    m_last_recorded = index;
+    return slot.commands;
+}
+ 
+void FrameRecorder::submitted(SyncPoint point) {
+    Slot& slot = m_slots[m_last_recorded];
+    slot.point = point;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot.state = SlotState::Submitted;
+    }
+    m_in_flight.push_back(m_last_recorded);
+    m_last_recorded = RING_SIZE;
+}
+ 
+void FrameRecorder::collect() {
+    // Copies complete in submission order, and the video has to be written
+    // in it.
+    std::size_t completed = 0;
+    while(completed < m_in_flight.size() && m_sync.reached(m_slots[m_in_flight[completed]].point)) {
+        queue_for_encoding(m_in_flight[completed]);
+        completed += 1;
+    }
+    m_in_flight.erase(m_in_flight.begin(), m_in_flight.begin() + completed);
+}
+ 
+void FrameRecorder::report(std::ostream& stream) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stream << "Frame recorder: " << m_video_frames << " video frames";
+    if(m_recording_video) {
+        stream << " to " << m_video_file << " (" << m_video_extent.width << "x" << m_video_extent.height << ")";
+    }
+    uint64_t encoded = m_video_frames + m_screenshots;
+    stream << ", " << m_screenshots << " screenshots, " << m_dropped << " frames dropped, "
+        << (encoded > 0 ? m_encode_ms / encoded : 0.0) << " ms encoding per frame\n";
+    if(m_write_failed) {
+        stream << "\t|> Writing frames failed, the output is incomplete\n";
+    }
+}
+ 
+void FrameRecorder::resize_slot(Slot& slot, VkDeviceSize size) {
+    if(slot.capacity >= size) {
+        return;
+    }
+    release_slot(slot);
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = size;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(vkCreateBuffer(m_device, &bufferInfo, m_host_allocator, &slot.buffer) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create readback buffer!");
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(m_device, slot.buffer, &requirements);
+    slot.memory = m_allocate(requirements.size, requirements.memoryTypeBits);
+    vkBindBufferMemory(m_device, slot.buffer, slot.memory, 0);
+
+    void* mapped;
+    if(vkMapMemory(m_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to map readback buffer!");
+    }
+    slot.mapped = static_cast<const uint8_t*>(mapped);
+    slot.capacity = size;
+}
+ 
+void FrameRecorder::release_slot(Slot& slot) {
+    if(slot.buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    vkDestroyBuffer(m_device, slot.buffer, m_host_allocator);
+    // Freeing memory unmaps it.
+    m_release(slot.memory);
+    slot.buffer = VK_NULL_HANDLE;
+    slot.memory = VK_NULL_HANDLE;
+    slot.mapped = nullptr;
+    slot.capacity = 0;
+}
+ 
+void FrameRecorder::queue_for_encoding(std::size_t index) {
+    // Host cached memory is not coherent, and invalidating coherent memory
+    // does nothing.
+    VkMappedMemoryRange range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = m_slots[index].memory;
+    range.offset = 0;
+    range.size = VK_WHOLE_SIZE;
+    vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_slots[index].state = SlotState::Encoding;
+        m_encode_queue.push_back(index);
+    }
+    m_wake.notify_one();
+}
+ 
+void FrameRecorder::encoder_main() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true) {
+        m_wake.wait(lock, [this] { return m_stopping || !m_encode_queue.empty(); });
+        if(m_encode_queue.empty()) {
+            return;
+        }
+        std::size_t index = m_encode_queue.front();
+        m_encode_queue.erase(m_encode_queue.begin());
+
+        // The render thread leaves slots alone until they are free again.
+        lock.unlock();
+        auto start = std::chrono::steady_clock::now();
+        encode(m_slots[index]);
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        lock.lock();
+
+        m_encode_ms += elapsed;
+        m_video_frames += m_slots[index].video ? m_slots[index].repeat : 0;
+        m_screenshots += m_slots[index].screenshot ? 1 : 0;
+        m_write_failed = m_write_failed || (m_recording_video && !m_video);
+        m_slots[index].state = SlotState::Free;
+    }
+}
+ 
+void FrameRecorder::encode(const Slot& slot) {
+    if(slot.video) {
+        write_video_frame(slot);
+    }
+    if(slot.screenshot) {
+        write_screenshot(slot);
+    }
+}
+ 
+void FrameRecorder::write_video_frame(const Slot& slot) {
+    if(m_video_extent.width == 0) {
+        // 4:2:0 needs even dimensions.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_video_extent = {slot.extent.width & ~1u, slot.extent.height & ~1u};
+        m_video << "YUV4MPEG2 W" << m_video_extent.width << " H" << m_video_extent.height << " F" << m_frame_rate
+            << ":1 Ip A1:1 C420jpeg\n";
+    }
+
+    uint32_t width = m_video_extent.width;
+    uint32_t height = m_video_extent.height;
+    std::size_t luma_size = std::size_t{width} * height;
+    m_planes.resize(luma_size + luma_size / 2);
+    uint8_t* y_plane = m_planes.data();
+    uint8_t* u_plane = y_plane + luma_size;
+    uint8_t* v_plane = u_plane + luma_size / 4;
+
+    int red = slot.bgra ? 2 : 0;
+    int blue = slot.bgra ? 0 : 2;
+    // Outside the frame is black, which is what a smaller frame is padded
+    // with.
+    auto pixel = [&](uint32_t x, uint32_t y, int channel) -> int {
+        if(x >= slot.extent.width || y >= slot.extent.height) {
+            return 0;
+        }
+        return slot.mapped[(std::size_t{y} * slot.extent.width + x) * BYTES_PER_PIXEL + channel];
+    };
+
+    for(uint32_t y = 0; y < height; y += 2) {
+        for(uint32_t x = 0; x < width; x += 2) {
+            int r_sum = 0;
+            int g_sum = 0;
+            int b_sum = 0;
+            for(uint32_t sample = 0; sample < 4; ++sample) {
+                uint32_t sx = x + (sample & 1);
+                uint32_t sy = y + (sample >> 1);
+                int r = pixel(sx, sy, red);
+                int g = pixel(sx, sy, 1);
+                int b = pixel(sx, sy, blue);
+                y_plane[std::size_t{sy} * width + sx] = luma(r, g, b);
+                r_sum += r;
+                g_sum += g;
+                b_sum += b;
+            }
+            std::size_t chroma_index = std::size_t{y / 2} * (width / 2) + x / 2;
+            u_plane[chroma_index] = chroma_blue((r_sum + 2) / 4, (g_sum + 2) / 4, (b_sum + 2) / 4);
+            v_plane[chroma_index] = chroma_red((r_sum + 2) / 4, (g_sum + 2) / 4, (b_sum + 2) / 4);
+        }
+    }
+
+    for(uint32_t i = 0; i < slot.repeat; ++i) {
+        m_video << "FRAME\n";
+        m_video.write(reinterpret_cast<const char*>(m_planes.data()), static_cast<std::streamsize>(m_planes.size()));
+    }
+}
+ 
+void FrameRecorder::write_screenshot(const Slot& slot) {
+    std::string filename = "screenshot_" + std::to_string(slot.frame) + ".ppm";
+    std::ofstream file(filename, std::ios::binary);
+    file << "P6\n" << slot.extent.width << " " << slot.extent.height << "\n255\n";
+
+    int red = slot.bgra ? 2 : 0;
+    int blue = slot.bgra ? 0 : 2;
+    std::vector<uint8_t> row(std::size_t{slot.extent.width} * 3);
+    for(uint32_t y = 0; y < slot.extent.height; ++y) {
+        const uint8_t* source = slot.mapped + std::size_t{y} * slot.extent.width * BYTES_PER_PIXEL;
+        for(uint32_t x = 0; x < slot.extent.width; ++x) {
+            row[x * 3 + 0] = source[x * BYTES_PER_PIXEL + red];
+            row[x * 3 + 1] = source[x * BYTES_PER_PIXEL + 1];
+            row[x * 3 + 2] = source[x * BYTES_PER_PIXEL + blue];
+        }
+        file.write(reinterpret_cast<const char*>(row.data()), static_cast<std::streamsize>(row.size()));
+    }
+    if(!file) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_write_failed = true;
+    }
+}
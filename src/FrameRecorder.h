@@ -0,0 +1,139 @@
+#ifndef FRAME_RECORDER_H_
+#define FRAME_RECORDER_H_
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "QueueSync.h"
+
+// Copies presented frames into a ring of host visible readback buffers and
+// encodes them on a background thread, either into a Y4M video (4:2:0, full
+// range BT.601) or as PPM screenshots. A copy is submitted with the frame it
+// reads and collected once its sync point is reached, so the render thread
+// never waits for the GPU or the encoder; when every slot is still busy the
+// frame is dropped and the next encoded frame repeats to keep the video's
+// timing.
+//
+// The swapchain images need VK_IMAGE_USAGE_TRANSFER_SRC_BIT and have to be
+// in VK_IMAGE_LAYOUT_PRESENT_SRC_KHR at the end of the frame. Only 8 bit
+// RGBA and BGRA formats are supported. Frames of a different size than the
+// first are cropped or padded to it.
+class FrameRecorder {
+public:
+    static constexpr std::size_t RING_SIZE = 4;
+
+    using AllocateFunction = std::function<VkDeviceMemory(VkDeviceSize size, uint32_t type_filter)>;
+    using ReleaseFunction = std::function<void(VkDeviceMemory memory)>;
+
+    // Without a video file only screenshots are taken.
+    FrameRecorder(VkDevice device, VkCommandPool command_pool, QueueSync& sync, const std::string& video_file,
+        uint32_t frame_rate, AllocateFunction allocate, ReleaseFunction release,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    // Encodes every submitted frame before returning, so the device has to
+    // be idle.
+    ~FrameRecorder();
+
+    FrameRecorder(const FrameRecorder& other) = delete;
+    FrameRecorder(FrameRecorder&& other) noexcept = delete;
+    FrameRecorder& operator =(const FrameRecorder& other) = delete;
+    FrameRecorder& operator =(FrameRecorder&& other) noexcept = delete;
+
+    static bool supports_format(VkFormat format);
+
+    bool wants_frame() const { return m_recording_video || m_screenshot_requested; }
+    // The next frame is also saved as a screenshot.
+    void request_screenshot() { m_screenshot_requested = true; }
+
+    // Records the copy of a presented image into a free slot and returns the
+    // command buffer to submit after the frame's, or VK_NULL_HANDLE when
+    // the frame is dropped.
+    VkCommandBuffer record(VkImage image, VkFormat format, VkExtent2D extent);
+    // The point of the submission that contains the last recorded copy.
+    void submitted(SyncPoint point);
+    // Hands the copies that have completed to the encoder. Never blocks.
+    void collect();
+
+    void report(std::ostream& stream) const;
+
+private:
+    enum class SlotState {
+        Free,
+        Recorded,
+        Submitted,
+        Encoding,
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        const uint8_t* mapped = nullptr;
+        VkDeviceSize capacity = 0;
+        VkCommandBuffer commands = VK_NULL_HANDLE;
+        SlotState state = SlotState::Free;
+        SyncPoint point;
+        VkExtent2D extent = {0, 0};
+        bool bgra = false;
+        bool video = false;
+        bool screenshot = false;
+        // Times the frame is written, more than once after dropped frames.
+        uint32_t repeat = 1;
+        uint64_t frame = 0;
+    };
+
+    void resize_slot(Slot& slot, VkDeviceSize size);
+    void release_slot(Slot& slot);
+    void queue_for_encoding(std::size_t index);
+    void encoder_main();
+    void encode(const Slot& slot);
+    void write_video_frame(const Slot& slot);
+    void write_screenshot(const Slot& slot);
+
+    VkDevice m_device;
+    VkCommandPool m_command_pool;
+    QueueSync& m_sync;
+    AllocateFunction m_allocate;
+    ReleaseFunction m_release;
+    const VkAllocationCallbacks* m_host_allocator;
+
+    std::array<Slot, RING_SIZE> m_slots;
+    // Submitted slots, oldest first. Render thread only.
+    std::vector<std::size_t> m_in_flight;
+    std::size_t m_next_slot = 0;
+    std::size_t m_last_recorded = RING_SIZE;
+    bool m_recording_video;
+    bool m_screenshot_requested = false;
+    uint32_t m_pending_repeats = 0;
+    uint64_t m_frame = 0;
+    uint64_t m_dropped = 0;
+
+    // Encoder thread only, apart from opening the video.
+    std::string m_video_file;
+    uint32_t m_frame_rate;
+    std::ofstream m_video;
+    std::vector<uint8_t> m_planes;
+
+    // Guards the slot states, the queue and what the report reads.
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::vector<std::size_t> m_encode_queue;
+    bool m_stopping = false;
+    VkExtent2D m_video_extent = {0, 0};
+    uint64_t m_video_frames = 0;
+    uint64_t m_screenshots = 0;
+    double m_encode_ms = 0.0;
+    bool m_write_failed = false;
+    std::thread m_encoder;
+};
+
+#endif
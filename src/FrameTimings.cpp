@@ -0,0 +1,38 @@
+#include "FrameTimings.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+double FrameTimings::percentile(double p) const {
+    if(m_samples.empty()) {
+        return 0.0;
+    }
+    std::vector<double> sorted(m_samples);
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+    rank = std::clamp<std::size_t>(rank, 1, sorted.size());
+    std::nth_element(sorted.begin(), sorted.begin() + (rank - 1), sorted.end());
+    return sorted[rank - 1];
+}
+ 
+double FrameTimings::mean() const {
+    if(m_samples.empty()) {
+        return 0.0;
+    }
+    return std::accumulate(m_samples.begin(), m_samples.end(), 0.0) / m_samples.size();
+}
+ 
+double FrameTimings::min() const {
+    return m_samples.empty() ? 0.0 : *std::min_element(m_samples.begin(), m_samples.end());
+}
+ 
+double FrameTimings::max() const {
+    return m_samples.empty() ? 0.0 : *std::max_element(m_samples.begin(), m_samples.end());
+}
+ 
+void FrameTimings::report(std::ostream& stream, const char* label) const {
+    stream << label << ": frames=" << count() << " mean=" << mean() << "ms min=" << min() << "ms p50="
+        << percentile(50.0) << "ms p95=" << percentile(95.0) << "ms p99=" << percentile(99.0) << "ms max="
+        << max() << "ms\n";
+}
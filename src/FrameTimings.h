@@ -0,0 +1,35 @@
+#ifndef FRAME_TIMINGS_H_
+#define FRAME_TIMINGS_H_
+
+#include <ostream>
+#include <vector>
+
+// Collects per-frame durations in milliseconds and summarizes them with
+// nearest-rank percentiles.
+class FrameTimings {
+public:
+    FrameTimings() = default;
+    ~FrameTimings() = default;
+
+    FrameTimings(const FrameTimings& other) = default;
+    FrameTimings(FrameTimings&& other) noexcept = default;
+    FrameTimings& operator =(const FrameTimings& other) = default;
+    FrameTimings& operator =(FrameTimings&& other) noexcept = default;
+
+    void reserve(std::size_t frames) { m_samples.reserve(frames); }
+    void add(double milliseconds) { m_samples.push_back(milliseconds); }
+    void clear() { m_samples.clear(); }
+
+    std::size_t count() const { return m_samples.size(); }
+    double percentile(double p) const;
+    double mean() const;
+    double min() const;
+    double max() const;
+
+    void report(std::ostream& stream, const char* label) const;
+
+private:
+    std::vector<double> m_samples;
+};
+
+#endif
@@ -0,0 +1,489 @@
+#include "HeightPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include "Heightmap.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEIGHT_PYRAMID_SSE 1
+#endif
+
+
+static constexpr float INFINITE_T = std::numeric_limits<float>::infinity();
+// How far, in cells, a hit may lie on the wrong side of the diagonal that
+// splits its cell and still count, so rays through the diagonal do not slip
+// between the two triangles.
+static constexpr float DIAGONAL_TOLERANCE = 1e-5f;
+static constexpr std::size_t PACKET_SIZE = 4;
+
+
+// A ray in grid space: x and y in samples from the first one, z unchanged.
+// Node boundaries are whole numbers there, and the ray crosses each at the
+// t plane_t gives, however the node was reached.
+struct HeightPyramid::GridRay {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec2 inverse;
+    int32_t step[2];
+    float t_min;
+    float t_max;
+
+    float plane_t(int axis, uint32_t plane) const {
+        return (static_cast<float>(plane) - origin[axis]) * inverse[axis];
+    }
+};
+
+
+static std::vector<float> decode_heights(const Heightmap& heightmap) {
+    std::vector<float> heights(std::size_t{heightmap.width()} * heightmap.height());
+    for(uint32_t y = 0; y < heightmap.height(); ++y) {
+        for(uint32_t x = 0; x < heightmap.width(); ++x) {
+            heights[std::size_t{y} * heightmap.width() + x] = heightmap.height_at(static_cast<int32_t>(x),
+                static_cast<int32_t>(y));
+        }
+    }
+    return heights;
+}
+
+
+HeightPyramid::HeightPyramid(const std::vector<float>& heights, glm::vec2 origin, float spacing, uint32_t width,
+        uint32_t height):
+    m_width(width),
+    m_height(height),
+    m_origin(origin),
+    m_spacing(spacing),
+    m_heights(heights)
+{
+    if(width < 2 || height < 2) {
+        throw std::runtime_error("Height pyramid needs at least 2 by 2 samples!");
+    }
+    if(heights.size() != std::size_t{width} * height) {
+        throw std::runtime_error("Height pyramid sample count does not match its size!");
+    }
+
+    m_levels.emplace_back();
+    while(level_width(level_count() - 1) > 1 || level_height(level_count() - 1) > 1) {
+        uint32_t level = level_count();
+        std::vector<glm::vec2> ranges(std::size_t{level_width(level)} * level_height(level));
+        m_levels.push_back(std::move(ranges));
+        for(uint32_t y = 0; y < level_height(level); ++y) {
+            for(uint32_t x = 0; x < level_width(level); ++x) {
+                m_levels[level][std::size_t{y} * level_width(level) + x] = compute_range(level, x, y);
+            }
+        }
+    }
+}
+ 
+HeightPyramid::HeightPyramid(const Heightmap& heightmap):
+    HeightPyramid(decode_heights(heightmap), heightmap.origin(), heightmap.spacing(), heightmap.width(),
+        heightmap.height())
+{ }
+ 
+TerrainHit HeightPyramid::raycast(const TerrainRay& ray) const {
+    return trace(ray, true);
+}
+ 
+void HeightPyramid::raycast(const TerrainRay* rays, std::size_t count, TerrainHit* hits) const {
+    std::size_t i = 0;
+#ifdef HEIGHT_PYRAMID_SSE
+    for(; i + PACKET_SIZE <= count; i += PACKET_SIZE) {
+        if(!raycast_packet(rays + i, hits + i)) {
+            for(std::size_t lane = 0; lane < PACKET_SIZE; ++lane) {
+                hits[i + lane] = trace(rays[i + lane], true);
+            }
+        }
+    }
+#endif
+    for(; i < count; ++i) {
+        hits[i] = trace(rays[i], true);
+    }
+}
+ 
+TerrainHit HeightPyramid::raycast_cells(const TerrainRay& ray) const {
+    return trace(ray, false);
+}
+ 
+void HeightPyramid::update(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* heights) {
+    if(width == 0 || height == 0) {
+        return;
+    }
+    if(x + width > m_width || y + height > m_height) {
+        throw std::out_of_range("Height pyramid update outside the heightfield!");
+    }
+    for(uint32_t row = 0; row < height; ++row) {
+        std::copy(heights + std::size_t{row} * width, heights + std::size_t{row + 1} * width,
+            m_heights.begin() + std::size_t{y + row} * m_width + x);
+    }
+
+    // Every cell a changed sample is a corner of, then their ancestors.
+    uint32_t first_x = std::max(x, 1u) - 1;
+    uint32_t first_y = std::max(y, 1u) - 1;
+    uint32_t last_x = std::min(x + width - 1, m_width - 2);
+    uint32_t last_y = std::min(y + height - 1, m_height - 2);
+    for(uint32_t level = 1; level < level_count(); ++level) {
+        first_x >>= 1;
+        first_y >>= 1;
+        last_x >>= 1;
+        last_y >>= 1;
+        for(uint32_t node_y = first_y; node_y <= last_y; ++node_y) {
+            for(uint32_t node_x = first_x; node_x <= last_x; ++node_x) {
+                m_levels[level][std::size_t{node_y} * level_width(level) + node_x] = compute_range(level, node_x, 
+                    node_y);
+            }
+        }
+    }
+}
+ 
+glm::vec2 HeightPyramid::range(uint32_t level, uint32_t x, uint32_t y) const {
+    if(level == 0) {
+        float h00 = height_at(x, y), h10 = height_at(x + 1, y);
+        float h01 = height_at(x, y + 1), h11 = height_at(x + 1, y + 1);
+        return glm::vec2(std::min({h00, h10, h01, h11}), std::max({h00, h10, h01, h11}));
+    }
+    return m_levels[level][std::size_t{y} * level_width(level) + x];
+}
+ 
+bool HeightPyramid::to_grid(const TerrainRay& ray, GridRay& grid) const {
+    grid.origin = glm::vec3((ray.origin.x - m_origin.x) / m_spacing, (ray.origin.y - m_origin.y) / m_spacing,
+        ray.origin.z);
+    grid.direction = glm::vec3(ray.direction.x / m_spacing, ray.direction.y / m_spacing, ray.direction.z);
+    grid.t_min = 0.0f;
+    grid.t_max = ray.max_t;
+
+    uint32_t cells[2] = {m_width - 1, m_height - 1};
+    for(int axis = 0; axis < 2; ++axis) {
+        float direction = grid.direction[axis];
+        grid.step[axis] = direction > 0.0f ? 1 : (direction < 0.0f ? -1 : 0);
+        if(grid.step[axis] == 0) {
+            grid.inverse[axis] = 0.0f;
+            if(grid.origin[axis] < 0.0f || grid.origin[axis] > static_cast<float>(cells[axis])) {
+                return false;
+            }
+            continue;
+        }
+        grid.inverse[axis] = 1.0f / direction;
+        float low = grid.plane_t(axis, 0);
+        float high = grid.plane_t(axis, cells[axis]);
+        grid.t_min = std::max(grid.t_min, std::min(low, high));
+        grid.t_max = std::min(grid.t_max, std::max(low, high));
+    }
+
+    // Nothing is hit above the highest or below the lowest sample.
+    glm::vec2 heights = range(level_count() - 1, 0, 0);
+    if(grid.direction.z == 0.0f) {
+        if(grid.origin.z < heights.x || grid.origin.z > heights.y) {
+            return false;
+        }
+    } else {
+        float low = (heights.x - grid.origin.z) / grid.direction.z;
+        float high = (heights.y - grid.origin.z) / grid.direction.z;
+        grid.t_min = std::max(grid.t_min, std::min(low, high));
+        grid.t_max = std::min(grid.t_max, std::max(low, high));
+    }
+    return grid.t_min <= grid.t_max;
+}
+ 
+TerrainHit HeightPyramid::trace(const TerrainRay& ray, bool hierarchical) const {
+    TerrainHit hit;
+    GridRay grid;
+    if(!to_grid(ray, grid)) {
+        return hit;
+    }
+
+    uint32_t cells[2] = {m_width - 1, m_height - 1};
+    uint32_t top = level_count() - 1;
+    uint32_t level = top;
+    uint32_t node[2] = {0, 0};
+    while(true) {
+        float enter[2] = {-INFINITE_T, -INFINITE_T};
+        float exit[2] = {INFINITE_T, INFINITE_T};
+        for(int axis = 0; axis < 2; ++axis) {
+            if(grid.step[axis] == 0) {
+                continue;
+            }
+            uint32_t low = node[axis] << level;
+            uint32_t high = std::min(low + (1u << level), cells[axis]);
+            float t_low = grid.plane_t(axis, low);
+            float t_high = grid.plane_t(axis, high);
+            enter[axis] = grid.step[axis] > 0 ? t_low : t_high;
+            exit[axis] = grid.step[axis] > 0 ? t_high : t_low;
+        }
+        float t_in = std::max({grid.t_min, enter[0], enter[1]});
+        float t_out = std::min({grid.t_max, exit[0], exit[1]});
+        if(t_in > grid.t_max) {
+            // Every node further along starts later still.
+            break;
+        }
+
+        if(t_in <= t_out) {
+            if(level == 0) {
+                float t;
+                if(intersect_cell(grid, node[0], node[1], t_in, t_out, t)) {
+                    hit.hit = true;
+                    hit.t = t;
+                    hit.position = ray.origin + ray.direction * t;
+                    return hit;
+                }
+            } else {
+                glm::vec2 heights = range(level, node[0], node[1]);
+                float z_in = grid.origin.z + grid.direction.z * t_in;
+                float z_out = grid.origin.z + grid.direction.z * t_out;
+                if(!hierarchical || (std::max(z_in, z_out) >= heights.x && std::min(z_in, z_out) <= heights.y)) {
+                    // Into the child the ray is in at t_in, decided by when it
+                    // crosses the middle so that the choice agrees with the
+                    // steps that led here.
+                    level -= 1;
+                    for(int axis = 0; axis < 2; ++axis) {
+                        uint32_t child = node[axis] * 2;
+                        uint32_t middle = (child + 1) << level;
+                        if(middle >= cells[axis]) {
+                            node[axis] = child;
+                        } else if(grid.step[axis] == 0) {
+                            node[axis] = child + (grid.origin[axis] >= static_cast<float>(middle) ? 1 : 0);
+                        } else {
+                            bool crossed = t_in >= grid.plane_t(axis, middle);
+                            node[axis] = child + ((crossed == (grid.step[axis] > 0)) ? 1 : 0);
+                        }
+                    }
+                    continue;
+                }
+            }
+        }
+
+        // On to the neighbour the ray leaves for, and up to its parent as
+        // long as the ray enters that through the same side.
+        int axis = exit[0] <= exit[1] ? 0 : 1;
+        if(grid.step[axis] == 0) {
+            break;
+        }
+        int64_t next = static_cast<int64_t>(node[axis]) + grid.step[axis];
+        uint32_t size = axis == 0 ? level_width(level) : level_height(level);
+        if(next < 0 || next >= static_cast<int64_t>(size)) {
+            break;
+        }
+        node[axis] = static_cast<uint32_t>(next);
+        uint32_t first_child = grid.step[axis] > 0 ? 0 : 1;
+        while(hierarchical && level < top && (node[axis] & 1) == first_child) {
+            level += 1;
+            node[0] >>= 1;
+            node[1] >>= 1;
+        }
+    }
+    return hit;
+}
+ 
+bool HeightPyramid::intersect_cell(const GridRay& ray, uint32_t x, uint32_t y, float t_in, float t_out,
+        float& t) const {
+    float h00 = height_at(x, y), h10 = height_at(x + 1, y);
+    float h01 = height_at(x, y + 1), h11 = height_at(x + 1, y + 1);
+    float fx = ray.origin.x - static_cast<float>(x);
+    float fy = ray.origin.y - static_cast<float>(y);
+
+    // The cell is split along its diagonal from (x, y) to (x + 1, y + 1):
+    // each triangle is a plane h00 + slope_x * fx + slope_y * fy over its
+    // side of the diagonal, which the ray meets where a + b * t = 0.
+    bool found = false;
+    t = t_out;
+    auto test = [&](float slope_x, float slope_y, float side) {
+        float a = ray.origin.z - h00 - slope_x * fx - slope_y * fy;
+        float b = ray.direction.z - slope_x * ray.direction.x - slope_y * ray.direction.y;
+        if(b == 0.0f) {
+            return;
+        }
+        float t_plane = -a / b;
+        if(t_plane < t_in || t_plane > t) {
+            return;
+        }
+        float along_x = fx + ray.direction.x * t_plane;
+        float along_y = fy + ray.direction.y * t_plane;
+        if((along_x - along_y) * side >= -DIAGONAL_TOLERANCE) {
+            t = t_plane;
+            found = true;
+        }
+    };
+    test(h10 - h00, h11 - h10, 1.0f);
+    test(h11 - h01, h01 - h00, -1.0f);
+    return found;
+}
+ 
+#ifdef HEIGHT_PYRAMID_SSE
+ 
+bool HeightPyramid::raycast_packet(const TerrainRay* rays, TerrainHit* hits) const {
+    std::array<GridRay, PACKET_SIZE> grids;
+    int live_lanes = 0;
+    std::size_t lead_lane = 0;
+    for(std::size_t lane = 0; lane < PACKET_SIZE; ++lane) {
+        hits[lane] = TerrainHit();
+        if(!to_grid(rays[lane], grids[lane])) {
+            continue;
+        }
+        if(grids[lane].step[0] == 0 || grids[lane].step[1] == 0) {
+            return false;
+        }
+        // Rays heading into different quadrants share little beyond the top
+        // levels and are traced faster one by one.
+        if(live_lanes == 0) {
+            lead_lane = lane;
+        } else if(grids[lead_lane].step[0] != grids[lane].step[0]
+                || grids[lead_lane].step[1] != grids[lane].step[1]) {
+            return false;
+        }
+        live_lanes |= 1 << lane;
+    }
+    if(live_lanes == 0) {
+        return true;
+    }
+
+    // Lanes that missed the grid get an empty interval, so no node is live
+    // for them.
+    alignas(16) float lane_values[10][PACKET_SIZE] = {};
+    for(std::size_t lane = 0; lane < PACKET_SIZE; ++lane) {
+        const GridRay& grid = grids[lane];
+        if(((live_lanes >> lane) & 1) == 0) {
+            lane_values[8][lane] = 1.0f;
+            continue;
+        }
+        const float values[10] = {grid.origin.x, grid.origin.y, grid.origin.z, grid.direction.x, grid.direction.y,
+            grid.direction.z, grid.inverse.x, grid.inverse.y, grid.t_min, grid.t_max};
+        for(std::size_t i = 0; i < 10; ++i) {
+            lane_values[i][lane] = values[i];
+        }
+    }
+    __m128 origin_x = _mm_load_ps(lane_values[0]), origin_y = _mm_load_ps(lane_values[1]);
+    __m128 origin_z = _mm_load_ps(lane_values[2]);
+    __m128 direction_x = _mm_load_ps(lane_values[3]), direction_y = _mm_load_ps(lane_values[4]);
+    __m128 direction_z = _mm_load_ps(lane_values[5]);
+    __m128 inverse_x = _mm_load_ps(lane_values[6]), inverse_y = _mm_load_ps(lane_values[7]);
+    __m128 t_min = _mm_load_ps(lane_values[8]);
+    // Shrinks to each lane's nearest hit so far, which culls everything behind it.
+    __m128 t_best = _mm_load_ps(lane_values[9]);
+    __m128 found = _mm_setzero_ps();
+
+    // All live lanes step the same way, so children are visited nearest first
+    // for every one of them.
+    const GridRay& lead = grids[lead_lane];
+    uint32_t near_x = lead.step[0] > 0 ? 0 : 1;
+    uint32_t near_y = lead.step[1] > 0 ? 0 : 1;
+
+    struct Node {
+        uint32_t level;
+        uint32_t x;
+        uint32_t y;
+    };
+    // Every level pushes at most three nodes more than it pops.
+    std::array<Node, 3 * 32 + 1> stack;
+    std::size_t stack_size = 0;
+    stack[stack_size++] = {level_count() - 1, 0, 0};
+    uint32_t cells[2] = {m_width - 1, m_height - 1};
+
+    while(stack_size > 0) {
+        Node node = stack[--stack_size];
+        uint32_t low_x = node.x << node.level;
+        uint32_t low_y = node.y << node.level;
+        uint32_t high_x = std::min(low_x + (1u << node.level), cells[0]);
+        uint32_t high_y = std::min(low_y + (1u << node.level), cells[1]);
+
+        // The slab formula of GridRay::plane_t, four lanes at a time.
+        __m128 t_low_x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(static_cast<float>(low_x)), origin_x), inverse_x);
+        __m128 t_high_x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(static_cast<float>(high_x)), origin_x), inverse_x);
+        __m128 t_low_y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(static_cast<float>(low_y)), origin_y), inverse_y);
+        __m128 t_high_y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(static_cast<float>(high_y)), origin_y), inverse_y);
+        __m128 t_in = _mm_max_ps(t_min, _mm_max_ps(_mm_min_ps(t_low_x, t_high_x), _mm_min_ps(t_low_y, t_high_y)));
+        __m128 t_out = _mm_min_ps(t_best, _mm_min_ps(_mm_max_ps(t_low_x, t_high_x), _mm_max_ps(t_low_y, t_high_y)));
+        __m128 live = _mm_cmple_ps(t_in, t_out);
+
+        if(node.level == 0) {
+            if(_mm_movemask_ps(live) == 0) {
+                continue;
+            }
+            float h00 = height_at(node.x, node.y), h10 = height_at(node.x + 1, node.y);
+            float h01 = height_at(node.x, node.y + 1), h11 = height_at(node.x + 1, node.y + 1);
+            __m128 fx = _mm_sub_ps(origin_x, _mm_set1_ps(static_cast<float>(node.x)));
+            __m128 fy = _mm_sub_ps(origin_y, _mm_set1_ps(static_cast<float>(node.y)));
+            // As intersect_cell.
+            auto test = [&](float slope_x, float slope_y, float side) {
+                __m128 sx = _mm_set1_ps(slope_x);
+                __m128 sy = _mm_set1_ps(slope_y);
+                __m128 a = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(origin_z, _mm_set1_ps(h00)), _mm_mul_ps(sx, fx)),
+                    _mm_mul_ps(sy, fy));
+                __m128 b = _mm_sub_ps(_mm_sub_ps(direction_z, _mm_mul_ps(sx, direction_x)), 
+                    _mm_mul_ps(sy, direction_y));
+                __m128 t_plane = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), a), b);
+                __m128 along_x = _mm_add_ps(fx, _mm_mul_ps(direction_x, t_plane));
+                __m128 along_y = _mm_add_ps(fy, _mm_mul_ps(direction_y, t_plane));
+                __m128 side_distance = _mm_mul_ps(_mm_sub_ps(along_x, along_y), _mm_set1_ps(side));
+                __m128 valid = _mm_and_ps(live, _mm_cmpneq_ps(b, _mm_setzero_ps()));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(t_plane, t_in));
+                valid = _mm_and_ps(valid, _mm_cmple_ps(t_plane, _mm_min_ps(t_out, t_best)));
+                valid = _mm_and_ps(valid, _mm_cmpge_ps(side_distance, _mm_set1_ps(-DIAGONAL_TOLERANCE)));
+                t_best = _mm_or_ps(_mm_and_ps(valid, t_plane), _mm_andnot_ps(valid, t_best));
+                found = _mm_or_ps(found, valid);
+            };
+            test(h10 - h00, h11 - h10, 1.0f);
+            test(h11 - h01, h01 - h00, -1.0f);
+            continue;
+        }
+
+        glm::vec2 heights = range(node.level, node.x, node.y);
+        __m128 z_in = _mm_add_ps(origin_z, _mm_mul_ps(direction_z, t_in));
+        __m128 z_out = _mm_add_ps(origin_z, _mm_mul_ps(direction_z, t_out));
+        live = _mm_and_ps(live, _mm_cmpge_ps(_mm_max_ps(z_in, z_out), _mm_set1_ps(heights.x)));
+        live = _mm_and_ps(live, _mm_cmple_ps(_mm_min_ps(z_in, z_out), _mm_set1_ps(heights.y)));
+        if(_mm_movemask_ps(live) == 0) {
+            continue;
+        }
+
+        // Pushed farthest first, so the nearest is popped next.
+        uint32_t child_level = node.level - 1;
+        uint32_t child_width = level_width(child_level);
+        uint32_t child_height = level_height(child_level);
+        for(uint32_t order = 4; order-- > 0;) {
+            uint32_t x = node.x * 2 + ((order & 1) ? 1 - near_x : near_x);
+            uint32_t y = node.y * 2 + ((order & 2) ? 1 - near_y : near_y);
+            if(x < child_width && y < child_height) {
+                stack[stack_size++] = {child_level, x, y};
+            }
+        }
+    }
+
+    alignas(16) float t_values[PACKET_SIZE];
+    _mm_store_ps(t_values, t_best);
+    int found_lanes = _mm_movemask_ps(found);
+    for(std::size_t lane = 0; lane < PACKET_SIZE; ++lane) {
+        if((found_lanes >> lane) & 1) {
+            hits[lane].hit = true;
+            hits[lane].t = t_values[lane];
+            hits[lane].position = rays[lane].origin + rays[lane].direction * t_values[lane];
+        }
+    }
+    return true;
+}
+ 
+#else
+ 
+bool HeightPyramid::raycast_packet(const TerrainRay*, TerrainHit*) const {
+    return false;
+}
+ 
+#endif
+ 
+glm::vec2 HeightPyramid::compute_range(uint32_t level, uint32_t x, uint32_t y) const {
+    // Level 1 from the samples, which level 0 stands for, the others from
+    // their up to four children.
+    uint32_t child_level = level - 1;
+    uint32_t first_x = x * 2, first_y = y * 2;
+    uint32_t last_x = std::min(first_x + 1, level_width(child_level) - 1);
+    uint32_t last_y = std::min(first_y + 1, level_height(child_level) - 1);
+    glm::vec2 heights = range(child_level, first_x, first_y);
+    for(uint32_t child_y = first_y; child_y <= last_y; ++child_y) {
+        for(uint32_t child_x = first_x; child_x <= last_x; ++child_x) {
+            glm::vec2 child = range(child_level, child_x, child_y);
+            heights.x = std::min(heights.x, child.x);
+            heights.y = std::max(heights.y, child.y);
+        }
+    }
+    return heights;
+}
@@ -0,0 +1,99 @@
+#ifndef HEIGHT_PYRAMID_H_
+#define HEIGHT_PYRAMID_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Heightmap;
+
+struct TerrainRay {
+    glm::vec3 origin = glm::vec3(0.0f);
+    // Need not be normalized; hits are measured in multiples of it.
+    glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+    // Hits beyond origin + max_t * direction are ignored.
+    float max_t = std::numeric_limits<float>::max();
+};
+
+struct TerrainHit {
+    bool hit = false;
+    // The first point of the surface along the ray, origin + t * direction.
+    float t = 0.0f;
+    glm::vec3 position = glm::vec3(0.0f);
+};
+
+// Min-max mip pyramid over a heightfield, for casting rays against the
+// terrain surface as the renderer triangulates it (see
+// TerrainGenerator::build_grid_indices). Cell (x, y) is the quad between
+// samples (x, y) and (x + 1, y + 1); node (x, y) of level L bounds the
+// heights of the 2^L by 2^L cells from (x << L, y << L), and one node of the
+// top level covers them all. Rays descend into the nodes whose height range
+// they pass through and step past the others at the coarsest level they can,
+// so open ground is crossed in a few steps whatever the resolution.
+//
+// Level 0 is not stored: a cell's range is that of its four samples. Queries
+// are const and may run on several threads; update is not thread safe.
+class HeightPyramid {
+public:
+    // Row by row, width * height of them, at least 2 by 2.
+    HeightPyramid(const std::vector<float>& heights, glm::vec2 origin, float spacing, uint32_t width,
+        uint32_t height);
+    explicit HeightPyramid(const Heightmap& heightmap);
+    ~HeightPyramid() = default;
+
+    HeightPyramid(const HeightPyramid& other) = default;
+    HeightPyramid(HeightPyramid&& other) noexcept = default;
+    HeightPyramid& operator =(const HeightPyramid& other) = default;
+    HeightPyramid& operator =(HeightPyramid&& other) noexcept = default;
+
+    TerrainHit raycast(const TerrainRay& ray) const;
+    // Same hits as raycast on each ray. With SSE2, rays are traced four at a
+    // time through the same nodes, which pays off for rays that start close
+    // together and point the same way, like the pixels of a picking region;
+    // groups of four heading different ways are traced one by one.
+    void raycast(const TerrainRay* rays, std::size_t count, TerrainHit* hits) const;
+    // Walks every cell along the ray, without the coarser levels; what the
+    // hierarchy is measured against.
+    TerrainHit raycast_cells(const TerrainRay& ray) const;
+
+    // Replaces a width by height block of samples from (x, y), given row by
+    // row, and refreshes only the nodes above it, e.g. when a tile changes.
+    void update(uint32_t x, uint32_t y, uint32_t width, uint32_t height, const float* heights);
+
+    float height_at(uint32_t x, uint32_t y) const { return m_heights[std::size_t{y} * m_width + x]; }
+    // Lowest and highest height under node (x, y) of a level.
+    glm::vec2 range(uint32_t level, uint32_t x, uint32_t y) const;
+
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    uint32_t level_count() const { return static_cast<uint32_t>(m_levels.size()); }
+    uint32_t level_width(uint32_t level) const { return (m_width - 2 + (1u << level)) >> level; }
+    uint32_t level_height(uint32_t level) const { return (m_height - 2 + (1u << level)) >> level; }
+    glm::vec2 origin() const { return m_origin; }
+    float spacing() const { return m_spacing; }
+
+private:
+    struct GridRay;
+
+    bool to_grid(const TerrainRay& ray, GridRay& grid) const;
+    TerrainHit trace(const TerrainRay& ray, bool hierarchical) const;
+    bool intersect_cell(const GridRay& ray, uint32_t x, uint32_t y, float t_in, float t_out, float& t) const;
+    // Traces rays[0..3] together; false if they cannot be, when a direction
+    // has no horizontal component along one of the axes or the directions
+    // point into different quadrants.
+    bool raycast_packet(const TerrainRay* rays, TerrainHit* hits) const;
+    glm::vec2 compute_range(uint32_t level, uint32_t x, uint32_t y) const;
+
+    uint32_t m_width;
+    uint32_t m_height;
+    glm::vec2 m_origin;
+    float m_spacing;
+    std::vector<float> m_heights;
+    // Node ranges of each level row by row; m_levels[0] stays empty.
+    std::vector<std::vector<glm::vec2>> m_levels;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "Heightmap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "JobSystem.h"
+
+static std::vector<float> generate_heights(const TerrainGenerator& generator, glm::vec2 origin, float spacing,
+        uint32_t width, uint32_t height, JobSystem* jobs) {
+    std::vector<float> heights(std::size_t{width} * height);
+    auto generate_rows = [&](std::size_t first, std::size_t last) {
+        for(std::size_t y = first; y < last; ++y) {
+            for(uint32_t x = 0; x < width; ++x) {
+                heights[y * width + x] = generator.height(origin.x + spacing * x, origin.y + spacing * y);
+            }
+        }
+    };
+    if(jobs) {
+        jobs->parallel_for(0, height, 16, generate_rows);
+    } else {
+        generate_rows(0, height);
+    }
+    return heights;
+}
+
+
+Heightmap::Heightmap(const TerrainGenerator& generator, glm::vec2 origin, float spacing, uint32_t width,
+        uint32_t height, VkFormat format, JobSystem* jobs):
+    Heightmap(generate_heights(generator, origin, spacing, width, height, jobs), origin, spacing, width, height, 
+        format)
+{ }
+ 
+Heightmap::Heightmap(const std::vector<float>& heights, glm::vec2 origin, float spacing, uint32_t width,
+        uint32_t height, VkFormat format):
+    m_width(width),
+    m_height(height),
+    m_format(format),
+    m_origin(origin),
+    m_spacing(spacing)
+{
+    if(heights.size() != std::size_t{width} * height) {
+        throw std::runtime_error("Heightmap sample count does not match its size!");
+    }
+    std::size_t sample_size = bytes_per_sample(format);
+    m_data.resize(heights.size() * sample_size);
+    if(format == VK_FORMAT_R32_SFLOAT) {
+        std::memcpy(m_data.data(), heights.data(), m_data.size());
+        return;
+    }
+
+    auto [low, high] = std::minmax_element(heights.begin(), heights.end());
+    m_height_bias = *low;
+    m_height_scale = std::max(*high - *low, 1e-6f);
+    auto* samples = reinterpret_cast<uint16_t*>(m_data.data());
+    for(std::size_t i = 0; i < heights.size(); ++i) {
+        float normalized = (heights[i] - m_height_bias) / m_height_scale;
+        samples[i] = static_cast<uint16_t>(std::lround(std::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+    }
+}
+ 
+std::size_t Heightmap::bytes_per_sample(VkFormat format) {
+    switch(format) {
+        case VK_FORMAT_R16_UNORM: return sizeof(uint16_t);
+        case VK_FORMAT_R32_SFLOAT: return sizeof(float);
+        default: throw std::runtime_error("Unsupported heightmap format!");
+    }
+}
+ 
+float Heightmap::decode(const std::byte* data, std::size_t index, VkFormat format, float height_scale, 
+        float height_bias) {
+    if(format == VK_FORMAT_R32_SFLOAT) {
+        float value;
+        std::memcpy(&value, data + index * sizeof(float), sizeof(float));
+        return value;
+    }
+    uint16_t value;
+    std::memcpy(&value, data + index * sizeof(uint16_t), sizeof(uint16_t));
+    return value / 65535.0f * height_scale + height_bias;
+}
+ 
+float Heightmap::height_at(int32_t x, int32_t y) const {
+    x = std::clamp<int32_t>(x, 0, m_width - 1);
+    y = std::clamp<int32_t>(y, 0, m_height - 1);
+    std::size_t index = static_cast<std::size_t>(y) * m_width + x;
+    return decode(m_data.data(), index, m_format, m_height_scale, m_height_bias);
+}
+ 
+std::vector<glm::vec2> Heightmap::chunk_heights(uint32_t chunk_resolution) const {
+    uint32_t chunks_x = (m_width - 1) / (chunk_resolution - 1);
+    uint32_t chunks_y = (m_height - 1) / (chunk_resolution - 1);
+    std::vector<glm::vec2> heights(std::size_t{chunks_x} * chunks_y);
+    for(uint32_t chunk = 0; chunk < heights.size(); ++chunk) {
+        int32_t first_x = static_cast<int32_t>((chunk % chunks_x) * (chunk_resolution - 1));
+        int32_t first_y = static_cast<int32_t>((chunk / chunks_x) * (chunk_resolution - 1));
+        float low = height_at(first_x, first_y);
+        float high = low;
+        for(int32_t y = first_y; y < first_y + static_cast<int32_t>(chunk_resolution); ++y) {
+            for(int32_t x = first_x; x < first_x + static_cast<int32_t>(chunk_resolution); ++x) {
+                float height = height_at(x, y);
+                low = std::min(low, height);
+                high = std::max(high, height);
+            }
+        }
+        heights[chunk] = glm::vec2(low, high);
+    }
+    return heights;
+}
@@ -0,0 +1,68 @@
+#ifndef HEIGHTMAP_H_
+#define HEIGHTMAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include "TerrainGenerator.h"
+
+class JobSystem;
+
+// Terrain heights on a regular grid, encoded for upload to a single channel
+// image. Only the height is stored per sample; the X/Y position follows from
+// the sample's grid coordinate and colour and normal are derived in
+// glsl/terrain.vert. With VK_FORMAT_R16_UNORM heights are quantized to the
+// range [height_bias(), height_bias() + height_scale()], with
+// VK_FORMAT_R32_SFLOAT they are stored as is (scale 1, bias 0).
+class Heightmap {
+public:
+    // Rows are generated in parallel when given a job system.
+    Heightmap(const TerrainGenerator& generator, glm::vec2 origin, float spacing, uint32_t width, uint32_t height,
+        VkFormat format, JobSystem* jobs = nullptr);
+    // Row by row, width * height of them.
+    Heightmap(const std::vector<float>& heights, glm::vec2 origin, float spacing, uint32_t width, uint32_t height,
+        VkFormat format);
+    ~Heightmap() = default;
+
+    Heightmap(const Heightmap& other) = delete;
+    Heightmap(Heightmap&& other) noexcept = default;
+    Heightmap& operator =(const Heightmap& other) = delete;
+    Heightmap& operator =(Heightmap&& other) noexcept = default;
+
+    static std::size_t bytes_per_sample(VkFormat format);
+    // Height of sample index of encoded data, e.g. a baked heightmap's.
+    static float decode(const std::byte* data, std::size_t index, VkFormat format, float height_scale, 
+        float height_bias);
+
+    // Decoded height of sample (x, y), clamped to the edge like the shader.
+    float height_at(int32_t x, int32_t y) const;
+    // Lowest and highest decoded height of every chunk of chunk_resolution
+    // samples per side, row by row; neighbouring chunks share their edges.
+    std::vector<glm::vec2> chunk_heights(uint32_t chunk_resolution) const;
+
+    uint32_t width() const { return m_width; }
+    uint32_t height() const { return m_height; }
+    VkFormat format() const { return m_format; }
+    glm::vec2 origin() const { return m_origin; }
+    float spacing() const { return m_spacing; }
+    float height_scale() const { return m_height_scale; }
+    float height_bias() const { return m_height_bias; }
+    const std::vector<std::byte>& data() const { return m_data; }
+
+private:
+    uint32_t m_width;
+    uint32_t m_height;
+    VkFormat m_format;
+    glm::vec2 m_origin;
+    float m_spacing;
+    float m_height_scale = 1.0f;
+    float m_height_bias = 0.0f;
+    std::vector<std::byte> m_data;
+};
+
+#endif
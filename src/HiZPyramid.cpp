@@ -0,0 +1,342 @@
+#include "HiZPyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+static constexpr VkFormat PYRAMID_FORMAT = VK_FORMAT_R32_SFLOAT;
+static constexpr uint32_t GROUP_SIZE = 8;
+
+
+HiZPyramid::HiZPyramid(VkDevice device, DescriptorLayoutCache& layout_cache, const std::vector<char>& shader_code,
+        AllocateFunction allocate, ReleaseFunction release, float timestamp_period,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_host_allocator(host_allocator),
+    m_allocate(std::move(allocate)),
+    m_release(std::move(release)),
+    m_timestamp_period(timestamp_period)
+{
+    std::array<VkDescriptorSetLayoutBinding, 2> bindings = {};
+    bindings[0].binding = 0;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    bindings[1].binding = 1;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    m_set_layout = layout_cache.get(std::vector<VkDescriptorSetLayoutBinding>(bindings.begin(), bindings.end()));
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &m_set_layout;
+    if(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_host_allocator, &m_pipeline_layout) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline layout!");
+    }
+
+    VkShaderModuleCreateInfo moduleInfo = {};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = shader_code.size();
+    moduleInfo.pCode = reinterpret_cast<const uint32_t*>(shader_code.data());
+    VkShaderModule module;
+    if(vkCreateShaderModule(m_device, &moduleInfo, m_host_allocator, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid shader module!");
+    }
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = module;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_pipeline_layout;
+    VkResult result = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, m_host_allocator, &m_pipeline);
+    vkDestroyShaderModule(m_device, module, m_host_allocator);
+    if(result != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid pipeline!");
+    }
+
+    // Fetched with texelFetch only, so filtering never applies.
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    if(vkCreateSampler(m_device, &samplerInfo, m_host_allocator, &m_sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid sampler!");
+    }
+
+    m_descriptors = std::make_unique<DescriptorAllocator>(m_device, std::vector<DescriptorPoolRatio>{
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0f},
+    }, 16, 0, m_host_allocator);
+}
+ 
+HiZPyramid::~HiZPyramid() {
+    destroy_sized_resources();
+    m_descriptors.reset();
+    vkDestroySampler(m_device, m_sampler, m_host_allocator);
+    vkDestroyPipeline(m_device, m_pipeline, m_host_allocator);
+    vkDestroyPipelineLayout(m_device, m_pipeline_layout, m_host_allocator);
+}
+ 
+void HiZPyramid::destroy_sized_resources() {
+    m_descriptors->reset();
+    m_sets.clear();
+    for(auto view : m_views) {
+        vkDestroyImageView(m_device, view, m_host_allocator);
+    }
+    m_views.clear();
+    m_levels.clear();
+    m_readback_levels.clear();
+    if(m_readback != VK_NULL_HANDLE) {
+        vkUnmapMemory(m_device, m_readback_memory);
+        vkDestroyBuffer(m_device, m_readback, m_host_allocator);
+        m_release(m_readback_memory);
+        m_readback = VK_NULL_HANDLE;
+        m_readback_ptr = nullptr;
+    }
+    if(m_image != VK_NULL_HANDLE) {
+        vkDestroyImage(m_device, m_image, m_host_allocator);
+        m_release(m_memory);
+        m_image = VK_NULL_HANDLE;
+    }
+    if(m_query_pool != VK_NULL_HANDLE) {
+        vkDestroyQueryPool(m_device, m_query_pool, m_host_allocator);
+        m_query_pool = VK_NULL_HANDLE;
+    }
+    m_image_bytes = 0;
+    m_readback_bytes = 0;
+    m_copies = 0;
+}
+ 
+void HiZPyramid::resize(VkExtent2D extent, uint32_t copies) {
+    destroy_sized_resources();
+    m_extent = extent;
+    m_copies = copies;
+
+    VkExtent2D level = {(extent.width + 1) / 2, (extent.height + 1) / 2};
+    while(true) {
+        m_levels.push_back(level);
+        if(level.width == 1 && level.height == 1) {
+            break;
+        }
+        level = {(level.width + 1) / 2, (level.height + 1) / 2};
+    }
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = PYRAMID_FORMAT;
+    imageInfo.extent = {m_levels[0].width, m_levels[0].height, 1};
+    imageInfo.mipLevels = level_count();
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if(vkCreateImage(m_device, &imageInfo, m_host_allocator, &m_image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid image!");
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(m_device, m_image, &requirements);
+    m_memory = m_allocate(requirements.size, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkBindImageMemory(m_device, m_image, m_memory, 0);
+    m_image_bytes = requirements.size;
+
+    for(uint32_t i = 0; i < level_count(); ++i) {
+        VkImageViewCreateInfo viewInfo = {};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = m_image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = PYRAMID_FORMAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1};
+        VkImageView view;
+        if(vkCreateImageView(m_device, &viewInfo, m_host_allocator, &view) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth pyramid view!");
+        }
+        m_views.push_back(view);
+    }
+
+    // Level i reads level i - 1, level 0 reads the depth buffer set_depth()
+    // is given.
+    for(uint32_t i = 0; i < level_count(); ++i) {
+        m_sets.push_back(m_descriptors->allocate(m_set_layout));
+        VkDescriptorImageInfo destinationInfo = {};
+        destinationInfo.imageView = m_views[i];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        write_descriptor(m_sets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, destinationInfo);
+        if(i > 0) {
+            VkDescriptorImageInfo sourceInfo = {};
+            sourceInfo.sampler = m_sampler;
+            sourceInfo.imageView = m_views[i - 1];
+            sourceInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+            write_descriptor(m_sets[i], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sourceInfo);
+        }
+    }
+
+    m_first_readback_level = 0;
+    while(m_levels[m_first_readback_level].width > READBACK_WIDTH) {
+        m_first_readback_level += 1;
+    }
+    std::size_t texels = 0;
+    for(uint32_t i = m_first_readback_level; i < level_count(); ++i) {
+        m_readback_levels.push_back({m_levels[i].width, m_levels[i].height, 2u << i, texels});
+        texels += std::size_t{m_levels[i].width} * m_levels[i].height;
+    }
+    m_readback_bytes = texels * sizeof(float);
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = m_readback_bytes * m_copies;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(vkCreateBuffer(m_device, &bufferInfo, m_host_allocator, &m_readback) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create depth pyramid readback buffer!");
+    }
+    vkGetBufferMemoryRequirements(m_device, m_readback, &requirements);
+    m_readback_memory = m_allocate(requirements.size, requirements.memoryTypeBits, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    vkBindBufferMemory(m_device, m_readback, m_readback_memory, 0);
+    void* data;
+    vkMapMemory(m_device, m_readback_memory, 0, m_readback_bytes * m_copies, 0, &data);
+    m_readback_ptr = static_cast<const float*>(data);
+
+    if(m_timestamp_period > 0.0f) {
+        VkQueryPoolCreateInfo queryInfo = {};
+        queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryInfo.queryCount = 2 * m_copies;
+        if(vkCreateQueryPool(m_device, &queryInfo, m_host_allocator, &m_query_pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create depth pyramid query pool!");
+        }
+    }
+}
+ 
+void HiZPyramid::set_depth(VkImageView depth_view) {
+    VkDescriptorImageInfo sourceInfo = {};
+    sourceInfo.sampler = m_sampler;
+    sourceInfo.imageView = depth_view;
+    sourceInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    write_descriptor(m_sets[0], 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sourceInfo);
+}
+ 
+void HiZPyramid::write_descriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, 
+        const VkDescriptorImageInfo& info) {
+    VkWriteDescriptorSet descriptorWrite = {};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = set;
+    descriptorWrite.dstBinding = binding;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.descriptorType = type;
+    descriptorWrite.pImageInfo = &info;
+    vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+}
+ 
+void HiZPyramid::add_passes(RenderGraph& graph, RenderGraph::Resource depth, uint32_t copy) {
+    RenderGraphImageDesc desc;
+    desc.format = PYRAMID_FORMAT;
+    desc.extent = m_levels[0];
+    desc.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    // Every execution rewrites all levels, so earlier contents never matter.
+    auto pyramid = graph.import_image("depth pyramid", m_image, m_views[0], desc, VK_IMAGE_LAYOUT_UNDEFINED, 
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_LAYOUT_UNDEFINED);
+    auto readback = graph.import_buffer("depth pyramid readback", m_readback);
+
+    graph.add_pass("depth pyramid")
+        .read(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL)
+        .write(pyramid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, 
+            VK_IMAGE_LAYOUT_GENERAL)
+        .execute([this, copy](VkCommandBuffer command_buffer) {
+            record_build(command_buffer, copy);
+        });
+
+    graph.add_pass("depth pyramid readback")
+        .read(pyramid, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL)
+        .write(readback, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)
+        .execute([this, copy](VkCommandBuffer command_buffer) {
+            record_readback(command_buffer, copy);
+        });
+}
+ 
+void HiZPyramid::record_build(VkCommandBuffer command_buffer, uint32_t copy) {
+    if(m_query_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, m_query_pool, 2 * copy, 2);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_query_pool, 2 * copy);
+    }
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for(uint32_t i = 0; i < level_count(); ++i) {
+        if(i > 0) {
+            // The graph only orders whole passes; within this one each level
+            // has to wait for the one it reduces.
+            VkImageMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = m_image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 1, 0, 1};
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 
+                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+        }
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 1, &m_sets[i], 
+            0, nullptr);
+        vkCmdDispatch(command_buffer, (m_levels[i].width + GROUP_SIZE - 1) / GROUP_SIZE, 
+            (m_levels[i].height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    }
+}
+ 
+void HiZPyramid::record_readback(VkCommandBuffer command_buffer, uint32_t copy) {
+    std::vector<VkBufferImageCopy> regions;
+    for(uint32_t i = m_first_readback_level; i < level_count(); ++i) {
+        const auto& level = m_readback_levels[i - m_first_readback_level];
+        VkBufferImageCopy region = {};
+        region.bufferOffset = copy * m_readback_bytes + level.offset * sizeof(float);
+        region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+        region.imageExtent = {level.width, level.height, 1};
+        regions.push_back(region);
+    }
+    vkCmdCopyImageToBuffer(command_buffer, m_image, VK_IMAGE_LAYOUT_GENERAL, m_readback, 
+        static_cast<uint32_t>(regions.size()), regions.data());
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_readback;
+    barrier.offset = copy * m_readback_bytes;
+    barrier.size = m_readback_bytes;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 
+        0, nullptr, 1, &barrier, 0, nullptr);
+
+    if(m_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_query_pool, 2 * copy + 1);
+    }
+}
+ 
+void HiZPyramid::read(OcclusionCuller& culler, uint32_t copy) {
+    std::size_t texels = m_readback_bytes / sizeof(float);
+    culler.set_pyramid(m_extent.width, m_extent.height, m_readback_levels, m_readback_ptr + copy * texels, texels);
+
+    if(m_query_pool != VK_NULL_HANDLE) {
+        std::array<uint64_t, 2> timestamps = {};
+        VkResult result = vkGetQueryPoolResults(m_device, m_query_pool, 2 * copy, 2, sizeof(timestamps), 
+            timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if(result == VK_SUCCESS) {
+            m_last_milliseconds = (timestamps[1] - timestamps[0]) * static_cast<double>(m_timestamp_period) / 1e6;
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef HIZ_PYRAMID_H_
+#define HIZ_PYRAMID_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "OcclusionCuller.h"
+#include "RenderGraph.h"
+
+// Conservative depth pyramid built from the scene depth buffer by a compute
+// pass and read back for CPU occlusion tests in the next frame. Level 0 is
+// half the depth buffer's size, rounded up, and every later level halves
+// the previous one, so a level k texel covers 2^(k+1) pixels along each
+// axis and holds the farthest depth among them. Only the levels at most
+// READBACK_WIDTH texels wide are copied back; the finer ones are just
+// inputs to the reduction.
+//
+// Every graph execution rewrites the pyramid and one of several readback
+// copies, so executions may overlap as long as they use different copies;
+// read() takes the copy of an execution that has finished.
+class HiZPyramid {
+public:
+    using AllocateFunction = std::function<VkDeviceMemory(VkDeviceSize size, uint32_t type_filter,
+        VkMemoryPropertyFlags properties)>;
+    using ReleaseFunction = std::function<void(VkDeviceMemory memory)>;
+
+    static constexpr uint32_t READBACK_WIDTH = 128;
+
+    // A timestamp_period of 0 disables GPU timing of the passes.
+    HiZPyramid(VkDevice device, DescriptorLayoutCache& layout_cache, const std::vector<char>& shader_code,
+        AllocateFunction allocate, ReleaseFunction release, float timestamp_period,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    ~HiZPyramid();
+
+    HiZPyramid(const HiZPyramid& other) = delete;
+    HiZPyramid(HiZPyramid&& other) noexcept = delete;
+    HiZPyramid& operator =(const HiZPyramid& other) = delete;
+    HiZPyramid& operator =(HiZPyramid&& other) noexcept = delete;
+
+    // Recreates the pyramid for a depth buffer of the given size, with
+    // copies readback copies. set_depth() has to follow before the passes
+    // execute.
+    void resize(VkExtent2D extent, uint32_t copies);
+    // The depth buffer the pyramid reduces. The view has to stay valid until
+    // the next resize or destruction.
+    void set_depth(VkImageView depth_view);
+
+    // Adds the reduction and readback passes, reading back into copy; an
+    // earlier pass has to write depth, the image behind the view passed to
+    // set_depth().
+    void add_passes(RenderGraph& graph, RenderGraph::Resource depth, uint32_t copy);
+
+    // Hands culler the levels that the last graph execution using copy read back.
+    void read(OcclusionCuller& culler, uint32_t copy);
+
+    uint32_t level_count() const { return static_cast<uint32_t>(m_levels.size()); }
+    VkDeviceSize memory_bytes() const { return m_image_bytes + m_readback_bytes * m_copies; }
+    bool timed() const { return m_timestamp_period > 0.0f; }
+    // GPU time of both passes in the last read execution.
+    double last_milliseconds() const { return m_last_milliseconds; }
+
+private:
+    void destroy_sized_resources();
+    void write_descriptor(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, 
+        const VkDescriptorImageInfo& info);
+    void record_build(VkCommandBuffer command_buffer, uint32_t copy);
+    void record_readback(VkCommandBuffer command_buffer, uint32_t copy);
+
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_host_allocator;
+    AllocateFunction m_allocate;
+    ReleaseFunction m_release;
+    float m_timestamp_period;
+
+    VkDescriptorSetLayout m_set_layout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    VkQueryPool m_query_pool = VK_NULL_HANDLE;
+    std::unique_ptr<DescriptorAllocator> m_descriptors;
+
+    VkExtent2D m_extent = {0, 0};
+    VkImage m_image = VK_NULL_HANDLE;
+    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    VkDeviceSize m_image_bytes = 0;
+    std::vector<VkExtent2D> m_levels;
+    std::vector<VkImageView> m_views;
+    std::vector<VkDescriptorSet> m_sets;
+
+    uint32_t m_first_readback_level = 0;
+    std::vector<OcclusionCuller::Level> m_readback_levels;
+    VkBuffer m_readback = VK_NULL_HANDLE;
+    VkDeviceMemory m_readback_memory = VK_NULL_HANDLE;
+    // Of one copy; the copies follow each other in m_readback, and each has
+    // its own pair of timestamps.
+    VkDeviceSize m_readback_bytes = 0;
+    uint32_t m_copies = 0;
+    const float* m_readback_ptr = nullptr;
+
+    double m_last_milliseconds = 0.0;
+};
+
+#endif
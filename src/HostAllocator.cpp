@@ -0,0 +1,264 @@
+#include "HostAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+
+// In front of every allocation. offset is the distance from the start of
+// the block, which is where pooled blocks return to their free list.
+struct AllocationHeader {
+    uint64_t size;
+    uint32_t offset;
+    uint8_t scope;
+    uint8_t size_class;
+    uint16_t reserved;
+};
+static_assert(sizeof(AllocationHeader) == 16, "Allocation header must stay 16 bytes!");
+
+static constexpr uint8_t UNPOOLED = 0xff;
+
+
+static AllocationHeader* header_of(void* memory) {
+    return reinterpret_cast<AllocationHeader*>(static_cast<std::byte*>(memory) - sizeof(AllocationHeader));
+}
+
+// Room for the header, rounded up so the memory after it stays aligned.
+static std::size_t header_offset(std::size_t alignment) {
+    return std::max(sizeof(AllocationHeader), alignment);
+}
+
+static std::size_t size_class_of(std::size_t block_size) {
+    std::size_t size_class = 0;
+    while((HostAllocator::MIN_CLASS_SIZE << size_class) < block_size) {
+        size_class += 1;
+    }
+    return size_class;
+}
+
+static void raise_peak(std::atomic<uint64_t>& peak, uint64_t value) {
+    uint64_t previous = peak.load(std::memory_order_relaxed);
+    while(previous < value && !peak.compare_exchange_weak(previous, value, std::memory_order_relaxed)) { }
+}
+
+
+const char* allocation_scope_name(VkSystemAllocationScope scope) {
+    switch(scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        default: return "unknown";
+    }
+}
+ 
+HostAllocator::HostAllocator() {
+    m_callbacks.pUserData = this;
+    m_callbacks.pfnAllocation = &HostAllocator::allocation_callback;
+    m_callbacks.pfnReallocation = &HostAllocator::reallocation_callback;
+    m_callbacks.pfnFree = &HostAllocator::free_callback;
+    m_callbacks.pfnInternalAllocation = &HostAllocator::internal_allocation_callback;
+    m_callbacks.pfnInternalFree = &HostAllocator::internal_free_callback;
+}
+ 
+HostAllocator::~HostAllocator() {
+    for(auto& pool : m_pools) {
+        for(void* slab : pool.slabs) {
+            std::free(slab);
+        }
+    }
+}
+ 
+HostScopeStats HostAllocator::stats(VkSystemAllocationScope scope) const {
+    const auto& counters = m_scopes[scope];
+    HostScopeStats stats;
+    stats.current_bytes = counters.current_bytes.load(std::memory_order_relaxed);
+    stats.peak_bytes = counters.peak_bytes.load(std::memory_order_relaxed);
+    stats.allocations = counters.allocations.load(std::memory_order_relaxed);
+    stats.pooled = counters.pooled.load(std::memory_order_relaxed);
+    stats.internal_bytes = counters.internal_bytes.load(std::memory_order_relaxed);
+    stats.internal_peak_bytes = counters.internal_peak_bytes.load(std::memory_order_relaxed);
+    return stats;
+}
+ 
+std::size_t HostAllocator::slab_bytes() const {
+    std::size_t total = 0;
+    for(auto& pool : m_pools) {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        total += pool.slabs.size() * SLAB_SIZE;
+    }
+    return total;
+}
+ 
+void HostAllocator::report(std::ostream& stream) const {
+    uint64_t allocations = 0;
+    uint64_t pooled = 0;
+    for(std::size_t scope = 0; scope < SCOPES; ++scope) {
+        allocations += m_scopes[scope].allocations.load(std::memory_order_relaxed);
+        pooled += m_scopes[scope].pooled.load(std::memory_order_relaxed);
+    }
+    stream << "Driver host memory: " << allocations << " allocations, "
+        << (allocations > 0 ? 100.0 * pooled / allocations : 0.0) << "% pooled, "
+        << slab_bytes() / 1024 << " KB in pool slabs\n";
+    for(std::size_t scope = 0; scope < SCOPES; ++scope) {
+        auto stats = this->stats(static_cast<VkSystemAllocationScope>(scope));
+        if(stats.allocations == 0 && stats.internal_peak_bytes == 0) {
+            continue;
+        }
+        stream << "\t|> " << allocation_scope_name(static_cast<VkSystemAllocationScope>(scope)) << ": "
+            << stats.current_bytes / 1024.0 << " KB current, " << stats.peak_bytes / 1024.0 << " KB peak, "
+            << stats.allocations << " allocations (" << stats.pooled << " pooled)";
+        if(stats.internal_peak_bytes > 0) {
+            stream << ", internal " << stats.internal_bytes / 1024.0 << " KB current, "
+                << stats.internal_peak_bytes / 1024.0 << " KB peak";
+        }
+        stream << "\n";
+    }
+}
+ 
+void* HostAllocator::allocation_callback(void* user_data, size_t size, size_t alignment,
+        VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator*>(user_data)->allocate(size, alignment, scope);
+}
+ 
+void* HostAllocator::reallocation_callback(void* user_data, void* original, size_t size, size_t alignment,
+        VkSystemAllocationScope scope) {
+    return static_cast<HostAllocator*>(user_data)->reallocate(original, size, alignment, scope);
+}
+ 
+void HostAllocator::free_callback(void* user_data, void* memory) {
+    static_cast<HostAllocator*>(user_data)->release(memory);
+}
+ 
+void HostAllocator::internal_allocation_callback(void* user_data, size_t size, VkInternalAllocationType,
+        VkSystemAllocationScope scope) {
+    auto& counters = static_cast<HostAllocator*>(user_data)->m_scopes[scope];
+    uint64_t current = counters.internal_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raise_peak(counters.internal_peak_bytes, current);
+}
+ 
+void HostAllocator::internal_free_callback(void* user_data, size_t size, VkInternalAllocationType,
+        VkSystemAllocationScope scope) {
+    auto& counters = static_cast<HostAllocator*>(user_data)->m_scopes[scope];
+    counters.internal_bytes.fetch_sub(size, std::memory_order_relaxed);
+}
+ 
+void* HostAllocator::allocate(std::size_t size, std::size_t alignment, VkSystemAllocationScope scope) {
+    if(size == 0) {
+        return nullptr;
+    }
+    std::size_t offset = header_offset(alignment);
+    std::size_t block_size = offset + size;
+
+    std::byte* block;
+    uint8_t size_class = UNPOOLED;
+    if(block_size <= MAX_CLASS_SIZE) {
+        // Blocks are aligned to their class size, which is at least offset
+        // and so at least the alignment.
+        size_class = static_cast<uint8_t>(size_class_of(block_size));
+        block = static_cast<std::byte*>(take_block(size_class));
+    } else {
+        std::size_t block_alignment = std::max(alignment, sizeof(AllocationHeader));
+        block = static_cast<std::byte*>(std::aligned_alloc(block_alignment,
+            (block_size + block_alignment - 1) / block_alignment * block_alignment));
+    }
+    if(!block) {
+        return nullptr;
+    }
+
+    void* memory = block + offset;
+    auto* header = header_of(memory);
+    header->size = size;
+    header->offset = static_cast<uint32_t>(offset);
+    header->scope = static_cast<uint8_t>(scope);
+    header->size_class = size_class;
+    header->reserved = 0;
+
+    auto& counters = m_scopes[scope];
+    uint64_t current = counters.current_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    raise_peak(counters.peak_bytes, current);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    if(size_class != UNPOOLED) {
+        counters.pooled.fetch_add(1, std::memory_order_relaxed);
+    }
+    return memory;
+}
+ 
+void* HostAllocator::reallocate(void* original, std::size_t size, std::size_t alignment,
+        VkSystemAllocationScope scope) {
+    if(!original) {
+        return allocate(size, alignment, scope);
+    }
+    if(size == 0) {
+        release(original);
+        return nullptr;
+    }
+
+    auto* header = header_of(original);
+    // A pooled block with room to spare is resized in place.
+    if(header->size_class != UNPOOLED && header->scope == scope
+            && header->offset + size <= (MIN_CLASS_SIZE << header->size_class)) {
+        auto& counters = m_scopes[scope];
+        if(size > header->size) {
+            uint64_t current = counters.current_bytes.fetch_add(size - header->size, std::memory_order_relaxed)
+                + (size - header->size);
+            raise_peak(counters.peak_bytes, current);
+        } else {
+            counters.current_bytes.fetch_sub(header->size - size, std::memory_order_relaxed);
+        }
+        header->size = size;
+        return original;
+    }
+
+    void* memory = allocate(size, alignment, scope);
+    if(!memory) {
+        return nullptr;
+    }
+    std::memcpy(memory, original, std::min<std::size_t>(size, header->size));
+    release(original);
+    return memory;
+}
+ 
+void HostAllocator::release(void* memory) {
+    if(!memory) {
+        return;
+    }
+    auto* header = header_of(memory);
+    m_scopes[header->scope].current_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+    void* block = static_cast<std::byte*>(memory) - header->offset;
+    if(header->size_class == UNPOOLED) {
+        std::free(block);
+    } else {
+        return_block(header->size_class, block);
+    }
+}
+ 
+void* HostAllocator::take_block(std::size_t size_class) {
+    auto& pool = m_pools[size_class];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    if(!pool.free_list) {
+        auto* slab = static_cast<std::byte*>(std::aligned_alloc(SLAB_SIZE, SLAB_SIZE));
+        if(!slab) {
+            return nullptr;
+        }
+        pool.slabs.push_back(slab);
+        // Thread the slab's blocks onto the free list, first block first.
+        std::size_t block_size = MIN_CLASS_SIZE << size_class;
+        for(std::size_t offset = SLAB_SIZE; offset > 0; offset -= block_size) {
+            void* block = slab + offset - block_size;
+            std::memcpy(block, &pool.free_list, sizeof(void*));
+            pool.free_list = block;
+        }
+    }
+    void* block = pool.free_list;
+    std::memcpy(&pool.free_list, block, sizeof(void*));
+    return block;
+}
+ 
+void HostAllocator::return_block(std::size_t size_class, void* block) {
+    auto& pool = m_pools[size_class];
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    std::memcpy(block, &pool.free_list, sizeof(void*));
+    pool.free_list = block;
+}
@@ -0,0 +1,100 @@
+#ifndef HOST_ALLOCATOR_H_
+#define HOST_ALLOCATOR_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+const char* allocation_scope_name(VkSystemAllocationScope scope);
+
+struct HostScopeStats {
+    uint64_t current_bytes = 0;
+    uint64_t peak_bytes = 0;
+    uint64_t allocations = 0;
+    // Allocations served from a size class pool.
+    uint64_t pooled = 0;
+    // Memory the driver allocated itself and only reported.
+    uint64_t internal_bytes = 0;
+    uint64_t internal_peak_bytes = 0;
+};
+
+// VkAllocationCallbacks for the driver's host memory. Allocations are
+// tracked per VkSystemAllocationScope, the lifetime the driver tags them
+// with, so swapchain rebuilds and pipeline compiles show up as command and
+// object scope churn.
+//
+// Small allocations come from power of two size classes carved out of 64 KB
+// slabs, which are kept until the allocator is destroyed. Every allocation
+// has a 16 byte header in front of it with its size and origin, so free and
+// reallocation don't need a lookup. Callbacks may run on any thread.
+//
+// Objects have to be destroyed with the callbacks they were created with,
+// and the allocator has to outlive the instance and device using it.
+class HostAllocator {
+public:
+    static constexpr std::size_t MIN_CLASS_SIZE = 32;
+    static constexpr std::size_t SIZE_CLASSES = 7;
+    static constexpr std::size_t MAX_CLASS_SIZE = MIN_CLASS_SIZE << (SIZE_CLASSES - 1);
+    static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+    static constexpr std::size_t SCOPES = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    HostAllocator();
+    ~HostAllocator();
+
+    // The callbacks point back at the allocator.
+    HostAllocator(const HostAllocator& other) = delete;
+    HostAllocator(HostAllocator&& other) noexcept = delete;
+    HostAllocator& operator =(const HostAllocator& other) = delete;
+    HostAllocator& operator =(HostAllocator&& other) noexcept = delete;
+
+    const VkAllocationCallbacks* callbacks() const { return &m_callbacks; }
+
+    HostScopeStats stats(VkSystemAllocationScope scope) const;
+    std::size_t slab_bytes() const;
+
+    void report(std::ostream& stream) const;
+
+private:
+    struct Pool {
+        mutable std::mutex mutex;
+        void* free_list = nullptr;
+        std::vector<void*> slabs;
+    };
+
+    struct Scope {
+        std::atomic<uint64_t> current_bytes{0};
+        std::atomic<uint64_t> peak_bytes{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> pooled{0};
+        std::atomic<uint64_t> internal_bytes{0};
+        std::atomic<uint64_t> internal_peak_bytes{0};
+    };
+
+    static VKAPI_ATTR void* VKAPI_CALL allocation_callback(void* user_data, size_t size, size_t alignment,
+        VkSystemAllocationScope scope);
+    static VKAPI_ATTR void* VKAPI_CALL reallocation_callback(void* user_data, void* original, size_t size,
+        size_t alignment, VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL free_callback(void* user_data, void* memory);
+    static VKAPI_ATTR void VKAPI_CALL internal_allocation_callback(void* user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+    static VKAPI_ATTR void VKAPI_CALL internal_free_callback(void* user_data, size_t size,
+        VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+    void* allocate(std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+    void* reallocate(void* original, std::size_t size, std::size_t alignment, VkSystemAllocationScope scope);
+    void release(void* memory);
+    void* take_block(std::size_t size_class);
+    void return_block(std::size_t size_class, void* block);
+
+    std::array<Pool, SIZE_CLASSES> m_pools;
+    std::array<Scope, SCOPES> m_scopes;
+    VkAllocationCallbacks m_callbacks = {};
+};
+
+#endif
@@ -0,0 +1,272 @@
+#include "JobSystem.h"
+
+#include <iomanip>
+
+
+// Steal rounds a thread retries before it goes to sleep.
+static constexpr int IDLE_SPINS = 64;
+// Initial ring size of every deque, a power of two.
+static constexpr std::size_t RING_SIZE = 256;
+
+static thread_local const JobSystem* t_system = nullptr;
+static thread_local std::size_t t_worker = JobSystem::NOT_A_WORKER;
+
+
+bool JobCounter::done() const {
+    return m_pending.load(std::memory_order_acquire) == 0 && m_finishing.load(std::memory_order_acquire) == 0;
+}
+ 
+JobStats& JobStats::operator +=(const JobStats& other) {
+    executed += other.executed;
+    stolen += other.stolen;
+    steal_attempts += other.steal_attempts;
+    contended += other.contended;
+    sleeps += other.sleeps;
+    return *this;
+}
+ 
+std::size_t JobSystem::default_thread_count() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+ 
+JobSystem::JobSystem(std::size_t thread_count) {
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for(std::size_t i = 0; i < thread_count; ++i) {
+        m_workers.push_back(std::make_unique<Worker>());
+        m_workers.back()->ring.resize(RING_SIZE);
+    }
+    t_system = this;
+    t_worker = 0;
+    for(std::size_t i = 1; i < thread_count; ++i) {
+        m_threads.emplace_back(&JobSystem::worker_main, this, i);
+    }
+}
+ 
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(auto& thread : m_threads) {
+        thread.join();
+    }
+    if(t_system == this) {
+        t_system = nullptr;
+        t_worker = NOT_A_WORKER;
+    }
+}
+ 
+void JobSystem::run(std::function<void()> function, JobCounter* counter) {
+    if(counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    push(Job{std::move(function), counter});
+}
+ 
+void JobSystem::run_after(JobCounter& dependency, std::function<void()> function, JobCounter* counter) {
+    if(counter) {
+        counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    Job job = {std::move(function), counter};
+    {
+        // finish() takes the continuations under the same lock after the
+        // count reaches zero, so either it sees this job or we see zero.
+        std::lock_guard<std::mutex> lock(dependency.m_mutex);
+        if(dependency.m_pending.load(std::memory_order_acquire) > 0) {
+            dependency.m_continuations.push_back(std::move(job));
+            return;
+        }
+    }
+    push(std::move(job));
+}
+ 
+void JobSystem::wait(const JobCounter& counter) {
+    std::size_t index = worker_index();
+    Job job;
+    while(!counter.done()) {
+        if(index != NOT_A_WORKER && take(index, job)) {
+            execute(index, job);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+ 
+std::size_t JobSystem::worker_index() const {
+    return t_system == this ? t_worker : NOT_A_WORKER;
+}
+ 
+JobStats JobSystem::stats() const {
+    JobStats total;
+    for(const auto& worker : m_workers) {
+        total.executed += worker->executed.load(std::memory_order_relaxed);
+        total.stolen += worker->stolen.load(std::memory_order_relaxed);
+        total.steal_attempts += worker->steal_attempts.load(std::memory_order_relaxed);
+        total.contended += worker->contended.load(std::memory_order_relaxed);
+        total.sleeps += worker->sleeps.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+ 
+void JobSystem::report(std::ostream& stream) const {
+    JobStats total = stats();
+    double stolen = total.executed > 0 ? 100.0 * total.stolen / total.executed : 0.0;
+    stream << "Jobs: " << m_workers.size() << " threads, " << total.executed << " executed, "
+        << std::fixed << std::setprecision(1) << stolen << std::defaultfloat << "% stolen, "
+        << total.contended << " contended locks, " << total.sleeps << " sleeps\n";
+    for(std::size_t i = 0; i < m_workers.size(); ++i) {
+        const auto& worker = *m_workers[i];
+        stream << "\t|> thread " << i << ": " << worker.executed.load(std::memory_order_relaxed) << " executed, "
+            << worker.stolen.load(std::memory_order_relaxed) << "/"
+            << worker.steal_attempts.load(std::memory_order_relaxed) << " steals, "
+            << worker.contended.load(std::memory_order_relaxed) << " contended, "
+            << worker.sleeps.load(std::memory_order_relaxed) << " sleeps\n";
+    }
+}
+ 
+void JobSystem::push_back(Worker& worker, Job&& job) {
+    std::size_t count = worker.size.load(std::memory_order_relaxed);
+    if(count == worker.ring.size()) {
+        std::vector<Job> ring(worker.ring.size() * 2);
+        for(std::size_t i = 0; i < count; ++i) {
+            ring[i] = std::move(worker.ring[(worker.head + i) & (worker.ring.size() - 1)]);
+        }
+        worker.ring.swap(ring);
+        worker.head = 0;
+    }
+    worker.ring[(worker.head + count) & (worker.ring.size() - 1)] = std::move(job);
+    worker.size.store(count + 1, std::memory_order_relaxed);
+}
+ 
+void JobSystem::pop_back(Worker& worker, Job& job) {
+    std::size_t count = worker.size.load(std::memory_order_relaxed) - 1;
+    job = std::move(worker.ring[(worker.head + count) & (worker.ring.size() - 1)]);
+    worker.size.store(count, std::memory_order_relaxed);
+}
+ 
+void JobSystem::pop_front(Worker& worker, Job& job) {
+    job = std::move(worker.ring[worker.head]);
+    worker.head = (worker.head + 1) & (worker.ring.size() - 1);
+    worker.size.store(worker.size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+}
+ 
+void JobSystem::push(Job job) {
+    std::size_t index = worker_index();
+    if(index == NOT_A_WORKER) {
+        index = m_next_worker.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+    }
+    Worker& worker = *m_workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        push_back(worker, std::move(job));
+    }
+
+    // A sleeper counts itself before it checks m_queued under the mutex, so
+    // either it sees this job or we see it and wake it up.
+    m_queued.fetch_add(1, std::memory_order_seq_cst);
+    if(m_sleeping.load(std::memory_order_seq_cst) > 0) {
+        {
+            std::lock_guard<std::mutex> lock(m_sleep_mutex);
+        }
+        m_wake.notify_one();
+    }
+}
+ 
+bool JobSystem::take(std::size_t index, Job& job) {
+    Worker& own = *m_workers[index];
+    if(own.size.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(own.size.load(std::memory_order_relaxed) > 0) {
+            pop_back(own, job);
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Go back to the last victim that had work before trying the others.
+    std::size_t others = m_workers.size() - 1;
+    for(std::size_t i = 0; i < others; ++i) {
+        std::size_t offset = 1 + (own.next_victim + i) % others;
+        Worker& victim = *m_workers[(index + offset) % m_workers.size()];
+        if(victim.size.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        own.steal_attempts.fetch_add(1, std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if(!lock.owns_lock()) {
+            own.contended.fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+        if(victim.size.load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        pop_front(victim, job);
+        m_queued.fetch_sub(1, std::memory_order_relaxed);
+        own.stolen.fetch_add(1, std::memory_order_relaxed);
+        own.next_victim = offset - 1;
+        return true;
+    }
+    return false;
+}
+ 
+void JobSystem::execute(std::size_t index, Job& job) {
+    job.function();
+    job.function = nullptr;
+    if(job.counter) {
+        finish(*job.counter);
+    }
+    m_workers[index]->executed.fetch_add(1, std::memory_order_relaxed);
+}
+ 
+void JobSystem::finish(JobCounter& counter) {
+    // Once m_pending is zero a waiter may destroy the counter, unless it
+    // sees m_finishing, which is the last thing touched here.
+    counter.m_finishing.fetch_add(1, std::memory_order_relaxed);
+    if(counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        counter.m_finishing.fetch_sub(1, std::memory_order_release);
+        return;
+    }
+
+    std::vector<Job> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter.m_mutex);
+        ready.swap(counter.m_continuations);
+    }
+    counter.m_finishing.fetch_sub(1, std::memory_order_release);
+    for(auto& job : ready) {
+        push(std::move(job));
+    }
+}
+ 
+void JobSystem::worker_main(std::size_t index) {
+    t_system = this;
+    t_worker = index;
+    Worker& own = *m_workers[index];
+
+    Job job;
+    int idle = 0;
+    while(true) {
+        if(take(index, job)) {
+            execute(index, job);
+            idle = 0;
+            continue;
+        }
+        if(++idle < IDLE_SPINS) {
+            std::this_thread::yield();
+            continue;
+        }
+        idle = 0;
+
+        std::unique_lock<std::mutex> lock(m_sleep_mutex);
+        m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+        if(!m_stopping && m_queued.load(std::memory_order_seq_cst) == 0) {
+            own.sleeps.fetch_add(1, std::memory_order_relaxed);
+            m_wake.wait(lock, [this]() { return m_stopping || m_queued.load(std::memory_order_seq_cst) > 0; });
+        }
+        m_sleeping.fetch_sub(1, std::memory_order_seq_cst);
+        if(m_stopping) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#ifndef JOB_SYSTEM_H_
+#define JOB_SYSTEM_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+struct Job {
+    std::function<void()> function;
+    // Decremented once the function has returned.
+    JobCounter* counter = nullptr;
+};
+
+// Number of unfinished jobs that were started with it, plus the jobs waiting
+// for it to reach zero. A counter may be reused once it is done, and has to
+// outlive the jobs it counts.
+class JobCounter {
+public:
+    JobCounter() = default;
+    ~JobCounter() = default;
+
+    JobCounter(const JobCounter& other) = delete;
+    JobCounter(JobCounter&& other) noexcept = delete;
+    JobCounter& operator =(const JobCounter& other) = delete;
+    JobCounter& operator =(JobCounter&& other) noexcept = delete;
+
+    bool done() const;
+    uint32_t pending() const { return m_pending.load(std::memory_order_acquire); }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> m_pending{0};
+    // Jobs that are past their decrement but may still be touching the
+    // counter; done() waits for them so the counter can be destroyed.
+    std::atomic<uint32_t> m_finishing{0};
+    std::mutex m_mutex;
+    std::vector<Job> m_continuations;
+};
+
+struct JobStats {
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+    // Looks into another thread's deque, successful or not.
+    uint64_t steal_attempts = 0;
+    // Deque locks that were already held by another thread.
+    uint64_t contended = 0;
+    uint64_t sleeps = 0;
+
+    JobStats& operator +=(const JobStats& other);
+};
+
+// Work stealing thread pool shared by everything that wants to run in
+// parallel, so that independent systems don't each start a thread per core.
+//
+// Every thread has its own deque: it pushes and pops its own jobs at the
+// back, newest first, while idle threads steal the oldest jobs from the
+// front of the others'. A deque is guarded by its own mutex, which only
+// sees contention when a thief and the owner meet on the same deque.
+// Threads that find nothing to run or steal sleep until a job is queued.
+//
+// The thread that constructs the system is worker 0: it has a deque and runs
+// jobs while it waits on a counter. Jobs started from threads the system
+// doesn't own are spread over the workers' deques.
+class JobSystem {
+public:
+    static constexpr std::size_t NOT_A_WORKER = ~std::size_t{0};
+
+    static std::size_t default_thread_count();
+
+    // thread_count includes the constructing thread.
+    explicit JobSystem(std::size_t thread_count = default_thread_count());
+    // Jobs still queued are dropped, so wait for them first.
+    ~JobSystem();
+
+    JobSystem(const JobSystem& other) = delete;
+    JobSystem(JobSystem&& other) noexcept = delete;
+    JobSystem& operator =(const JobSystem& other) = delete;
+    JobSystem& operator =(JobSystem&& other) noexcept = delete;
+
+    void run(std::function<void()> function, JobCounter* counter = nullptr);
+    // Queues function once dependency has reached zero. counter counts it
+    // from now on, not just from when it is queued.
+    void run_after(JobCounter& dependency, std::function<void()> function, JobCounter* counter = nullptr);
+    // Runs queued jobs until counter is done. Threads the system doesn't own
+    // only yield while they wait.
+    void wait(const JobCounter& counter);
+
+    // Calls function(chunk_begin, chunk_end) for chunks of at most grain
+    // indices covering [begin, end) and returns when all are done. The
+    // calling thread takes the first chunk.
+    template <typename Function>
+    void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const Function& function);
+
+    std::size_t thread_count() const { return m_workers.size(); }
+    // Index of the calling thread, or NOT_A_WORKER.
+    std::size_t worker_index() const;
+
+    JobStats stats() const;
+    void report(std::ostream& stream) const;
+
+private:
+    // Ring buffer deque that keeps its storage, so queuing a job doesn't
+    // allocate once the ring has grown to the thread's working set.
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::vector<Job> ring;
+        std::size_t head = 0;
+        // Lets thieves skip empty deques without taking their lock.
+        std::atomic<std::size_t> size{0};
+        std::size_t next_victim = 0;
+
+        // Only ever written by the worker's own thread.
+        std::atomic<uint64_t> executed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> steal_attempts{0};
+        std::atomic<uint64_t> contended{0};
+        std::atomic<uint64_t> sleeps{0};
+    };
+
+    static void push_back(Worker& worker, Job&& job);
+    static void pop_back(Worker& worker, Job& job);
+    static void pop_front(Worker& worker, Job& job);
+
+    void push(Job job);
+    bool take(std::size_t index, Job& job);
+    void execute(std::size_t index, Job& job);
+    void finish(JobCounter& counter);
+    void worker_main(std::size_t index);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<std::size_t> m_next_worker{0};
+
+    // Jobs sitting in deques, and the threads sleeping until there are some.
+    std::atomic<std::size_t> m_queued{0};
+    std::atomic<std::size_t> m_sleeping{0};
+    std::mutex m_sleep_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+};
+
+template <typename Function>
+void JobSystem::parallel_for(std::size_t begin, std::size_t end, std::size_t grain, const Function& function) {
+    if(begin >= end) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    std::size_t chunks = (end - begin + grain - 1) / grain;
+    if(chunks == 1 || m_workers.size() == 1) {
+        function(begin, end);
+        return;
+    }
+
+    // The jobs only capture a pointer and an index, which std::function
+    // stores without allocating.
+    struct Range {
+        std::size_t begin;
+        std::size_t end;
+        std::size_t grain;
+        const Function* function;
+    };
+    Range range = {begin, end, grain, &function};
+    JobCounter counter;
+    for(std::size_t chunk = chunks - 1; chunk > 0; --chunk) {
+        run([&range, chunk]() {
+            std::size_t chunk_begin = range.begin + chunk * range.grain;
+            (*range.function)(chunk_begin, std::min(range.end, chunk_begin + range.grain));
+        }, &counter);
+    }
+    function(begin, std::min(end, begin + grain));
+    wait(counter);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+
+MappedFile::MappedFile(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0) {
+        throw std::runtime_error("Failed to open " + filename + " for mapping!");
+    }
+
+    struct stat info;
+    if(::fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat " + filename + "!");
+    }
+
+    void* mapping = ::mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map " + filename + "!");
+    }
+
+    m_data = static_cast<std::byte*>(mapping);
+    m_size = static_cast<std::size_t>(info.st_size);
+}
+ 
+MappedFile::~MappedFile() {
+    close();
+}
+ 
+MappedFile::MappedFile(MappedFile&& other) noexcept:
+    m_data(std::exchange(other.m_data, nullptr)),
+    m_size(std::exchange(other.m_size, 0))
+{ }
+ 
+MappedFile& MappedFile::operator =(MappedFile&& other) noexcept {
+    if(this != &other) {
+        close();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+    return *this;
+}
+ 
+void MappedFile::close() {
+    if(m_data) {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+ 
+void MappedFile::advise_will_need(std::size_t offset, std::size_t length) const {
+    if(offset >= m_size) {
+        return;
+    }
+    std::size_t page = page_size();
+    std::size_t start = offset - offset % page;
+    ::madvise(m_data + start, std::min(length, m_size - offset) + (offset - start), MADV_WILLNEED);
+}
+ 
+uint32_t MappedFile::fault_in(std::size_t offset, std::size_t length) const {
+    // Touch one byte per page so the page cache is populated on the calling
+    // thread. The running sum keeps the reads from being optimized away.
+    if(offset >= m_size) {
+        return 0;
+    }
+    std::size_t page = page_size();
+    std::size_t end = offset + std::min(length, m_size - offset);
+    const volatile std::byte* data = m_data;
+    uint32_t sum = 0;
+    for(std::size_t i = offset; i < end; i += page) {
+        sum += static_cast<uint32_t>(data[i]);
+    }
+    return sum;
+}
+ 
+std::size_t MappedFile::page_size() {
+    static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+}
@@ -0,0 +1,38 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are faulted in lazily by the
+// kernel, so callers that care about where the disk reads happen should call
+// fault_in() from the thread that is allowed to block.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator =(const MappedFile& other) = delete;
+    MappedFile& operator =(MappedFile&& other) noexcept;
+
+    bool is_open() const { return m_data != nullptr; }
+    const std::byte* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+    void advise_will_need(std::size_t offset, std::size_t length) const;
+    uint32_t fault_in(std::size_t offset, std::size_t length) const;
+
+    static std::size_t page_size();
+
+private:
+    void close();
+
+    std::byte* m_data = nullptr;
+    std::size_t m_size = 0;
+};
+
+#endif
@@ -0,0 +1,178 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+const char* memory_category_name(MemoryCategory category) {
+    switch(category) {
+        case MemoryCategory::Geometry: return "geometry";
+        case MemoryCategory::Terrain: return "terrain";
+        case MemoryCategory::Uniforms: return "uniforms";
+        case MemoryCategory::Staging: return "staging";
+        case MemoryCategory::RenderTargets: return "render targets";
+        case MemoryCategory::Textures: return "textures";
+        case MemoryCategory::Readback: return "readback";
+        case MemoryCategory::Other: return "other";
+        default: return "unknown";
+    }
+}
+ 
+const char* memory_pressure_name(MemoryPressure pressure) {
+    switch(pressure) {
+        case MemoryPressure::None: return "none";
+        case MemoryPressure::Moderate: return "moderate";
+        case MemoryPressure::Critical: return "critical";
+        default: return "unknown";
+    }
+}
+ 
+MemoryBudget::MemoryBudget(VkPhysicalDevice physical_device, bool budget_extension):
+    m_physical_device(physical_device),
+    m_budget_extension(budget_extension)
+{
+    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_properties);
+    m_heaps.resize(m_properties.memoryHeapCount);
+    m_heap_categories.resize(m_properties.memoryHeapCount);
+    update();
+}
+ 
+uint32_t MemoryBudget::select_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties,
+        VkDeviceSize size) const {
+    // Prefer the first matching type whose heap still has room; only fall
+    // back to an over budget heap when no matching heap has any.
+    uint32_t fallback = UINT32_MAX;
+    for(uint32_t i = 0; i < m_properties.memoryTypeCount; ++i) {
+        if(!(type_filter & (1u << i)) || (m_properties.memoryTypes[i].propertyFlags & properties) != properties) {
+            continue;
+        }
+        uint32_t heap = m_properties.memoryTypes[i].heapIndex;
+        if(heap_usage(heap) + size <= m_heaps[heap].budget) {
+            return i;
+        }
+        if(fallback == UINT32_MAX) {
+            fallback = i;
+        }
+    }
+    if(fallback == UINT32_MAX) {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+    return fallback;
+}
+ 
+bool MemoryBudget::has_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+    for(uint32_t i = 0; i < m_properties.memoryTypeCount; ++i) {
+        if((type_filter & (1u << i)) && (m_properties.memoryTypes[i].propertyFlags & properties) == properties) {
+            return true;
+        }
+    }
+    return false;
+}
+ 
+void MemoryBudget::record_allocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size,
+        MemoryCategory category) {
+    uint32_t heap = heap_of_type(memory_type);
+    m_allocations[memory] = AllocationRecord{heap, size, category};
+    m_heaps[heap].tracked += size;
+    auto& totals = m_heap_categories[heap][static_cast<std::size_t>(category)];
+    totals.bytes += size;
+    totals.allocations += 1;
+}
+ 
+void MemoryBudget::record_free(VkDeviceMemory memory) {
+    auto it = m_allocations.find(memory);
+    if(it == m_allocations.end()) {
+        return;
+    }
+    const auto& record = it->second;
+    m_heaps[record.heap].tracked -= record.size;
+    auto& totals = m_heap_categories[record.heap][static_cast<std::size_t>(record.category)];
+    totals.bytes -= record.size;
+    totals.allocations -= 1;
+    m_allocations.erase(it);
+}
+ 
+std::size_t MemoryBudget::add_listener(PressureFunction listener) {
+    m_listeners.push_back(std::move(listener));
+    return m_listeners.size() - 1;
+}
+ 
+void MemoryBudget::remove_listener(std::size_t id) {
+    m_listeners[id] = nullptr;
+}
+ 
+void MemoryBudget::update() {
+    if(m_budget_extension) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        VkPhysicalDeviceMemoryProperties2 properties = {};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget;
+        vkGetPhysicalDeviceMemoryProperties2(m_physical_device, &properties);
+        for(uint32_t i = 0; i < m_heaps.size(); ++i) {
+            m_heaps[i].budget = budget.heapBudget[i];
+            m_heaps[i].driver_usage = budget.heapUsage[i];
+        }
+    } else {
+        for(uint32_t i = 0; i < m_heaps.size(); ++i) {
+            m_heaps[i].budget = static_cast<VkDeviceSize>(m_properties.memoryHeaps[i].size * FALLBACK_BUDGET_FRACTION);
+        }
+    }
+
+    for(uint32_t i = 0; i < m_heaps.size(); ++i) {
+        auto& heap = m_heaps[i];
+        VkDeviceSize usage = heap_usage(i);
+        double ratio = heap.budget == 0 ? 0.0 : static_cast<double>(usage) / heap.budget;
+        MemoryPressure pressure = MemoryPressure::None;
+        if(ratio >= CRITICAL_THRESHOLD) {
+            pressure = MemoryPressure::Critical;
+        } else if(ratio >= MODERATE_THRESHOLD) {
+            pressure = MemoryPressure::Moderate;
+        }
+
+        bool notify = pressure != heap.pressure || pressure == MemoryPressure::Critical;
+        heap.pressure = pressure;
+        if(!notify) {
+            continue;
+        }
+        auto target = static_cast<VkDeviceSize>(heap.budget * MODERATE_THRESHOLD);
+        VkDeviceSize excess = usage > target ? usage - target : 0;
+        for(const auto& listener : m_listeners) {
+            if(listener) {
+                listener(i, pressure, excess);
+            }
+        }
+    }
+}
+ 
+VkDeviceSize MemoryBudget::heap_usage(uint32_t heap) const {
+    // The driver figure lags behind allocations made since the last update,
+    // so never report less than what is tracked here.
+    return std::max(m_heaps[heap].driver_usage, m_heaps[heap].tracked);
+}
+ 
+VkDeviceSize MemoryBudget::category_bytes(MemoryCategory category) const {
+    VkDeviceSize total = 0;
+    for(const auto& categories : m_heap_categories) {
+        total += categories[static_cast<std::size_t>(category)].bytes;
+    }
+    return total;
+}
+ 
+void MemoryBudget::report(std::ostream& stream) const {
+    constexpr double MB = 1024.0 * 1024.0;
+    stream << "Device memory (" << (m_budget_extension ? "VK_EXT_memory_budget" : "tracked") << "):\n";
+    for(uint32_t i = 0; i < m_heaps.size(); ++i) {
+        const auto& heap = m_heaps[i];
+        stream << "\tHeap " << i << ": " << heap_usage(i) / MB << " / " << heap.budget / MB << " MB budget, "
+            << heap.tracked / MB << " MB ours, pressure " << memory_pressure_name(heap.pressure) << "\n";
+        for(std::size_t c = 0; c < CATEGORY_COUNT; ++c) {
+            const auto& totals = m_heap_categories[i][c];
+            if(totals.allocations == 0) {
+                continue;
+            }
+            stream << "\t\t|> " << memory_category_name(static_cast<MemoryCategory>(c)) << ": "
+                << totals.bytes / MB << " MB in " << totals.allocations << " allocations\n";
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef MEMORY_BUDGET_H_
+#define MEMORY_BUDGET_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+enum class MemoryCategory {
+    Geometry,
+    Terrain,
+    Uniforms,
+    Staging,
+    RenderTargets,
+    Textures,
+    Readback,
+    Other,
+    Count,
+};
+
+const char* memory_category_name(MemoryCategory category);
+
+enum class MemoryPressure {
+    None,
+    Moderate,
+    Critical,
+};
+
+const char* memory_pressure_name(MemoryPressure pressure);
+
+// Tracks device memory per heap and per category and compares it against
+// the heap budgets. With VK_EXT_memory_budget the driver reported budget and
+// usage (which include other processes) are used, otherwise the budget is a
+// fixed fraction of the heap size and usage is what was recorded here.
+//
+// update() re-reads the budgets and notifies listeners of heaps whose
+// pressure level changed, or that are still critical, with the number of
+// bytes that would have to be released to get back under the moderate
+// threshold. Listeners run on the calling thread.
+class MemoryBudget {
+public:
+    using PressureFunction = std::function<void(uint32_t heap, MemoryPressure pressure, VkDeviceSize excess)>;
+
+    static constexpr double FALLBACK_BUDGET_FRACTION = 0.8;
+    static constexpr double MODERATE_THRESHOLD = 0.8;
+    static constexpr double CRITICAL_THRESHOLD = 0.95;
+
+    MemoryBudget(VkPhysicalDevice physical_device, bool budget_extension);
+    ~MemoryBudget() = default;
+
+    MemoryBudget(const MemoryBudget& other) = delete;
+    MemoryBudget(MemoryBudget&& other) noexcept = delete;
+    MemoryBudget& operator =(const MemoryBudget& other) = delete;
+    MemoryBudget& operator =(MemoryBudget&& other) noexcept = delete;
+
+    uint32_t select_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties, VkDeviceSize size) const;
+    bool has_memory_type(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    uint32_t heap_of_type(uint32_t memory_type) const { return m_properties.memoryTypes[memory_type].heapIndex; }
+
+    void record_allocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size, MemoryCategory category);
+    void record_free(VkDeviceMemory memory);
+
+    std::size_t add_listener(PressureFunction listener);
+    void remove_listener(std::size_t id);
+    void update();
+
+    uint32_t heap_count() const { return m_properties.memoryHeapCount; }
+    VkDeviceSize heap_budget(uint32_t heap) const { return m_heaps[heap].budget; }
+    VkDeviceSize heap_usage(uint32_t heap) const;
+    MemoryPressure heap_pressure(uint32_t heap) const { return m_heaps[heap].pressure; }
+    VkDeviceSize category_bytes(MemoryCategory category) const;
+    bool uses_budget_extension() const { return m_budget_extension; }
+
+    void report(std::ostream& stream) const;
+
+private:
+    struct HeapState {
+        VkDeviceSize budget = 0;
+        VkDeviceSize driver_usage = 0;
+        VkDeviceSize tracked = 0;
+        MemoryPressure pressure = MemoryPressure::None;
+    };
+
+    struct AllocationRecord {
+        uint32_t heap;
+        VkDeviceSize size;
+        MemoryCategory category;
+    };
+
+    struct CategoryTotals {
+        VkDeviceSize bytes = 0;
+        uint64_t allocations = 0;
+    };
+
+    static constexpr std::size_t CATEGORY_COUNT = static_cast<std::size_t>(MemoryCategory::Count);
+    using CategoryArray = std::array<CategoryTotals, CATEGORY_COUNT>;
+
+    VkPhysicalDevice m_physical_device;
+    bool m_budget_extension;
+    VkPhysicalDeviceMemoryProperties m_properties;
+
+    std::vector<HeapState> m_heaps;
+    std::vector<CategoryArray> m_heap_categories;
+    std::unordered_map<VkDeviceMemory, AllocationRecord> m_allocations;
+
+    std::vector<PressureFunction> m_listeners;
+};
+
+#endif
@@ -0,0 +1,378 @@
+#include "MeshCodec.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESH_CODEC_SSE 1
+#endif
+
+// Values per packed row; one row is one 128 bit register.
+static constexpr std::size_t LANES = 8;
+static constexpr std::size_t ROWS = MeshCodec::BLOCK_SIZE / LANES;
+static constexpr std::size_t VERTEX_CHANNELS = 7;
+
+struct MeshBlobHeader {
+    uint32_t vertex_count;
+    uint32_t index_count;
+    float position_min[3];
+    float position_step[3];
+};
+static_assert(sizeof(MeshBlobHeader) == 32, "MeshBlobHeader layout is part of the blob format");
+
+struct HeightfieldBlobHeader {
+    uint32_t width;
+    uint32_t height;
+};
+static_assert(sizeof(HeightfieldBlobHeader) == 8, "HeightfieldBlobHeader layout is part of the blob format");
+
+struct StreamHeader {
+    uint32_t count;
+    uint32_t stride;
+    uint32_t bytes;
+};
+static_assert(sizeof(StreamHeader) == 12, "StreamHeader layout is part of the blob format");
+
+// Precedes the 16 * width bytes of every block.
+struct BlockHeader {
+    int16_t reference;
+    uint8_t width;
+    uint8_t reserved;
+};
+static_assert(sizeof(BlockHeader) == 4, "BlockHeader layout is part of the blob format");
+
+
+template <typename T>
+static void append(std::vector<std::byte>& out, const T& value) {
+    std::size_t offset = out.size();
+    out.resize(offset + sizeof(T));
+    std::memcpy(out.data() + offset, &value, sizeof(T));
+}
+ 
+template <typename T>
+static const std::byte* read(const std::byte* data, const std::byte* end, T& value) {
+    if(static_cast<std::size_t>(end - data) < sizeof(T)) {
+        throw std::runtime_error("Compressed data is truncated!");
+    }
+    std::memcpy(&value, data, sizeof(T));
+    return data + sizeof(T);
+}
+ 
+static uint32_t bit_width(uint32_t value) {
+    uint32_t width = 0;
+    while(value != 0) {
+        width += 1;
+        value >>= 1;
+    }
+    return width;
+}
+ 
+static void encode_blocks(const uint16_t* values, std::size_t count, uint32_t stride, std::vector<std::byte>& out) {
+    std::size_t header_offset = out.size();
+    append(out, StreamHeader{static_cast<uint32_t>(count), stride, 0});
+
+    for(std::size_t first = 0; first < count; first += MeshCodec::BLOCK_SIZE) {
+        std::size_t block_count = std::min(MeshCodec::BLOCK_SIZE, count - first);
+        std::array<int16_t, MeshCodec::BLOCK_SIZE> deltas;
+        int32_t low = std::numeric_limits<int32_t>::max();
+        int32_t high = std::numeric_limits<int32_t>::min();
+        for(std::size_t i = 0; i < block_count; ++i) {
+            std::size_t j = first + i;
+            uint16_t previous = j >= stride ? values[j - stride] : 0;
+            deltas[i] = static_cast<int16_t>(static_cast<uint16_t>(values[j] - previous));
+            low = std::min<int32_t>(low, deltas[i]);
+            high = std::max<int32_t>(high, deltas[i]);
+        }
+        // Padding after the last value packs as zero.
+        std::fill(deltas.begin() + block_count, deltas.end(), static_cast<int16_t>(low));
+
+        uint32_t width = bit_width(static_cast<uint32_t>(high - low));
+        append(out, BlockHeader{static_cast<int16_t>(low), static_cast<uint8_t>(width), 0});
+
+        std::array<std::array<uint16_t, LANES>, 16> words = {};
+        for(std::size_t row = 0; row < ROWS && width > 0; ++row) {
+            uint32_t bit = static_cast<uint32_t>(row) * width;
+            uint32_t word = bit / 16;
+            uint32_t shift = bit % 16;
+            for(std::size_t lane = 0; lane < LANES; ++lane) {
+                auto offset = static_cast<uint16_t>(deltas[row * LANES + lane] - low);
+                words[word][lane] |= static_cast<uint16_t>(offset << shift);
+                if(shift + width > 16) {
+                    words[word + 1][lane] |= static_cast<uint16_t>(offset >> (16 - shift));
+                }
+            }
+        }
+        for(uint32_t word = 0; word < width; ++word) {
+            append(out, words[word]);
+        }
+    }
+
+    StreamHeader header = {static_cast<uint32_t>(count), stride,
+        static_cast<uint32_t>(out.size() - header_offset - sizeof(StreamHeader))};
+    std::memcpy(out.data() + header_offset, &header, sizeof(header));
+}
+ 
+bool MeshCodec::simd_supported() {
+#ifdef MESH_CODEC_SSE
+    return true;
+#else
+    return false;
+#endif
+}
+ 
+MeshCodec::MeshCodec(bool simd):
+    m_simd(simd && simd_supported())
+{ }
+ 
+void MeshCodec::encode_stream(const uint16_t* values, std::size_t count, const std::vector<uint32_t>& strides,
+        std::vector<std::byte>& out) {
+    // Ties keep the earlier stride, so callers list the ones that decode
+    // with SIMD first.
+    std::vector<std::byte> best;
+    std::vector<std::byte> candidate;
+    for(uint32_t stride : strides) {
+        if(stride == 0 || (stride >= count && stride != 1)) {
+            continue;
+        }
+        candidate.clear();
+        encode_blocks(values, count, stride, candidate);
+        if(best.empty() || candidate.size() < best.size()) {
+            std::swap(best, candidate);
+        }
+    }
+    if(best.empty()) {
+        encode_blocks(values, count, 1, best);
+    }
+    out.insert(out.end(), best.begin(), best.end());
+}
+ 
+void MeshCodec::encode_mesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices,
+        uint32_t grid_width, std::vector<std::byte>& out) {
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(std::numeric_limits<float>::lowest());
+    for(const auto& vertex : vertices) {
+        low = glm::min(low, vertex.pos);
+        high = glm::max(high, vertex.pos);
+    }
+
+    MeshBlobHeader header = {};
+    header.vertex_count = static_cast<uint32_t>(vertices.size());
+    header.index_count = static_cast<uint32_t>(indices.size());
+    for(int axis = 0; axis < 3 && !vertices.empty(); ++axis) {
+        header.position_min[axis] = low[axis];
+        header.position_step[axis] = (high[axis] - low[axis]) / 65535.0f;
+    }
+    append(out, header);
+
+    std::vector<uint16_t> channel(vertices.size());
+    std::vector<uint32_t> strides = {1, grid_width};
+    for(std::size_t c = 0; c < VERTEX_CHANNELS; ++c) {
+        for(std::size_t i = 0; i < vertices.size(); ++i) {
+            if(c < 3) {
+                float step = header.position_step[c];
+                float q = step > 0.0f ? (vertices[i].pos[c] - header.position_min[c]) / step : 0.0f;
+                channel[i] = static_cast<uint16_t>(std::lround(std::clamp(q, 0.0f, 65535.0f)));
+            } else {
+                float value = std::clamp(vertices[i].color[c - 3], 0.0f, 1.0f);
+                channel[i] = static_cast<uint16_t>(std::lround(value * 255.0f));
+            }
+        }
+        encode_stream(channel.data(), channel.size(), strides, out);
+    }
+
+    // Triangle lists walk grids one quad (six indices) at a time, which
+    // strides of two and four quads pick up.
+    encode_stream(indices.data(), indices.size(), {1, 12, 24, 3, 6}, out);
+}
+ 
+void MeshCodec::encode_heightfield(const uint16_t* samples, uint32_t width, uint32_t height,
+        std::vector<std::byte>& out) {
+    append(out, HeightfieldBlobHeader{width, height});
+    encode_stream(samples, std::size_t{width} * height, {1, width}, out);
+}
+ 
+void MeshCodec::mesh_counts(const std::byte* data, std::size_t size, uint32_t& vertex_count, uint32_t& index_count) {
+    MeshBlobHeader header;
+    read(data, data + size, header);
+    vertex_count = header.vertex_count;
+    index_count = header.index_count;
+}
+ 
+void MeshCodec::unpack_block(const std::byte* data, uint32_t width, uint16_t reference, uint16_t* deltas) const {
+    if(width == 0) {
+        std::fill(deltas, deltas + BLOCK_SIZE, reference);
+        return;
+    }
+    uint16_t mask = static_cast<uint16_t>(width == 16 ? 0xFFFF : (1u << width) - 1);
+
+#ifdef MESH_CODEC_SSE
+    if(m_simd) {
+        __m128i mask_lanes = _mm_set1_epi16(static_cast<int16_t>(mask));
+        __m128i reference_lanes = _mm_set1_epi16(static_cast<int16_t>(reference));
+        for(std::size_t row = 0; row < ROWS; ++row) {
+            uint32_t bit = static_cast<uint32_t>(row) * width;
+            uint32_t word = bit / 16;
+            uint32_t shift = bit % 16;
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + word);
+            __m128i value = _mm_srl_epi16(low, _mm_cvtsi32_si128(static_cast<int>(shift)));
+            if(shift + width > 16) {
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + word + 1);
+                value = _mm_or_si128(value, _mm_sll_epi16(high, _mm_cvtsi32_si128(static_cast<int>(16 - shift))));
+            }
+            value = _mm_add_epi16(_mm_and_si128(value, mask_lanes), reference_lanes);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(deltas + row * LANES), value);
+        }
+        return;
+    }
+#endif
+
+    for(std::size_t row = 0; row < ROWS; ++row) {
+        uint32_t bit = static_cast<uint32_t>(row) * width;
+        uint32_t word = bit / 16;
+        uint32_t shift = bit % 16;
+        for(std::size_t lane = 0; lane < LANES; ++lane) {
+            uint16_t low;
+            std::memcpy(&low, data + (word * LANES + lane) * sizeof(uint16_t), sizeof(low));
+            uint32_t value = low >> shift;
+            if(shift + width > 16) {
+                uint16_t high;
+                std::memcpy(&high, data + ((word + 1) * LANES + lane) * sizeof(uint16_t), sizeof(high));
+                value |= uint32_t{high} << (16 - shift);
+            }
+            deltas[row * LANES + lane] = static_cast<uint16_t>((value & mask) + reference);
+        }
+    }
+}
+ 
+void MeshCodec::undo_deltas(const uint16_t* deltas, std::size_t first, uint32_t stride, uint16_t* values) const {
+    std::size_t i = 0;
+#ifdef MESH_CODEC_SSE
+    if(m_simd && stride == 1) {
+        // Prefix sum of each row in three shifted adds, plus the last value
+        // of the row before.
+        __m128i carry = _mm_set1_epi16(first > 0 ? static_cast<int16_t>(values[first - 1]) : 0);
+        for(; i < BLOCK_SIZE; i += LANES) {
+            __m128i sum = _mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i));
+            sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 2));
+            sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 4));
+            sum = _mm_add_epi16(sum, _mm_slli_si128(sum, 8));
+            sum = _mm_add_epi16(sum, carry);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + first + i), sum);
+            carry = _mm_shufflehi_epi16(sum, 0xFF);
+            carry = _mm_unpackhi_epi64(carry, carry);
+        }
+        return;
+    }
+    if(m_simd && stride >= LANES) {
+        // A row only depends on values at least a row earlier.
+        for(; i < BLOCK_SIZE && first + i < stride; ++i) {
+            values[first + i] = deltas[i];
+        }
+        for(; i + LANES <= BLOCK_SIZE; i += LANES) {
+            std::size_t j = first + i;
+            __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + j - stride));
+            __m128i delta = _mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(values + j), _mm_add_epi16(previous, delta));
+        }
+    }
+#endif
+    for(; i < BLOCK_SIZE; ++i) {
+        std::size_t j = first + i;
+        uint16_t previous = j >= stride ? values[j - stride] : 0;
+        values[j] = static_cast<uint16_t>(previous + deltas[i]);
+    }
+}
+ 
+const std::byte* MeshCodec::decode_stream(const std::byte* data, const std::byte* end, uint16_t* values,
+        std::size_t capacity, std::size_t& count) const {
+    StreamHeader header;
+    data = read(data, end, header);
+    if(header.stride == 0 || padded(header.count) > capacity) {
+        throw std::runtime_error("Compressed stream does not fit its destination!");
+    }
+    if(static_cast<std::size_t>(end - data) < header.bytes) {
+        throw std::runtime_error("Compressed data is truncated!");
+    }
+    end = data + header.bytes;
+
+    alignas(16) std::array<uint16_t, BLOCK_SIZE> deltas;
+    for(std::size_t first = 0; first < header.count; first += BLOCK_SIZE) {
+        BlockHeader block;
+        data = read(data, end, block);
+        std::size_t block_bytes = std::size_t{block.width} * LANES * sizeof(uint16_t);
+        if(block.width > 16 || static_cast<std::size_t>(end - data) < block_bytes) {
+            throw std::runtime_error("Compressed block is malformed!");
+        }
+        unpack_block(data, block.width, static_cast<uint16_t>(block.reference), deltas.data());
+        undo_deltas(deltas.data(), first, header.stride, values);
+        data += block_bytes;
+    }
+    count = header.count;
+    return end;
+}
+ 
+void MeshCodec::decode_mesh(const std::byte* data, std::size_t size, Vertex* vertices, std::size_t vertex_capacity,
+        uint16_t* indices, std::size_t index_capacity) {
+    const std::byte* end = data + size;
+    MeshBlobHeader header;
+    data = read(data, end, header);
+    if(header.vertex_count > vertex_capacity || header.index_count > index_capacity) {
+        throw std::runtime_error("Compressed mesh does not fit its destination!");
+    }
+
+    std::size_t stride = padded(header.vertex_count);
+    m_channels.resize(stride * VERTEX_CHANNELS);
+    for(std::size_t c = 0; c < VERTEX_CHANNELS; ++c) {
+        std::size_t count;
+        data = decode_stream(data, end, m_channels.data() + c * stride, stride, count);
+        if(count != header.vertex_count) {
+            throw std::runtime_error("Compressed mesh channel has the wrong length!");
+        }
+    }
+    m_indices.resize(padded(header.index_count));
+    std::size_t index_count;
+    decode_stream(data, end, m_indices.data(), m_indices.size(), index_count);
+    if(index_count != header.index_count) {
+        throw std::runtime_error("Compressed mesh index stream has the wrong length!");
+    }
+
+    // Whole vertices, written in order, so write combined memory sees full
+    // lines.
+    glm::vec3 position_min(header.position_min[0], header.position_min[1], header.position_min[2]);
+    glm::vec3 position_step(header.position_step[0], header.position_step[1], header.position_step[2]);
+    const uint16_t* x = m_channels.data();
+    const uint16_t* color = m_channels.data() + 3 * stride;
+    constexpr float COLOR_SCALE = 1.0f / 255.0f;
+    for(std::size_t i = 0; i < header.vertex_count; ++i) {
+        Vertex vertex;
+        vertex.pos = position_min + position_step * glm::vec3(static_cast<float>(x[i]), 
+            static_cast<float>(x[stride + i]), static_cast<float>(x[2 * stride + i]));
+        vertex.color = glm::vec4(static_cast<float>(color[i]), static_cast<float>(color[stride + i]), 
+            static_cast<float>(color[2 * stride + i]), static_cast<float>(color[3 * stride + i])) * COLOR_SCALE;
+        std::memcpy(vertices + i, &vertex, sizeof(Vertex));
+    }
+    std::memcpy(indices, m_indices.data(), header.index_count * sizeof(uint16_t));
+}
+ 
+void MeshCodec::decode_heightfield(const std::byte* data, std::size_t size, uint16_t* samples, std::size_t capacity) {
+    const std::byte* end = data + size;
+    HeightfieldBlobHeader header;
+    data = read(data, end, header);
+    std::size_t sample_count = std::size_t{header.width} * header.height;
+    if(sample_count > capacity) {
+        throw std::runtime_error("Compressed heightfield does not fit its destination!");
+    }
+
+    m_channels.resize(padded(sample_count));
+    std::size_t count;
+    decode_stream(data, end, m_channels.data(), m_channels.size(), count);
+    if(count != sample_count) {
+        throw std::runtime_error("Compressed heightfield has the wrong size!");
+    }
+    std::memcpy(samples, m_channels.data(), sample_count * sizeof(uint16_t));
+}
@@ -0,0 +1,76 @@
+#ifndef MESH_CODEC_H_
+#define MESH_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "RenderTypes.h"
+
+// Compression for vertex, index and heightfield data.
+//
+// Everything is coded as streams of 16 bit values. Each value is stored as
+// the difference to the value `stride` positions earlier, in blocks of 128
+// differences: a block keeps its smallest difference and packs every other
+// one's offset from it with just enough bits for the largest. Bits are laid
+// out lane by lane so that eight values unpack with a handful of SSE2
+// instructions. The encoder tries a few strides per stream (e.g. one grid
+// row) and keeps the shortest result; strides of 1 and of 8 or more also
+// undo the differences with SIMD, others fall back to scalar code.
+//
+// Mesh positions are quantized to 16 bits across the mesh's bounding box and
+// colors to 8 bits per channel; indices and heightfield samples are kept
+// exactly.
+//
+// Encoding is static. Decoding needs scratch memory, so every thread that
+// decodes keeps its own MeshCodec.
+class MeshCodec {
+public:
+    static constexpr std::size_t BLOCK_SIZE = 128;
+
+    static bool simd_supported();
+
+    explicit MeshCodec(bool simd = simd_supported());
+    ~MeshCodec() = default;
+
+    MeshCodec(const MeshCodec& other) = default;
+    MeshCodec(MeshCodec&& other) noexcept = default;
+    MeshCodec& operator =(const MeshCodec& other) = default;
+    MeshCodec& operator =(MeshCodec&& other) noexcept = default;
+
+    // Append to out. A non-zero grid_width, the length of the vertex rows
+    // when the mesh is a grid, is tried as a stride for every channel.
+    static void encode_mesh(const std::vector<Vertex>& vertices, const std::vector<uint16_t>& indices,
+        uint32_t grid_width, std::vector<std::byte>& out);
+    static void encode_heightfield(const uint16_t* samples, uint32_t width, uint32_t height,
+        std::vector<std::byte>& out);
+    static void encode_stream(const uint16_t* values, std::size_t count, const std::vector<uint32_t>& strides,
+        std::vector<std::byte>& out);
+
+    static void mesh_counts(const std::byte* data, std::size_t size, uint32_t& vertex_count, uint32_t& index_count);
+
+    // Decode into caller memory, which is only ever written, front to back,
+    // so it may be mapped staging memory. Throw when the data is malformed
+    // or does not fit the given capacities.
+    void decode_mesh(const std::byte* data, std::size_t size, Vertex* vertices, std::size_t vertex_capacity,
+        uint16_t* indices, std::size_t index_capacity);
+    void decode_heightfield(const std::byte* data, std::size_t size, uint16_t* samples, std::size_t capacity);
+    // Decodes one stream into values, which needs room for its count rounded
+    // up to whole blocks (see padded()); returns the end of the stream.
+    const std::byte* decode_stream(const std::byte* data, const std::byte* end, uint16_t* values,
+        std::size_t capacity, std::size_t& count) const;
+
+    static std::size_t padded(std::size_t count) { return (count + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE; }
+
+    bool simd() const { return m_simd; }
+
+private:
+    void unpack_block(const std::byte* data, uint32_t width, uint16_t reference, uint16_t* deltas) const;
+    void undo_deltas(const uint16_t* deltas, std::size_t first, uint32_t stride, uint16_t* values) const;
+
+    bool m_simd;
+    std::vector<uint16_t> m_channels;
+    std::vector<uint16_t> m_indices;
+};
+
+#endif
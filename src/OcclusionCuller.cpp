@@ -0,0 +1,86 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <stdexcept>
+
+
+void OcclusionCuller::set_pyramid(uint32_t viewport_width, uint32_t viewport_height, const std::vector<Level>& levels,
+        const float* depths, std::size_t depth_count) {
+    for(const auto& level : levels) {
+        if(level.texel_pixels == 0 || level.offset + std::size_t{level.width} * level.height > depth_count) {
+            throw std::runtime_error("Depth pyramid level is out of range!");
+        }
+    }
+    m_viewport_width = viewport_width;
+    m_viewport_height = viewport_height;
+    m_levels.assign(levels.begin(), levels.end());
+    m_depths.assign(depths, depths + depth_count);
+}
+ 
+void OcclusionCuller::clear() {
+    m_levels.clear();
+    m_depths.clear();
+}
+ 
+OcclusionResult OcclusionCuller::test(const glm::mat4& clip, const glm::vec3& min, const glm::vec3& max) const {
+    float min_x = FLT_MAX;
+    float min_y = FLT_MAX;
+    float max_x = -FLT_MAX;
+    float max_y = -FLT_MAX;
+    float nearest = FLT_MAX;
+    for(uint32_t corner = 0; corner < 8; ++corner) {
+        glm::vec4 position((corner & 1) ? max.x : min.x, (corner & 2) ? max.y : min.y, (corner & 4) ? max.z : min.z,
+            1.0f);
+        glm::vec4 projected = clip * position;
+        // Parts in front of the near plane have no screen rectangle to test.
+        if(projected.w <= 0.0f || projected.z < 0.0f) {
+            return OcclusionResult::Visible;
+        }
+        float x = projected.x / projected.w;
+        float y = projected.y / projected.w;
+        min_x = std::min(min_x, x);
+        min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x);
+        max_y = std::max(max_y, y);
+        nearest = std::min(nearest, projected.z / projected.w);
+    }
+
+    if(max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f || nearest > 1.0f) {
+        return OcclusionResult::Outside;
+    }
+    if(m_levels.empty()) {
+        return OcclusionResult::Visible;
+    }
+
+    // Screen rectangle in whole pixels, clamped to the viewport.
+    auto to_pixel = [](float ndc, uint32_t size) {
+        float pixel = (ndc * 0.5f + 0.5f) * size;
+        return static_cast<uint32_t>(std::clamp(pixel, 0.0f, static_cast<float>(size - 1)));
+    };
+    uint32_t left = to_pixel(min_x, m_viewport_width);
+    uint32_t right = to_pixel(max_x, m_viewport_width);
+    uint32_t top = to_pixel(min_y, m_viewport_height);
+    uint32_t bottom = to_pixel(max_y, m_viewport_height);
+
+    for(std::size_t i = 0; i < m_levels.size(); ++i) {
+        const auto& level = m_levels[i];
+        uint32_t x0 = std::min(left / level.texel_pixels, level.width - 1);
+        uint32_t x1 = std::min(right / level.texel_pixels, level.width - 1);
+        uint32_t y0 = std::min(top / level.texel_pixels, level.height - 1);
+        uint32_t y1 = std::min(bottom / level.texel_pixels, level.height - 1);
+        if((x1 - x0 > 1 || y1 - y0 > 1) && i + 1 < m_levels.size()) {
+            continue;
+        }
+
+        float farthest = 0.0f;
+        for(uint32_t y = y0; y <= y1; ++y) {
+            const float* row = m_depths.data() + level.offset + std::size_t{y} * level.width;
+            for(uint32_t x = x0; x <= x1; ++x) {
+                farthest = std::max(farthest, row[x]);
+            }
+        }
+        return nearest > farthest ? OcclusionResult::Occluded : OcclusionResult::Visible;
+    }
+    return OcclusionResult::Visible;
+}
@@ -0,0 +1,60 @@
+#ifndef OCCLUSION_CULLER_H_
+#define OCCLUSION_CULLER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+enum class OcclusionResult {
+    Visible,
+    Outside,
+    Occluded,
+};
+
+// Tests world space boxes against a conservative depth pyramid, as built by
+// HiZPyramid: each texel of a level holds the farthest depth of the pixels
+// it covers. A box is occluded when its nearest depth lies behind the
+// farthest depth of every texel its screen rectangle touches; the test uses
+// the finest level on which that rectangle spans at most 2x2 texels.
+//
+// Depths follow the Vulkan convention of z / w in [0, 1] with 1 the far
+// plane. Boxes reaching in front of the near plane are always visible.
+class OcclusionCuller {
+public:
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        // Viewport pixels covered by one texel along each axis.
+        uint32_t texel_pixels;
+        std::size_t offset;
+    };
+
+    OcclusionCuller() = default;
+    ~OcclusionCuller() = default;
+
+    OcclusionCuller(const OcclusionCuller& other) = default;
+    OcclusionCuller(OcclusionCuller&& other) noexcept = default;
+    OcclusionCuller& operator =(const OcclusionCuller& other) = default;
+    OcclusionCuller& operator =(OcclusionCuller&& other) noexcept = default;
+
+    // Levels ordered from fine to coarse, their texels stored row-major at
+    // their offset into depths.
+    // Copied into storage kept from the previous pyramid.
+    void set_pyramid(uint32_t viewport_width, uint32_t viewport_height, const std::vector<Level>& levels,
+        const float* depths, std::size_t depth_count);
+    void clear();
+    bool ready() const { return !m_levels.empty(); }
+
+    // Without a pyramid every box inside the view frustum is visible.
+    OcclusionResult test(const glm::mat4& clip, const glm::vec3& min, const glm::vec3& max) const;
+
+private:
+    uint32_t m_viewport_width = 0;
+    uint32_t m_viewport_height = 0;
+    std::vector<Level> m_levels;
+    std::vector<float> m_depths;
+};
+
+#endif
@@ -0,0 +1,407 @@
+#include "PipelineManager.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "RenderTypes.h"
+
+
+bool PipelineState::operator ==(const PipelineState& other) const {
+    return vertex_shader == other.vertex_shader && 
+        tessellation_control_shader == other.tessellation_control_shader && 
+        tessellation_evaluation_shader == other.tessellation_evaluation_shader && 
+        fragment_shader == other.fragment_shader && specialization == other.specialization && 
+        vertex_input == other.vertex_input && topology == other.topology && 
+        patch_control_points == other.patch_control_points && polygon_mode == other.polygon_mode && 
+        cull_mode == other.cull_mode && depth_test == other.depth_test && depth_write == other.depth_write && 
+        blend == other.blend && color_write == other.color_write;
+}
+ 
+std::size_t PipelineStateHash::operator ()(const PipelineState& state) const {
+    auto combine = [](std::size_t seed, std::size_t value) {
+        return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+    };
+
+    std::hash<std::string> hash_string;
+    std::size_t seed = hash_string(state.vertex_shader);
+    seed = combine(seed, hash_string(state.tessellation_control_shader));
+    seed = combine(seed, hash_string(state.tessellation_evaluation_shader));
+    seed = combine(seed, hash_string(state.fragment_shader));
+    for(uint32_t value : state.specialization) {
+        seed = combine(seed, value);
+    }
+    uint64_t packed = (static_cast<uint64_t>(state.topology) << 32) | (static_cast<uint64_t>(state.polygon_mode) << 16) 
+        | (static_cast<uint64_t>(state.cull_mode) << 8) | (state.patch_control_points & 0xff);
+    uint64_t flags = (state.vertex_input ? 1 : 0) | (state.depth_test ? 2 : 0) | (state.depth_write ? 4 : 0) 
+        | (state.blend ? 8 : 0) | (state.color_write ? 16 : 0);
+    seed = combine(seed, std::hash<uint64_t>()(packed));
+    return combine(seed, std::hash<uint64_t>()(flags));
+}
+ 
+std::vector<char> PipelineManager::load_shader_file(const std::string& filename) {
+    std::ifstream file(filename, std::ios::binary | std::ios::in);
+    if(!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    file.seekg(0, std::ios::end);
+    auto size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::vector<char> data(size);
+    file.read(data.data(), data.size());
+
+    return data;
+}
+ 
+PipelineManager::PipelineManager(VkDevice device, ShaderLoader loader, std::size_t thread_count,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_host_allocator(host_allocator),
+    m_loader(std::move(loader))
+{
+    VkPipelineCacheCreateInfo cacheInfo = {};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    if(vkCreatePipelineCache(m_device, &cacheInfo, m_host_allocator, &m_cache) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline cache!");
+    }
+
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for(std::size_t i = 0; i < thread_count; ++i) {
+        m_workers.emplace_back(&PipelineManager::worker_main, this);
+    }
+}
+ 
+PipelineManager::~PipelineManager() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(auto& worker : m_workers) {
+        worker.join();
+    }
+
+    for(const auto& [state, variant] : m_variants) {
+        vkDestroyPipeline(m_device, variant.pipeline, m_host_allocator);
+    }
+    for(const auto& [filename, module] : m_shaders) {
+        vkDestroyShaderModule(m_device, module, m_host_allocator);
+    }
+    vkDestroyPipelineCache(m_device, m_cache, m_host_allocator);
+}
+ 
+void PipelineManager::set_target(VkRenderPass render_pass, VkPipelineLayout layout) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_compiling == 0; });
+
+    for(const auto& [state, variant] : m_variants) {
+        vkDestroyPipeline(m_device, variant.pipeline, m_host_allocator);
+    }
+    m_variants.clear();
+    m_queue.clear();
+    m_target = {render_pass, layout};
+}
+ 
+VkPipeline PipelineManager::prepare(const PipelineState& state) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_variants.find(state);
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(it == m_variants.end() || it->second.status == VariantStatus::Queued) {
+        pipeline = compile_locked(lock, state, false);
+    } else {
+        pipeline = wait_locked(lock, state);
+    }
+    if(pipeline == VK_NULL_HANDLE) {
+        throw std::runtime_error("Failed to create pipeline!");
+    }
+    return pipeline;
+}
+ 
+void PipelineManager::request(const PipelineState& state) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_variants.count(state) > 0) {
+            return;
+        }
+        m_variants.emplace(state, Variant{});
+        m_queue.push_back(state);
+    }
+    m_wake.notify_one();
+}
+ 
+VkPipeline PipelineManager::get(const PipelineState& state, const PipelineState& fallback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_variants.find(state);
+    if(it != m_variants.end() && it->second.status == VariantStatus::Ready) {
+        return it->second.pipeline;
+    }
+    if(it == m_variants.end()) {
+        m_variants.emplace(state, Variant{});
+        m_queue.push_back(state);
+        m_wake.notify_one();
+    }
+
+    auto fallback_it = m_variants.find(fallback);
+    if(fallback_it != m_variants.end() && fallback_it->second.status == VariantStatus::Ready) {
+        m_stats.fallbacks += 1;
+        return fallback_it->second.pipeline;
+    }
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    if(m_variants[state].status == VariantStatus::Queued) {
+        pipeline = compile_locked(lock, state, true);
+    } else {
+        m_stats.hitches += 1;
+        pipeline = wait_locked(lock, state);
+    }
+    if(pipeline == VK_NULL_HANDLE) {
+        throw std::runtime_error("Neither pipeline variant nor its fallback could be created!");
+    }
+    return pipeline;
+}
+ 
+VkPipeline PipelineManager::compile_locked(std::unique_lock<std::mutex>& lock, const PipelineState& state, 
+        bool hitch) {
+    // Still in m_queue when it was queued; workers skip it once compiling.
+    m_variants[state].status = VariantStatus::Compiling;
+    m_compiling += 1;
+    Target target = m_target;
+    if(hitch) {
+        m_stats.hitches += 1;
+    }
+    lock.unlock();
+
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        pipeline = build(state, target);
+    } catch(const std::exception& error) {
+        std::cout << "Pipeline variant failed: " << error.what() << "\n";
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    lock.lock();
+    auto& variant = m_variants[state];
+    variant.pipeline = pipeline;
+    variant.status = pipeline != VK_NULL_HANDLE ? VariantStatus::Ready : VariantStatus::Failed;
+    if(pipeline != VK_NULL_HANDLE) {
+        record_compile(std::chrono::duration<double, std::milli>(end - start).count());
+    } else {
+        m_stats.failed += 1;
+    }
+    m_compiling -= 1;
+    m_done.notify_all();
+    return pipeline;
+}
+ 
+VkPipeline PipelineManager::wait_locked(std::unique_lock<std::mutex>& lock, const PipelineState& state) {
+    m_done.wait(lock, [&]() { return m_variants[state].status != VariantStatus::Compiling; });
+    return m_variants[state].pipeline;
+}
+ 
+void PipelineManager::record_compile(double milliseconds) {
+    m_stats.compiled += 1;
+    m_stats.compile_ms += milliseconds;
+    m_stats.max_compile_ms = std::max(m_stats.max_compile_ms, milliseconds);
+}
+ 
+uint64_t PipelineManager::generation() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_generation;
+}
+ 
+std::size_t PipelineManager::variant_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_variants.size();
+}
+ 
+PipelineStats PipelineManager::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+ 
+void PipelineManager::report(std::ostream& stream) const {
+    PipelineStats stats = this->stats();
+    stream << "Pipelines: " << variant_count() << " variants, " << stats.compiled << " compiled (" 
+        << stats.background_compiles << " in the background), " << stats.failed << " failed\n";
+    stream << "\t|> Compile time: " << (stats.compiled > 0 ? stats.compile_ms / stats.compiled : 0.0) 
+        << " ms mean, " << stats.max_compile_ms << " ms max\n";
+    stream << "\t|> Hitches: " << stats.hitches << ", fallback binds: " << stats.fallbacks << "\n";
+}
+ 
+VkShaderModule PipelineManager::shader_module(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(m_shader_mutex);
+    auto it = m_shaders.find(filename);
+    if(it != m_shaders.end()) {
+        return it->second;
+    }
+
+    auto data = m_loader(filename);
+    VkShaderModuleCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = data.size();
+    createInfo.pCode = reinterpret_cast<const uint32_t*>(data.data());
+    VkShaderModule module;
+    if(vkCreateShaderModule(m_device, &createInfo, m_host_allocator, &module) != VK_SUCCESS) {
+        throw std::runtime_error("Unable to create shader module " + filename + "!");
+    }
+    m_shaders.emplace(filename, module);
+    return module;
+}
+ 
+VkPipeline PipelineManager::build(const PipelineState& state, const Target& target) {
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    for(uint32_t i = 0; i < state.specialization.size(); ++i) {
+        specializationEntries.push_back({i, static_cast<uint32_t>(i * sizeof(uint32_t)), sizeof(uint32_t)});
+    }
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = state.specialization.size() * sizeof(uint32_t);
+    specializationInfo.pData = state.specialization.data();
+
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+    auto add_stage = [&](VkShaderStageFlagBits stage, const std::string& filename) {
+        if(filename.empty()) {
+            return;
+        }
+        VkPipelineShaderStageCreateInfo stageInfo = {};
+        stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        stageInfo.stage = stage;
+        stageInfo.module = shader_module(filename);
+        stageInfo.pName = "main";
+        stageInfo.pSpecializationInfo = state.specialization.empty() ? nullptr : &specializationInfo;
+        stages.push_back(stageInfo);
+    };
+    add_stage(VK_SHADER_STAGE_VERTEX_BIT, state.vertex_shader);
+    add_stage(VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, state.tessellation_control_shader);
+    add_stage(VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, state.tessellation_evaluation_shader);
+    add_stage(VK_SHADER_STAGE_FRAGMENT_BIT, state.fragment_shader);
+
+    auto binding_desc = Vertex::binding_desc();
+    auto attrib_desc = Vertex::attrib_desc();
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    if(state.vertex_input) {
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &binding_desc;
+        vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attrib_desc.size());
+        vertexInputInfo.pVertexAttributeDescriptions = attrib_desc.data();
+    }
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = state.topology;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineTessellationStateCreateInfo tessellationState = {};
+    tessellationState.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    tessellationState.patchControlPoints = state.patch_control_points;
+
+    // Viewport and scissor are set while recording, so one variant serves
+    // every render resolution.
+    VkPipelineViewportStateCreateInfo viewportState = {};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.scissorCount = 1;
+
+    std::array<VkDynamicState, 2> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+    dynamicState.pDynamicStates = dynamicStates.data();
+
+    VkPipelineRasterizationStateCreateInfo rasterizer = {};
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = state.polygon_mode;
+    rasterizer.lineWidth = 1.0f;
+    rasterizer.cullMode = state.cull_mode;
+    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+
+    VkPipelineMultisampleStateCreateInfo multisampling = {};
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.minSampleShading = 1.0f;
+
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {};
+    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencil.depthTestEnable = state.depth_test ? VK_TRUE : VK_FALSE;
+    depthStencil.depthWriteEnable = state.depth_write ? VK_TRUE : VK_FALSE;
+    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+    depthStencil.depthBoundsTestEnable = VK_FALSE;
+    depthStencil.stencilTestEnable = VK_FALSE;
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+    colorBlendAttachment.colorWriteMask = state.color_write ? 
+        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT : 0;
+    colorBlendAttachment.blendEnable = state.blend ? VK_TRUE : VK_FALSE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending = {};
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY;
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+
+    VkGraphicsPipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = static_cast<uint32_t>(stages.size());
+    pipelineInfo.pStages = stages.data();
+    pipelineInfo.pTessellationState = state.patch_control_points > 0 ? &tessellationState : nullptr;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = &depthStencil;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = &dynamicState;
+    pipelineInfo.layout = target.layout;
+    pipelineInfo.renderPass = target.render_pass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkPipeline pipeline;
+    if(vkCreateGraphicsPipelines(m_device, m_cache, 1, &pipelineInfo, m_host_allocator, &pipeline) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create pipeline!");
+    }
+    return pipeline;
+}
+ 
+void PipelineManager::worker_main() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true) {
+        m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+        if(m_stopping) {
+            return;
+        }
+
+        PipelineState state = std::move(m_queue.front());
+        m_queue.pop_front();
+        auto it = m_variants.find(state);
+        if(it == m_variants.end() || it->second.status != VariantStatus::Queued) {
+            continue;
+        }
+        if(compile_locked(lock, state, false) != VK_NULL_HANDLE) {
+            m_stats.background_compiles += 1;
+            m_generation += 1;
+        }
+    }
+}
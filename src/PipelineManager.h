@@ -0,0 +1,143 @@
+#ifndef PIPELINE_MANAGER_H_
+#define PIPELINE_MANAGER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// Everything that distinguishes one graphics pipeline variant from another.
+// Shaders are named by their SPIR-V file; an empty name leaves the stage out.
+struct PipelineState {
+    std::string vertex_shader;
+    std::string tessellation_control_shader;
+    std::string tessellation_evaluation_shader;
+    std::string fragment_shader;
+    // Values of specialization constants 0..n-1, given to every stage.
+    std::vector<uint32_t> specialization;
+    // Whether vertices come from a Vertex buffer or are pulled by index.
+    bool vertex_input = true;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    uint32_t patch_control_points = 0;
+    VkPolygonMode polygon_mode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+    bool depth_test = true;
+    bool depth_write = true;
+    bool blend = false;
+    bool color_write = true;
+
+    bool operator ==(const PipelineState& other) const;
+    bool operator !=(const PipelineState& other) const { return !(*this == other); }
+};
+
+struct PipelineStateHash {
+    std::size_t operator ()(const PipelineState& state) const;
+};
+
+struct PipelineStats {
+    uint64_t compiled = 0;
+    uint64_t background_compiles = 0;
+    // Compiles the render thread had to wait for inside a frame.
+    uint64_t hitches = 0;
+    uint64_t fallbacks = 0;
+    uint64_t failed = 0;
+    double compile_ms = 0.0;
+    double max_compile_ms = 0.0;
+};
+
+// Builds and owns graphics pipeline variants keyed by PipelineState. Missing
+// variants are compiled by a pool of worker threads while callers draw with
+// a fallback variant; generation() changes whenever one finishes so
+// prerecorded command buffers know to pick it up. All variants share one
+// VkPipelineCache and target the render pass and layout given to
+// set_target(); viewport and scissor are dynamic state.
+class PipelineManager {
+public:
+    using ShaderLoader = std::function<std::vector<char>(const std::string& filename)>;
+
+    PipelineManager(VkDevice device, ShaderLoader loader, std::size_t thread_count,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    ~PipelineManager();
+
+    PipelineManager(const PipelineManager& other) = delete;
+    PipelineManager(PipelineManager&& other) noexcept = delete;
+    PipelineManager& operator =(const PipelineManager& other) = delete;
+    PipelineManager& operator =(PipelineManager&& other) noexcept = delete;
+
+    // Reads a SPIR-V file; the loader the renderer and benchmarks pass in.
+    static std::vector<char> load_shader_file(const std::string& filename);
+
+    // Waits for compiles in flight and drops every variant built for the
+    // previous target. The pipeline cache keeps rebuilding them cheap.
+    void set_target(VkRenderPass render_pass, VkPipelineLayout layout);
+
+    // Compiles on the calling thread unless already done. Meant for setup,
+    // so it does not count as a hitch; throws when compilation fails.
+    VkPipeline prepare(const PipelineState& state);
+    // Queues a background compile unless the variant is known already.
+    void request(const PipelineState& state);
+    // The variant if it is ready. Otherwise it is queued and the fallback
+    // returned; only when the fallback is not ready either does the calling
+    // thread compile, or wait for, the variant, which counts as a hitch.
+    VkPipeline get(const PipelineState& state, const PipelineState& fallback);
+
+    uint64_t generation() const;
+    std::size_t variant_count() const;
+    PipelineStats stats() const;
+    void report(std::ostream& stream) const;
+
+private:
+    enum class VariantStatus {
+        Queued,
+        Compiling,
+        Ready,
+        Failed,
+    };
+
+    struct Variant {
+        VariantStatus status = VariantStatus::Queued;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+    };
+
+    struct Target {
+        VkRenderPass render_pass = VK_NULL_HANDLE;
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+    };
+
+    VkPipeline compile_locked(std::unique_lock<std::mutex>& lock, const PipelineState& state, bool hitch);
+    VkPipeline wait_locked(std::unique_lock<std::mutex>& lock, const PipelineState& state);
+    VkPipeline build(const PipelineState& state, const Target& target);
+    VkShaderModule shader_module(const std::string& filename);
+    void record_compile(double milliseconds);
+    void worker_main();
+
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_host_allocator;
+    ShaderLoader m_loader;
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    Target m_target;
+    std::unordered_map<PipelineState, Variant, PipelineStateHash> m_variants;
+    std::deque<PipelineState> m_queue;
+    std::size_t m_compiling = 0;
+    uint64_t m_generation = 0;
+    PipelineStats m_stats;
+    std::vector<std::thread> m_workers;
+    bool m_stopping = false;
+
+    std::mutex m_shader_mutex;
+    std::unordered_map<std::string, VkShaderModule> m_shaders;
+};
+
+#endif
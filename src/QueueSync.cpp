@@ -0,0 +1,306 @@
+#include "QueueSync.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+
+template <typename Duration>
+static double milliseconds(Duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+
+bool QueueSync::supported(VkPhysicalDevice physical_device) {
+    uint32_t extension_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, nullptr);
+    std::vector<VkExtensionProperties> extensions(extension_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extension_count, extensions.data());
+
+    bool has_extension = false;
+    for(const auto& extension : extensions) {
+        if(std::strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0) {
+            has_extension = true;
+        }
+    }
+    if(!has_extension) {
+        return false;
+    }
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline = {};
+    timeline.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    VkPhysicalDeviceFeatures2 features = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features.pNext = &timeline;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features);
+    return timeline.timelineSemaphore == VK_TRUE;
+}
+ 
+QueueSync::QueueSync(VkDevice device, bool timeline, const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_timeline(timeline),
+    m_host_allocator(host_allocator)
+{
+    if(m_timeline) {
+        m_wait_semaphores =
+            (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr(m_device, "vkWaitSemaphoresKHR");
+        m_get_counter_value =
+            (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr(m_device, "vkGetSemaphoreCounterValueKHR");
+        if(!m_wait_semaphores || !m_get_counter_value) {
+            throw std::runtime_error("Failed to load timeline semaphore functions!");
+        }
+    }
+}
+ 
+QueueSync::~QueueSync() {
+    for(auto& queue : m_queues) {
+        for(const auto& submission : queue.in_flight) {
+            vkDestroyFence(m_device, submission.fence, m_host_allocator);
+        }
+        if(queue.semaphore != VK_NULL_HANDLE) {
+            vkDestroySemaphore(m_device, queue.semaphore, m_host_allocator);
+        }
+    }
+    for(VkFence fence : m_free_fences) {
+        vkDestroyFence(m_device, fence, m_host_allocator);
+    }
+}
+ 
+uint32_t QueueSync::add_queue(const std::string& name, VkQueue queue) {
+    Queue added;
+    added.name = name;
+    added.queue = queue;
+    if(m_timeline) {
+        VkSemaphoreTypeCreateInfo typeInfo = {};
+        typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = 0;
+        VkSemaphoreCreateInfo semaphoreInfo = {};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphoreInfo.pNext = &typeInfo;
+        if(vkCreateSemaphore(m_device, &semaphoreInfo, m_host_allocator, &added.semaphore) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timeline semaphore!");
+        }
+    }
+    m_queues.push_back(std::move(added));
+    return static_cast<uint32_t>(m_queues.size() - 1);
+}
+ 
+SyncPoint QueueSync::submit(uint32_t queue_index, const SyncSubmission& submission) {
+    if(submission.wait_count > MAX_WAITS) {
+        throw std::runtime_error("Too many waits in one submission!");
+    }
+    auto& queue = m_queues[queue_index];
+
+    // Room for the waits and the binary semaphore.
+    std::array<VkSemaphore, MAX_WAITS + 1> wait_semaphores;
+    std::array<uint64_t, MAX_WAITS + 1> wait_values;
+    std::array<VkPipelineStageFlags, MAX_WAITS + 1> wait_stages;
+    uint32_t wait_count = 0;
+    auto now = Clock::now();
+    for(uint32_t i = 0; i < submission.wait_count; ++i) {
+        const auto& wait = submission.waits[i];
+        if(wait.point.value == 0) {
+            continue;
+        }
+        if(wait.point.value > m_queues[wait.point.queue].submitted) {
+            throw std::runtime_error("Cannot wait on a sync point that was never submitted!");
+        }
+        bool cross_queue = wait.point.queue != queue_index;
+        bool pending = !reached(wait.point);
+        if(cross_queue) {
+            queue.stats.cross_queue_waits += 1;
+            queue.stats.blocking_waits += pending ? 1 : 0;
+        }
+
+        if(m_timeline) {
+            // Reached points are still waited on, the wait is what makes
+            // their writes visible to this submission.
+            wait_semaphores[wait_count] = m_queues[wait.point.queue].semaphore;
+            wait_values[wait_count] = wait.point.value;
+            wait_stages[wait_count] = wait.stages;
+            wait_count += 1;
+            if(cross_queue && pending) {
+                m_blocked.push_back({queue_index, wait.point, now});
+            }
+        } else if(pending) {
+            // Fences only signal the host, so the queue waits by not being
+            // submitted to yet.
+            auto start = Clock::now();
+            this->wait(wait.point);
+            if(cross_queue) {
+                queue.stats.blocked_ms += milliseconds(Clock::now() - start);
+            }
+        }
+    }
+    if(submission.wait_semaphore != VK_NULL_HANDLE) {
+        wait_semaphores[wait_count] = submission.wait_semaphore;
+        wait_values[wait_count] = 0;
+        wait_stages[wait_count] = submission.wait_semaphore_stages;
+        wait_count += 1;
+    }
+
+    uint64_t value = queue.submitted + 1;
+    std::array<VkSemaphore, 2> signal_semaphores;
+    std::array<uint64_t, 2> signal_values;
+    uint32_t signal_count = 0;
+    if(m_timeline) {
+        signal_semaphores[signal_count] = queue.semaphore;
+        signal_values[signal_count] = value;
+        signal_count += 1;
+    }
+    if(submission.signal_semaphore != VK_NULL_HANDLE) {
+        signal_semaphores[signal_count] = submission.signal_semaphore;
+        signal_values[signal_count] = 0;
+        signal_count += 1;
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount = wait_count;
+    timelineInfo.pWaitSemaphoreValues = wait_values.data();
+    timelineInfo.signalSemaphoreValueCount = signal_count;
+    timelineInfo.pSignalSemaphoreValues = signal_values.data();
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pNext = m_timeline ? &timelineInfo : nullptr;
+    submitInfo.waitSemaphoreCount = wait_count;
+    submitInfo.pWaitSemaphores = wait_semaphores.data();
+    submitInfo.pWaitDstStageMask = wait_stages.data();
+    submitInfo.commandBufferCount = submission.command_buffer_count;
+    submitInfo.pCommandBuffers = submission.command_buffers;
+    submitInfo.signalSemaphoreCount = signal_count;
+    submitInfo.pSignalSemaphores = signal_semaphores.data();
+
+    VkFence fence = m_timeline ? VK_NULL_HANDLE : take_fence();
+    if(vkQueueSubmit(queue.queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to submit to the " + queue.name + " queue!");
+    }
+    if(fence != VK_NULL_HANDLE) {
+        queue.in_flight.push_back({value, fence});
+    }
+    queue.submitted = value;
+    queue.stats.submissions += 1;
+    return {queue_index, value};
+}
+ 
+bool QueueSync::reached(SyncPoint point) {
+    if(point.value <= m_queues[point.queue].completed) {
+        return true;
+    }
+    poll(point.queue);
+    return point.value <= m_queues[point.queue].completed;
+}
+ 
+void QueueSync::wait(SyncPoint point) {
+    if(reached(point)) {
+        return;
+    }
+    auto& queue = m_queues[point.queue];
+    auto start = Clock::now();
+    if(m_timeline) {
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &queue.semaphore;
+        waitInfo.pValues = &point.value;
+        if(m_wait_semaphores(m_device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to wait for the " + queue.name + " queue!");
+        }
+        queue.completed = std::max(queue.completed, point.value);
+        update_blocked();
+    } else {
+        // Submissions signal consecutive values, so the one to wait for is
+        // found by its distance to the oldest.
+        const auto& submission = queue.in_flight[point.value - queue.in_flight.front().value];
+        if(vkWaitForFences(m_device, 1, &submission.fence, VK_TRUE, std::numeric_limits<uint64_t>::max())
+                != VK_SUCCESS) {
+            throw std::runtime_error("Failed to wait for the " + queue.name + " queue!");
+        }
+        poll(point.queue);
+    }
+    queue.stats.host_waits += 1;
+    queue.stats.host_wait_ms += milliseconds(Clock::now() - start);
+}
+ 
+void QueueSync::update() {
+    for(uint32_t queue = 0; queue < m_queues.size(); ++queue) {
+        poll(queue);
+    }
+}
+ 
+void QueueSync::report(std::ostream& stream) const {
+    stream << "Queue sync (" << (m_timeline ? "timeline semaphores" : "fences") << "): " << m_queues.size()
+        << " queues, " << m_fence_count << " fences\n";
+    for(const auto& queue : m_queues) {
+        const auto& stats = queue.stats;
+        stream << "\t|> " << queue.name << ": " << stats.submissions << " submissions, "
+            << stats.cross_queue_waits << " cross-queue waits (" << stats.blocking_waits << " blocking, at most "
+            << stats.blocked_ms << " ms blocked), host waited " << stats.host_wait_ms << " ms in "
+            << stats.host_waits << " waits\n";
+    }
+}
+ 
+void QueueSync::poll(uint32_t queue_index) {
+    auto& queue = m_queues[queue_index];
+    if(m_timeline) {
+        uint64_t value;
+        if(m_get_counter_value(m_device, queue.semaphore, &value) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to read the " + queue.name + " queue's timeline!");
+        }
+        queue.completed = std::max(queue.completed, value);
+    } else {
+        // One queue signals its fences in submission order, so the first
+        // submission still running ends the search.
+        std::size_t completed = 0;
+        while(completed < queue.in_flight.size()
+                && vkGetFenceStatus(m_device, queue.in_flight[completed].fence) == VK_SUCCESS) {
+            completed += 1;
+        }
+        if(completed > 0) {
+            queue.completed = queue.in_flight[completed - 1].value;
+            retire_fences(queue, completed);
+        }
+    }
+    update_blocked();
+}
+ 
+void QueueSync::retire_fences(Queue& queue, std::size_t count) {
+    for(std::size_t i = 0; i < count; ++i) {
+        vkResetFences(m_device, 1, &queue.in_flight[i].fence);
+        m_free_fences.push_back(queue.in_flight[i].fence);
+    }
+    queue.in_flight.erase(queue.in_flight.begin(), queue.in_flight.begin() + count);
+}
+ 
+void QueueSync::update_blocked() {
+    auto now = Clock::now();
+    auto done = std::remove_if(m_blocked.begin(), m_blocked.end(), [&](const Blocked& blocked) {
+        if(blocked.point.value > m_queues[blocked.point.queue].completed) {
+            return false;
+        }
+        m_queues[blocked.queue].stats.blocked_ms += milliseconds(now - blocked.since);
+        return true;
+    });
+    m_blocked.erase(done, m_blocked.end());
+}
+ 
+VkFence QueueSync::take_fence() {
+    if(!m_free_fences.empty()) {
+        VkFence fence = m_free_fences.back();
+        m_free_fences.pop_back();
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    if(vkCreateFence(m_device, &fenceInfo, m_host_allocator, &fence) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create submission fence!");
+    }
+    m_fence_count += 1;
+    return fence;
+}
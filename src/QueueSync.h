@@ -0,0 +1,131 @@
+#ifndef QUEUE_SYNC_H_
+#define QUEUE_SYNC_H_
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// A value on one queue's timeline. Every submission to a queue signals the
+// next value, so a point is reached once the submission that signaled it and
+// everything submitted to the queue before it have completed. Value 0 is
+// reached from the start and stands for "nothing to wait on".
+struct SyncPoint {
+    uint32_t queue = 0;
+    uint64_t value = 0;
+};
+
+struct SyncWait {
+    SyncPoint point;
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+};
+
+// Binary semaphores are only for presentation, which cannot wait on timeline
+// values; work on the device synchronizes through waits.
+struct SyncSubmission {
+    const VkCommandBuffer* command_buffers = nullptr;
+    uint32_t command_buffer_count = 0;
+    const SyncWait* waits = nullptr;
+    uint32_t wait_count = 0;
+    VkSemaphore wait_semaphore = VK_NULL_HANDLE;
+    VkPipelineStageFlags wait_semaphore_stages = 0;
+    VkSemaphore signal_semaphore = VK_NULL_HANDLE;
+};
+
+struct QueueSyncStats {
+    uint64_t submissions = 0;
+    // Waits on other queues, and those still running when submitted.
+    uint64_t cross_queue_waits = 0;
+    uint64_t blocking_waits = 0;
+    // From submission until the host saw the dependency reached, so an
+    // upper bound of the time the queue sat blocked.
+    double blocked_ms = 0.0;
+    uint64_t host_waits = 0;
+    double host_wait_ms = 0.0;
+};
+
+// Submits work to the device's queues and tracks its completion as
+// SyncPoints. With VK_KHR_timeline_semaphore every queue has one timeline
+// semaphore that its submissions signal and others wait on. Without it each
+// submission gets a fence instead, and waits on points that are not reached
+// yet are resolved on the host before submitting.
+//
+// Not thread safe.
+class QueueSync {
+public:
+    static constexpr uint32_t MAX_WAITS = 8;
+
+    static bool supported(VkPhysicalDevice physical_device);
+
+    QueueSync(VkDevice device, bool timeline, const VkAllocationCallbacks* host_allocator = nullptr);
+    // The device has to be idle.
+    ~QueueSync();
+
+    QueueSync(const QueueSync& other) = delete;
+    QueueSync(QueueSync&& other) noexcept = delete;
+    QueueSync& operator =(const QueueSync& other) = delete;
+    QueueSync& operator =(QueueSync&& other) noexcept = delete;
+
+    // Returns the index submissions refer to the queue by.
+    uint32_t add_queue(const std::string& name, VkQueue queue);
+
+    SyncPoint submit(uint32_t queue, const SyncSubmission& submission);
+
+    // Never blocks.
+    bool reached(SyncPoint point);
+    void wait(SyncPoint point);
+    // Polls every queue, so recycled fences and blocked time stay current.
+    void update();
+
+    bool timeline() const { return m_timeline; }
+    SyncPoint last_submitted(uint32_t queue) const { return {queue, m_queues[queue].submitted}; }
+    const QueueSyncStats& stats(uint32_t queue) const { return m_queues[queue].stats; }
+
+    void report(std::ostream& stream) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct InFlight {
+        uint64_t value;
+        VkFence fence;
+    };
+
+    struct Queue {
+        std::string name;
+        VkQueue queue;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        // Oldest first, fence mode only.
+        std::vector<InFlight> in_flight;
+        QueueSyncStats stats;
+    };
+
+    struct Blocked {
+        uint32_t queue;
+        SyncPoint point;
+        Clock::time_point since;
+    };
+
+    void poll(uint32_t queue);
+    void retire_fences(Queue& queue, std::size_t count);
+    void update_blocked();
+    VkFence take_fence();
+
+    VkDevice m_device;
+    bool m_timeline;
+    const VkAllocationCallbacks* m_host_allocator;
+    PFN_vkWaitSemaphoresKHR m_wait_semaphores = nullptr;
+    PFN_vkGetSemaphoreCounterValueKHR m_get_counter_value = nullptr;
+
+    std::vector<Queue> m_queues;
+    std::vector<Blocked> m_blocked;
+    std::vector<VkFence> m_free_fences;
+    std::size_t m_fence_count = 0;
+};
+
+#endif
@@ -0,0 +1,581 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+static constexpr VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+    | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT
+    | VK_ACCESS_MEMORY_WRITE_BIT;
+
+
+static bool same_desc(const RenderGraphImageDesc& a, const RenderGraphImageDesc& b) {
+    return a.format == b.format && a.extent.width == b.extent.width && a.extent.height == b.extent.height
+        && a.usage == b.usage && a.aspect == b.aspect && a.layers == b.layers;
+}
+
+
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::read(Resource resource, VkPipelineStageFlags stages,
+        VkAccessFlags access, VkImageLayout layout) {
+    m_graph.add_access(m_pass, resource, stages, access, layout, false);
+    return *this;
+}
+ 
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::write(Resource resource, VkPipelineStageFlags stages,
+        VkAccessFlags access, VkImageLayout layout) {
+    m_graph.add_access(m_pass, resource, stages, access, layout, true);
+    return *this;
+}
+ 
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::side_effects() {
+    m_graph.m_passes[m_pass].side_effects = true;
+    return *this;
+}
+ 
+RenderGraph::PassBuilder& RenderGraph::PassBuilder::execute(ExecuteFunction function) {
+    m_graph.m_passes[m_pass].execute = std::move(function);
+    return *this;
+}
+ 
+RenderGraph::RenderGraph(VkDevice device, AllocateFunction allocate, ReleaseFunction release,
+        const VkAllocationCallbacks* host_allocator):
+    m_device(device),
+    m_host_allocator(host_allocator),
+    m_allocate(std::move(allocate)),
+    m_release(std::move(release))
+{ }
+ 
+RenderGraph::~RenderGraph() {
+    release_transients();
+}
+ 
+RenderGraph::Resource RenderGraph::import_image(const std::string& name, VkImage image, VkImageView view,
+        const RenderGraphImageDesc& desc, VkImageLayout initial_layout, VkPipelineStageFlags initial_stages,
+        VkImageLayout final_layout) {
+    ResourceNode node;
+    node.name = name;
+    node.kind = ResourceKind::Image;
+    node.imported = true;
+    node.desc = desc;
+    node.image = image;
+    node.view = view;
+    node.initial_layout = initial_layout;
+    node.initial_stages = initial_stages;
+    node.final_layout = final_layout;
+    m_resources.push_back(std::move(node));
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+ 
+RenderGraph::Resource RenderGraph::import_buffer(const std::string& name, VkBuffer buffer) {
+    ResourceNode node;
+    node.name = name;
+    node.kind = ResourceKind::Buffer;
+    node.imported = true;
+    node.buffer = buffer;
+    m_resources.push_back(std::move(node));
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+ 
+RenderGraph::Resource RenderGraph::create_image(const std::string& name, const RenderGraphImageDesc& desc) {
+    ResourceNode node;
+    node.name = name;
+    node.kind = ResourceKind::Image;
+    node.desc = desc;
+    m_resources.push_back(std::move(node));
+    return static_cast<Resource>(m_resources.size() - 1);
+}
+ 
+RenderGraph::PassBuilder RenderGraph::add_pass(const std::string& name) {
+    if(m_compiled) {
+        throw std::runtime_error("Cannot add passes to a compiled render graph!");
+    }
+    PassNode pass;
+    pass.name = name;
+    m_passes.push_back(std::move(pass));
+    return PassBuilder(*this, m_passes.size() - 1);
+}
+ 
+void RenderGraph::add_access(std::size_t pass, Resource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+        VkImageLayout layout, bool write) {
+    if(resource >= m_resources.size()) {
+        throw std::runtime_error("Render graph pass uses an unknown resource!");
+    }
+    bool is_image = m_resources[resource].kind == ResourceKind::Image;
+    if(is_image && layout == VK_IMAGE_LAYOUT_UNDEFINED) {
+        throw std::runtime_error("Render graph image access needs a layout!");
+    }
+
+    auto& accesses = m_passes[pass].accesses;
+    for(auto& existing : accesses) {
+        if(existing.resource != resource) {
+            continue;
+        }
+        if(is_image && existing.layout != layout) {
+            throw std::runtime_error("Render graph pass uses one image in two layouts!");
+        }
+        existing.stages |= stages;
+        existing.access |= access;
+        existing.read = existing.read || !write;
+        existing.write = existing.write || write;
+        return;
+    }
+    accesses.push_back(Access{resource, stages, access, layout, !write, write});
+}
+ 
+void RenderGraph::compile(const RenderGraph* shared) {
+    if(m_compiled) {
+        throw std::runtime_error("Render graph already compiled!");
+    }
+    cull_passes();
+    if(shared) {
+        share_transients(*shared);
+    } else {
+        allocate_transients();
+    }
+    plan_barriers();
+    m_compiled = true;
+}
+ 
+void RenderGraph::cull_passes() {
+    // Walk backwards from the passes whose output is observable. A resource
+    // is needed while some kept pass later in the frame reads it; a kept pass
+    // that overwrites it without reading ends the need for earlier writers.
+    std::vector<bool> needed(m_resources.size(), false);
+    for(std::size_t p = m_passes.size(); p-- > 0;) {
+        auto& pass = m_passes[p];
+        bool keep = pass.side_effects;
+        for(const auto& access : pass.accesses) {
+            if(access.write && (m_resources[access.resource].imported || needed[access.resource])) {
+                keep = true;
+            }
+        }
+        pass.culled = !keep;
+        if(!keep) {
+            continue;
+        }
+        for(const auto& access : pass.accesses) {
+            if(access.write && !access.read) {
+                needed[access.resource] = false;
+            }
+        }
+        for(const auto& access : pass.accesses) {
+            if(access.read) {
+                needed[access.resource] = true;
+            }
+        }
+    }
+
+    m_order.clear();
+    for(std::size_t p = 0; p < m_passes.size(); ++p) {
+        if(!m_passes[p].culled) {
+            m_order.push_back(p);
+        }
+    }
+    m_stats.passes = m_order.size();
+    m_stats.culled_passes = m_passes.size() - m_order.size();
+
+    // Lifetimes in the order the kept passes run.
+    for(std::size_t k = 0; k < m_order.size(); ++k) {
+        for(const auto& access : m_passes[m_order[k]].accesses) {
+            auto& node = m_resources[access.resource];
+            node.first_use = std::min(node.first_use, k);
+            node.last_use = std::max(node.last_use, k);
+        }
+    }
+}
+ 
+void RenderGraph::allocate_transients() {
+    struct Candidate {
+        Resource resource;
+        VkMemoryRequirements requirements;
+    };
+    std::vector<Candidate> candidates;
+    for(Resource r = 0; r < m_resources.size(); ++r) {
+        auto& node = m_resources[r];
+        if(node.imported || node.kind != ResourceKind::Image || node.first_use == SIZE_MAX) {
+            continue;
+        }
+
+        VkImageCreateInfo imageInfo = {};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = node.desc.format;
+        imageInfo.extent = {node.desc.extent.width, node.desc.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = node.desc.layers;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = node.desc.usage;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if(vkCreateImage(m_device, &imageInfo, m_host_allocator, &node.image) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transient image!");
+        }
+        Candidate candidate;
+        candidate.resource = r;
+        vkGetImageMemoryRequirements(m_device, node.image, &candidate.requirements);
+        candidates.push_back(candidate);
+        m_stats.transient_images += 1;
+        m_stats.transient_bytes += candidate.requirements.size;
+    }
+
+    // Largest first so smaller images fill in behind the blocks they fit in.
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.requirements.size > b.requirements.size;
+    });
+
+    for(const auto& candidate : candidates) {
+        const auto& node = m_resources[candidate.resource];
+        MemoryBlock* target = nullptr;
+        for(auto& block : m_blocks) {
+            if((block.type_bits & candidate.requirements.memoryTypeBits) == 0 || block.size < candidate.requirements.size) {
+                continue;
+            }
+            bool overlaps = false;
+            for(Resource other : block.images) {
+                const auto& placed = m_resources[other];
+                if(node.first_use <= placed.last_use && placed.first_use <= node.last_use) {
+                    overlaps = true;
+                    break;
+                }
+            }
+            if(!overlaps) {
+                target = &block;
+                break;
+            }
+        }
+        if(!target) {
+            target = &m_blocks.emplace_back();
+            target->size = candidate.requirements.size;
+            target->type_bits = candidate.requirements.memoryTypeBits;
+        }
+        target->type_bits &= candidate.requirements.memoryTypeBits;
+        target->images.push_back(candidate.resource);
+    }
+
+    for(auto& block : m_blocks) {
+        std::sort(block.images.begin(), block.images.end(), [this](Resource a, Resource b) {
+            return m_resources[a].first_use < m_resources[b].first_use;
+        });
+        for(std::size_t i = 1; i < block.images.size(); ++i) {
+            auto& node = m_resources[block.images[i]];
+            node.has_alias_predecessor = true;
+            node.alias_predecessor = block.images[i - 1];
+        }
+
+        block.memory = m_allocate(block.size, block.type_bits);
+        m_stats.allocated_bytes += block.size;
+
+        for(Resource r : block.images) {
+            auto& node = m_resources[r];
+            vkBindImageMemory(m_device, node.image, block.memory, 0);
+
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = node.image;
+            viewInfo.viewType = node.desc.layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = node.desc.format;
+            viewInfo.subresourceRange.aspectMask = node.desc.aspect;
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = node.desc.layers;
+            if(vkCreateImageView(m_device, &viewInfo, m_host_allocator, &node.view) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create transient image view!");
+            }
+            for(uint32_t layer = 0; node.desc.layers > 1 && layer < node.desc.layers; ++layer) {
+                viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+                viewInfo.subresourceRange.baseArrayLayer = layer;
+                viewInfo.subresourceRange.layerCount = 1;
+                VkImageView view;
+                if(vkCreateImageView(m_device, &viewInfo, m_host_allocator, &view) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to create transient image view!");
+                }
+                node.layer_views.push_back(view);
+            }
+        }
+    }
+}
+ 
+void RenderGraph::share_transients(const RenderGraph& shared) {
+    // Same lifetimes give the same memory blocks and alias predecessors,
+    // so the shared graph's placement holds for this one's passes too.
+    bool same = shared.m_compiled && !shared.m_shares_transients 
+        && shared.m_resources.size() == m_resources.size();
+    for(Resource r = 0; same && r < m_resources.size(); ++r) {
+        const auto& node = m_resources[r];
+        const auto& other = shared.m_resources[r];
+        same = node.kind == other.kind && node.imported == other.imported;
+        if(same && !node.imported && node.kind == ResourceKind::Image) {
+            same = node.name == other.name && same_desc(node.desc, other.desc) && node.first_use == other.first_use 
+                && node.last_use == other.last_use;
+        }
+    }
+    if(!same) {
+        throw std::runtime_error("Render graph transients differ from the graph they are shared with!");
+    }
+
+    for(Resource r = 0; r < m_resources.size(); ++r) {
+        auto& node = m_resources[r];
+        const auto& other = shared.m_resources[r];
+        if(node.imported || node.kind != ResourceKind::Image) {
+            continue;
+        }
+        node.image = other.image;
+        node.view = other.view;
+        node.layer_views = other.layer_views;
+        node.has_alias_predecessor = other.has_alias_predecessor;
+        node.alias_predecessor = other.alias_predecessor;
+    }
+    m_blocks = shared.m_blocks;
+    m_shares_transients = true;
+    m_stats.transient_images = shared.m_stats.transient_images;
+    m_stats.transient_bytes = shared.m_stats.transient_bytes;
+}
+ 
+void RenderGraph::plan_barriers() {
+    // The previous execution may still run when this one starts. Planning once
+    // finds where it leaves every resource, which the first use of the memory
+    // of each image that starts over has to wait for.
+    std::vector<ResourceState> previous = initial_states();
+    plan_passes(previous);
+    std::vector<ResourceState> states = initial_states();
+    auto wait_for = [&states](Resource r, const ResourceState& last) {
+        states[r].write_stages |= last.write_stages;
+        states[r].write_access |= last.write_access;
+        states[r].read_stages |= last.read_stages;
+    };
+    for(Resource r = 0; r < m_resources.size(); ++r) {
+        if(m_resources[r].imported && m_resources[r].starts_over()) {
+            wait_for(r, previous[r]);
+        }
+    }
+    for(const auto& block : m_blocks) {
+        wait_for(block.images.front(), previous[block.images.back()]);
+    }
+    plan_passes(states);
+
+    for(Resource r = 0; r < m_resources.size(); ++r) {
+        const auto& node = m_resources[r];
+        const auto& state = states[r];
+        if(!node.imported || node.kind != ResourceKind::Image || node.final_layout == VK_IMAGE_LAYOUT_UNDEFINED
+                || node.final_layout == state.layout) {
+            continue;
+        }
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = state.write_access;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = node.final_layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = node.image;
+        barrier.subresourceRange = {node.desc.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        VkPipelineStageFlags src_stages = state.write_stages | state.read_stages;
+        if(src_stages == 0) {
+            src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        m_final_barriers.src_stages |= src_stages;
+        m_final_barriers.dst_stages |= VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        m_final_barriers.images.push_back(barrier);
+    }
+
+    for(auto& batch : m_pass_barriers) {
+        if(!batch.empty() && batch.src_stages == 0) {
+            // Only transitions out of UNDEFINED with nothing to wait for.
+            batch.src_stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        }
+        m_stats.barrier_batches += batch.empty() ? 0 : 1;
+        m_stats.image_barriers += batch.images.size();
+        m_stats.buffer_barriers += batch.buffers.size();
+    }
+    m_stats.barrier_batches += m_final_barriers.empty() ? 0 : 1;
+    m_stats.image_barriers += m_final_barriers.images.size();
+}
+ 
+std::vector<RenderGraph::ResourceState> RenderGraph::initial_states() const {
+    std::vector<ResourceState> states(m_resources.size());
+    for(Resource r = 0; r < m_resources.size(); ++r) {
+        if(m_resources[r].imported) {
+            states[r].layout = m_resources[r].initial_layout;
+            states[r].write_stages = m_resources[r].initial_stages;
+        }
+    }
+    return states;
+}
+ 
+void RenderGraph::plan_passes(std::vector<ResourceState>& states) {
+    m_pass_barriers.assign(m_order.size(), BarrierBatch());
+    for(std::size_t k = 0; k < m_order.size(); ++k) {
+        for(const auto& access : m_passes[m_order[k]].accesses) {
+            const auto& node = m_resources[access.resource];
+            const ResourceState* alias_state = nullptr;
+            if(node.has_alias_predecessor && node.first_use == k) {
+                alias_state = &states[node.alias_predecessor];
+            }
+            plan_access(access, states[access.resource], m_pass_barriers[k], alias_state);
+        }
+    }
+}
+ 
+void RenderGraph::plan_access(const Access& access, ResourceState& state, BarrierBatch& batch,
+        const ResourceState* alias_state) const {
+    const auto& node = m_resources[access.resource];
+    bool is_image = node.kind == ResourceKind::Image;
+    bool transition = is_image && access.layout != state.layout;
+
+    VkPipelineStageFlags src_stages = 0;
+    VkAccessFlags src_access = 0;
+    bool memory_barrier = false;
+
+    if(alias_state) {
+        // First use of memory another transient image just released.
+        src_stages |= alias_state->write_stages | alias_state->read_stages;
+        src_access |= alias_state->write_access;
+    }
+
+    if(transition) {
+        src_stages |= state.write_stages | state.read_stages;
+        src_access |= state.write_access;
+        memory_barrier = true;
+    } else if(access.write) {
+        // Earlier reads were already ordered after the last write, so waiting
+        // for them is enough unless this access also reads.
+        src_stages |= state.read_stages;
+        if(state.write_stages && (!state.read_stages || access.read)) {
+            src_stages |= state.write_stages;
+            src_access |= state.write_access;
+            memory_barrier = true;
+        }
+    } else if(state.write_stages) {
+        bool visible = (state.read_stages & access.stages) == access.stages
+            && (state.read_access & access.access) == access.access;
+        if(!visible) {
+            src_stages |= state.write_stages;
+            src_access |= state.write_access;
+            memory_barrier = true;
+        }
+    }
+
+    if(src_stages != 0 || memory_barrier) {
+        batch.src_stages |= src_stages;
+        batch.dst_stages |= access.stages;
+    }
+    if(memory_barrier && is_image) {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = access.access;
+        barrier.oldLayout = state.layout;
+        barrier.newLayout = access.layout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = node.image;
+        barrier.subresourceRange = {node.desc.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        batch.images.push_back(barrier);
+    } else if(memory_barrier) {
+        VkBufferMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = access.access;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = node.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        batch.buffers.push_back(barrier);
+    }
+
+    if(transition) {
+        state.layout = access.layout;
+    }
+    if(access.write) {
+        state.write_stages = access.stages;
+        state.write_access = access.access & WRITE_ACCESS_MASK;
+        state.read_stages = 0;
+        state.read_access = 0;
+    } else {
+        if(transition) {
+            // The transition itself is a write that completed before this
+            // access; later readers in other stages chain off it.
+            state.write_stages = access.stages;
+            state.write_access = 0;
+            state.read_stages = 0;
+            state.read_access = 0;
+        }
+        state.read_stages |= access.stages;
+        state.read_access |= access.access;
+    }
+}
+ 
+void RenderGraph::execute(VkCommandBuffer command_buffer) const {
+    if(!m_compiled) {
+        throw std::runtime_error("Render graph must be compiled before execution!");
+    }
+
+    auto emit = [command_buffer](const BarrierBatch& batch) {
+        if(batch.empty()) {
+            return;
+        }
+        vkCmdPipelineBarrier(command_buffer, batch.src_stages, batch.dst_stages, 0, 0, nullptr,
+            static_cast<uint32_t>(batch.buffers.size()), batch.buffers.data(),
+            static_cast<uint32_t>(batch.images.size()), batch.images.data());
+    };
+
+    for(std::size_t k = 0; k < m_order.size(); ++k) {
+        emit(m_pass_barriers[k]);
+        const auto& pass = m_passes[m_order[k]];
+        if(pass.execute) {
+            pass.execute(command_buffer);
+        }
+    }
+    emit(m_final_barriers);
+}
+ 
+bool RenderGraph::culled(const std::string& pass) const {
+    for(const auto& node : m_passes) {
+        if(node.name == pass) {
+            return node.culled;
+        }
+    }
+    throw std::runtime_error("Unknown render graph pass!");
+}
+ 
+void RenderGraph::print(std::ostream& stream) const {
+    stream << "Render graph: " << m_stats.passes << " passes (" << m_stats.culled_passes << " culled), "
+        << m_stats.barrier_batches << " barrier batches, " << m_stats.image_barriers << " image / "
+        << m_stats.buffer_barriers << " buffer barriers\n";
+    for(const auto& pass : m_passes) {
+        stream << "\t" << (pass.culled ? "[culled] " : "") << pass.name << "\n";
+    }
+    if(m_stats.transient_images > 0) {
+        stream << "\t|> " << m_stats.transient_images << " transient images, " << m_stats.transient_bytes / 1024
+            << " KB requested, " << m_stats.allocated_bytes / 1024 << " KB allocated\n";
+    }
+}
+ 
+void RenderGraph::release_transients() {
+    if(m_shares_transients) {
+        return;
+    }
+    for(const auto& node : m_resources) {
+        if(node.imported) {
+            continue;
+        }
+        for(VkImageView view : node.layer_views) {
+            vkDestroyImageView(m_device, view, m_host_allocator);
+        }
+        if(node.view != VK_NULL_HANDLE) {
+            vkDestroyImageView(m_device, node.view, m_host_allocator);
+        }
+        if(node.image != VK_NULL_HANDLE) {
+            vkDestroyImage(m_device, node.image, m_host_allocator);
+        }
+    }
+    for(const auto& block : m_blocks) {
+        m_release(block.memory);
+    }
+    m_blocks.clear();
+}
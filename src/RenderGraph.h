@@ -0,0 +1,214 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+struct RenderGraphImageDesc {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkImageUsageFlags usage = 0;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    uint32_t layers = 1;
+};
+
+struct RenderGraphStats {
+    std::size_t passes = 0;
+    std::size_t culled_passes = 0;
+    std::size_t barrier_batches = 0;
+    std::size_t image_barriers = 0;
+    std::size_t buffer_barriers = 0;
+    std::size_t transient_images = 0;
+    VkDeviceSize transient_bytes = 0;
+    VkDeviceSize allocated_bytes = 0;
+};
+
+// Frame graph over a fixed list of passes. Passes declare which resources
+// they read and write and in which pipeline stage, access and layout; on
+// compile() the graph
+//  - culls passes whose results never reach an imported resource or a pass
+//    marked with side effects,
+//  - plans one batched vkCmdPipelineBarrier per pass covering exactly the
+//    hazards and layout transitions its accesses introduce,
+//  - creates transient images and places those with disjoint lifetimes in
+//    the same device memory.
+//
+// Transient images with more than one layer get a 2D array view over all
+// of them and one 2D view per layer.
+//
+// Passes record their own commands, including any VkRenderPass; attachments
+// are expected to already be in the declared layout, so render passes used
+// inside the graph should keep initialLayout == finalLayout.
+//
+// A compiled graph can be executed into any number of command buffers, and
+// executions submitted to one queue may overlap. Transient images, and
+// imported ones with neither an initial nor a final layout, start over in
+// every execution; their first use waits for the previous execution's last
+// use of their memory. Other imported resources are ordered by the
+// initial_stages they were imported with.
+//
+// Graphs that differ only in their imported resources, like one per
+// swapchain image, can share transients: compiling with another compiled
+// graph that declares the same transients, used by the same passes, takes
+// its images and memory instead of creating them. Executions of either
+// graph then start over like executions of one; the shared graph has to
+// outlive the others, which report no allocated_bytes of their own.
+class RenderGraph {
+public:
+    using Resource = uint32_t;
+    using ExecuteFunction = std::function<void(VkCommandBuffer command_buffer)>;
+    using AllocateFunction = std::function<VkDeviceMemory(VkDeviceSize size, uint32_t type_filter)>;
+    using ReleaseFunction = std::function<void(VkDeviceMemory memory)>;
+
+    class PassBuilder {
+    public:
+        PassBuilder& read(Resource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+        PassBuilder& write(Resource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+            VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED);
+        PassBuilder& side_effects();
+        PassBuilder& execute(ExecuteFunction function);
+
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, std::size_t pass): m_graph(graph), m_pass(pass) { }
+
+        RenderGraph& m_graph;
+        std::size_t m_pass;
+    };
+
+    RenderGraph(VkDevice device, AllocateFunction allocate, ReleaseFunction release,
+        const VkAllocationCallbacks* host_allocator = nullptr);
+    ~RenderGraph();
+
+    RenderGraph(const RenderGraph& other) = delete;
+    RenderGraph(RenderGraph&& other) noexcept = delete;
+    RenderGraph& operator =(const RenderGraph& other) = delete;
+    RenderGraph& operator =(RenderGraph&& other) noexcept = delete;
+
+    Resource import_image(const std::string& name, VkImage image, VkImageView view, const RenderGraphImageDesc& desc,
+        VkImageLayout initial_layout, VkPipelineStageFlags initial_stages, VkImageLayout final_layout);
+    Resource import_buffer(const std::string& name, VkBuffer buffer);
+    Resource create_image(const std::string& name, const RenderGraphImageDesc& desc);
+    PassBuilder add_pass(const std::string& name);
+
+    void compile(const RenderGraph* shared = nullptr);
+    void execute(VkCommandBuffer command_buffer) const;
+
+    VkImage image(Resource resource) const { return m_resources[resource].image; }
+    VkImageView view(Resource resource) const { return m_resources[resource].view; }
+    VkImageView layer_view(Resource resource, uint32_t layer) const {
+        const auto& node = m_resources[resource];
+        return node.layer_views.empty() ? node.view : node.layer_views[layer];
+    }
+    VkBuffer buffer(Resource resource) const { return m_resources[resource].buffer; }
+    bool culled(const std::string& pass) const;
+
+    const RenderGraphStats& stats() const { return m_stats; }
+    void print(std::ostream& stream) const;
+
+private:
+    enum class ResourceKind { Image, Buffer };
+
+    struct Access {
+        Resource resource;
+        VkPipelineStageFlags stages;
+        VkAccessFlags access;
+        VkImageLayout layout;
+        bool read;
+        bool write;
+    };
+
+    struct ResourceNode {
+        std::string name;
+        ResourceKind kind;
+        bool imported = false;
+        RenderGraphImageDesc desc;
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        std::vector<VkImageView> layer_views;
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags initial_stages = 0;
+        VkImageLayout final_layout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // Lifetime in compiled pass order and the transient image, if any,
+        // that used the same memory before this one.
+        std::size_t first_use = SIZE_MAX;
+        std::size_t last_use = 0;
+        bool has_alias_predecessor = false;
+        Resource alias_predecessor = 0;
+
+        // Whether no execution reads what the previous one left behind.
+        bool starts_over() const {
+            return kind == ResourceKind::Image && (!imported || (initial_layout == VK_IMAGE_LAYOUT_UNDEFINED 
+                && final_layout == VK_IMAGE_LAYOUT_UNDEFINED));
+        }
+    };
+
+    struct PassNode {
+        std::string name;
+        std::vector<Access> accesses;
+        ExecuteFunction execute;
+        bool side_effects = false;
+        bool culled = false;
+    };
+
+    struct ResourceState {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags write_stages = 0;
+        VkAccessFlags write_access = 0;
+        VkPipelineStageFlags read_stages = 0;
+        VkAccessFlags read_access = 0;
+    };
+
+    struct BarrierBatch {
+        VkPipelineStageFlags src_stages = 0;
+        VkPipelineStageFlags dst_stages = 0;
+        std::vector<VkImageMemoryBarrier> images;
+        std::vector<VkBufferMemoryBarrier> buffers;
+
+        bool empty() const { return dst_stages == 0; }
+    };
+
+    struct MemoryBlock {
+        VkDeviceSize size = 0;
+        uint32_t type_bits = 0;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        std::vector<Resource> images;
+    };
+
+    void add_access(std::size_t pass, Resource resource, VkPipelineStageFlags stages, VkAccessFlags access,
+        VkImageLayout layout, bool write);
+    void cull_passes();
+    void allocate_transients();
+    void share_transients(const RenderGraph& shared);
+    void plan_barriers();
+    std::vector<ResourceState> initial_states() const;
+    void plan_passes(std::vector<ResourceState>& states);
+    void plan_access(const Access& access, ResourceState& state, BarrierBatch& batch,
+        const ResourceState* alias_state) const;
+    void release_transients();
+
+    VkDevice m_device;
+    const VkAllocationCallbacks* m_host_allocator;
+    AllocateFunction m_allocate;
+    ReleaseFunction m_release;
+
+    std::vector<ResourceNode> m_resources;
+    std::vector<PassNode> m_passes;
+    std::vector<std::size_t> m_order;
+    std::vector<BarrierBatch> m_pass_barriers;
+    BarrierBatch m_final_barriers;
+    std::vector<MemoryBlock> m_blocks;
+    RenderGraphStats m_stats;
+    bool m_shares_transients = false;
+    bool m_compiled = false;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef RENDER_TYPES_H_
+#define RENDER_TYPES_H_
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec4 color;
+
+    static VkVertexInputBindingDescription binding_desc();
+    static std::array<VkVertexInputAttributeDescription, 2> attrib_desc();
+};
+
+// Views rendered by one multiview pass, see Uniforms::view_clip.
+static constexpr uint32_t MAX_VIEWS = 4;
+
+struct Uniforms {
+    glm::mat4 view_projection;
+    // Maps the clip space of view_projection, which the object transforms
+    // are premultiplied with, to that of each view. Indexed by gl_ViewIndex
+    // in shader.vert and terrain.vert; identity for a single view.
+    glm::mat4 view_clip[MAX_VIEWS];
+
+    static VkDescriptorSetLayoutBinding binding_desc();
+    static VkDescriptorSetLayoutCreateInfo layout_info();
+};
+
+// Storage buffer of per-object clip space matrices written by
+// TransformSystem::update and indexed by gl_InstanceIndex in shader.vert.
+struct ObjectTransforms {
+    static VkDescriptorSetLayoutBinding binding_desc();
+};
+
+// The terrain is TERRAIN_TILES x TERRAIN_TILES chunks of
+// TERRAIN_TILE_RESOLUTION samples per side sharing their edge samples,
+// starting at TERRAIN_ORIGIN on both axes. Tiles and heightmaps baked by
+// landscape_bake are laid out to match.
+static constexpr uint32_t TERRAIN_TILES = 16;
+static constexpr uint32_t TERRAIN_TILE_RESOLUTION = 33;
+static constexpr float TERRAIN_TILE_EXTENT = 1.0f;
+static constexpr float TERRAIN_ORIGIN = -8.0f;
+
+// Heightmap sampled by glsl/terrain.vert, and the push constants that place
+// one draw's patches on it. Patch p of a draw covers the samples starting at
+// (p % chunks_x, p / chunks_x) * (patch_resolution - 1), p = gl_InstanceIndex.
+struct TerrainHeightmap {
+    static VkDescriptorSetLayoutBinding binding_desc();
+};
+
+struct TerrainPushConstants {
+    glm::vec2 origin;
+    float sample_spacing;
+    float height_scale;
+    float height_bias;
+    uint32_t patch_resolution;
+    uint32_t chunks_x;
+    uint32_t object;
+    // Only read by the tessellation shaders.
+    glm::vec2 viewport;
+    float edge_pixels;
+    uint32_t patch_step;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+ResolutionController::ResolutionController(const ResolutionSettings& settings):
+    m_settings(settings)
+{
+    if(m_settings.step <= 0.0 || m_settings.min_scale < m_settings.step || m_settings.max_scale < m_settings.min_scale) {
+        throw std::runtime_error("Invalid resolution scale range!");
+    }
+    m_min_level = static_cast<uint32_t>(std::ceil(m_settings.min_scale / m_settings.step - 1e-6));
+    m_max_level = level_of(m_settings.max_scale);
+    m_level = m_max_level;
+    m_level_frames.assign(m_max_level + 1, 0);
+}
+ 
+bool ResolutionController::update(double gpu_ms) {
+    m_level_frames[m_level] += 1;
+    double target = m_settings.target_ms;
+
+    if(gpu_ms > target) {
+        m_under_frames = 0;
+        m_over_min_ms = m_over_frames == 0 ? gpu_ms : std::min(m_over_min_ms, gpu_ms);
+        m_over_frames += 1;
+        if(m_over_frames < m_settings.decrease_frames || m_level == m_min_level) {
+            return false;
+        }
+        // Use the fastest frame of the run so a single spike in it does not
+        // drop the scale further than needed.
+        double fit = scale() * std::sqrt(target * m_settings.headroom / m_over_min_ms);
+        m_level = std::clamp(level_of(fit), m_min_level, m_level - 1);
+        m_over_frames = 0;
+        m_changes += 1;
+        return true;
+    }
+
+    m_over_frames = 0;
+    if(m_level == m_max_level) {
+        return false;
+    }
+    double growth = static_cast<double>(m_level + 1) / m_level;
+    if(gpu_ms * growth * growth > target * m_settings.headroom) {
+        m_under_frames = 0;
+        return false;
+    }
+    m_under_frames += 1;
+    if(m_under_frames < m_settings.increase_frames) {
+        return false;
+    }
+    m_level += 1;
+    m_under_frames = 0;
+    m_changes += 1;
+    return true;
+}
+ 
+uint32_t ResolutionController::scaled(uint32_t size) const {
+    auto pixels = static_cast<uint32_t>(std::lround(size * scale()));
+    return std::max<uint32_t>(pixels, 1);
+}
+ 
+uint32_t ResolutionController::level_of(double scale) const {
+    return static_cast<uint32_t>(std::floor(scale / m_settings.step + 1e-6));
+}
+ 
+void ResolutionController::report(std::ostream& stream) const {
+    uint64_t frames = 0;
+    for(auto count : m_level_frames) {
+        frames += count;
+    }
+    stream << "Dynamic resolution: target " << m_settings.target_ms << " ms, scale " << scale() << ", " 
+        << m_changes << " changes\n";
+    if(frames == 0) {
+        return;
+    }
+    for(uint32_t level = m_max_level + 1; level-- > m_min_level;) {
+        if(m_level_frames[level] == 0) {
+            continue;
+        }
+        stream << "\t|> Scale " << level * m_settings.step << ": " << m_level_frames[level] << " frames (" 
+            << 100.0 * m_level_frames[level] / frames << "%)\n";
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef RESOLUTION_CONTROLLER_H_
+#define RESOLUTION_CONTROLLER_H_
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+struct ResolutionSettings {
+    double target_ms = 16.0;
+    // Scales apply to both axes and are multiples of step.
+    double min_scale = 0.5;
+    double max_scale = 1.0;
+    double step = 0.05;
+    // Consecutive frames over the target before the scale drops, and under
+    // the headroom before it grows.
+    uint32_t decrease_frames = 3;
+    uint32_t increase_frames = 60;
+    // Fraction of the target a frame may take after a change.
+    double headroom = 0.85;
+};
+
+// Picks the render resolution scale that keeps the GPU frame time at a
+// target. GPU time is taken to grow with the pixel count, i.e. with the
+// square of the scale.
+//
+// Both directions have hysteresis: the scale only drops after several
+// frames in a row over the target, then far enough for the fastest of them
+// to fit the headroom, and only grows one step after many frames in a row
+// that would still fit the headroom at the larger scale. Frame times between
+// the two thresholds leave the scale alone, so it settles instead of
+// oscillating around the target.
+class ResolutionController {
+public:
+    explicit ResolutionController(const ResolutionSettings& settings);
+    ~ResolutionController() = default;
+
+    ResolutionController(const ResolutionController& other) = default;
+    ResolutionController(ResolutionController&& other) noexcept = default;
+    ResolutionController& operator =(const ResolutionController& other) = default;
+    ResolutionController& operator =(ResolutionController&& other) noexcept = default;
+
+    // Feeds the GPU time of a frame rendered at the current scale; returns
+    // true when the scale changed.
+    bool update(double gpu_ms);
+
+    double scale() const { return m_level * m_settings.step; }
+    uint32_t scaled(uint32_t size) const;
+    const ResolutionSettings& settings() const { return m_settings; }
+    uint64_t changes() const { return m_changes; }
+
+    void report(std::ostream& stream) const;
+
+private:
+    uint32_t level_of(double scale) const;
+
+    ResolutionSettings m_settings;
+    uint32_t m_min_level;
+    uint32_t m_max_level;
+    uint32_t m_level;
+
+    uint32_t m_over_frames = 0;
+    double m_over_min_ms = 0.0;
+    uint32_t m_under_frames = 0;
+
+    uint64_t m_changes = 0;
+    // Frames rendered at each level, indexed by level.
+    std::vector<uint64_t> m_level_frames;
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include "SceneDatabase.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+SceneHandle SceneDatabase::add(const SceneEntity& entity) {
+    uint32_t slot;
+    if(!m_free_slots.empty()) {
+        slot = m_free_slots.back();
+        m_free_slots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(m_slot_dense.size());
+        m_slot_dense.push_back(0);
+        m_slot_generation.push_back(0);
+    }
+
+    std::size_t dense = m_count;
+    if(dense / SceneChunk::SIZE == m_chunks.size()) {
+        m_chunks.emplace_back();
+    }
+    m_count += 1;
+    m_slot_dense[slot] = static_cast<uint32_t>(dense);
+    write(dense, entity, slot);
+    return {slot, m_slot_generation[slot]};
+}
+ 
+void SceneDatabase::remove(SceneHandle handle) {
+    std::size_t dense = dense_index(handle);
+    std::size_t last = m_count - 1;
+    if(dense != last) {
+        move(last, dense);
+    }
+    m_count -= 1;
+    if(m_chunks.size() * SceneChunk::SIZE >= m_count + SceneChunk::SIZE) {
+        m_chunks.pop_back();
+    }
+    m_slot_generation[handle.index] += 1;
+    m_free_slots.push_back(handle.index);
+}
+ 
+bool SceneDatabase::contains(SceneHandle handle) const {
+    return handle.index < m_slot_generation.size() && m_slot_generation[handle.index] == handle.generation;
+}
+ 
+void SceneDatabase::reserve(std::size_t count) {
+    m_chunks.reserve((count + SceneChunk::SIZE - 1) / SceneChunk::SIZE);
+    m_slot_dense.reserve(count);
+    m_slot_generation.reserve(count);
+}
+ 
+void SceneDatabase::clear() {
+    // Every handle handed out so far goes stale.
+    for(std::size_t dense = 0; dense < m_count; ++dense) {
+        uint32_t slot = m_chunks[dense / SceneChunk::SIZE].slot[dense % SceneChunk::SIZE];
+        m_slot_generation[slot] += 1;
+        m_free_slots.push_back(slot);
+    }
+    m_chunks.clear();
+    m_count = 0;
+}
+ 
+SceneEntity SceneDatabase::get(SceneHandle handle) const {
+    std::size_t dense = dense_index(handle);
+    const auto& chunk = m_chunks[dense / SceneChunk::SIZE];
+    std::size_t lane = dense % SceneChunk::SIZE;
+    SceneEntity entity;
+    entity.position = glm::vec3(chunk.position_x[lane], chunk.position_y[lane], chunk.position_z[lane]);
+    entity.radius = chunk.radius[lane];
+    entity.extent = glm::vec3(chunk.extent_x[lane], chunk.extent_y[lane], chunk.extent_z[lane]);
+    entity.mesh = chunk.mesh[lane];
+    entity.material = chunk.material[lane];
+    entity.flags = chunk.flags[lane];
+    entity.instance = chunk.instance[lane];
+    return entity;
+}
+ 
+void SceneDatabase::set_position(SceneHandle handle, const glm::vec3& position) {
+    std::size_t dense = dense_index(handle);
+    auto& chunk = m_chunks[dense / SceneChunk::SIZE];
+    std::size_t lane = dense % SceneChunk::SIZE;
+    chunk.position_x[lane] = position.x;
+    chunk.position_y[lane] = position.y;
+    chunk.position_z[lane] = position.z;
+}
+ 
+void SceneDatabase::set_flags(SceneHandle handle, uint32_t flags) {
+    std::size_t dense = dense_index(handle);
+    m_chunks[dense / SceneChunk::SIZE].flags[dense % SceneChunk::SIZE] = flags;
+}
+ 
+void SceneDatabase::set_mesh(SceneHandle handle, uint32_t mesh, uint32_t material) {
+    std::size_t dense = dense_index(handle);
+    auto& chunk = m_chunks[dense / SceneChunk::SIZE];
+    chunk.mesh[dense % SceneChunk::SIZE] = mesh;
+    chunk.material[dense % SceneChunk::SIZE] = material;
+}
+ 
+void SceneDatabase::translate(const glm::vec3& offset) {
+    // A multiply instead of a branch keeps the lane loops vectorizable.
+    for(std::size_t c = 0; c < m_chunks.size(); ++c) {
+        auto& chunk = m_chunks[c];
+        std::size_t lanes = chunk_size(c);
+        for(std::size_t lane = 0; lane < lanes; ++lane) {
+            float moves = (chunk.flags[lane] & SCENE_FLAG_STATIC) ? 0.0f : 1.0f;
+            chunk.position_x[lane] += offset.x * moves;
+            chunk.position_y[lane] += offset.y * moves;
+            chunk.position_z[lane] += offset.z * moves;
+        }
+    }
+}
+ 
+std::size_t SceneDatabase::cull(const glm::mat4& view_projection, std::vector<uint64_t>& visible) const {
+    auto planes = frustum_planes(view_projection);
+    visible.resize(m_chunks.size());
+    std::size_t visible_count = 0;
+    for(std::size_t c = 0; c < m_chunks.size(); ++c) {
+        const auto& chunk = m_chunks[c];
+        std::size_t lanes = chunk_size(c);
+        uint64_t mask = 0;
+        for(std::size_t lane = 0; lane < lanes; ++lane) {
+            bool inside = (chunk.flags[lane] & SCENE_FLAG_HIDDEN) == 0;
+            for(const auto& plane : planes) {
+                float distance = plane.x * chunk.position_x[lane] + plane.y * chunk.position_y[lane]
+                    + plane.z * chunk.position_z[lane] + plane.w;
+                inside &= distance >= -chunk.radius[lane];
+            }
+            mask |= static_cast<uint64_t>(inside) << lane;
+        }
+        visible[c] = mask;
+        visible_count += mask_popcount(mask);
+    }
+    return visible_count;
+}
+ 
+std::size_t SceneDatabase::chunk_size(std::size_t index) const {
+    return std::min(SceneChunk::SIZE, m_count - index * SceneChunk::SIZE);
+}
+ 
+std::array<glm::vec4, 6> SceneDatabase::frustum_planes(const glm::mat4& view_projection) {
+    auto row = [&](int i) {
+        return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    };
+    std::array<glm::vec4, 6> planes = {
+        row(3) + row(0), row(3) - row(0),
+        row(3) + row(1), row(3) - row(1),
+        row(3) + row(2), row(3) - row(2),
+    };
+    for(auto& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+ 
+std::size_t SceneDatabase::dense_index(SceneHandle handle) const {
+    if(!contains(handle)) {
+        throw std::out_of_range("Stale scene handle!");
+    }
+    return m_slot_dense[handle.index];
+}
+ 
+void SceneDatabase::write(std::size_t dense, const SceneEntity& entity, uint32_t slot) {
+    auto& chunk = m_chunks[dense / SceneChunk::SIZE];
+    std::size_t lane = dense % SceneChunk::SIZE;
+    chunk.position_x[lane] = entity.position.x;
+    chunk.position_y[lane] = entity.position.y;
+    chunk.position_z[lane] = entity.position.z;
+    chunk.radius[lane] = entity.radius;
+    chunk.extent_x[lane] = entity.extent.x;
+    chunk.extent_y[lane] = entity.extent.y;
+    chunk.extent_z[lane] = entity.extent.z;
+    chunk.mesh[lane] = entity.mesh;
+    chunk.material[lane] = entity.material;
+    chunk.flags[lane] = entity.flags;
+    chunk.instance[lane] = entity.instance;
+    chunk.slot[lane] = slot;
+}
+ 
+void SceneDatabase::move(std::size_t from, std::size_t to) {
+    const auto& source = m_chunks[from / SceneChunk::SIZE];
+    std::size_t lane = from % SceneChunk::SIZE;
+    SceneEntity entity;
+    entity.position = glm::vec3(source.position_x[lane], source.position_y[lane], source.position_z[lane]);
+    entity.radius = source.radius[lane];
+    entity.extent = glm::vec3(source.extent_x[lane], source.extent_y[lane], source.extent_z[lane]);
+    entity.mesh = source.mesh[lane];
+    entity.material = source.material[lane];
+    entity.flags = source.flags[lane];
+    entity.instance = source.instance[lane];
+    uint32_t slot = source.slot[lane];
+    write(to, entity, slot);
+    m_slot_dense[slot] = static_cast<uint32_t>(to);
+}
@@ -0,0 +1,153 @@
+#ifndef SCENE_DATABASE_H_
+#define SCENE_DATABASE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+enum SceneFlags : uint32_t {
+    // Never passes culling.
+    SCENE_FLAG_HIDDEN = 1,
+    // Left alone by bulk moves.
+    SCENE_FLAG_STATIC = 2,
+};
+
+// Stays valid while its entity lives, however the others are added and
+// removed; a removed entity's handle is stale from then on.
+struct SceneHandle {
+    uint32_t index = std::numeric_limits<uint32_t>::max();
+    uint32_t generation = 0;
+
+    bool operator ==(const SceneHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator !=(const SceneHandle& other) const { return !(*this == other); }
+};
+
+// One placed object as handed in and out; not how it is stored.
+struct SceneEntity {
+    // Centre of the world space bounds.
+    glm::vec3 position = glm::vec3(0.0f);
+    // Bounding sphere radius and half size of the axis aligned box.
+    float radius = 0.0f;
+    glm::vec3 extent = glm::vec3(0.0f);
+    uint32_t mesh = 0;
+    uint32_t material = 0;
+    uint32_t flags = 0;
+    // Index of the entity's transform in the object buffer, passed to draws
+    // as firstInstance.
+    uint32_t instance = 0;
+};
+
+// SIZE entities, one array per field. Each array is a whole number of cache
+// lines, so a pass over one field streams through memory without touching
+// the others.
+struct alignas(64) SceneChunk {
+    static constexpr std::size_t SIZE = 64;
+
+    float position_x[SIZE];
+    float position_y[SIZE];
+    float position_z[SIZE];
+    float radius[SIZE];
+    float extent_x[SIZE];
+    float extent_y[SIZE];
+    float extent_z[SIZE];
+    uint32_t mesh[SIZE];
+    uint32_t material[SIZE];
+    uint32_t flags[SIZE];
+    uint32_t instance[SIZE];
+    // Slot of the handle that refers to the entity, to repoint it when the
+    // entity moves to fill a gap.
+    uint32_t slot[SIZE];
+};
+static_assert(sizeof(SceneChunk) % 64 == 0, "Scene chunks have to be whole cache lines");
+static_assert(SceneChunk::SIZE == 64, "Culling writes one 64 bit mask per chunk");
+
+// Bit counts of culling masks. GCC and Clang have builtins; elsewhere the
+// bits are summed in parallel, which needs no particular instruction set.
+inline uint32_t mask_popcount(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_popcountll(mask));
+#else
+    mask = mask - ((mask >> 1) & 0x5555555555555555ull);
+    mask = (mask & 0x3333333333333333ull) + ((mask >> 2) & 0x3333333333333333ull);
+    mask = (mask + (mask >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<uint32_t>((mask * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+// Lane of the lowest set bit; mask must not be 0.
+inline uint32_t mask_lowest_lane(uint64_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<uint32_t>(__builtin_ctzll(mask));
+#else
+    return mask_popcount((mask & (~mask + 1)) - 1);
+#endif
+}
+
+// Placed objects stored as structure-of-arrays in chunks, for passes over
+// hundreds of thousands of them. Entities are kept densely packed: entity i
+// is lane i % SIZE of chunk i / SIZE and removal moves the last entity into
+// the gap, so bulk updates and culling run over count() entities without
+// holes. Handles go through a slot table to find their entity.
+//
+// Not thread safe.
+class SceneDatabase {
+public:
+    SceneDatabase() = default;
+    ~SceneDatabase() = default;
+
+    SceneDatabase(const SceneDatabase& other) = default;
+    SceneDatabase(SceneDatabase&& other) noexcept = default;
+    SceneDatabase& operator =(const SceneDatabase& other) = default;
+    SceneDatabase& operator =(SceneDatabase&& other) noexcept = default;
+
+    SceneHandle add(const SceneEntity& entity);
+    void remove(SceneHandle handle);
+    bool contains(SceneHandle handle) const;
+    void reserve(std::size_t count);
+    void clear();
+
+    SceneEntity get(SceneHandle handle) const;
+    void set_position(SceneHandle handle, const glm::vec3& position);
+    void set_flags(SceneHandle handle, uint32_t flags);
+    void set_mesh(SceneHandle handle, uint32_t mesh, uint32_t material);
+
+    // Moves every entity without SCENE_FLAG_STATIC by offset.
+    void translate(const glm::vec3& offset);
+
+    // Writes one mask per chunk to visible, bit i set when lane i passed:
+    // not hidden and its bounding sphere not outside a plane of the view
+    // frustum. Returns the number of visible entities.
+    std::size_t cull(const glm::mat4& view_projection, std::vector<uint64_t>& visible) const;
+
+    std::size_t count() const { return m_count; }
+    std::size_t chunk_count() const { return m_chunks.size(); }
+    const SceneChunk& chunk(std::size_t index) const { return m_chunks[index]; }
+    // Entities in the chunk, SIZE for all but the last.
+    std::size_t chunk_size(std::size_t index) const;
+
+    // Inward facing planes (normal, distance) of the frustum of a
+    // view_projection with OpenGL's depth range. For Vulkan's 0 to 1 range
+    // the near plane is a little too close, which only keeps a few extra
+    // entities.
+    static std::array<glm::vec4, 6> frustum_planes(const glm::mat4& view_projection);
+
+private:
+    // Throws for stale handles.
+    std::size_t dense_index(SceneHandle handle) const;
+    void write(std::size_t dense, const SceneEntity& entity, uint32_t slot);
+    void move(std::size_t from, std::size_t to);
+
+    std::vector<SceneChunk> m_chunks;
+    std::size_t m_count = 0;
+
+    // Dense position and generation of every slot; free slots are reused.
+    std::vector<uint32_t> m_slot_dense;
+    std::vector<uint32_t> m_slot_generation;
+    std::vector<uint32_t> m_free_slots;
+};
+
+#endif
@@ -0,0 +1,225 @@
+#include "SceneFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+static const char SCENE_FILE_MAGIC[8] = {'L', 'S', 'S', 'C', 'E', 'N', 'E', '\0'};
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static void write_padded(std::ofstream& file, const void* data, uint64_t size, const std::vector<char>& padding) {
+    file.write(static_cast<const char*>(data), size);
+    file.write(padding.data(), align_up(size, padding.size()) - size);
+}
+
+
+SceneFile::SceneFile(const std::string& filename):
+    m_file(filename)
+{
+    if(m_file.size() < sizeof(SceneFileHeader)) {
+        throw std::runtime_error("Scene file is truncated!");
+    }
+    m_header = reinterpret_cast<const SceneFileHeader*>(m_file.data());
+    if(std::memcmp(m_header->magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC)) != 0) {
+        throw std::runtime_error("Not a scene file: " + filename);
+    }
+    if(m_header->version != VERSION) {
+        throw std::runtime_error("Unsupported scene file version, rebake " + filename + "!");
+    }
+    if(m_header->page_size % MappedFile::page_size() != 0) {
+        throw std::runtime_error("Scene file pages are not aligned to the system page size!");
+    }
+
+    check_range(m_header->directory_offset,
+        m_header->mesh_count * sizeof(SceneMeshEntry) + m_header->heightmap_count * sizeof(SceneHeightmapEntry));
+    m_meshes = reinterpret_cast<const SceneMeshEntry*>(m_file.data() + m_header->directory_offset);
+    m_heightmaps = reinterpret_cast<const SceneHeightmapEntry*>(m_meshes + m_header->mesh_count);
+
+    // Validated once here, so the accessors can hand out the mapping as is.
+    for(uint32_t i = 0; i < m_header->mesh_count; ++i) {
+        const auto& entry = m_meshes[i];
+        check_range(entry.vertex_offset, uint64_t{entry.vertex_count} * sizeof(Vertex));
+        check_range(entry.index_offset, uint64_t{entry.index_count} * sizeof(uint16_t));
+        if(entry.lod_count == 0 || entry.lod_count > SceneMeshEntry::MAX_LODS) {
+            throw std::runtime_error("Scene file mesh has an invalid number of levels of detail!");
+        }
+        for(uint32_t lod = 0; lod < entry.lod_count; ++lod) {
+            if(uint64_t{entry.lods[lod].first_index} + entry.lods[lod].index_count > entry.index_count) {
+                throw std::runtime_error("Scene file mesh level of detail is out of range!");
+            }
+        }
+        // The indices are uploaded as they are, so one past the mesh's
+        // vertices would be read by the GPU.
+        if(entry.index_offset % alignof(uint16_t) != 0) {
+            throw std::runtime_error("Scene file mesh indices are misaligned!");
+        }
+        const auto* indices = reinterpret_cast<const uint16_t*>(m_file.data() + entry.index_offset);
+        for(uint32_t index = 0; index < entry.index_count; ++index) {
+            if(indices[index] >= entry.vertex_count) {
+                throw std::runtime_error("Scene file mesh index is out of range!");
+            }
+        }
+    }
+    for(uint32_t i = 0; i < m_header->heightmap_count; ++i) {
+        const auto& entry = m_heightmaps[i];
+        check_range(entry.sample_offset, entry.sample_size());
+        check_range(entry.bounds_offset, entry.bounds_size());
+    }
+}
+ 
+const SceneMeshEntry& SceneFile::mesh(uint32_t index) const {
+    if(index >= m_header->mesh_count) {
+        throw std::out_of_range("Mesh index outside of scene file!");
+    }
+    return m_meshes[index];
+}
+ 
+const std::byte* SceneFile::vertex_data(uint32_t mesh) const {
+    return m_file.data() + this->mesh(mesh).vertex_offset;
+}
+ 
+const std::byte* SceneFile::index_data(uint32_t mesh) const {
+    return m_file.data() + this->mesh(mesh).index_offset;
+}
+ 
+const SceneHeightmapEntry& SceneFile::heightmap(uint32_t index) const {
+    if(index >= m_header->heightmap_count) {
+        throw std::out_of_range("Heightmap index outside of scene file!");
+    }
+    return m_heightmaps[index];
+}
+ 
+const std::byte* SceneFile::sample_data(uint32_t heightmap) const {
+    return m_file.data() + this->heightmap(heightmap).sample_offset;
+}
+ 
+const glm::vec2* SceneFile::chunk_heights(uint32_t heightmap) const {
+    return reinterpret_cast<const glm::vec2*>(m_file.data() + this->heightmap(heightmap).bounds_offset);
+}
+ 
+void SceneFile::check_range(uint64_t offset, uint64_t size) const {
+    if(offset > m_file.size() || size > m_file.size() - offset) {
+        throw std::runtime_error("Scene file is truncated!");
+    }
+}
+ 
+void SceneFile::write(const std::string& filename, const std::vector<Mesh>& meshes,
+        const std::vector<Terrain>& terrains) {
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(SCENE_FILE_MAGIC));
+    header.version = VERSION;
+    header.page_size = static_cast<uint32_t>(MappedFile::page_size());
+    header.mesh_count = static_cast<uint32_t>(meshes.size());
+    header.heightmap_count = static_cast<uint32_t>(terrains.size());
+
+    std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if(!file) {
+        throw std::runtime_error("Failed to open " + filename + " for writing!");
+    }
+
+    std::vector<char> padding(header.page_size, 0);
+    uint64_t offset = align_up(sizeof(SceneFileHeader), header.page_size);
+    write_padded(file, &header, sizeof(header), padding);
+
+    std::vector<SceneMeshEntry> mesh_entries(meshes.size());
+    std::vector<uint16_t> indices;
+    for(std::size_t i = 0; i < meshes.size(); ++i) {
+        const auto& mesh = meshes[i];
+        auto& entry = mesh_entries[i];
+        if(mesh.vertices.empty() || mesh.lods.empty() || mesh.lods.size() > SceneMeshEntry::MAX_LODS) {
+            throw std::runtime_error("Mesh " + mesh.name + " needs vertices and 1 to 4 levels of detail!");
+        }
+        if(mesh.vertices.size() > std::numeric_limits<uint16_t>::max() + std::size_t{1}) {
+            throw std::runtime_error("Mesh " + mesh.name + " has too many vertices for 16 bit indices!");
+        }
+        std::strncpy(entry.name, mesh.name.c_str(), sizeof(entry.name) - 1);
+
+        indices.clear();
+        entry.lod_count = static_cast<uint32_t>(mesh.lods.size());
+        for(std::size_t lod = 0; lod < mesh.lods.size(); ++lod) {
+            entry.lods[lod].first_index = static_cast<uint32_t>(indices.size());
+            entry.lods[lod].index_count = static_cast<uint32_t>(mesh.lods[lod].size());
+            entry.lods[lod].error = lod < mesh.lod_errors.size() ? mesh.lod_errors[lod] : 0.0f;
+            indices.insert(indices.end(), mesh.lods[lod].begin(), mesh.lods[lod].end());
+        }
+
+        glm::vec3 low(std::numeric_limits<float>::max());
+        glm::vec3 high(std::numeric_limits<float>::lowest());
+        for(const auto& vertex : mesh.vertices) {
+            low = glm::min(low, vertex.pos);
+            high = glm::max(high, vertex.pos);
+        }
+        glm::vec3 center = (low + high) * 0.5f;
+        float radius = 0.0f;
+        for(const auto& vertex : mesh.vertices) {
+            radius = std::max(radius, glm::length(vertex.pos - center));
+        }
+        for(int axis = 0; axis < 3; ++axis) {
+            entry.bounds_min[axis] = low[axis];
+            entry.bounds_max[axis] = high[axis];
+            entry.sphere_center[axis] = center[axis];
+        }
+        entry.sphere_radius = radius;
+
+        uint64_t vertex_bytes = mesh.vertices.size() * sizeof(Vertex);
+        entry.vertex_offset = offset;
+        entry.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        write_padded(file, mesh.vertices.data(), vertex_bytes, padding);
+        offset += align_up(vertex_bytes, header.page_size);
+
+        uint64_t index_bytes = indices.size() * sizeof(uint16_t);
+        entry.index_offset = offset;
+        entry.index_count = static_cast<uint32_t>(indices.size());
+        write_padded(file, indices.data(), index_bytes, padding);
+        offset += align_up(index_bytes, header.page_size);
+    }
+
+    std::vector<SceneHeightmapEntry> heightmap_entries(terrains.size());
+    std::vector<glm::vec2> bounds;
+    for(std::size_t i = 0; i < terrains.size(); ++i) {
+        const auto& heightmap = *terrains[i].heightmap;
+        uint32_t resolution = terrains[i].chunk_resolution;
+        auto& entry = heightmap_entries[i];
+        if(resolution < 2 || (heightmap.width() - 1) % (resolution - 1) != 0
+                || (heightmap.height() - 1) % (resolution - 1) != 0) {
+            throw std::runtime_error("Heightmap does not split into chunks of the given resolution!");
+        }
+        entry.width = heightmap.width();
+        entry.height = heightmap.height();
+        entry.format = static_cast<uint32_t>(heightmap.format());
+        entry.chunk_resolution = resolution;
+        entry.chunks_x = (heightmap.width() - 1) / (resolution - 1);
+        entry.chunks_y = (heightmap.height() - 1) / (resolution - 1);
+        entry.origin_x = heightmap.origin().x;
+        entry.origin_y = heightmap.origin().y;
+        entry.spacing = heightmap.spacing();
+        entry.height_scale = heightmap.height_scale();
+        entry.height_bias = heightmap.height_bias();
+
+        entry.sample_offset = offset;
+        write_padded(file, heightmap.data().data(), heightmap.data().size(), padding);
+        offset += align_up(heightmap.data().size(), header.page_size);
+
+        // Of the decoded heights, so culling agrees with what the shader draws.
+        bounds = heightmap.chunk_heights(resolution);
+        entry.bounds_offset = offset;
+        write_padded(file, bounds.data(), bounds.size() * sizeof(glm::vec2), padding);
+        offset += align_up(bounds.size() * sizeof(glm::vec2), header.page_size);
+    }
+
+    header.directory_offset = offset;
+    file.write(reinterpret_cast<const char*>(mesh_entries.data()), mesh_entries.size() * sizeof(SceneMeshEntry));
+    file.write(reinterpret_cast<const char*>(heightmap_entries.data()),
+        heightmap_entries.size() * sizeof(SceneHeightmapEntry));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    if(!file) {
+        throw std::runtime_error("Failed to write scene file " + filename + "!");
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef SCENE_FILE_H_
+#define SCENE_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Heightmap.h"
+#include "MappedFile.h"
+#include "RenderTypes.h"
+
+// On-disk layout:
+//   [SceneFileHeader][pad to page]
+//   [mesh 0: vertices][pad to page][mesh 0: indices][pad to page] ...
+//   [heightmap 0: samples][pad to page][heightmap 0: chunk bounds][pad to page] ...
+//   [SceneMeshEntry x mesh_count][SceneHeightmapEntry x heightmap_count]
+// Everything is stored in the layout the renderer uploads: Vertex and
+// uint16_t indices for meshes, samples in the heightmap image's format and
+// one min/max height pair per chunk, so loading is a copy out of the mapping.
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t mesh_count;
+    uint32_t heightmap_count;
+    uint64_t directory_offset;
+};
+static_assert(sizeof(SceneFileHeader) == 32, "SceneFileHeader layout is part of the file format");
+
+// A range of the mesh's indices; every level indexes the same vertices.
+struct SceneMeshLod {
+    uint32_t first_index;
+    uint32_t index_count;
+    // Largest distance a vertex moved from the finest level.
+    float error;
+};
+static_assert(sizeof(SceneMeshLod) == 12, "SceneMeshLod layout is part of the file format");
+
+struct SceneMeshEntry {
+    static constexpr uint32_t MAX_LODS = 4;
+
+    char name[32];
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint32_t vertex_count;
+    // Of all levels together, finest first.
+    uint32_t index_count;
+    uint32_t lod_count;
+    SceneMeshLod lods[MAX_LODS];
+    float bounds_min[3];
+    float bounds_max[3];
+    float sphere_center[3];
+    float sphere_radius;
+    uint32_t reserved;
+};
+static_assert(sizeof(SceneMeshEntry) == 152, "SceneMeshEntry layout is part of the file format");
+
+// The heightmap is split into chunks_x * chunks_y chunks of
+// chunk_resolution samples per side that share their edge samples.
+struct SceneHeightmapEntry {
+    uint64_t sample_offset;
+    uint64_t bounds_offset;
+    uint32_t width;
+    uint32_t height;
+    // A VkFormat that Heightmap supports.
+    uint32_t format;
+    uint32_t chunk_resolution;
+    uint32_t chunks_x;
+    uint32_t chunks_y;
+    float origin_x;
+    float origin_y;
+    float spacing;
+    float height_scale;
+    float height_bias;
+    uint32_t reserved;
+
+    uint64_t sample_size() const {
+        return uint64_t{width} * height * Heightmap::bytes_per_sample(static_cast<VkFormat>(format));
+    }
+    uint64_t bounds_size() const { return uint64_t{chunks_x} * chunks_y * sizeof(glm::vec2); }
+};
+static_assert(sizeof(SceneHeightmapEntry) == 64, "SceneHeightmapEntry layout is part of the file format");
+
+// Geometry and terrain baked by landscape_bake, mapped read-only.
+class SceneFile {
+public:
+    struct Mesh {
+        std::string name;
+        std::vector<Vertex> vertices;
+        // Finest first, at most SceneMeshEntry::MAX_LODS.
+        std::vector<std::vector<uint16_t>> lods;
+        std::vector<float> lod_errors;
+    };
+
+    struct Terrain {
+        const Heightmap* heightmap;
+        uint32_t chunk_resolution;
+    };
+
+    static constexpr uint32_t VERSION = 1;
+
+    explicit SceneFile(const std::string& filename);
+    ~SceneFile() = default;
+
+    SceneFile(const SceneFile& other) = delete;
+    SceneFile(SceneFile&& other) noexcept = default;
+    SceneFile& operator =(const SceneFile& other) = delete;
+    SceneFile& operator =(SceneFile&& other) noexcept = default;
+
+    const SceneFileHeader& header() const { return *m_header; }
+    const MappedFile& mapping() const { return m_file; }
+
+    uint32_t mesh_count() const { return m_header->mesh_count; }
+    const SceneMeshEntry& mesh(uint32_t index) const;
+    const std::byte* vertex_data(uint32_t mesh) const;
+    const std::byte* index_data(uint32_t mesh) const;
+
+    uint32_t heightmap_count() const { return m_header->heightmap_count; }
+    const SceneHeightmapEntry& heightmap(uint32_t index) const;
+    const std::byte* sample_data(uint32_t heightmap) const;
+    // As Heightmap::chunk_heights.
+    const glm::vec2* chunk_heights(uint32_t heightmap) const;
+
+    // Bounds are computed here, so the sources only need the uploaded data.
+    static void write(const std::string& filename, const std::vector<Mesh>& meshes,
+        const std::vector<Terrain>& terrains);
+
+private:
+    void check_range(uint64_t offset, uint64_t size) const;
+
+    MappedFile m_file;
+    const SceneFileHeader* m_header;
+    const SceneMeshEntry* m_meshes;
+    const SceneHeightmapEntry* m_heightmaps;
+};
+
+#endif
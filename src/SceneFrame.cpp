@@ -0,0 +1,80 @@
+#include "SceneFrame.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <array>
+#include <cstring>
+
+#include "RenderTypes.h"
+
+// Distance between neighbouring views' eyes, about a pair of eyes apart at
+// the scale of the 16 unit wide terrain.
+static constexpr float VIEW_SEPARATION = 0.065f;
+
+
+glm::mat4 ViewLayout::clip(const Camera& camera, uint32_t view) const {
+    if(count == 1) {
+        return glm::mat4(1.0f);
+    }
+    // Parallel eyes spread along the camera's right axis. Moving the eye by
+    // x is moving the scene by -x in view space, before the projection.
+    float offset = (static_cast<float>(view) - 0.5f * static_cast<float>(count - 1)) * VIEW_SEPARATION;
+    const glm::mat4& projection = camera.projection();
+    return projection * glm::translate(glm::mat4(1.0f), glm::vec3(-offset, 0.0f, 0.0f)) * glm::inverse(projection);
+}
+ 
+bool SceneUpdate::animate(float time, const Camera& camera, TransformSystem& transforms, uint32_t quad) const {
+    transforms.set_rotation(quad, glm::angleAxis(time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)));
+    return camera.revision() != m_uploaded_revision;
+}
+ 
+void SceneUpdate::write_uniforms(const Camera& camera, const ViewLayout& views, void* data, std::size_t stride) {
+    for(uint32_t pass = 0; pass < views.passes(); ++pass) {
+        // Separate view passes all render as view 0, with their own copy of
+        // the uniforms.
+        Uniforms u;
+        u.view_projection = camera.view_projection();
+        for(uint32_t view = 0; view < MAX_VIEWS; ++view) {
+            u.view_clip[view] = views.clip(camera, views.separate ? pass : view);
+        }
+        std::memcpy(static_cast<char*>(data) + pass * stride, &u, sizeof(u));
+    }
+    m_uploaded_revision = camera.revision();
+}
+ 
+std::size_t SceneUpdate::update_objects(const Camera& camera, const ViewLayout& views, bool camera_changed,
+        TransformSystem& transforms, float* clip_out, const SceneDatabase& scene, std::vector<uint64_t>& visible) {
+    std::size_t updated = transforms.update(camera.view_projection(), camera_changed, clip_out);
+
+    // Drawn when any view sees it.
+    scene.cull(views.clip(camera, 0) * camera.view_projection(), visible);
+    for(uint32_t view = 1; view < views.count; ++view) {
+        scene.cull(views.clip(camera, view) * camera.view_projection(), m_view_visibility);
+        for(std::size_t c = 0; c < visible.size(); ++c) {
+            visible[c] |= m_view_visibility[c];
+        }
+    }
+    return updated;
+}
+ 
+void FrameDescriptors::write(VkDevice device, VkDescriptorSet set) const {
+    std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+    for(std::size_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+        auto& descriptorWrite = descriptorWrites[binding];
+        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrite.dstSet = set;
+        descriptorWrite.dstBinding = static_cast<uint32_t>(binding);
+        descriptorWrite.dstArrayElement = 0;
+        descriptorWrite.descriptorCount = 1;
+    }
+    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[0].pBufferInfo = &uniforms;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[1].pBufferInfo = &objects;
+    descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[2].pImageInfo = &heightmap;
+
+    uint32_t write_count = heightmap.imageView != VK_NULL_HANDLE ? 3 : 2;
+    vkUpdateDescriptorSets(device, write_count, descriptorWrites.data(), 0, nullptr);
+}
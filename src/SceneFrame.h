@@ -0,0 +1,69 @@
+#ifndef SCENE_FRAME_H_
+#define SCENE_FRAME_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "SceneDatabase.h"
+#include "TransformSystem.h"
+
+// The per-frame CPU work of the scene pass, kept out of Simulation so that
+// landscape_bench times the code the renderer runs.
+
+// Side by side views of one camera, rendered either by one multiview pass or
+// by one pass per view.
+struct ViewLayout {
+    uint32_t count = 1;
+    bool separate = false;
+
+    uint32_t passes() const { return separate ? count : 1; }
+    // Maps the clip space of the camera's view_projection to that of view,
+    // see Uniforms::view_clip.
+    glm::mat4 clip(const Camera& camera, uint32_t view) const;
+};
+
+// Uniform and transform updates of one frame, see Simulation::update_ubo.
+class SceneUpdate {
+public:
+    SceneUpdate() = default;
+    ~SceneUpdate() = default;
+
+    SceneUpdate(const SceneUpdate& other) = default;
+    SceneUpdate(SceneUpdate&& other) noexcept = default;
+    SceneUpdate& operator =(const SceneUpdate& other) = default;
+    SceneUpdate& operator =(SceneUpdate&& other) noexcept = default;
+
+    // Spins quad to time seconds. Returns whether the camera changed since
+    // the uniforms were last written.
+    bool animate(float time, const Camera& camera, TransformSystem& transforms, uint32_t quad) const;
+    // Writes one Uniforms per view pass to data, stride bytes apart.
+    void write_uniforms(const Camera& camera, const ViewLayout& views, void* data, std::size_t stride);
+    // Writes the clip transforms of the moved objects, or of all of them when
+    // camera_changed, and sets the bits of the objects any view sees.
+    // Returns the number of clip transforms written.
+    std::size_t update_objects(const Camera& camera, const ViewLayout& views, bool camera_changed,
+        TransformSystem& transforms, float* clip_out, const SceneDatabase& scene, std::vector<uint64_t>& visible);
+
+private:
+    uint64_t m_uploaded_revision = 0;
+    std::vector<uint64_t> m_view_visibility;
+};
+
+// Contents of the per-frame descriptor set of the scene pipelines: Uniforms
+// at binding 0, ObjectTransforms at 1 and, when heightmap has a view, the
+// TerrainHeightmap at 2.
+struct FrameDescriptors {
+    VkDescriptorBufferInfo uniforms = {};
+    VkDescriptorBufferInfo objects = {};
+    VkDescriptorImageInfo heightmap = {};
+
+    void write(VkDevice device, VkDescriptorSet set) const;
+};
+
+#endif
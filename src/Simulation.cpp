@@ -1,47 +1,234 @@
 #include "Simulation.h"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <algorithm>
 #include <array>
 #include <cmath>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
+#include <functional>
+#include <thread>
 
+#include "AllocationCounter.h"
 #include "Extensions.h"
+#include "Heightmap.h"
+#include "HiZPyramid.h"
 #include "Layers.h"
+#include "PipelineManager.h"
+#include "StagingPacker.h"
+#include "TerrainGenerator.h"
 #include "Version.h"
 
+static const char* TILE_FILE_NAME = "landscape.tiles";
+static const char* PACKED_TILE_FILE_NAME = "landscape_packed.tiles";
+static constexpr VkDeviceSize DEFAULT_TILE_CACHE_BUDGET = 64ull * 1024 * 1024;
+static constexpr VkDeviceSize MIN_TILE_CACHE_BUDGET = 8ull * 1024 * 1024;
+static constexpr VkDeviceSize TILE_STAGING_SIZE = 4ull * 1024 * 1024;
+static constexpr VkDeviceSize TILE_STAGING_ALIGNMENT = 4;
+static constexpr int32_t TILE_DRAW_RADIUS = 3;
+// Heightmap samples between tessellation control points, which is also the
+// highest tessellation level used, and the targeted on-screen edge length.
+static constexpr uint32_t TERRAIN_PATCH_STEP = 8;
+static constexpr float TERRAIN_EDGE_PIXELS = 8.0f;
+// CPU LOD halves the grid resolution once per ring of chunks around the
+// camera, down to a grid of (TERRAIN_TILE_RESOLUTION - 1) >> (levels - 1).
+static constexpr uint32_t TERRAIN_LOD_LEVELS = 4;
+static constexpr int32_t TILE_PREFETCH_RADIUS = 5;
+
+static constexpr std::size_t MAX_OBJECTS = 16384;
+// Clip transforms of one swapchain image's copy of the object buffer.
+static constexpr VkDeviceSize OBJECT_BUFFER_SIZE = MAX_OBJECTS * sizeof(glm::mat4);
+
+static constexpr uint32_t BINDLESS_MAX_BUFFERS = 1024;
+static constexpr uint32_t BINDLESS_MAX_IMAGES = 1024;
+
+static constexpr std::size_t PIPELINE_COMPILE_THREADS = 2;
+// Specialization constant 0 of shader.frag.
+static constexpr uint32_t SHADING_WIREFRAME = 1;
+
+// Frames the CPU may prepare while the GPU is still rendering earlier ones.
+static constexpr std::size_t FRAMES_IN_FLIGHT = 2;
+// Frame times a live session keeps without reallocating, about 18 minutes
+// at 60 Hz.
+static constexpr std::size_t LIVE_TIMING_FRAMES = 65536;
+static constexpr uint64_t ALLOCATION_WARMUP_FRAMES = 120;
+// Every presented frame becomes one video frame, whatever the frame time.
+static constexpr uint32_t VIDEO_FRAME_RATE = 60;
+
+static const glm::vec3 CAMERA_EYE(2.0f, 2.0f, 2.0f);
+
+// Secondary command buffers of each scene pass, executed in this order.
+static constexpr uint32_t OBJECT_SEGMENT = 0;
+static constexpr uint32_t TERRAIN_SEGMENT = 1;
+static constexpr uint32_t SEGMENTS_PER_PASS = 2;
+
+// Non-dispatchable handles are pointers on the 64 bit platforms that
+// DeletionQueue.h requires, so a handle fits one segment input.
+template <typename T>
+static uint64_t handle_input(T handle) {
+    return reinterpret_cast<uint64_t>(handle);
+}
+
+static uint64_t tile_input(TileCoord coord) {
+    return (uint64_t{static_cast<uint32_t>(coord.x)} << 32) | static_cast<uint32_t>(coord.y);
+}
+
+// The heights of a tile file's vertices as one grid, decoded the way
+// upload_tiles does, so that picking hits what is drawn, quantization of
+// packed tiles included. Neighbouring tiles share their edge vertices.
+static std::unique_ptr<HeightPyramid> tile_height_pyramid(const TileFile& file) {
+    const auto& layout = file.header();
+    uint32_t resolution = layout.tile_resolution;
+    uint32_t width = layout.tiles_x * (resolution - 1) + 1;
+    uint32_t height = layout.tiles_y * (resolution - 1) + 1;
+    std::vector<float> heights(std::size_t{width} * height);
+
+    MeshCodec codec;
+    std::vector<Vertex> vertices(std::size_t{resolution} * resolution);
+    std::vector<uint16_t> indices;
+    for(uint32_t y = 0; y < layout.tiles_y; ++y) {
+        for(uint32_t x = 0; x < layout.tiles_x; ++x) {
+            TileCoord coord = {static_cast<int32_t>(x), static_cast<int32_t>(y)};
+            const auto& entry = file.entry(coord);
+            if(entry.vertex_count != vertices.size()) {
+                throw std::runtime_error("Tile is not a grid of the file's tile resolution!");
+            }
+            const std::byte* data = file.tile_data(coord);
+            if(entry.encoding == TileEncoding::MeshCodec) {
+                indices.resize(entry.index_count);
+                codec.decode_mesh(data, entry.size, vertices.data(), vertices.size(), indices.data(), indices.size());
+            } else {
+                std::memcpy(vertices.data(), data, vertices.size() * sizeof(Vertex));
+            }
+            for(uint32_t row = 0; row < resolution; ++row) {
+                for(uint32_t col = 0; col < resolution; ++col) {
+                    std::size_t sample = std::size_t{y * (resolution - 1) + row} * width + x * (resolution - 1) + col;
+                    heights[sample] = vertices[std::size_t{row} * resolution + col].pos.z;
+                }
+            }
+        }
+    }
+    return std::make_unique<HeightPyramid>(heights, glm::vec2(layout.origin_x, layout.origin_y), 
+        layout.tile_extent / (resolution - 1), width, height);
+}
+
 
-Simulation::Simulation() {
+const char* terrain_detail_name(TerrainDetail detail) {
+    switch(detail) {
+        case TerrainDetail::Full: return "full grid";
+        case TerrainDetail::Tessellated: return "hardware tessellation";
+        case TerrainDetail::CpuLod: return "CPU LOD";
+        case TerrainDetail::Tiles: return "tile meshes";
+        default: return "unknown";
+    }
+}
  
+Simulation::Simulation(const SimulationOptions& options):
+    m_options(options),
+    m_jobs(std::make_unique<JobSystem>()),
+    m_host_allocator(m_host_memory.callbacks())
+{
+    for(std::size_t slot = 0; slot < FRAMES_IN_FLIGHT; ++slot) {
+        m_frame_slots.emplace_back(m_jobs->thread_count());
+    }
+    if(!m_options.replay_file.empty()) {
+        m_replay = std::make_unique<CaptureReader>(m_options.replay_file);
+        std::cout << "Replaying " << m_replay->frame_count() << " frames from " << m_options.replay_file << "\n";
+        m_frame_timings.reserve(m_replay->frame_count());
+    } else {
+        m_frame_timings.reserve(LIVE_TIMING_FRAMES);
+        m_gpu_timings.reserve(LIVE_TIMING_FRAMES);
+    }
+    if(!m_options.capture_file.empty()) {
+        m_capture = std::make_unique<CaptureWriter>(m_options.capture_file);
+    }
+    if(m_options.on_demand) {
+        if(m_replay) {
+            std::cout << "Replays draw every captured frame, on-demand rendering disabled\n";
+        } else if(!m_options.video_file.empty()) {
+            std::cout << "Videos need a frame per refresh, on-demand rendering disabled\n";
+        } else {
+            m_on_demand = true;
+            m_animating = false;
+            std::cout << "Rendering on demand, Space resumes the animation\n";
+        }
+    }
+    if(!m_options.scene_file.empty()) {
+        m_scene = std::make_unique<SceneFile>(m_options.scene_file);
+        std::cout << "Loaded scene " << m_options.scene_file << ": " << m_scene->mesh_count() << " meshes, " 
+            << m_scene->heightmap_count() << " heightmaps\n";
+    }
+
+    m_camera.look_at(CAMERA_EYE, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    m_camera.set_perspective(45.0f, 1.0f, 0.1f, 10.0f);
+
+    m_quad_object = m_transforms.add(glm::vec3(0.0f));
+    m_terrain_object = m_transforms.add(glm::vec3(0.0f));
 }
  
 Simulation::~Simulation() {
+    if(m_capture) {
+        m_capture->close();
+        std::cout << "Captured " << m_capture->frame_count() << " frames to " << m_options.capture_file << "\n";
+    }
+    // Finishes encoding the frames still in flight.
+    m_recorder.reset();
+
     cleanup_swapchain();
-    vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
-    vkFreeMemory(m_device, m_ubo_mem, nullptr);
-    vkDestroyBuffer(m_device, m_ubo, nullptr);
-    vkFreeMemory(m_device, m_ibo_mem, nullptr);
-    vkDestroyBuffer(m_device, m_ibo, nullptr);
-    vkFreeMemory(m_device, m_vbo_mem, nullptr);
-    vkDestroyBuffer(m_device, m_vbo, nullptr);
-    vkDestroySemaphore(m_device, m_image_available_semaphore, nullptr);
-    vkDestroySemaphore(m_device, m_render_finished_semaphore, nullptr);
-
-    vkDestroyDescriptorSetLayout(m_device, m_desc_set_layout, nullptr);
-    vkDestroyCommandPool(m_device, m_command_pool, nullptr);
-    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+    m_frame_graphs.clear();
+    m_segments.reset();
+    m_hiz.reset();
+    m_frame_descriptors.clear();
+    m_bindless.reset();
+    m_tile_streamer.reset();
+    m_tile_cache.reset();
+    m_tile_file.reset();
+    // Handles only retire their objects, so they have to go before the
+    // queue destroying them does. Freeing memory unmaps it.
+    m_terrain_queries.reset();
+    m_heightmap_sampler.reset();
+    m_heightmap_view.reset();
+    m_heightmap_image.reset();
+    m_heightmap_mem.reset();
+    m_grid_ibo.reset();
+    m_grid_ibo_mem.reset();
+    m_tile_staging.reset();
+    m_tile_staging_mem.reset();
+    m_object_buffer.reset();
+    m_object_buffer_mem.reset();
+    m_ubo.reset();
+    m_ubo_mem.reset();
+    m_ibo.reset();
+    m_ibo_mem.reset();
+    m_vbo.reset();
+    m_vbo_mem.reset();
+    m_frame_slots.clear();
+    m_frame_queries.reset();
+    m_deletions.reset();
+    m_sync.reset();
+
+    m_pipelines.reset();
+    m_layout_cache.reset();
+    vkDestroyCommandPool(m_device, m_command_pool, m_host_allocator);
+    if(m_transfer_command_pool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(m_device, m_transfer_command_pool, m_host_allocator);
+    }
+    vkDestroySurfaceKHR(m_instance, m_surface, m_host_allocator);
     auto vkDestroyDebugReportCallbackEXT = 
         (PFN_vkDestroyDebugReportCallbackEXT) vkGetInstanceProcAddr(m_instance, "vkDestroyDebugReportCallbackEXT");
     if(vkDestroyDebugReportCallbackEXT) {
-        vkDestroyDebugReportCallbackEXT(m_instance, m_debug_callback, nullptr);
+        vkDestroyDebugReportCallbackEXT(m_instance, m_debug_callback, m_host_allocator);
     }
-    vkDestroyDevice(m_device, nullptr);
+    vkDestroyDevice(m_device, m_host_allocator);
 
-    vkDestroyInstance(m_instance, nullptr);
+    vkDestroyInstance(m_instance, m_host_allocator);
     glfwDestroyWindow(m_window);
     glfwTerminate();
 }
@@ -49,14 +236,218 @@ Simulation::~Simulation() {
 void Simulation::run() {
     create_window();
     setup_device();
+    m_start_time = std::chrono::steady_clock::now();
+    m_last_frame_time = m_start_time;
+    m_start_cpu_time = std::clock();
 
     while (!glfwWindowShouldClose(m_window)) {
         glfwPollEvents();
+        if(m_on_demand) {
+            if(scene_changed()) {
+                // Occlusion culling tests against the depth of the oldest
+                // frame in flight, so what a change uncovers is only drawn
+                // FRAMES_IN_FLIGHT frames later.
+                uint32_t frames = m_occlusion_culling ? static_cast<uint32_t>(FRAMES_IN_FLIGHT) + 1 : 1;
+                m_redraw_frames = std::max(m_redraw_frames, frames);
+            }
+            if(m_redraw_frames == 0) {
+                auto wait_start = std::chrono::steady_clock::now();
+                glfwWaitEvents();
+                m_idle_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - wait_start).count();
+                continue;
+            }
+            m_redraw_frames -= 1;
+        }
+
+        auto frame_start = std::chrono::steady_clock::now();
+        uint64_t thread_allocations = thread_allocation_count();
+        uint64_t allocations = allocation_count();
+        if(!begin_frame()) {
+            break;
+        }
         draw_frame();
-        vkQueueWaitIdle(m_present_queue);
+        // The next frame takes the slot of the oldest one in flight, which
+        // has to be done first. The others keep the GPU busy meanwhile.
+        m_frame_slot = (m_frame_slot + 1) % m_frame_slots.size();
+        m_sync->wait(m_frame_slots[m_frame_slot].point);
+        end_frame();
+        auto frame_end = std::chrono::steady_clock::now();
+        m_frame_timings.add(std::chrono::duration<double, std::milli>(frame_end - frame_start).count());
+        count_frame_allocations(thread_allocation_count() - thread_allocations, allocation_count() - allocations);
     }
 
     vkDeviceWaitIdle(m_device);
+    m_frame_timings.report(std::cout, m_replay ? "Replay frame times" : "Frame times");
+    report_terrain_statistics();
+    if(m_hiz) {
+        report_occlusion_statistics();
+    }
+    if(m_frame_queries) {
+        m_gpu_timings.report(std::cout, "GPU frame times");
+    }
+    if(m_resolution) {
+        m_resolution->report(std::cout);
+    }
+    m_pipelines->report(std::cout);
+    m_segments->report(std::cout);
+    m_jobs->report(std::cout);
+    for(const auto& slot : m_frame_slots) {
+        slot.arenas.report(std::cout);
+    }
+    m_host_memory.report(std::cout);
+    m_sync->report(std::cout);
+    if(m_tile_cache && m_transfer_queue == VK_NULL_HANDLE) {
+        std::cout << "\t|> transfer: none, tile uploads were submitted to the graphics queue\n";
+    }
+    if(m_recorder) {
+        m_recorder->report(std::cout);
+    }
+    m_deletions->report(std::cout);
+    report_frame_allocations();
+    report_utilization();
+}
+ 
+void Simulation::count_frame_allocations(uint64_t thread_allocations, uint64_t allocations) {
+    // Frames rendered before the warm-up is over still fill caches, pools
+    // and arenas.
+    if(m_frame_timings.count() <= ALLOCATION_WARMUP_FRAMES) {
+        return;
+    }
+    m_steady_frames += 1;
+    m_steady_allocating_frames += thread_allocations > 0 ? 1 : 0;
+    m_steady_thread_allocations += thread_allocations;
+    m_steady_allocations += allocations;
+}
+ 
+void Simulation::report_frame_allocations() const {
+    if(m_steady_frames == 0) {
+        return;
+    }
+    double frames = static_cast<double>(m_steady_frames);
+    std::cout << "Heap allocations after " << ALLOCATION_WARMUP_FRAMES << " warm-up frames: " 
+        << m_steady_thread_allocations / frames << " per frame on the main thread (" << m_steady_allocating_frames 
+        << " of " << m_steady_frames << " frames allocated), " << m_steady_allocations / frames 
+        << " per frame on all threads\n";
+}
+ 
+bool Simulation::scene_changed() const {
+    if(m_animating || m_was_resized || !m_pending_input.empty()) {
+        return true;
+    }
+    // Tiles waiting for upload, including those a budget left for later.
+    return m_tile_streamer && (!m_tile_upload_queue.empty() || m_tile_streamer->ready() > 0);
+}
+ 
+void Simulation::report_utilization() const {
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start_time).count();
+    if(wall_seconds <= 0.0) {
+        return;
+    }
+    double cpu_seconds = static_cast<double>(std::clock() - m_start_cpu_time) / CLOCKS_PER_SEC;
+    std::cout << (m_on_demand ? "On-demand" : "Continuous") << " rendering: " << m_frame_timings.count() 
+        << " frames in " << wall_seconds << " s, " << m_idle_seconds << " s waiting for events\n";
+    std::cout << "\t|> CPU: " << 100.0 * cpu_seconds / wall_seconds << "% of one core, all threads\n";
+    if(m_frame_queries) {
+        double gpu_seconds = m_gpu_timings.mean() * m_gpu_timings.count() / 1000.0;
+        std::cout << "\t|> GPU: " << 100.0 * gpu_seconds / wall_seconds << "% busy between frame timestamps\n";
+    }
+}
+ 
+bool Simulation::begin_frame() {
+    if(m_replay) {
+        if(!m_replay->next(m_frame)) {
+            return false;
+        }
+        if(m_frame.width != m_swapchain_size.width || m_frame.height != m_swapchain_size.height) {
+            std::cout << "Warning: replay frame " << m_replay->frames_read() << " was captured at " 
+                << m_frame.width << "x" << m_frame.height << ", rendering at " 
+                << m_swapchain_size.width << "x" << m_swapchain_size.height << "\n";
+        }
+        m_camera.look_at(m_frame.camera_position, m_frame.camera_target, m_camera.up());
+    } else {
+        auto now = std::chrono::steady_clock::now();
+        if(m_animating) {
+            m_frame.time += std::chrono::duration<double>(now - m_last_frame_time).count();
+        }
+        m_last_frame_time = now;
+        // Swapped rather than moved so that both keep their storage.
+        m_frame.input.swap(m_pending_input);
+        m_pending_input.clear();
+    }
+
+    for(const auto& event : m_frame.input) {
+        handle_key(event.key, event.action);
+    }
+
+    m_frame_number += 1;
+    if(m_tile_cache) {
+        m_tile_cache->begin_frame(m_frame_number, m_completed_frame);
+    }
+    m_frame_uploads.clear();
+    m_memory_budget->update();
+    if(m_heightmap_terrain) {
+        if(m_replay) {
+            set_drawn_tiles(m_frame.draws.data(), m_frame.draws.size());
+        } else {
+            auto chunks = visible_terrain_chunks(frame_arena());
+            cull_occluded_chunks(chunks);
+            set_drawn_tiles(chunks.data(), chunks.size());
+        }
+        if(m_terrain_detail == TerrainDetail::CpuLod) {
+            m_lod_center = terrain_center_chunk();
+        }
+    } else if(m_replay) {
+        replay_tile_streaming();
+    } else {
+        update_tile_streaming();
+    }
+    update_ubo();
+    return true;
+}
+ 
+void Simulation::end_frame() {
+    // run() waited for the frame in this slot, so nothing uses its transient
+    // data any more and its results are ready.
+    auto& slot = m_frame_slots[m_frame_slot];
+    slot.arenas.reset();
+    m_sync->update();
+    m_deletions->collect();
+    if(m_recorder) {
+        m_recorder->collect();
+    }
+    if(slot.submitted) {
+        slot.submitted = false;
+        m_completed_frame = slot.frame;
+        collect_terrain_statistics(slot.image);
+        if(m_hiz) {
+            m_hiz->read(m_occlusion, slot.image);
+            m_occlusion_gpu_ms += m_hiz->last_milliseconds();
+            m_occlusion_gpu_frames += 1;
+        }
+        if(m_frame_queries) {
+            std::array<uint64_t, 2> timestamps = {};
+            vkGetQueryPoolResults(m_device, m_frame_queries.get(), 2 * slot.image, 2, sizeof(timestamps), 
+                timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            double gpu_ms = (timestamps[1] - timestamps[0]) * static_cast<double>(m_timestamp_period) / 1e6;
+            m_gpu_timings.add(gpu_ms);
+            if(m_resolution && m_resolution->update(gpu_ms)) {
+                update_render_scale();
+                m_command_buffer_dirty.assign(m_command_buffers.size(), true);
+                std::cout << "Render scale " << m_resolution->scale() << " (" << m_render_size.width << "x" 
+                    << m_render_size.height << ") after a " << gpu_ms << " ms GPU frame\n";
+            }
+        }
+    }
+    if(!m_capture) {
+        return;
+    }
+    m_frame.width = m_swapchain_size.width;
+    m_frame.height = m_swapchain_size.height;
+    m_frame.camera_position = m_camera.position();
+    m_frame.camera_target = m_camera.target();
+    m_frame.uploads = m_frame_uploads;
+    m_frame.draws = m_drawn_tiles;
+    m_capture->write(m_frame);
 }
  
 void Simulation::create_window() {
@@ -68,6 +459,9 @@ void Simulation::create_window() {
     }
     glfwSetWindowUserPointer(m_window, this);
     glfwSetWindowSizeCallback(m_window, glfw_resize_callback);
+    glfwSetKeyCallback(m_window, glfw_key_callback);
+    glfwSetWindowRefreshCallback(m_window, glfw_refresh_callback);
+    glfwSetMouseButtonCallback(m_window, glfw_mouse_button_callback);
 }
  
 void Simulation::setup_device() {
@@ -91,25 +485,40 @@ void Simulation::setup_device() {
     createInfo.enabledLayerCount = layers.size();
     createInfo.ppEnabledLayerNames = layers.data();
 
-    VkResult result = vkCreateInstance(&createInfo, nullptr, &m_instance);
+    VkResult result = vkCreateInstance(&createInfo, m_host_allocator, &m_instance);
     if(result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create vulkan instance.");
     }
     setup_debug_callback();
     make_logical_device(); 
+    create_descriptor_allocators();
     setup_surface();
+    setup_dynamic_resolution();
+    setup_views();
     setup_framebuffer();
     setup_render_pass();
+    m_pipelines = std::make_unique<PipelineManager>(m_device, PipelineManager::load_shader_file, 
+        PIPELINE_COMPILE_THREADS, m_host_allocator);
     create_pipeline();
-    create_framebuffer();
+    if(m_occlusion_culling) {
+        create_occlusion_culling();
+    }
     create_command_pool();
     create_vbo();
     create_ibo();
+    if(m_heightmap_terrain) {
+        create_heightmap();
+    } else {
+        if(m_scene && m_scene->heightmap_count() > 0) {
+            std::cout << "Drawing terrain tiles, the heightmap baked into " << m_options.scene_file 
+                << " is only used with LANDSCAPE_TERRAIN=heightmap, lod or tessellated\n";
+        }
+        create_tile_streaming();
+    }
+    m_scene.reset();
     create_semaphores();
-    create_ubo();
-    create_descriptor_pool();
-    create_descriptor_set();
     create_command_buffers();
+    create_frame_recorder();
 }
  
 std::vector<const char*> Simulation::get_extension_layers() {
@@ -201,7 +610,7 @@ void Simulation::setup_debug_callback() {
         throw std::runtime_error("Can't load vkCreateDebugReportCallbackEXT function pointer!");
     }
 
-    vkCreateDebugReportCallbackEXT(m_instance, &debug_info, nullptr, &m_debug_callback);
+    vkCreateDebugReportCallbackEXT(m_instance, &debug_info, m_host_allocator, &m_debug_callback);
     
 }
  
@@ -248,19 +657,31 @@ void Simulation::make_logical_device() {
         }
         i += 1;
     }
+    // A family that can only copy is usually backed by DMA engines, which
+    // upload tiles while the graphics queue keeps rendering.
+    int transfer_id = -1;
+    for(uint32_t family = 0; family < queue_family_count; ++family) {
+        VkQueueFlags flags = queue_families[family].queueFlags;
+        if((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            transfer_id = static_cast<int>(family);
+            break;
+        }
+    }
     float queue_priorities = 1.0;
 
-    VkDeviceQueueCreateInfo queueCreateInfo = {};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = id;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &queue_priorities;
+    std::array<VkDeviceQueueCreateInfo, 2> queueCreateInfos = {};
+    for(auto& queueCreateInfo : queueCreateInfos) {
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queue_priorities;
+    }
+    queueCreateInfos[0].queueFamilyIndex = id;
 
     VkPhysicalDeviceFeatures device_features = {};
     VkDeviceCreateInfo device_info = {};
     device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     device_info.pEnabledFeatures = &device_features;
-    device_info.pQueueCreateInfos = &queueCreateInfo;
+    device_info.pQueueCreateInfos = queueCreateInfos.data();
     device_info.queueCreateInfoCount = 1;
 
     uint32_t extension_count;
@@ -273,32 +694,256 @@ void Simulation::make_logical_device() {
         const auto& ex = extensions[i];
         std::cout << "\t" << ex.extensionName << ". Spec version " << ex.specVersion << "\n";
     }
+    ExtensionSet available_extensions(extensions);
 
     std::vector<const char*> device_extensions = {
         "VK_KHR_swapchain",
     };
 
+    bool memory_budget = available_extensions.contains(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if(memory_budget) {
+        device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    }
+
+    const char* bindless_env = std::getenv("LANDSCAPE_BINDLESS");
+    bool want_bindless = bindless_env && std::strcmp(bindless_env, "0") != 0;
+    m_bindless_enabled = want_bindless && BindlessTable::supported(physical_device);
+    if(want_bindless && !m_bindless_enabled) {
+        std::cout << "Descriptor indexing not supported, bindless descriptors disabled\n";
+    }
+
+    const char* occlusion_env = std::getenv("LANDSCAPE_OCCLUSION");
+    m_occlusion_culling = occlusion_env && std::strcmp(occlusion_env, "0") != 0;
+
+    // The pyramid is built by sampling depth, so the format has to allow it.
+    VkFormatFeatureFlags depth_features = 
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    VkFormatProperties depth_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_D32_SFLOAT, &depth_properties);
+    m_depth_format = (depth_properties.optimalTilingFeatures & depth_features) == depth_features 
+        ? VK_FORMAT_D32_SFLOAT : VK_FORMAT_D16_UNORM;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    if(queue_families[id].timestampValidBits > 0) {
+        m_timestamp_period = properties.limits.timestampPeriod;
+    }
+
+    const char* terrain_env = std::getenv("LANDSCAPE_TERRAIN");
+    std::string_view terrain_mode = terrain_env ? terrain_env : "";
+    bool want_tessellation = terrain_mode == "tessellated";
+    bool want_heightmap = want_tessellation || terrain_mode == "heightmap" || terrain_mode == "lod";
+    m_heightmap_terrain = want_heightmap && !m_bindless_enabled;
+    if(want_heightmap && !m_heightmap_terrain) {
+        std::cout << "Heightmap terrain has no bindless shader variant, using terrain tiles\n";
+    }
+
+    VkPhysicalDeviceFeatures supported_features;
+    vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+    m_wireframe_supported = supported_features.fillModeNonSolid == VK_TRUE;
+    device_features.fillModeNonSolid = supported_features.fillModeNonSolid;
+    if(m_heightmap_terrain) {
+        if(want_tessellation && supported_features.tessellationShader) {
+            device_features.tessellationShader = VK_TRUE;
+            m_terrain_detail = TerrainDetail::Tessellated;
+        } else if(want_tessellation) {
+            std::cout << "Tessellation shaders not supported, falling back to CPU terrain LOD\n";
+            m_terrain_detail = TerrainDetail::CpuLod;
+        } else if(terrain_mode == "lod") {
+            m_terrain_detail = TerrainDetail::CpuLod;
+        }
+    } else {
+        m_terrain_detail = TerrainDetail::Tiles;
+    }
+    // Counts the terrain triangles of every mode, so they can be compared.
+    if(supported_features.pipelineStatisticsQuery) {
+        device_features.pipelineStatisticsQuery = VK_TRUE;
+        m_pipeline_statistics = true;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing_features = BindlessTable::required_features();
+    if(m_bindless_enabled) {
+        device_features.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        device_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        device_info.pNext = &indexing_features;
+    }
+
+    const char* timeline_env = std::getenv("LANDSCAPE_TIMELINE");
+    bool want_timeline = !timeline_env || std::strcmp(timeline_env, "0") != 0;
+    bool timeline = want_timeline && QueueSync::supported(physical_device);
+    if(!timeline) {
+        std::cout << "Synchronizing queues with fences instead of timeline semaphores\n";
+    }
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features = {};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline_features.timelineSemaphore = VK_TRUE;
+    if(timeline) {
+        device_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        timeline_features.pNext = const_cast<void*>(device_info.pNext);
+        device_info.pNext = &timeline_features;
+    }
+    // With fences a wait on another queue is resolved on the host, which
+    // does not make the copies visible to the graphics queue.
+    if(transfer_id < 0) {
+        std::cout << "No dedicated transfer queue family, uploading tiles on the graphics queue\n";
+    } else if(!timeline) {
+        std::cout << "Uploading tiles on the graphics queue, the transfer queue needs timeline semaphores\n";
+        transfer_id = -1;
+    } else {
+        queueCreateInfos[1].queueFamilyIndex = static_cast<uint32_t>(transfer_id);
+        device_info.queueCreateInfoCount = 2;
+    }
+
+    // Core and required since Vulkan 1.1. The vertex shaders read
+    // gl_ViewIndex, so it is enabled even for a single view.
+    VkPhysicalDeviceMultiviewFeatures multiview_features = {};
+    multiview_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES;
+    VkPhysicalDeviceFeatures2 features2 = {};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    features2.pNext = &multiview_features;
+    vkGetPhysicalDeviceFeatures2(physical_device, &features2);
+    if(!multiview_features.multiview) {
+        throw std::runtime_error("Multiview not supported!");
+    }
+    multiview_features.multiviewGeometryShader = VK_FALSE;
+    multiview_features.multiviewTessellationShader = VK_FALSE;
+    multiview_features.pNext = const_cast<void*>(device_info.pNext);
+    device_info.pNext = &multiview_features;
+
+    VkPhysicalDeviceMultiviewProperties multiview_properties = {};
+    multiview_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties2 = {};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &multiview_properties;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties2);
+    m_max_views = multiview_properties.maxMultiviewViewCount;
+
     device_info.enabledExtensionCount = device_extensions.size();
     device_info.ppEnabledExtensionNames = device_extensions.data();
 
-    auto result = vkCreateDevice(physical_device, &device_info, nullptr, &m_device);
+    auto result = vkCreateDevice(physical_device, &device_info, m_host_allocator, &m_device);
     if(result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create device!");
     }
 
     vkGetDeviceQueue(m_device, id, 0, &m_queue);
     m_physical_device = physical_device;
+    m_memory_budget = std::make_unique<MemoryBudget>(physical_device, memory_budget);
+    m_sync = std::make_unique<QueueSync>(m_device, timeline, m_host_allocator);
+    m_graphics_sync = m_sync->add_queue("graphics", m_queue);
+    if(transfer_id >= 0) {
+        m_transfer_queue_idx = static_cast<uint32_t>(transfer_id);
+        vkGetDeviceQueue(m_device, m_transfer_queue_idx, 0, &m_transfer_queue);
+        m_transfer_sync = m_sync->add_queue("transfer", m_transfer_queue);
+    }
+    m_deletions = std::make_unique<DeletionQueue>(m_device, *m_sync, [this](VkDeviceMemory memory) {
+        free_memory(memory);
+    }, m_host_allocator);
     m_draw_queue_idx = id; 
     m_present_queue_idx = id; 
     m_present_queue = m_queue;
 }
  
 void Simulation::setup_surface() {
-    if (glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS) {
+    if (glfwCreateWindowSurface(m_instance, m_window, m_host_allocator, &m_surface) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create window surface!");
     }
     VkBool32 present_support = false;
     vkGetPhysicalDeviceSurfaceSupportKHR(m_physical_device, 0, m_surface, &present_support);
+    m_swapchain_format = VK_FORMAT_B8G8R8A8_SRGB;
+}
+ 
+void Simulation::setup_dynamic_resolution() {
+    const char* resolution_env = std::getenv("LANDSCAPE_DYNAMIC_RESOLUTION");
+    double target_ms = resolution_env ? std::strtod(resolution_env, nullptr) : 0.0;
+    if(target_ms <= 0.0) {
+        return;
+    }
+    if(m_timestamp_period == 0.0f) {
+        std::cout << "Dynamic resolution needs GPU timestamps, which are not supported\n";
+        return;
+    }
+
+    if(!can_blit_to_swapchain()) {
+        std::cout << "Swapchain images cannot be blitted to, dynamic resolution disabled\n";
+        return;
+    }
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device, m_swapchain_format, &format_properties);
+    m_upscale_filter = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) 
+        ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+
+    ResolutionSettings settings;
+    settings.target_ms = target_ms;
+    m_resolution = std::make_unique<ResolutionController>(settings);
+    std::cout << "Dynamic resolution enabled, targeting " << target_ms << " ms of GPU time per frame\n";
+
+    if(m_occlusion_culling) {
+        // The pyramid would include the stale depth outside the render area.
+        std::cout << "Occlusion culling reads the whole depth buffer, disabled with dynamic resolution\n";
+        m_occlusion_culling = false;
+    }
+}
+ 
+void Simulation::setup_views() {
+    if(m_options.views <= 1) {
+        return;
+    }
+    uint32_t views = std::min({m_options.views, MAX_VIEWS, m_max_views});
+    if(views < m_options.views) {
+        std::cout << "At most " << views << " views supported\n";
+    }
+    if(m_bindless_enabled) {
+        std::cout << "The bindless shader has no view matrices, rendering one view\n";
+        return;
+    }
+    if(m_terrain_detail == TerrainDetail::Tessellated) {
+        std::cout << "Tessellated terrain is placed without the view index, rendering one view\n";
+        return;
+    }
+    // The views are rendered to the layers of the scene color image, which
+    // are placed side by side in the swapchain images.
+    if(!can_blit_to_swapchain()) {
+        std::cout << "Swapchain images cannot be blitted to, rendering one view\n";
+        return;
+    }
+    m_view_count = views;
+    m_separate_views = m_options.separate_views;
+    if(!m_resolution) {
+        // Only the last view is stretched, by less than a pixel per view.
+        m_upscale_filter = VK_FILTER_NEAREST;
+    }
+    std::cout << "Rendering " << m_view_count << " views " 
+        << (m_separate_views ? "with one scene pass each" : "with one multiview scene pass") << "\n";
+
+    if(m_occlusion_culling) {
+        std::cout << "Occlusion culling reads a single view's depth, disabled with multiple views\n";
+        m_occlusion_culling = false;
+    }
+}
+ 
+bool Simulation::can_blit_to_swapchain() const {
+    // The scene color image shares the swapchain format.
+    VkSurfaceCapabilitiesKHR surface_capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physical_device, m_surface, &surface_capabilities);
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device, m_swapchain_format, &format_properties);
+    VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT 
+        | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    return (surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT) 
+        && (format_properties.optimalTilingFeatures & blit_features) == blit_features;
+}
+ 
+void Simulation::create_frame_queries() {
+    VkQueryPoolCreateInfo queryInfo = {};
+    queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = static_cast<uint32_t>(2 * m_command_buffers.size());
+    VkQueryPool frame_queries;
+    if(vkCreateQueryPool(m_device, &queryInfo, m_host_allocator, &frame_queries) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create frame query pool!");
+    }
+    m_frame_queries = own(frame_queries);
 }
  
 void Simulation::setup_framebuffer() {
@@ -336,8 +981,10 @@ void Simulation::setup_framebuffer() {
         std::cout << "\t" << mode << "\n";
     }
 
-    m_swapchain_format = VK_FORMAT_B8G8R8A8_SRGB;
     m_swapchain_size = choose_swapchain_extent();
+    m_view_size = {std::max(m_swapchain_size.width / m_view_count, uint32_t{1}), m_swapchain_size.height};
+    m_camera.set_aspect(static_cast<float>(m_view_size.width) / m_view_size.height);
+    update_render_scale();
 
     VkSwapchainCreateInfoKHR createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -346,18 +993,26 @@ void Simulation::setup_framebuffer() {
     createInfo.imageExtent = m_swapchain_size;
     createInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
     createInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    createInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    createInfo.presentMode = choose_present_mode(present_modes);
     createInfo.imageArrayLayers = 1;
     createInfo.minImageCount = std::max(surface_capabilities.minImageCount, uint32_t{3});
     createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
     createInfo.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     createInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if(renders_to_scene_color()) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+    m_swapchain_readback = (surface_capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != 0
+        && FrameRecorder::supports_format(m_swapchain_format);
+    if(m_swapchain_readback) {
+        createInfo.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    }
     createInfo.queueFamilyIndexCount = 1;
     createInfo.pQueueFamilyIndices = &m_draw_queue_idx;
     createInfo.imageFormat = m_swapchain_format;
     createInfo.clipped = VK_TRUE;
 
-    VkResult result = vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapchain);
+    VkResult result = vkCreateSwapchainKHR(m_device, &createInfo, m_host_allocator, &m_swapchain);
     if(result != VK_SUCCESS) {
         throw std::runtime_error("Failed to create swapchain!");
     }
@@ -367,7 +1022,7 @@ void Simulation::setup_framebuffer() {
     m_swap_chain_images.resize(swapchain_size);
     vkGetSwapchainImagesKHR(m_device, m_swapchain, &swapchain_size, m_swap_chain_images.data());
 
-    m_swap_chain_views.resize(createInfo.minImageCount);
+    m_swap_chain_views.clear();
     for(uint32_t i = 0; i < createInfo.minImageCount; ++i) {
         VkImageViewCreateInfo view_create = {};
         view_create.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -385,190 +1040,112 @@ void Simulation::setup_framebuffer() {
         view_create.subresourceRange.baseArrayLayer = 0;
         view_create.subresourceRange.layerCount = 1;
 
-        VkResult result = vkCreateImageView(m_device, &view_create, nullptr, &m_swap_chain_views[i]);
+        VkImageView view;
+        VkResult result = vkCreateImageView(m_device, &view_create, m_host_allocator, &view);
         if(result != VK_SUCCESS) {
             throw std::runtime_error("Failed to create image view!");
         }
+        m_swap_chain_views.push_back(own(view));
     }
 }
  
 void Simulation::create_pipeline() {
-    auto vert_file = load_shader_file("../src/glsl/vert.spv");
-    auto frag_file = load_shader_file("../src/glsl/frag.spv");
-    std::cout << vert_file.size() << std::endl;
-    std::cout << frag_file.size() << std::endl;
-
-    auto vert_module = make_shader_module(vert_file);
-    auto frag_module = make_shader_module(frag_file);
-
-    std::array<VkPipelineShaderStageCreateInfo, 2> stages;
-
-    stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[0].pNext = nullptr;
-    stages[0].pSpecializationInfo = nullptr;
-    stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-    stages[0].module = vert_module;
-    stages[0].pName = "main";
-
-    stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    stages[1].pNext = nullptr;
-    stages[1].pSpecializationInfo = nullptr;
-    stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    stages[1].module = frag_module;
-    stages[1].pName = "main";
-
-    auto binding_desc = Vertex::binding_desc();
-    auto attrib_desc = Vertex::attrib_desc();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = &binding_desc;
-    vertexInputInfo.vertexAttributeDescriptionCount = 2;
-    vertexInputInfo.pVertexAttributeDescriptions = attrib_desc.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {};
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.width = (float) m_swapchain_size.width;
-    viewport.height = (float) m_swapchain_size.height;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-
-    VkRect2D scissor = {};
-    scissor.offset = {0, 0};
-    scissor.extent = m_swapchain_size;
-
-    VkPipelineViewportStateCreateInfo viewportState = {};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer = {};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE;
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling = {};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_FALSE;
-    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampling.minSampleShading = 1.0f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-    colorBlendAttachment.colorWriteMask = 
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_FALSE;
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending = {};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
-    auto ubo_binding = Uniforms::binding_desc();
-    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
-    layoutInfo.pBindings = &ubo_binding;
+    if(m_bindless) {
+        m_desc_set_layout = m_bindless->layout();
+    } else {
+        std::vector<VkDescriptorSetLayoutBinding> bindings = {
+            Uniforms::binding_desc(),
+            ObjectTransforms::binding_desc(),
+        };
+        if(m_heightmap_terrain) {
+            bindings.push_back(TerrainHeightmap::binding_desc());
+        }
+        if(m_terrain_detail == TerrainDetail::Tessellated) {
+            // The control shader measures edges and the evaluation shader
+            // displaces vertices, both with the transforms and heightmap.
+            for(auto& binding : bindings) {
+                if(binding.binding != 0) {
+                    binding.stageFlags |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT 
+                        | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+                }
+            }
+        }
+        m_desc_set_layout = m_layout_cache->get(bindings);
+    }
 
-    if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &m_desc_set_layout) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor set layout!");
-    } 
+    // All pipeline variants share this layout so the frame descriptors stay
+    // bound when switching between them.
+    m_push_constant_stages = VK_SHADER_STAGE_VERTEX_BIT;
+    if(m_terrain_detail == TerrainDetail::Tessellated) {
+        m_push_constant_stages |= VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+    }
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = m_push_constant_stages;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = m_heightmap_terrain ? sizeof(TerrainPushConstants) : sizeof(uint32_t);
+    bool push_constants = m_bindless || m_heightmap_terrain;
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
     pipelineLayoutInfo.pSetLayouts = &m_desc_set_layout;
-    pipelineLayoutInfo.pushConstantRangeCount = 0;
-    pipelineLayoutInfo.pPushConstantRanges = nullptr;
+    pipelineLayoutInfo.pushConstantRangeCount = push_constants ? 1 : 0;
+    pipelineLayoutInfo.pPushConstantRanges = push_constants ? &pushConstantRange : nullptr;
 
-    if(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &m_pipeline_layout) != VK_SUCCESS) {
+    VkPipelineLayout pipeline_layout;
+    if(vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, m_host_allocator, &pipeline_layout) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create pipeline layout!");
     }
-
-    VkGraphicsPipelineCreateInfo pipelineInfo = {};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = stages.data();
-    pipelineInfo.pTessellationState = nullptr;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = nullptr;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = nullptr;
-    pipelineInfo.layout = m_pipeline_layout;
-    pipelineInfo.renderPass = m_render_pass;
-    pipelineInfo.subpass = 0;
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    if(vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create pipeline!");
+    m_pipeline_layout = own(pipeline_layout);
+
+    m_pipelines->set_target(m_render_pass.get(), m_pipeline_layout.get());
+
+    m_scene_state = PipelineState();
+    m_scene_state.vertex_shader = m_bindless ? "../src/glsl/vert_bindless.spv" : "../src/glsl/vert.spv";
+    m_scene_state.fragment_shader = "../src/glsl/frag.spv";
+    m_pipelines->prepare(m_scene_state);
+
+    if(m_heightmap_terrain) {
+        // Same state, but vertices are pulled from the heightmap by index.
+        m_terrain_state = m_scene_state;
+        m_terrain_state.vertex_input = false;
+        if(m_terrain_detail == TerrainDetail::Tessellated) {
+            m_terrain_state.vertex_shader = "../src/glsl/vert_terrain_tess.spv";
+            m_terrain_state.tessellation_control_shader = "../src/glsl/tesc_terrain.spv";
+            m_terrain_state.tessellation_evaluation_shader = "../src/glsl/tese_terrain.spv";
+            m_terrain_state.topology = VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+            m_terrain_state.patch_control_points = 4;
+            // The winding of generated triangles follows the tessellator's
+            // domain rather than the grid, so draw both faces.
+            m_terrain_state.cull_mode = VK_CULL_MODE_NONE;
+        } else {
+            m_terrain_state.vertex_shader = "../src/glsl/vert_terrain.spv";
+        }
+        m_pipelines->prepare(m_terrain_state);
     }
 
-    vkDestroyShaderModule(m_device, vert_module, nullptr);
-    vkDestroyShaderModule(m_device, frag_module, nullptr);
+    // Not needed until toggled, so compile them in the background.
+    if(m_wireframe_supported) {
+        m_pipelines->request(wireframe_state(m_scene_state));
+        if(m_heightmap_terrain) {
+            m_pipelines->request(wireframe_state(m_terrain_state));
+        }
+    }
 }
  
-std::vector<char> Simulation::load_shader_file(const std::string& filename) {
-    std::ifstream file(filename, std::ios::binary | std::ios::in);
-
-    file.seekg(0, std::ios::end);
-    auto size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    std::vector<char> data(size);
-    file.read(data.data(), data.size());
-
-    return data;
+PipelineState Simulation::wireframe_state(const PipelineState& state) const {
+    PipelineState wireframe = state;
+    wireframe.polygon_mode = VK_POLYGON_MODE_LINE;
+    wireframe.cull_mode = VK_CULL_MODE_NONE;
+    wireframe.specialization = {SHADING_WIREFRAME};
+    return wireframe;
 }
  
-VkShaderModule Simulation::make_shader_module(const std::vector<char>& data) {
-    VkShaderModuleCreateInfo create_info = {};
-    create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    create_info.codeSize = data.size();
-    create_info.pCode = reinterpret_cast<const uint32_t*>(data.data());
-    create_info.flags = 0;
-
-    VkShaderModule module;
-    VkResult result = ::vkCreateShaderModule(m_device, &create_info, nullptr, &module);
-    if(result != VK_SUCCESS) {
-        throw std::runtime_error("Unable to create shader module!");
+VkPipeline Simulation::pipeline_variant(const PipelineState& state) {
+    if(!m_wireframe) {
+        return m_pipelines->get(state, state);
     }
-    return module;
+    return m_pipelines->get(wireframe_state(state), state);
 }
  
 void Simulation::setup_render_pass() {
@@ -579,59 +1156,97 @@ void Simulation::setup_render_pass() {
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Layout transitions and the wait on the acquired image are done by the
+    // frame graph around the pass.
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription depthAttachment = {};
+    depthAttachment.format = m_depth_format;
+    depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    // Only the depth pyramid reads depth after the pass.
+    depthAttachment.storeOp = m_occlusion_culling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
     VkAttachmentReference colorAttachmentRef = {};
     colorAttachmentRef.attachment = 0;
     colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+    VkAttachmentReference depthAttachmentRef = {};
+    depthAttachmentRef.attachment = 1;
+    depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
     VkSubpassDescription subpass = {};
     subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
     subpass.colorAttachmentCount = 1;
     subpass.pColorAttachments = &colorAttachmentRef;
+    subpass.pDepthStencilAttachment = &depthAttachmentRef;
 
+    std::array<VkAttachmentDescription, 2> attachments = {colorAttachment, depthAttachment};
     VkRenderPassCreateInfo renderPassInfo = {};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &colorAttachment;
+    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    renderPassInfo.pAttachments = attachments.data();
     renderPassInfo.subpassCount = 1;
     renderPassInfo.pSubpasses = &subpass;
 
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.srcAccessMask = 0;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &dependency;
-
-    if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_render_pass) != VK_SUCCESS) {
+    // Every draw is broadcast to all views, each rendered to its layer of
+    // the attachments with its gl_ViewIndex. The views see nearly the same
+    // geometry, which the correlation mask lets the implementation exploit.
+    uint32_t view_mask = (1u << m_view_count) - 1;
+    VkRenderPassMultiviewCreateInfo multiviewInfo = {};
+    multiviewInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO;
+    multiviewInfo.subpassCount = 1;
+    multiviewInfo.pViewMasks = &view_mask;
+    multiviewInfo.correlationMaskCount = 1;
+    multiviewInfo.pCorrelationMasks = &view_mask;
+    if(m_view_count > 1 && !m_separate_views) {
+        renderPassInfo.pNext = &multiviewInfo;
+    }
+
+    VkRenderPass render_pass;
+    if (vkCreateRenderPass(m_device, &renderPassInfo, m_host_allocator, &render_pass) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create render pass!");
     }
+    m_render_pass = own(render_pass);
 }
  
 void Simulation::create_framebuffer() {
-    m_framebuffers.resize(m_swap_chain_views.size());
-
-    for(std::size_t i = 0; i < m_framebuffers.size(); ++i) {
-        VkImageView attachments[] = {
-            m_swap_chain_views[i]
-        };
-
-        VkFramebufferCreateInfo framebuffer_info = {};
-        framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_info.renderPass = m_render_pass;
-        framebuffer_info.attachmentCount = 1;
-        framebuffer_info.pAttachments = attachments;
-        framebuffer_info.width = m_swapchain_size.width;
-        framebuffer_info.height = m_swapchain_size.height;
-        framebuffer_info.layers = 1;
-
-        if (vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &m_framebuffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create a framebuffer!");
+    m_framebuffers.clear();
+
+    // One per image and view pass, in pass_index order. A multiview pass
+    // takes the layers from the attachments, so its framebuffer has one.
+    for(std::size_t i = 0; i < m_swap_chain_views.size(); ++i) {
+        for(uint32_t pass = 0; pass < view_passes(); ++pass) {
+            const auto& graph = *m_frame_graphs[i];
+            VkImageView color = m_swap_chain_views[i].get();
+            if(renders_to_scene_color()) {
+                color = m_separate_views ? graph.layer_view(m_scene_color_target, pass) 
+                    : graph.view(m_scene_color_target);
+            }
+            VkImageView attachments[] = {
+                color,
+                m_separate_views ? graph.layer_view(m_depth_target, pass) : graph.view(m_depth_target),
+            };
+
+            VkFramebufferCreateInfo framebuffer_info = {};
+            framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+            framebuffer_info.renderPass = m_render_pass.get();
+            framebuffer_info.attachmentCount = 2;
+            framebuffer_info.pAttachments = attachments;
+            framebuffer_info.width = m_view_size.width;
+            framebuffer_info.height = m_view_size.height;
+            framebuffer_info.layers = 1;
+
+            VkFramebuffer framebuffer;
+            if (vkCreateFramebuffer(m_device, &framebuffer_info, m_host_allocator, &framebuffer) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create a framebuffer!");
+            }
+            m_framebuffers.push_back(own(framebuffer));
         }
     }
 }
@@ -640,15 +1255,50 @@ void Simulation::create_command_pool() {
     VkCommandPoolCreateInfo pool_info = {};
     pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     pool_info.queueFamilyIndex = m_draw_queue_idx;
-    pool_info.flags = 0;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
-    if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_command_pool) != VK_SUCCESS) {
+    if (vkCreateCommandPool(m_device, &pool_info, m_host_allocator, &m_command_pool) != VK_SUCCESS) {
         throw std::runtime_error("Failed to create command pool!");
     }
+    if(m_transfer_queue != VK_NULL_HANDLE) {
+        pool_info.queueFamilyIndex = m_transfer_queue_idx;
+        if (vkCreateCommandPool(m_device, &pool_info, m_host_allocator, &m_transfer_command_pool) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create transfer command pool!");
+        }
+    }
 }
  
 void Simulation::create_command_buffers() {
-    m_command_buffers.resize(m_framebuffers.size());
+    if(!m_command_buffers.empty()) {
+        vkFreeCommandBuffers(m_device, m_command_pool, static_cast<uint32_t>(m_command_buffers.size()), 
+            m_command_buffers.data());
+    }
+    m_command_buffers.resize(m_swap_chain_views.size());
+    m_command_buffer_dirty.assign(m_command_buffers.size(), true);
+    m_image_points.assign(m_command_buffers.size(), SyncPoint());
+    if(m_image_uniforms_revision.size() != m_command_buffers.size()) {
+        create_ubo();
+    }
+    while(m_frame_descriptors.size() < m_command_buffers.size()) {
+        m_frame_descriptors.push_back(std::make_unique<DescriptorAllocator>(m_device, std::vector<DescriptorPoolRatio>{
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0f},
+        }, 4, 0, m_host_allocator));
+    }
+    // Shared by a pass's segments, so one of them being re-recorded must
+    // not replace the set the other one still binds.
+    m_frame_sets.assign(m_command_buffers.size() * view_passes(), VK_NULL_HANDLE);
+    if(!m_bindless) {
+        // None of the command buffers is pending, so the sets the previous
+        // ones used can go.
+        for(std::size_t i = 0; i < m_command_buffers.size(); ++i) {
+            m_frame_descriptors[i]->reset();
+            for(uint32_t pass = 0; pass < view_passes(); ++pass) {
+                m_frame_sets[pass_index(i, pass)] = write_frame_descriptors(i, pass);
+            }
+        }
+    }
 
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -660,51 +1310,324 @@ void Simulation::create_command_buffers() {
         throw std::runtime_error("Failed to allocate command buffers!");
     }
 
+    create_terrain_queries();
+    if(m_timestamp_period != 0.0f) {
+        create_frame_queries();
+    }
+
+    if(m_hiz) {
+        m_hiz->resize(m_view_size, static_cast<uint32_t>(m_command_buffers.size()));
+        m_occlusion.clear();
+    }
+    m_frame_graphs.clear();
     for(std::size_t i = 0; i < m_command_buffers.size(); ++i) {
-        VkCommandBufferBeginInfo beginInfo = {};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-        beginInfo.pInheritanceInfo = nullptr; // Optional
+        m_frame_graphs.push_back(build_frame_graph(i));
+    }
+    m_frame_graphs.front()->print(std::cout);
+    if(m_hiz) {
+        m_hiz->set_depth(m_frame_graphs.front()->view(m_depth_target));
+    }
+    create_framebuffer();
 
-        if (vkBeginCommandBuffer(m_command_buffers[i], &beginInfo) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to begin recording command buffer!");
+    if(!m_segments) {
+        std::vector<std::string> names;
+        for(uint32_t pass = 0; pass < view_passes(); ++pass) {
+            std::string suffix = m_separate_views ? " (view " + std::to_string(pass) + ")" : "";
+            names.push_back("objects" + suffix);
+            names.push_back("terrain" + suffix);
         }
+        m_segments = std::make_unique<CommandSegments>(m_device, m_command_pool, std::move(names));
+    }
+    m_segments->reset(m_command_buffers.size());
+    for(std::size_t i = 0; i < m_command_buffers.size(); ++i) {
+        update_command_buffer(i);
+    }
+}
+ 
+std::unique_ptr<RenderGraph> Simulation::build_frame_graph(std::size_t i) {
+    auto graph = std::make_unique<RenderGraph>(m_device, 
+        [this](VkDeviceSize size, uint32_t type_filter) {
+            return allocate_memory(size, type_filter, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::RenderTargets);
+        },
+        [this](VkDeviceMemory memory) {
+            free_memory(memory);
+        }, m_host_allocator);
+
+    RenderGraphImageDesc swapchain_desc;
+    swapchain_desc.format = m_swapchain_format;
+    swapchain_desc.extent = m_swapchain_size;
+    swapchain_desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    auto backbuffer = graph->import_image("backbuffer", m_swap_chain_images[i], m_swap_chain_views[i].get(), swapchain_desc,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+
+    auto color = backbuffer;
+    if(renders_to_scene_color()) {
+        // Allocated at full size so changing the scale never reallocates it.
+        RenderGraphImageDesc color_desc;
+        color_desc.format = m_swapchain_format;
+        color_desc.extent = m_view_size;
+        color_desc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        color_desc.layers = m_view_count;
+        color = graph->create_image("scene color", color_desc);
+        m_scene_color_target = color;
+    }
 
-        VkRenderPassBeginInfo renderPassInfo = {};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = m_render_pass;
-        renderPassInfo.framebuffer = m_framebuffers[i];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = m_swapchain_size;
+    RenderGraphImageDesc depth_desc;
+    depth_desc.format = m_depth_format;
+    depth_desc.extent = m_view_size;
+    depth_desc.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    depth_desc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    depth_desc.layers = m_view_count;
+    auto depth = graph->create_image("depth", depth_desc);
+    m_depth_target = depth;
+
+    for(uint32_t pass = 0; pass < view_passes(); ++pass) {
+        std::string name = m_separate_views ? "scene view " + std::to_string(pass) : "scene";
+        graph->add_pass(name)
+            .write(color, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+            .write(depth, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 
+                VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, 
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+            .execute([this, i, pass](VkCommandBuffer command_buffer) {
+                record_scene_pass(command_buffer, i, pass);
+            });
+    }
 
-        VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
-        renderPassInfo.clearValueCount = 1;
-        renderPassInfo.pClearValues = &clearColor;
+    if(renders_to_scene_color()) {
+        graph->add_pass("upscale")
+            .read(color, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+            .write(backbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, 
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
+            .execute([this, i](VkCommandBuffer command_buffer) {
+                record_upscale_pass(command_buffer, i);
+            });
+    }
 
-        vkCmdBeginRenderPass(m_command_buffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if(m_hiz) {
+        m_hiz->add_passes(*graph, depth, static_cast<uint32_t>(i));
+    }
 
-        VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(m_command_buffers[i], 0, 1, &m_vbo, &offset);
-        vkCmdBindIndexBuffer(m_command_buffers[i], m_ibo, 0, VK_INDEX_TYPE_UINT16);
-        vkCmdBindDescriptorSets(m_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, 
-            &m_descriptor_sets[i], 0, nullptr);
-        vkCmdBindPipeline(m_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline);
-        vkCmdDrawIndexed(m_command_buffers[i], 6, 1, 0, 0, 0);
+    // Only the backbuffer differs between the graphs.
+    graph->compile(i == 0 ? nullptr : m_frame_graphs.front().get());
+    return graph;
+}
+ 
+void Simulation::update_command_buffer(std::size_t i) {
+    bool segments_recorded = false;
+    for(uint32_t pass = 0; pass < view_passes(); ++pass) {
+        VkCommandBufferInheritanceInfo inheritance = {};
+        inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritance.renderPass = m_render_pass.get();
+        inheritance.subpass = 0;
+        inheritance.framebuffer = m_framebuffers[pass_index(i, pass)].get();
+        uint32_t first_segment = pass * SEGMENTS_PER_PASS;
+
+        auto& object_inputs = m_segments->inputs();
+        push_segment_inputs(object_inputs, i, pass);
+        object_inputs.push_back(handle_input(pipeline_variant(m_scene_state)));
+        object_inputs.push_back(handle_input(m_vbo.get()));
+        object_inputs.push_back(handle_input(m_ibo.get()));
+        object_inputs.push_back((uint64_t{m_quad_lod.first_index} << 32) | m_quad_lod.index_count);
+        object_inputs.insert(object_inputs.end(), m_object_visibility.begin(), m_object_visibility.end());
+        segments_recorded |= m_segments->update(first_segment + OBJECT_SEGMENT, i, inheritance, 
+            [this, i, pass](VkCommandBuffer command_buffer) {
+                record_object_segment(command_buffer, i, pass);
+            });
+
+        // The draw list itself, so the segment is re-recorded exactly when a
+        // draw would differ.
+        auto& terrain_inputs = m_segments->inputs();
+        push_segment_inputs(terrain_inputs, i, pass);
+        if(m_heightmap_terrain) {
+            terrain_inputs.push_back(handle_input(pipeline_variant(m_terrain_state)));
+            terrain_inputs.push_back(tile_input(m_lod_center));
+            for(const auto& coord : m_drawn_tiles) {
+                terrain_inputs.push_back(tile_input(coord));
+            }
+        } else {
+            terrain_inputs.push_back(handle_input(pipeline_variant(m_scene_state)));
+            for(const auto& coord : m_drawn_tiles) {
+                const auto* tile = m_tile_cache->find(coord);
+                terrain_inputs.push_back(handle_input(tile->allocation.buffer));
+                terrain_inputs.push_back(tile->index_offset);
+                terrain_inputs.push_back(tile->index_count);
+            }
+        }
+        segments_recorded |= m_segments->update(first_segment + TERRAIN_SEGMENT, i, inheritance, 
+            [this, i, pass](VkCommandBuffer command_buffer) {
+                record_terrain_segment(command_buffer, i, pass);
+            });
+    }
+
+    if(segments_recorded || m_command_buffer_dirty[i]) {
+        record_command_buffer(i);
+        m_command_buffer_dirty[i] = false;
+    }
+}
+ 
+void Simulation::record_command_buffer(std::size_t i) {
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    beginInfo.pInheritanceInfo = nullptr; // Optional
 
-        vkCmdEndRenderPass(m_command_buffers[i]);
+    if (vkBeginCommandBuffer(m_command_buffers[i], &beginInfo) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to begin recording command buffer!");
+    }
+
+    uint32_t first_query = static_cast<uint32_t>(2 * i);
+    if(m_frame_queries) {
+        vkCmdResetQueryPool(m_command_buffers[i], m_frame_queries.get(), first_query, 2);
+        vkCmdWriteTimestamp(m_command_buffers[i], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_frame_queries.get(), 
+            first_query);
+    }
+    m_frame_graphs[i]->execute(m_command_buffers[i]);
+    if(m_frame_queries) {
+        vkCmdWriteTimestamp(m_command_buffers[i], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_frame_queries.get(), 
+            first_query + 1);
+    }
 
-        if (vkEndCommandBuffer(m_command_buffers[i]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to record command buffer!");
+    if (vkEndCommandBuffer(m_command_buffers[i]) != VK_SUCCESS) {
+        throw std::runtime_error("failed to record command buffer!");
+    }
+}
+ 
+void Simulation::record_scene_pass(VkCommandBuffer command_buffer, std::size_t i, uint32_t pass) {
+    VkRenderPassBeginInfo renderPassInfo = {};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    renderPassInfo.renderPass = m_render_pass.get();
+    renderPassInfo.framebuffer = m_framebuffers[pass_index(i, pass)].get();
+    renderPassInfo.renderArea.offset = {0, 0};
+    renderPassInfo.renderArea.extent = m_render_size;
+
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color = {{0.0f, 0.0f, 0.0f, 1.0f}};
+    clearValues[1].depthStencil = {1.0f, 0};
+    renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    renderPassInfo.pClearValues = clearValues.data();
+
+    if(m_terrain_queries) {
+        // A multiview pass uses one query per view.
+        uint32_t query_count = m_separate_views ? 1 : m_view_count;
+        vkCmdResetQueryPool(command_buffer, m_terrain_queries.get(), static_cast<uint32_t>(i * m_view_count + pass), 
+            query_count);
+    }
+    vkCmdBeginRenderPass(command_buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    uint32_t first_segment = pass * SEGMENTS_PER_PASS;
+    std::array<VkCommandBuffer, SEGMENTS_PER_PASS> segments = {
+        m_segments->get(first_segment + OBJECT_SEGMENT, i), 
+        m_segments->get(first_segment + TERRAIN_SEGMENT, i),
+    };
+    vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(segments.size()), segments.data());
+    vkCmdEndRenderPass(command_buffer);
+}
+ 
+void Simulation::push_segment_inputs(std::vector<uint64_t>& inputs, std::size_t i, uint32_t pass) const {
+    inputs.push_back((uint64_t{m_render_size.width} << 32) | m_render_size.height);
+    if(m_bindless) {
+        inputs.push_back(handle_input(m_bindless->set()));
+        inputs.push_back(m_object_buffer_slots[i]);
+    } else {
+        inputs.push_back(handle_input(m_frame_sets[pass_index(i, pass)]));
+    }
+}
+ 
+void Simulation::bind_segment_state(VkCommandBuffer command_buffer, std::size_t i, uint32_t pass) {
+    // Secondary command buffers inherit no state from each other.
+    VkViewport viewport = {};
+    viewport.width = static_cast<float>(m_render_size.width);
+    viewport.height = static_cast<float>(m_render_size.height);
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    VkRect2D scissor = {{0, 0}, m_render_size};
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    if(m_bindless) {
+        VkDescriptorSet global_set = m_bindless->set();
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout.get(), 0, 1, 
+            &global_set, 0, nullptr);
+        vkCmdPushConstants(command_buffer, m_pipeline_layout.get(), m_push_constant_stages, 0, 
+            sizeof(uint32_t), &m_object_buffer_slots[i]);
+    } else {
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout.get(), 0, 1, 
+            &m_frame_sets[pass_index(i, pass)], 0, nullptr);
+    }
+}
+ 
+void Simulation::record_object_segment(VkCommandBuffer command_buffer, std::size_t i, uint32_t pass) {
+    bind_segment_state(command_buffer, i, pass);
+    VkDeviceSize offset = 0;
+    VkBuffer vbo = m_vbo.get();
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &vbo, &offset);
+    vkCmdBindIndexBuffer(command_buffer, m_ibo.get(), 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_variant(m_scene_state));
+    for(std::size_t c = 0; c < m_object_visibility.size(); ++c) {
+        const auto& chunk = m_scene_objects.chunk(c);
+        for(uint64_t mask = m_object_visibility[c]; mask != 0; mask &= mask - 1) {
+            std::size_t lane = mask_lowest_lane(mask);
+            vkCmdDrawIndexed(command_buffer, m_quad_lod.index_count, 1, m_quad_lod.first_index, 0, 
+                chunk.instance[lane]);
         }
     }
 }
  
-void Simulation::draw_frame() {
-    update_ubo();
+void Simulation::record_terrain_segment(VkCommandBuffer command_buffer, std::size_t i, uint32_t pass) {
+    bind_segment_state(command_buffer, i, pass);
+    uint32_t query = static_cast<uint32_t>(i * m_view_count + pass);
+    if(m_terrain_queries) {
+        vkCmdBeginQuery(command_buffer, m_terrain_queries.get(), query, 0);
+    }
+
+    uint64_t triangles = 0;
+    if(m_heightmap_terrain) {
+        triangles = record_heightmap_terrain(command_buffer);
+    } else {
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_variant(m_scene_state));
+        triangles = m_tile_cache->record_draws(command_buffer, m_drawn_tiles.data(), m_drawn_tiles.size(), 
+            m_terrain_object);
+    }
 
+    if(m_terrain_queries) {
+        vkCmdEndQuery(command_buffer, m_terrain_queries.get(), query);
+    }
+    m_recorded_terrain_triangles[query] = triangles * (m_separate_views ? 1 : m_view_count);
+}
+ 
+void Simulation::record_upscale_pass(VkCommandBuffer command_buffer, std::size_t i) {
+    // Views side by side, the last one stretched over the columns left when
+    // the width does not divide.
+    std::array<VkImageBlit, MAX_VIEWS> blits = {};
+    for(uint32_t view = 0; view < m_view_count; ++view) {
+        auto& blit = blits[view];
+        int32_t left = static_cast<int32_t>(view * m_view_size.width);
+        int32_t right = view + 1 == m_view_count ? static_cast<int32_t>(m_swapchain_size.width) 
+            : left + static_cast<int32_t>(m_view_size.width);
+        blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, view, 1};
+        blit.srcOffsets[1] = {static_cast<int32_t>(m_render_size.width), static_cast<int32_t>(m_render_size.height), 1};
+        blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        blit.dstOffsets[0] = {left, 0, 0};
+        blit.dstOffsets[1] = {right, static_cast<int32_t>(m_swapchain_size.height), 1};
+    }
+    VkImage scene_color = m_frame_graphs[i]->image(m_scene_color_target);
+    vkCmdBlitImage(command_buffer, scene_color, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_swap_chain_images[i], 
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_view_count, blits.data(), m_upscale_filter);
+}
+ 
+void Simulation::update_render_scale() {
+    m_render_size = m_view_size;
+    if(m_resolution) {
+        m_render_size = {m_resolution->scaled(m_view_size.width), m_resolution->scaled(m_view_size.height)};
+    }
+}
+ 
+void Simulation::draw_frame() {
+    auto& slot = m_frame_slots[m_frame_slot];
     uint32_t image_idx;
     auto result = vkAcquireNextImageKHR(m_device, m_swapchain, std::numeric_limits<uint64_t>::max(), 
-        m_image_available_semaphore, VK_NULL_HANDLE, &image_idx);
+        slot.image_available.get(), VK_NULL_HANDLE, &image_idx);
 
     if(result == VK_ERROR_OUT_OF_DATE_KHR || m_was_resized) {
         rebuild_swapchain();
@@ -716,23 +1639,43 @@ void Simulation::draw_frame() {
     }
 
     std::cout << "Acquired swapchain image #" << image_idx << "\n";
+    // Usually done already: the image was presented before, and all but the
+    // last FRAMES_IN_FLIGHT frames have completed.
+    m_sync->wait(m_image_points[image_idx]);
+    write_frame_data(image_idx);
+    update_command_buffer(image_idx);
+    // Counted into the totals of the exit report.
+    m_segments->end_frame();
+
+    // The readback copy runs before presentation, which waits for the
+    // whole submission.
+    std::array<VkCommandBuffer, 2> command_buffers = {m_command_buffers[image_idx], VK_NULL_HANDLE};
+    uint32_t command_buffer_count = 1;
+    if(m_recorder && m_swapchain_readback && m_recorder->wants_frame()) {
+        command_buffers[1] = m_recorder->record(m_swap_chain_images[image_idx], m_swapchain_format, m_swapchain_size);
+        command_buffer_count += command_buffers[1] != VK_NULL_HANDLE ? 1 : 0;
+    }
 
-    VkSubmitInfo submit_info = {};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore waitSemaphores[] = {m_image_available_semaphore};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = waitSemaphores;
-    submit_info.pWaitDstStageMask = waitStages;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &m_command_buffers[image_idx];
-    VkSemaphore signalSemaphores[] = {m_render_finished_semaphore};
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signalSemaphores;
-
-    if (vkQueueSubmit(m_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
-        throw std::runtime_error("failed to submit draw command buffer!");
+    // Tiles are drawn from the frame they were uploaded for.
+    SyncWait tile_upload = {m_tile_upload_point, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT};
+    VkSemaphore signalSemaphores[] = {slot.render_finished.get()};
+    SyncSubmission submission;
+    submission.command_buffers = command_buffers.data();
+    submission.command_buffer_count = command_buffer_count;
+    submission.waits = &tile_upload;
+    submission.wait_count = 1;
+    submission.wait_semaphore = slot.image_available.get();
+    submission.wait_semaphore_stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    submission.signal_semaphore = signalSemaphores[0];
+
+    slot.point = m_sync->submit(m_graphics_sync, submission);
+    slot.submitted = true;
+    slot.image = image_idx;
+    slot.frame = m_frame_number;
+    m_image_points[image_idx] = slot.point;
+    m_deletions->submitted(slot.point);
+    if(command_buffer_count > 1) {
+        m_recorder->submitted(slot.point);
     }
 
     VkPresentInfoKHR presentInfo = {};
@@ -750,39 +1693,69 @@ void Simulation::draw_frame() {
     vkQueuePresentKHR(m_present_queue, &presentInfo);
 }
  
+void Simulation::create_frame_recorder() {
+    // Created once, as it opens and truncates the video. Frames of a rebuilt
+    // swapchain are cropped or padded to the video's size; swapchains that
+    // cannot be read back skip recording.
+    if(!m_swapchain_readback) {
+        if(!m_options.video_file.empty()) {
+            std::cout << "Swapchain images cannot be read back, not recording " << m_options.video_file << "\n";
+        }
+        return;
+    }
+    m_recorder = std::make_unique<FrameRecorder>(m_device, m_command_pool, *m_sync, m_options.video_file, 
+        VIDEO_FRAME_RATE, 
+        [this](VkDeviceSize size, uint32_t type_filter) {
+            // The encoder reads every byte, which is slow from uncached,
+            // write combined memory.
+            VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+            if(!m_memory_budget->has_memory_type(type_filter, properties)) {
+                properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+            }
+            return allocate_memory(size, type_filter, properties, MemoryCategory::Readback);
+        },
+        [this](VkDeviceMemory memory) {
+            free_memory(memory);
+        }, m_host_allocator);
+}
+ 
 void Simulation::create_semaphores() {
     VkSemaphoreCreateInfo semaphoreInfo = {};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    if(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_image_available_semaphore) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create semaphore!");
-    }
-    if(vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_render_finished_semaphore) != VK_SUCCESS) {
-        throw std::runtime_error("Failed to create semaphore!");
+    for(auto& slot : m_frame_slots) {
+        for(auto* semaphore : {&slot.image_available, &slot.render_finished}) {
+            VkSemaphore created;
+            if(vkCreateSemaphore(m_device, &semaphoreInfo, m_host_allocator, &created) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create semaphore!");
+            }
+            *semaphore = own(created);
+        }
     }
 }
  
 void Simulation::cleanup_swapchain() {
-    for(auto& framebuffer : m_framebuffers) {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
-    }
-    vkDestroyRenderPass(m_device, m_render_pass, nullptr);
-    vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
-    vkDestroyPipeline(m_device, m_pipeline, nullptr);
-    for(auto& view : m_swap_chain_views) {
-        vkDestroyImageView(m_device, view, nullptr);
-    }
-    vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+    m_framebuffers.clear();
+    m_render_pass.reset();
+    m_pipeline_layout.reset();
+    m_swap_chain_views.clear();
+    vkDestroySwapchainKHR(m_device, m_swapchain, m_host_allocator);
 }
  
 void Simulation::rebuild_swapchain() {
+    // Presentation has no sync points, only an idle device is done with the
+    // swapchain images. The queries and readback copies of the frames in
+    // flight are recreated, so their results are dropped.
     vkDeviceWaitIdle(m_device);
+    for(auto& slot : m_frame_slots) {
+        slot.submitted = false;
+    }
+    m_completed_frame = m_frame_number;
 
     cleanup_swapchain();
     setup_framebuffer();
     setup_render_pass();
     create_pipeline();
-    create_framebuffer();
     create_command_buffers();
 }
  
@@ -801,11 +1774,111 @@ VkExtent2D Simulation::choose_swapchain_extent() {
     }
 }
  
+VkPresentModeKHR Simulation::choose_present_mode(const std::vector<VkPresentModeKHR>& present_modes) const {
+    if(!m_replay) {
+        return VK_PRESENT_MODE_FIFO_KHR;
+    }
+    // Replays run unthrottled so the frame times measure the renderer, not
+    // the display refresh.
+    for(auto preferred : {VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR}) {
+        if(std::find(present_modes.begin(), present_modes.end(), preferred) != present_modes.end()) {
+            return preferred;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+ 
 void Simulation::glfw_resize_callback(GLFWwindow* window, int width, int height) {
     Simulation* sim = reinterpret_cast<Simulation*>(glfwGetWindowUserPointer(window));
     sim->m_was_resized = true;
 }
  
+void Simulation::glfw_key_callback(GLFWwindow* window, int key, int, int action, int) {
+    Simulation* sim = reinterpret_cast<Simulation*>(glfwGetWindowUserPointer(window));
+    // Input is applied at the start of the next frame so that captures
+    // record it with the frame it affected; replays ignore live input.
+    if(!sim->m_replay) {
+        sim->m_pending_input.push_back(InputEvent{key, action});
+    }
+}
+ 
+void Simulation::glfw_refresh_callback(GLFWwindow* window) {
+    // The window was uncovered or otherwise lost its contents.
+    Simulation* sim = reinterpret_cast<Simulation*>(glfwGetWindowUserPointer(window));
+    sim->m_redraw_frames = std::max(sim->m_redraw_frames, 1u);
+}
+ 
+void Simulation::glfw_mouse_button_callback(GLFWwindow* window, int button, int action, int) {
+    Simulation* sim = reinterpret_cast<Simulation*>(glfwGetWindowUserPointer(window));
+    if(button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
+        sim->pick_terrain();
+    }
+}
+ 
+void Simulation::handle_key(int key, int action) {
+    if(action != GLFW_PRESS) {
+        return;
+    }
+    if(key == GLFW_KEY_M) {
+        m_memory_budget->report(std::cout);
+    } else if(key == GLFW_KEY_P) {
+        m_pipelines->report(std::cout);
+    } else if(key == GLFW_KEY_F12) {
+        if(!m_recorder || !m_swapchain_readback) {
+            std::cout << "Screenshots need swapchain images that can be copied from\n";
+            return;
+        }
+        m_recorder->request_screenshot();
+    } else if(key == GLFW_KEY_W) {
+        if(!m_wireframe_supported) {
+            std::cout << "Wireframe needs fillModeNonSolid, which is not supported\n";
+            return;
+        }
+        m_wireframe = !m_wireframe;
+    } else if(key == GLFW_KEY_SPACE) {
+        m_animating = !m_animating;
+    }
+}
+ 
+void Simulation::pick_terrain() {
+    int window_width = 0;
+    int window_height = 0;
+    glfwGetWindowSize(m_window, &window_width, &window_height);
+    if(!m_terrain_pyramid || window_width <= 0 || window_height <= 0) {
+        return;
+    }
+    double cursor_x;
+    double cursor_y;
+    glfwGetCursorPos(m_window, &cursor_x, &cursor_y);
+
+    // The cursor in swapchain pixels, then within the view it is over; the
+    // last view is stretched as in record_upscale_pass.
+    float x = static_cast<float>(cursor_x / window_width * m_swapchain_size.width);
+    float y = static_cast<float>(cursor_y / window_height * m_swapchain_size.height);
+    uint32_t view = std::min(static_cast<uint32_t>(std::max(x, 0.0f)) / m_view_size.width, m_view_count - 1);
+    float view_left = static_cast<float>(view * m_view_size.width);
+    float view_width = view + 1 == m_view_count ? m_swapchain_size.width - view_left 
+        : static_cast<float>(m_view_size.width);
+    glm::vec2 ndc = glm::vec2((x - view_left) / view_width, y / m_swapchain_size.height) * 2.0f - glm::vec2(1.0f);
+
+    // From the near to the far end of the depth range Vulkan keeps.
+    glm::mat4 unproject = glm::inverse(views().clip(m_camera, view) * m_camera.view_projection());
+    glm::vec4 near_point = unproject * glm::vec4(ndc, 0.0f, 1.0f);
+    glm::vec4 far_point = unproject * glm::vec4(ndc, 1.0f, 1.0f);
+    TerrainRay ray;
+    ray.origin = glm::vec3(near_point) / near_point.w;
+    ray.direction = glm::vec3(far_point) / far_point.w - ray.origin;
+    ray.max_t = 1.0f;
+
+    TerrainHit hit = m_terrain_pyramid->raycast(ray);
+    if(hit.hit) {
+        std::cout << "Picked terrain at (" << hit.position.x << ", " << hit.position.y << ", " << hit.position.z 
+            << ")\n";
+    } else {
+        std::cout << "No terrain under the cursor\n";
+    }
+}
+ 
 void Simulation::create_vbo() {
     std::vector<Vertex> vertices = {
         {{-0.5f, -0.5f, 1.0}, {1.0f, 0.0f, 0.0f, 1.0}},
@@ -814,26 +1887,32 @@ void Simulation::create_vbo() {
         {{-0.5f, 0.5f, 1.0}, {1.0f, 1.0f, 1.0f, 1.0}},
     };
 
+    const void* source = vertices.data();
     VkDeviceSize buffer_size = vertices.size() * sizeof(Vertex);
+    if(m_scene && m_scene->mesh_count() > 0) {
+        source = m_scene->vertex_data(0);
+        buffer_size = VkDeviceSize{m_scene->mesh(0).vertex_count} * sizeof(Vertex);
+    }
 
     auto [buffer, memory] = make_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
 
     void* data;
     vkMapMemory(m_device, memory, 0, buffer_size, 0, &data);
-    std::memcpy(data, vertices.data(), vertices.size()*sizeof(Vertex));
+    std::memcpy(data, source, buffer_size);
     vkUnmapMemory(m_device, memory);
 
     auto [device_buffer, device_memory] = make_buffer(buffer_size, 
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+        MemoryCategory::Geometry);
 
     buffer_copy(buffer, device_buffer, buffer_size);
 
-    vkDestroyBuffer(m_device, buffer, nullptr);
-    vkFreeMemory(m_device, memory, nullptr);
+    vkDestroyBuffer(m_device, buffer, m_host_allocator);
+    free_memory(memory);
 
-    m_vbo = device_buffer;
-    m_vbo_mem = device_memory;
+    m_vbo = own(device_buffer);
+    m_vbo_mem = own(device_memory);
 }
  
 VkVertexInputBindingDescription Vertex::binding_desc() {
@@ -860,22 +1939,33 @@ std::array<VkVertexInputAttributeDescription, 2> Vertex::attrib_desc() {
     return attrib_desc;
 }
 
-uint32_t Simulation::select_memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_physical_device, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-            std::cout << "Choosing memory " << i << ".\n";
-            return i;
-        }
-    }
+VkDeviceMemory Simulation::allocate_memory(VkDeviceSize size, uint32_t type_filter, VkMemoryPropertyFlags properties, 
+    MemoryCategory category) 
+{
+    uint32_t mem_type = m_memory_budget->select_memory_type(type_filter, properties, size);
+
+    VkDeviceMemory memory;
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = mem_type;
 
-    throw std::runtime_error("failed to find suitable memory type!");
+    if (vkAllocateMemory(m_device, &allocInfo, m_host_allocator, &memory) != VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+    m_memory_budget->record_allocation(memory, mem_type, size, category);
+    return memory;
+}
+ 
+void Simulation::free_memory(VkDeviceMemory memory) {
+    m_memory_budget->record_free(memory);
+    vkFreeMemory(m_device, memory, m_host_allocator);
 }
  
 std::tuple<VkBuffer, VkDeviceMemory> Simulation::make_buffer(VkDeviceSize size, VkBufferUsageFlags usage, 
-    VkMemoryPropertyFlags properties) 
+    VkMemoryPropertyFlags properties, MemoryCategory category, bool transfer_shared) 
 {
+    std::array<uint32_t, 2> families = {m_draw_queue_idx, m_transfer_queue_idx};
     VkBuffer buffer;
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -883,10 +1973,14 @@ std::tuple<VkBuffer, VkDeviceMemory> Simulation::make_buffer(VkDeviceSize size,
     bufferInfo.flags = 0;
     bufferInfo.usage = usage;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    bufferInfo.pQueueFamilyIndices = &m_draw_queue_idx;
+    bufferInfo.pQueueFamilyIndices = families.data();
     bufferInfo.queueFamilyIndexCount = 1;
+    if(transfer_shared && m_transfer_queue != VK_NULL_HANDLE) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+    }
 
-    if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+    if (vkCreateBuffer(m_device, &bufferInfo, m_host_allocator, &buffer) != VK_SUCCESS) {
         throw std::runtime_error("failed to create vertex buffer!");
     }
 
@@ -895,31 +1989,31 @@ std::tuple<VkBuffer, VkDeviceMemory> Simulation::make_buffer(VkDeviceSize size,
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(m_physical_device, &memProperties);
 
-    auto mem_type = select_memory_type(memRequirements.memoryTypeBits, properties);
-
     std::cout << memRequirements.memoryTypeBits << "\n";
     for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i) {
         std::cout << "\t" <<memProperties.memoryTypes[i].heapIndex << ":" << memProperties.memoryTypes[i].propertyFlags << std::endl;
     }
-    VkDeviceMemory memory;
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = mem_type;
-
-    if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
+    VkDeviceMemory memory = allocate_memory(memRequirements.size, memRequirements.memoryTypeBits, properties, category);
     vkBindBufferMemory(m_device, buffer, memory, 0);
 
     return {buffer, memory};
 }
 
 void Simulation::buffer_copy(VkBuffer source, VkBuffer dest, VkDeviceSize size) {
+    VkCommandBuffer commandBuffer = begin_single_use_commands(m_command_pool);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = 0;
+    copyRegion.size = size;
+    vkCmdCopyBuffer(commandBuffer, source, dest, 1, &copyRegion);
+    submit_single_use_commands(commandBuffer);
+}
+ 
+VkCommandBuffer Simulation::begin_single_use_commands(VkCommandPool pool) {
     VkCommandBufferAllocateInfo allocInfo = {};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = m_command_pool;
+    allocInfo.commandPool = pool;
     allocInfo.commandBufferCount = 1;
 
     VkCommandBuffer commandBuffer;
@@ -930,20 +2024,16 @@ void Simulation::buffer_copy(VkBuffer source, VkBuffer dest, VkDeviceSize size)
     beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     vkBeginCommandBuffer(commandBuffer, &beginInfo);
-    VkBufferCopy copyRegion = {};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, source, dest, 1, &copyRegion);
+    return commandBuffer;
+}
+ 
+void Simulation::submit_single_use_commands(VkCommandBuffer commandBuffer) {
     vkEndCommandBuffer(commandBuffer);
 
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(m_queue);
+    SyncSubmission submission;
+    submission.command_buffers = &commandBuffer;
+    submission.command_buffer_count = 1;
+    m_sync->wait(m_sync->submit(m_graphics_sync, submission));
 
     vkFreeCommandBuffers(m_device, m_command_pool, 1, &commandBuffer);
 }
@@ -953,26 +2043,53 @@ void Simulation::create_ibo() {
         0, 1, 2, 2, 3, 0
     };
 
+    // Every level of detail is uploaded, the finest is drawn.
+    const void* source = indices.data();
     VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    m_quad_lod = {0, static_cast<uint32_t>(indices.size()), 0.0f};
+    if(m_scene && m_scene->mesh_count() > 0) {
+        const auto& mesh = m_scene->mesh(0);
+        source = m_scene->index_data(0);
+        bufferSize = VkDeviceSize{mesh.index_count} * sizeof(uint16_t);
+        m_quad_lod = mesh.lods[0];
+    }
+
+    // The object spins about the z axis, so its bounds are widened to
+    // everything the mesh sweeps.
+    SceneEntity entity;
+    entity.position = glm::vec3(0.0f, 0.0f, 1.0f);
+    entity.radius = glm::length(glm::vec2(0.5f));
+    entity.extent = glm::vec3(entity.radius, entity.radius, 0.0f);
+    if(m_scene && m_scene->mesh_count() > 0) {
+        const auto& mesh = m_scene->mesh(0);
+        float axis_distance = glm::length(glm::vec2(mesh.sphere_center[0], mesh.sphere_center[1]));
+        entity.position = glm::vec3(0.0f, 0.0f, mesh.sphere_center[2]);
+        entity.radius = axis_distance + mesh.sphere_radius;
+        entity.extent = glm::vec3(entity.radius, entity.radius, 0.5f * (mesh.bounds_max[2] - mesh.bounds_min[2]));
+    }
+    entity.instance = m_quad_object;
+    m_scene_objects.clear();
+    m_scene_objects.add(entity);
 
     auto [staging_buffer, staging_mem] = make_buffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
 
     void* data;
     vkMapMemory(m_device, staging_mem, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t) bufferSize);
+    memcpy(data, source, (size_t) bufferSize);
     vkUnmapMemory(m_device, staging_mem);
 
     auto [dev_buffer, dev_buffer_mem] = make_buffer(bufferSize, 
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+        MemoryCategory::Geometry);
 
     buffer_copy(staging_buffer, dev_buffer, bufferSize);
 
-    vkDestroyBuffer(m_device, staging_buffer, nullptr);
-    vkFreeMemory(m_device, staging_mem, nullptr);
+    vkDestroyBuffer(m_device, staging_buffer, m_host_allocator);
+    free_memory(staging_mem);
 
-    m_ibo = dev_buffer;
-    m_ibo_mem = dev_buffer_mem;
+    m_ibo = own(dev_buffer);
+    m_ibo_mem = own(dev_buffer_mem);
 }
  
 VkDescriptorSetLayoutBinding Uniforms::binding_desc() {
@@ -986,6 +2103,28 @@ VkDescriptorSetLayoutBinding Uniforms::binding_desc() {
     return uboLayoutBinding;
 }
  
+VkDescriptorSetLayoutBinding ObjectTransforms::binding_desc() {
+    VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+    objectLayoutBinding.binding = 1;
+    objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    objectLayoutBinding.descriptorCount = 1;
+    objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    objectLayoutBinding.pImmutableSamplers = nullptr;
+
+    return objectLayoutBinding;
+}
+ 
+VkDescriptorSetLayoutBinding TerrainHeightmap::binding_desc() {
+    VkDescriptorSetLayoutBinding heightmapLayoutBinding = {};
+    heightmapLayoutBinding.binding = 2;
+    heightmapLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    heightmapLayoutBinding.descriptorCount = 1;
+    heightmapLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    heightmapLayoutBinding.pImmutableSamplers = nullptr;
+
+    return heightmapLayoutBinding;
+}
+ 
 VkDescriptorSetLayoutCreateInfo Uniforms::layout_info() {
     VkDescriptorSetLayoutBinding binding = binding_desc();
     VkDescriptorSetLayoutCreateInfo layoutInfo = {};
@@ -997,79 +2136,829 @@ VkDescriptorSetLayoutCreateInfo Uniforms::layout_info() {
 }
  
 void Simulation::create_ubo() {
-    VkDeviceSize bufferSize = sizeof(Uniforms);
+    // Copies per swapchain image, so recreated when the count changes. The
+    // device is idle then, see rebuild_swapchain.
+    std::size_t images = m_command_buffers.size();
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(m_physical_device, &properties);
+    VkDeviceSize alignment = properties.limits.minUniformBufferOffsetAlignment;
+    m_ubo_stride = (sizeof(Uniforms) + alignment - 1) / alignment * alignment;
+    VkDeviceSize bufferSize = m_ubo_stride * view_passes() * images;
 
     auto [uniform_buffer, uniform_buffer_mem] = make_buffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, 
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Uniforms);
+
+    m_ubo = own(uniform_buffer);
+    m_ubo_mem = own(uniform_buffer_mem);
+
+    VkDeviceSize objectBufferSize = OBJECT_BUFFER_SIZE * images;
+    auto [object_buffer, object_buffer_mem] = make_buffer(objectBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Uniforms);
 
-    m_ubo = uniform_buffer;
-    m_ubo_mem = uniform_buffer_mem;
+    m_object_buffer = own(object_buffer);
+    m_object_buffer_mem = own(object_buffer_mem);
+    void* data;
+    vkMapMemory(m_device, object_buffer_mem, 0, objectBufferSize, 0, &data);
+    m_object_buffer_ptr = static_cast<float*>(data);
+
+    if(m_bindless) {
+        for(uint32_t slot : m_object_buffer_slots) {
+            m_bindless->remove_storage_buffer(slot);
+        }
+        m_object_buffer_slots.clear();
+        for(std::size_t i = 0; i < images; ++i) {
+            VkDescriptorBufferInfo objectBufferInfo = {};
+            objectBufferInfo.buffer = m_object_buffer.get();
+            objectBufferInfo.offset = i * OBJECT_BUFFER_SIZE;
+            objectBufferInfo.range = OBJECT_BUFFER_SIZE;
+            m_object_buffer_slots.push_back(m_bindless->add_storage_buffer(objectBufferInfo));
+        }
+    }
+
+    m_uniforms.resize(m_ubo_stride * view_passes());
+    m_object_clip.resize(MAX_OBJECTS * 16);
+    // None of the new copies holds anything yet.
+    m_image_uniforms_revision.assign(images, 0);
+    m_image_objects_revision.assign(images, 0);
+    m_uniforms_revision += 1;
+    m_objects_revision += 1;
 }
  
 void Simulation::update_ubo() {
-    static auto startTime = std::chrono::high_resolution_clock::now();
+    float time = static_cast<float>(m_frame.time);
+    bool camera_changed = m_scene_update.animate(time, m_camera, m_transforms, m_quad_object);
+    if(camera_changed) {
+        m_scene_update.write_uniforms(m_camera, views(), m_uniforms.data(), m_ubo_stride);
+        m_uniforms_revision += 1;
+    }
+
+    if(m_transforms.capacity() > MAX_OBJECTS) {
+        throw std::runtime_error("Too many objects for the object transform buffer!");
+    }
+    std::size_t updated = m_scene_update.update_objects(m_camera, views(), camera_changed, m_transforms, 
+        m_object_clip.data(), m_scene_objects, m_object_visibility);
+    m_objects_revision += updated > 0 ? 1 : 0;
+}
+ 
+void Simulation::write_frame_data(std::size_t image) {
+    // The image's last frame has completed, the other copies may still be
+    // in use.
+    if(m_image_uniforms_revision[image] != m_uniforms_revision) {
+        VkDeviceSize size = m_ubo_stride * view_passes();
+        void* data;
+        vkMapMemory(m_device, m_ubo_mem.get(), pass_index(image, 0) * m_ubo_stride, size, 0, &data);
+        std::memcpy(data, m_uniforms.data(), size);
+        vkUnmapMemory(m_device, m_ubo_mem.get());
+        m_image_uniforms_revision[image] = m_uniforms_revision;
+    }
+    if(m_image_objects_revision[image] != m_objects_revision) {
+        std::memcpy(m_object_buffer_ptr + image * MAX_OBJECTS * 16, m_object_clip.data(), 
+            m_transforms.capacity() * sizeof(glm::mat4));
+        m_image_objects_revision[image] = m_objects_revision;
+    }
+}
+ 
+void Simulation::create_heightmap() {
+    // R16_UNORM is half the size of R32_SFLOAT, but has to be sampleable.
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(m_physical_device, VK_FORMAT_R16_UNORM, &format_properties);
+    VkFormat format = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) 
+        ? VK_FORMAT_R16_UNORM : VK_FORMAT_R32_SFLOAT;
+
+    uint32_t samples = TERRAIN_TILES * (TERRAIN_TILE_RESOLUTION - 1) + 1;
+    float spacing = TERRAIN_TILE_EXTENT / (TERRAIN_TILE_RESOLUTION - 1);
+    std::unique_ptr<Heightmap> generated;
+    const void* source;
+    VkDeviceSize size;
+    if(m_scene && m_scene->heightmap_count() > 0) {
+        // Baked samples and chunk heights are copied as they are, so they
+        // have to be laid out like the generated ones.
+        const auto& baked = m_scene->heightmap(0);
+        if(baked.width != samples || baked.height != samples || baked.chunk_resolution != TERRAIN_TILE_RESOLUTION 
+                || std::abs(baked.origin_x - TERRAIN_ORIGIN) > 1e-4f || std::abs(baked.origin_y - TERRAIN_ORIGIN) > 1e-4f
+                || std::abs(baked.spacing - spacing) > 1e-6f) {
+            throw std::runtime_error("The scene's heightmap does not match the terrain layout, rebake it!");
+        }
+        if(baked.format != VK_FORMAT_R32_SFLOAT && static_cast<VkFormat>(baked.format) != format) {
+            throw std::runtime_error("The scene's heightmap format cannot be sampled, rebake it with float heights!");
+        }
+        format = static_cast<VkFormat>(baked.format);
+        source = m_scene->sample_data(0);
+        size = baked.sample_size();
+        m_heightmap_origin = glm::vec2(baked.origin_x, baked.origin_y);
+        m_heightmap_spacing = baked.spacing;
+        m_heightmap_scale = baked.height_scale;
+        m_heightmap_bias = baked.height_bias;
+        const glm::vec2* chunk_heights = m_scene->chunk_heights(0);
+        m_chunk_heights.assign(chunk_heights, chunk_heights + TERRAIN_TILES * TERRAIN_TILES);
+        std::vector<float> heights(std::size_t{samples} * samples);
+        for(std::size_t i = 0; i < heights.size(); ++i) {
+            heights[i] = Heightmap::decode(m_scene->sample_data(0), i, format, baked.height_scale, baked.height_bias);
+        }
+        m_terrain_pyramid = std::make_unique<HeightPyramid>(heights, m_heightmap_origin, m_heightmap_spacing, 
+            samples, samples);
+    } else {
+        TerrainGenerator generator;
+        generated = std::make_unique<Heightmap>(generator, glm::vec2(TERRAIN_ORIGIN), spacing, samples, samples, 
+            format, m_jobs.get());
+        source = generated->data().data();
+        size = generated->data().size();
+        m_heightmap_origin = generated->origin();
+        m_heightmap_spacing = generated->spacing();
+        m_heightmap_scale = generated->height_scale();
+        m_heightmap_bias = generated->height_bias();
+        m_chunk_heights = generated->chunk_heights(TERRAIN_TILE_RESOLUTION);
+        m_terrain_pyramid = std::make_unique<HeightPyramid>(*generated);
+    }
+
+    auto [staging, staging_mem] = make_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+    void* data;
+    vkMapMemory(m_device, staging_mem, 0, size, 0, &data);
+    std::memcpy(data, source, size);
+    vkUnmapMemory(m_device, staging_mem);
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = {samples, samples, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage image;
+    if(vkCreateImage(m_device, &imageInfo, m_host_allocator, &image) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create heightmap image!");
+    }
+    m_heightmap_image = own(image);
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(m_device, image, &requirements);
+    m_heightmap_mem = own(allocate_memory(requirements.size, requirements.memoryTypeBits, 
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, MemoryCategory::Terrain));
+    vkBindImageMemory(m_device, image, m_heightmap_mem.get(), 0);
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+    VkCommandBuffer command_buffer = begin_single_use_commands(m_command_pool);
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 
+        0, nullptr, 0, nullptr, 1, &barrier);
+    VkBufferImageCopy region = {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {samples, samples, 1};
+    vkCmdCopyBufferToImage(command_buffer, staging, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+        1, &region);
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 
+        0, nullptr, 0, nullptr, 1, &barrier);
+    submit_single_use_commands(command_buffer);
+
+    vkDestroyBuffer(m_device, staging, m_host_allocator);
+    free_memory(staging_mem);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    VkImageView view;
+    if(vkCreateImageView(m_device, &viewInfo, m_host_allocator, &view) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create heightmap view!");
+    }
+    m_heightmap_view = own(view);
+
+    // Only read with texelFetch, so filtering never applies.
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    VkSampler sampler;
+    if(vkCreateSampler(m_device, &samplerInfo, m_host_allocator, &sampler) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create heightmap sampler!");
+    }
+    m_heightmap_sampler = own(sampler);
+
+    // Full grid, its coarser levels appended when LOD is picked on the CPU,
+    // or only the corners of tessellation patches. Each CPU level comes in
+    // GRID_EDGE_VARIANTS index lists, one per set of edges stitched to the
+    // next level, see terrain_chunk_edges.
+    std::vector<uint16_t> indices;
+    m_grid_lod_first.clear();
+    m_grid_lod_count.clear();
+    if(m_terrain_detail == TerrainDetail::Tessellated) {
+        TerrainGenerator::build_patch_indices((TERRAIN_TILE_RESOLUTION - 1) / TERRAIN_PATCH_STEP + 1, indices);
+        m_grid_lod_first.push_back(0);
+        m_grid_lod_count.push_back(static_cast<uint32_t>(indices.size()));
+    } else {
+        uint32_t levels = m_terrain_detail == TerrainDetail::CpuLod ? TERRAIN_LOD_LEVELS : 1;
+        std::vector<uint16_t> level_indices;
+        for(uint32_t level = 0; level < levels; ++level) {
+            uint32_t variants = level + 1 < levels ? GRID_EDGE_VARIANTS : 1;
+            for(uint32_t edges = 0; edges < variants; ++edges) {
+                TerrainGenerator::build_grid_indices(TERRAIN_TILE_RESOLUTION, level_indices, 1u << level, edges);
+                m_grid_lod_first.push_back(static_cast<uint32_t>(indices.size()));
+                m_grid_lod_count.push_back(static_cast<uint32_t>(level_indices.size()));
+                indices.insert(indices.end(), level_indices.begin(), level_indices.end());
+            }
+            // The coarsest level has no coarser neighbour to stitch to.
+            for(uint32_t edges = variants; edges < GRID_EDGE_VARIANTS && levels > 1; ++edges) {
+                m_grid_lod_first.push_back(m_grid_lod_first.back());
+                m_grid_lod_count.push_back(m_grid_lod_count.back());
+            }
+        }
+    }
+    VkDeviceSize index_size = indices.size() * sizeof(uint16_t);
+    auto [index_staging, index_staging_mem] = make_buffer(index_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+    vkMapMemory(m_device, index_staging_mem, 0, index_size, 0, &data);
+    std::memcpy(data, indices.data(), index_size);
+    vkUnmapMemory(m_device, index_staging_mem);
+    auto [grid_ibo, grid_ibo_mem] = make_buffer(index_size, 
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
+        MemoryCategory::Terrain);
+    m_grid_ibo = own(grid_ibo);
+    m_grid_ibo_mem = own(grid_ibo_mem);
+    buffer_copy(index_staging, grid_ibo, index_size);
+    vkDestroyBuffer(m_device, index_staging, m_host_allocator);
+    free_memory(index_staging_mem);
+
+    VkDeviceSize tile_index_bytes = (TERRAIN_TILE_RESOLUTION - 1) * (TERRAIN_TILE_RESOLUTION - 1) * 6 * sizeof(uint16_t);
+    VkDeviceSize tile_bytes = VkDeviceSize{TERRAIN_TILES} * TERRAIN_TILES 
+        * (TERRAIN_TILE_RESOLUTION * TERRAIN_TILE_RESOLUTION * sizeof(Vertex) + tile_index_bytes);
+    std::cout << "Heightmap terrain (" << terrain_detail_name(m_terrain_detail) << "): " << samples << "x" << samples 
+        << " samples, " << Heightmap::bytes_per_sample(format) << " bytes each, " << (size + index_size) / 1024 
+        << " KB resident (" << tile_bytes / 1024 << " KB as vertex tiles)\n";
+}
+ 
+TileCoord Simulation::terrain_center_chunk() const {
+    glm::vec2 camera = (glm::vec2(m_camera.position().x, m_camera.position().y) - TERRAIN_ORIGIN) / TERRAIN_TILE_EXTENT;
+    return {static_cast<int32_t>(std::floor(camera.x)), static_cast<int32_t>(std::floor(camera.y))};
+}
+ 
+ArenaVector<TileCoord> Simulation::visible_terrain_chunks(FrameArena& arena) const {
+    TileCoord center = terrain_center_chunk();
+    int32_t center_x = center.x;
+    int32_t center_y = center.y;
+
+    // Row-major, so neighbouring chunks of a row end up in one instanced draw.
+    int32_t last = static_cast<int32_t>(TERRAIN_TILES) - 1;
+    int32_t min_x = std::max(center_x - TILE_DRAW_RADIUS, 0);
+    int32_t max_x = std::min(center_x + TILE_DRAW_RADIUS, last);
+    int32_t min_y = std::max(center_y - TILE_DRAW_RADIUS, 0);
+    int32_t max_y = std::min(center_y + TILE_DRAW_RADIUS, last);
+
+    ArenaVector<TileCoord> visible{ArenaAllocator<TileCoord>(arena)};
+    visible.reserve(static_cast<std::size_t>(max_x - min_x + 1) * (max_y - min_y + 1));
+    for(int32_t y = min_y; y <= max_y; ++y) {
+        for(int32_t x = min_x; x <= max_x; ++x) {
+            visible.push_back({x, y});
+        }
+    }
+    return visible;
+}
+ 
+uint32_t Simulation::terrain_chunk_lod(TileCoord chunk, TileCoord center) const {
+    if(m_terrain_detail != TerrainDetail::CpuLod) {
+        return 0;
+    }
+    int32_t ring = std::max(std::abs(chunk.x - center.x), std::abs(chunk.y - center.y));
+    return std::min(static_cast<uint32_t>(ring), TERRAIN_LOD_LEVELS - 1);
+}
+ 
+uint32_t Simulation::terrain_chunk_edges(TileCoord chunk, TileCoord center) const {
+    // Rings grow one level at a time, so a neighbour is at most one level
+    // coarser; chunks off the map have nothing to meet.
+    uint32_t lod = terrain_chunk_lod(chunk, center);
+    int32_t last = static_cast<int32_t>(TERRAIN_TILES) - 1;
+    auto coarser = [&](int32_t x, int32_t y) {
+        return x >= 0 && y >= 0 && x <= last && y <= last && terrain_chunk_lod({x, y}, center) > lod;
+    };
+
+    uint32_t edges = 0;
+    if(coarser(chunk.x - 1, chunk.y)) {
+        edges |= GRID_EDGE_MIN_X;
+    }
+    if(coarser(chunk.x + 1, chunk.y)) {
+        edges |= GRID_EDGE_MAX_X;
+    }
+    if(coarser(chunk.x, chunk.y - 1)) {
+        edges |= GRID_EDGE_MIN_Y;
+    }
+    if(coarser(chunk.x, chunk.y + 1)) {
+        edges |= GRID_EDGE_MAX_Y;
+    }
+    return edges;
+}
+ 
+uint64_t Simulation::record_heightmap_terrain(VkCommandBuffer command_buffer) {
+    TerrainPushConstants params = {};
+    params.origin = m_heightmap_origin;
+    params.sample_spacing = m_heightmap_spacing;
+    params.height_scale = m_heightmap_scale;
+    params.height_bias = m_heightmap_bias;
+    params.patch_resolution = TERRAIN_TILE_RESOLUTION;
+    params.chunks_x = TERRAIN_TILES;
+    params.object = m_terrain_object;
+    params.viewport = glm::vec2(m_render_size.width, m_render_size.height);
+    params.edge_pixels = TERRAIN_EDGE_PIXELS;
+    params.patch_step = TERRAIN_PATCH_STEP;
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_variant(m_terrain_state));
+    vkCmdBindIndexBuffer(command_buffer, m_grid_ibo.get(), 0, VK_INDEX_TYPE_UINT16);
+    vkCmdPushConstants(command_buffer, m_pipeline_layout.get(), m_push_constant_stages, 0, sizeof(params), &params);
+
+    // Levels are relative to m_lod_center, which is one of the terrain
+    // segment's inputs.
+    TileCoord center = m_lod_center;
+    auto grid_range = [&](TileCoord chunk) {
+        uint32_t lod = terrain_chunk_lod(chunk, center);
+        return lod * GRID_EDGE_VARIANTS + terrain_chunk_edges(chunk, center);
+    };
+    uint64_t triangles = 0;
+    std::size_t i = 0;
+    while(i < m_drawn_tiles.size()) {
+        const auto& first = m_drawn_tiles[i];
+        uint32_t range = grid_range(first);
+        uint32_t count = 1;
+        while(i + count < m_drawn_tiles.size() && m_drawn_tiles[i + count].y == first.y 
+                && m_drawn_tiles[i + count].x == first.x + static_cast<int32_t>(count)
+                && grid_range(m_drawn_tiles[i + count]) == range) {
+            count += 1;
+        }
+        uint32_t first_chunk = static_cast<uint32_t>(first.y) * TERRAIN_TILES + static_cast<uint32_t>(first.x);
+        vkCmdDrawIndexed(command_buffer, m_grid_lod_count[range], count, m_grid_lod_first[range], 0, first_chunk);
+        if(m_terrain_detail != TerrainDetail::Tessellated) {
+            triangles += uint64_t{m_grid_lod_count[range]} / 3 * count;
+        }
+        i += count;
+    }
+    return triangles;
+}
+ 
+void Simulation::create_terrain_queries() {
+    // m_view_count per image: one per pass or per view of the multiview pass.
+    m_recorded_terrain_triangles.assign(m_command_buffers.size() * m_view_count, 0);
+    if(!m_pipeline_statistics) {
+        return;
+    }
+
+    VkQueryPoolCreateInfo queryInfo = {};
+    queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    queryInfo.queryCount = static_cast<uint32_t>(m_command_buffers.size() * m_view_count);
+    queryInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT;
+    VkQueryPool terrain_queries;
+    if(vkCreateQueryPool(m_device, &queryInfo, m_host_allocator, &terrain_queries) != VK_SUCCESS) {
+        throw std::runtime_error("Failed to create terrain query pool!");
+    }
+    m_terrain_queries = own(terrain_queries);
+}
+ 
+void Simulation::collect_terrain_statistics(uint32_t image) {
+    // Summed over the views; a multiview pass may count all of them in its
+    // first query.
+    uint32_t first_query = image * m_view_count;
+    std::array<uint64_t, MAX_VIEWS> counts = {};
+    std::copy_n(m_recorded_terrain_triangles.begin() + first_query, m_view_count, counts.begin());
+    if(m_terrain_queries) {
+        // The frame that used the image was waited for, so the result is ready.
+        vkGetQueryPoolResults(m_device, m_terrain_queries.get(), first_query, m_view_count, 
+            sizeof(uint64_t) * m_view_count, counts.data(), sizeof(uint64_t), 
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    }
+    uint64_t triangles = 0;
+    for(uint64_t count : counts) {
+        triangles += count;
+    }
+    m_terrain_triangles += triangles;
+    m_terrain_frames += 1;
+}
+ 
+void Simulation::report_terrain_statistics() const {
+    if(m_terrain_frames == 0) {
+        return;
+    }
+    if(!m_terrain_queries && m_terrain_detail == TerrainDetail::Tessellated) {
+        std::cout << "Terrain triangle counts need pipeline statistics queries, which are not supported\n";
+        return;
+    }
+
+    double triangles = static_cast<double>(m_terrain_triangles) / m_terrain_frames;
+    double seconds = m_frame_timings.mean() / 1000.0;
+    std::cout << "Terrain (" << terrain_detail_name(m_terrain_detail) << "): " 
+        << m_memory_budget->category_bytes(MemoryCategory::Terrain) / 1024 << " KB device memory, " 
+        << static_cast<uint64_t>(triangles) << " triangles per frame" 
+        << (m_terrain_queries ? " (clipper input)" : " (submitted)") << ", " 
+        << (seconds > 0.0 ? triangles / seconds / 1e6 : 0.0) << " Mtri/s\n";
+}
+ 
+void Simulation::create_descriptor_allocators() {
+    m_layout_cache = std::make_unique<DescriptorLayoutCache>(m_device, m_host_allocator);
+    if(m_bindless_enabled) {
+        m_bindless = std::make_unique<BindlessTable>(m_device, *m_layout_cache, BINDLESS_MAX_BUFFERS, BINDLESS_MAX_IMAGES,
+            m_host_allocator);
+        std::cout << "Bindless descriptors enabled\n";
+    }
+}
+ 
+VkDescriptorSet Simulation::write_frame_descriptors(std::size_t image, uint32_t pass) {
+    VkDescriptorSet set = m_frame_descriptors[image]->allocate(m_desc_set_layout);
+
+    FrameDescriptors descriptors;
+    descriptors.uniforms.buffer = m_ubo.get();
+    descriptors.uniforms.offset = pass_index(image, pass) * m_ubo_stride;
+    descriptors.uniforms.range = sizeof(Uniforms);
+    descriptors.objects.buffer = m_object_buffer.get();
+    descriptors.objects.offset = image * OBJECT_BUFFER_SIZE;
+    descriptors.objects.range = OBJECT_BUFFER_SIZE;
+    if(m_heightmap_terrain) {
+        descriptors.heightmap.sampler = m_heightmap_sampler.get();
+        descriptors.heightmap.imageView = m_heightmap_view.get();
+        descriptors.heightmap.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    }
+    descriptors.write(m_device, set);
+    return set;
+}
+ 
+void Simulation::create_occlusion_culling() {
+    float timestamp_period = m_timestamp_period;
+    auto hiz_shader = PipelineManager::load_shader_file("../src/glsl/hiz.spv");
+    m_hiz = std::make_unique<HiZPyramid>(m_device, *m_layout_cache, hiz_shader, 
+        [this](VkDeviceSize size, uint32_t type_filter, VkMemoryPropertyFlags properties) {
+            bool readback = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+            return allocate_memory(size, type_filter, properties, 
+                readback ? MemoryCategory::Staging : MemoryCategory::RenderTargets);
+        },
+        [this](VkDeviceMemory memory) {
+            free_memory(memory);
+        }, timestamp_period, m_host_allocator);
+    std::cout << "Occlusion culling enabled" << (timestamp_period > 0.0f ? "" : ", no GPU timestamps") << "\n";
+}
+ 
+void Simulation::chunk_bounds(TileCoord chunk, glm::vec3& min, glm::vec3& max) const {
+    glm::vec2 heights;
+    if(m_heightmap_terrain) {
+        heights = m_chunk_heights[static_cast<uint32_t>(chunk.y) * TERRAIN_TILES + static_cast<uint32_t>(chunk.x)];
+    } else {
+        const auto& entry = m_tile_file->entry(chunk);
+        heights = glm::vec2(entry.min_height, entry.max_height);
+    }
+    float x = TERRAIN_ORIGIN + chunk.x * TERRAIN_TILE_EXTENT;
+    float y = TERRAIN_ORIGIN + chunk.y * TERRAIN_TILE_EXTENT;
+    min = glm::vec3(x, y, heights.x);
+    max = glm::vec3(x + TERRAIN_TILE_EXTENT, y + TERRAIN_TILE_EXTENT, heights.y);
+}
+ 
+void Simulation::cull_occluded_chunks(ArenaVector<TileCoord>& chunks) {
+    if(!m_hiz) {
+        return;
+    }
 
-    auto currentTime = std::chrono::high_resolution_clock::now();
-    float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    auto start = std::chrono::steady_clock::now();
+    // The terrain object stays at the origin, so its clip transform is the
+    // camera's.
+    const glm::mat4& clip = m_camera.view_projection();
+    std::size_t kept = 0;
+    for(const auto& chunk : chunks) {
+        glm::vec3 min;
+        glm::vec3 max;
+        chunk_bounds(chunk, min, max);
+        switch(m_occlusion.test(clip, min, max)) {
+            case OcclusionResult::Outside: m_occlusion_outside += 1; break;
+            case OcclusionResult::Occluded: m_occlusion_occluded += 1; break;
+            default: chunks[kept++] = chunk; break;
+        }
+    }
+    m_occlusion_tested += chunks.size();
+    chunks.resize(kept);
 
-    Uniforms u;
-    u.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));;
-    u.view = glm::lookAt(glm::vec3(2.0, 2.0, 2.0), glm::vec3(0.0, 0.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
-    u.perspective = glm::perspective(45.0f, static_cast<float>(m_swapchain_size.width) / m_swapchain_size.height, 0.1f, 10.0f);
+    auto end = std::chrono::steady_clock::now();
+    m_occlusion_cpu_ms += std::chrono::duration<double, std::milli>(end - start).count();
+    m_occlusion_frames += 1;
+}
+ 
+void Simulation::report_occlusion_statistics() const {
+    if(m_occlusion_frames == 0) {
+        return;
+    }
+    double frames = static_cast<double>(m_occlusion_frames);
+    std::cout << "Occlusion culling: " << m_occlusion_tested / frames << " chunk draws tested per frame, " 
+        << m_occlusion_occluded / frames << " occluded, " << m_occlusion_outside / frames << " outside the view\n";
+    std::cout << "\t|> CPU tests: " << m_occlusion_cpu_ms / frames << " ms per frame\n";
+    std::cout << "\t|> Depth pyramid: " << m_hiz->level_count() << " levels, " << m_hiz->memory_bytes() / 1024 << " KB";
+    if(m_hiz->timed() && m_occlusion_gpu_frames > 0) {
+        std::cout << ", " << m_occlusion_gpu_ms / m_occlusion_gpu_frames << " ms GPU per frame";
+    }
+    std::cout << "\n";
+}
+ 
+void Simulation::create_tile_streaming() {
+    const char* codec_env = std::getenv("LANDSCAPE_TILE_CODEC");
+    bool packed = codec_env && std::strcmp(codec_env, "0") != 0;
+    const char* tile_file_name = packed ? PACKED_TILE_FILE_NAME : TILE_FILE_NAME;
+
+    std::ifstream existing(tile_file_name, std::ios::binary);
+    if(!existing) {
+        std::cout << "Generating " << tile_file_name << "\n";
+        TerrainGenerator generator;
+        TileFileHeader layout = {};
+        layout.tiles_x = TERRAIN_TILES;
+        layout.tiles_y = TERRAIN_TILES;
+        layout.tile_resolution = TERRAIN_TILE_RESOLUTION;
+        layout.tile_extent = TERRAIN_TILE_EXTENT;
+        layout.origin_x = TERRAIN_ORIGIN;
+        layout.origin_y = TERRAIN_ORIGIN;
+        TileFile::write(tile_file_name, layout, [&](TileCoord coord, auto& vertices, auto& indices) {
+            glm::vec2 origin = {layout.origin_x + coord.x * layout.tile_extent, layout.origin_y + coord.y * layout.tile_extent};
+            generator.build_patch(origin, layout.tile_extent, layout.tile_resolution, vertices, indices);
+        }, packed ? TileEncoding::MeshCodec : TileEncoding::Raw);
+    }
+    existing.close();
+
+    m_tile_file = std::make_unique<TileFile>(tile_file_name);
+    m_terrain_pyramid = tile_height_pyramid(*m_tile_file);
+    m_tile_codecs.resize(m_jobs->thread_count());
+    if(packed) {
+        std::cout << "Tiles are decoded " << (MeshCodec::simd_supported() ? "with SSE2" : "without SIMD") 
+            << " into staging memory\n";
+    }
 
+    VkDeviceSize budget = DEFAULT_TILE_CACHE_BUDGET;
+    if(const char* budget_mb = std::getenv("LANDSCAPE_TILE_BUDGET_MB")) {
+        budget = std::strtoull(budget_mb, nullptr, 10) * 1024 * 1024;
+    }
+    std::cout << "Tile cache budget: " << budget / (1024 * 1024) << " MB\n";
+    m_tile_budget = budget;
+
+    m_tile_cache = std::make_unique<TileCache>(budget, 
+        [this](VkDeviceSize size) {
+            auto [buffer, memory] = make_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT 
+                | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                MemoryCategory::Terrain, true);
+            return TileAllocation{buffer, memory, size};
+        },
+        [this](const TileAllocation& allocation) {
+            // Evictions happen mid-frame, while earlier frames may still draw
+            // the tile.
+            m_deletions->retire(allocation.buffer);
+            m_deletions->retire(allocation.memory);
+        });
+
+    auto [staging, staging_mem] = make_buffer(TILE_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, MemoryCategory::Staging);
+    m_tile_staging = own(staging);
+    m_tile_staging_mem = own(staging_mem);
     void* data;
-    vkMapMemory(m_device, m_ubo_mem, 0, sizeof(u), 0, &data);
-    std::memcpy(data, &u, sizeof(u));
-    vkUnmapMemory(m_device, m_ubo_mem);
+    vkMapMemory(m_device, staging_mem, 0, TILE_STAGING_SIZE, 0, &data);
+    m_tile_staging_ptr = static_cast<std::byte*>(data);
+
+    std::size_t thread_count = std::max(2u, std::thread::hardware_concurrency() / 2);
+    // Wakes the main thread when it waits for events with on-demand
+    // rendering; glfwPostEmptyEvent may be called from any thread.
+    m_tile_streamer = std::make_unique<TileStreamer>(*m_tile_file, thread_count, glfwPostEmptyEvent);
+    m_tile_report_time = std::chrono::steady_clock::now();
+
+    m_tile_heap = m_memory_budget->heap_of_type(
+        m_memory_budget->select_memory_type(~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0));
+    m_memory_budget->add_listener([this](uint32_t heap, MemoryPressure pressure, VkDeviceSize excess) {
+        on_memory_pressure(heap, pressure, excess);
+    });
 }
  
-void Simulation::create_descriptor_pool() {
-    VkDescriptorPoolSize poolSize = {};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(m_swap_chain_images.size());
+void Simulation::on_memory_pressure(uint32_t heap, MemoryPressure pressure, VkDeviceSize excess) {
+    if(heap != m_tile_heap) {
+        return;
+    }
+
+    // Called at the start of a frame. The tile cache may evict immediately,
+    // tiles that frames in flight draw go through the deletion queue.
+    VkDeviceSize budget = m_tile_budget;
+    if(pressure != MemoryPressure::None) {
+        VkDeviceSize allocated = m_tile_cache->allocated_bytes();
+        budget = allocated > excess ? allocated - excess : 0;
+        budget = std::max(budget, std::min(MIN_TILE_CACHE_BUDGET, m_tile_budget));
+        budget = std::min(budget, m_tile_cache->budget());
+    }
+    if(budget == m_tile_cache->budget()) {
+        return;
+    }
 
-    VkDescriptorPoolCreateInfo poolInfo = {};
-    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolInfo.poolSizeCount = 1;
-    poolInfo.pPoolSizes = &poolSize;
-    poolInfo.maxSets = static_cast<uint32_t>(m_swap_chain_images.size());;
+    std::cout << "Memory pressure " << memory_pressure_name(pressure) << " on heap " << heap 
+        << ", tile cache budget " << m_tile_cache->budget() / (1024 * 1024) << " -> " << budget / (1024 * 1024) << " MB\n";
+    m_tile_cache->set_budget(budget);
+}
+ 
+void Simulation::update_tile_streaming() {
+    TileCoord center = m_tile_file->tile_at(m_camera.position().x, m_camera.position().y);
+
+    // Walk rings outwards from the camera so nearer tiles are requested first.
+    ArenaAllocator<TileCoord> allocator(frame_arena());
+    ArenaVector<TileCoord> visible(allocator);
+    ArenaVector<TileCoord> wanted(allocator);
+    for(int32_t ring = 0; ring <= TILE_PREFETCH_RADIUS; ++ring) {
+        for(int32_t dy = -ring; dy <= ring; ++dy) {
+            for(int32_t dx = -ring; dx <= ring; ++dx) {
+                if(std::max(std::abs(dx), std::abs(dy)) != ring) {
+                    continue;
+                }
+                TileCoord coord = {center.x + dx, center.y + dy};
+                if(!m_tile_file->contains(coord)) {
+                    continue;
+                }
+                if(ring <= TILE_DRAW_RADIUS) {
+                    visible.push_back(coord);
+                }
+                if(!m_tile_cache->contains(coord)) {
+                    wanted.push_back(coord);
+                }
+            }
+        }
+    }
 
-    if (vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
-        throw std::runtime_error("failed to create descriptor pool!");
+    m_tile_streamer->request(wanted.data(), wanted.size());
+    m_tile_streamer->take_ready(m_tile_upload_queue);
+    upload_tiles();
+
+    bool stalled = false;
+    ArenaVector<TileCoord> drawn(allocator);
+    for(const auto& coord : visible) {
+        if(m_tile_cache->lookup(coord)) {
+            drawn.push_back(coord);
+        } else {
+            stalled = true;
+        }
+    }
+    if(stalled) {
+        m_tile_cache->record_stall();
     }
+
+    cull_occluded_chunks(drawn);
+    set_drawn_tiles(drawn.data(), drawn.size());
+    report_tile_streaming();
 }
  
-void Simulation::create_descriptor_set() {
-    std::vector<VkDescriptorSetLayout> layouts(m_swap_chain_images.size(), m_desc_set_layout);
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = m_descriptor_pool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(m_swap_chain_images.size());
-    allocInfo.pSetLayouts = layouts.data();
+void Simulation::replay_tile_streaming() {
+    // Uploads happen exactly when they did in the captured session, without
+    // the streamer's timing. Tiles the capture drew but this run evicted (a
+    // different memory budget, say) are uploaded again so the draw list holds.
+    for(const auto& coords : {std::cref(m_frame.uploads), std::cref(m_frame.draws)}) {
+        for(const auto& coord : coords.get()) {
+            if(!m_tile_file->contains(coord)) {
+                throw std::runtime_error("Capture references a tile that is not in the tile file!");
+            }
+        }
+    }
 
-    m_descriptor_sets.resize(m_swap_chain_images.size());
-    if (vkAllocateDescriptorSets(m_device, &allocInfo, &m_descriptor_sets[0]) != VK_SUCCESS) {
-            throw std::runtime_error("failed to allocate descriptor sets!");
+    m_tile_upload_queue = m_frame.uploads;
+    for(const auto& coord : m_frame.draws) {
+        if(!m_tile_cache->contains(coord)) {
+            m_tile_upload_queue.push_back(coord);
+        }
+    }
+    while(!m_tile_upload_queue.empty()) {
+        std::size_t queued = m_tile_upload_queue.size();
+        upload_tiles();
+        if(m_tile_upload_queue.size() == queued) {
+            throw std::runtime_error("Tile does not fit into the staging buffer!");
+        }
     }
 
-    for (size_t i = 0; i < m_swap_chain_images.size(); i++) {
-        VkDescriptorBufferInfo bufferInfo = {};
-        bufferInfo.buffer = m_ubo;
-        bufferInfo.offset = 0;
-        bufferInfo.range = sizeof(Uniforms);
+    for(const auto& coord : m_frame.draws) {
+        m_tile_cache->lookup(coord);
+    }
+    set_drawn_tiles(m_frame.draws.data(), m_frame.draws.size());
+    report_tile_streaming();
+}
+ 
+void Simulation::set_drawn_tiles(const TileCoord* drawn, std::size_t count) {
+    // Diffed against what the command buffers were recorded with when they
+    // are updated.
+    m_drawn_tiles.assign(drawn, drawn + count);
+}
+ 
+void Simulation::upload_tiles() {
+    bool transfer_queue = m_transfer_queue != VK_NULL_HANDLE;
+    VkCommandPool pool = transfer_queue ? m_transfer_command_pool : m_command_pool;
+    // The staging buffer is reused, so the last upload has to be done.
+    if(m_tile_upload_commands != VK_NULL_HANDLE) {
+        m_sync->wait(m_tile_upload_point);
+        vkFreeCommandBuffers(m_device, pool, 1, &m_tile_upload_commands);
+        m_tile_upload_commands = VK_NULL_HANDLE;
+    }
 
-        VkWriteDescriptorSet descriptorWrite = {};
-        descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptorWrite.dstSet = m_descriptor_sets[i];
-        descriptorWrite.dstBinding = 0;
-        descriptorWrite.dstArrayElement = 0;
-        descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorWrite.descriptorCount = 1;
-        descriptorWrite.pBufferInfo = &bufferInfo;
-        descriptorWrite.pImageInfo = nullptr;
-        descriptorWrite.pTexelBufferView = nullptr;
+    VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+    StagingPacker staging(m_tile_staging_ptr, TILE_STAGING_SIZE);
+    std::size_t uploaded = 0;
+    m_tile_staging_writes.clear();
 
-        vkUpdateDescriptorSets(m_device, 1, &descriptorWrite, 0, nullptr);
+    for(; uploaded < m_tile_upload_queue.size(); ++uploaded) {
+        TileCoord coord = m_tile_upload_queue[uploaded];
+        if(m_tile_cache->contains(coord)) {
+            continue;
+        }
+        const auto& entry = m_tile_file->entry(coord);
+        VkDeviceSize size = entry.uploaded_size();
+        VkDeviceSize staging_offset;
+        std::byte* staged = staging.allocate(size, TILE_STAGING_ALIGNMENT, staging_offset);
+        if(!staged) {
+            break;
+        }
+        m_tile_staging_writes.emplace_back(coord, staged);
+
+        auto& tile = m_tile_cache->insert(coord, size);
+        tile.index_offset = entry.index_offset;
+        tile.index_count = entry.index_count;
+
+        if(command_buffer == VK_NULL_HANDLE) {
+            command_buffer = begin_single_use_commands(pool);
+        }
+        VkBufferCopy region = {};
+        region.srcOffset = staging_offset;
+        region.dstOffset = 0;
+        region.size = size;
+        vkCmdCopyBuffer(command_buffer, m_tile_staging.get(), tile.allocation.buffer, 1, &region);
+
+        m_tile_cache->record_streamed(entry.size);
+        m_frame_uploads.push_back(coord);
+    }
+    m_tile_upload_queue.erase(m_tile_upload_queue.begin(), m_tile_upload_queue.begin() + uploaded);
+
+    // The copies only execute once submitted, so the staging memory can be
+    // filled after they are recorded.
+    m_jobs->parallel_for(0, m_tile_staging_writes.size(), 1, [this](std::size_t begin, std::size_t end) {
+        MeshCodec& codec = m_tile_codecs[m_jobs->worker_index()];
+        for(std::size_t i = begin; i < end; ++i) {
+            auto [coord, staged] = m_tile_staging_writes[i];
+            const auto& entry = m_tile_file->entry(coord);
+            const std::byte* data = m_tile_file->tile_data(coord);
+            if(entry.encoding == TileEncoding::MeshCodec) {
+                codec.decode_mesh(data, entry.size, reinterpret_cast<Vertex*>(staged), entry.vertex_count, 
+                    reinterpret_cast<uint16_t*>(staged + entry.index_offset), entry.index_count);
+            } else {
+                std::memcpy(staged, data, entry.size);
+            }
+        }
+    });
+
+    if(command_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+    // Also covers the fence fallback, where the frame's wait on the upload
+    // only orders the submissions. The transfer queue has no vertex input
+    // stage; there the frame's semaphore wait makes the copies visible.
+    if(!transfer_queue) {
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 
+            1, &barrier, 0, nullptr, 0, nullptr);
     }
+    vkEndCommandBuffer(command_buffer);
+
+    SyncSubmission submission;
+    submission.command_buffers = &command_buffer;
+    submission.command_buffer_count = 1;
+    m_tile_upload_point = m_sync->submit(transfer_queue ? m_transfer_sync : m_graphics_sync, submission);
+    m_tile_upload_commands = command_buffer;
 }
  
+void Simulation::report_tile_streaming() {
+    auto now = std::chrono::steady_clock::now();
+    float elapsed = std::chrono::duration<float, std::chrono::seconds::period>(now - m_tile_report_time).count();
+    if(elapsed < 2.0f) {
+        return;
+    }
+
+    const auto& stats = m_tile_cache->stats();
+    float bytes_per_second = (stats.bytes_streamed - m_tile_report_bytes) / elapsed;
+    std::cout << "Tile streaming: hit rate " << stats.hit_rate() * 100.0 << "%"
+        << ", " << bytes_per_second / (1024.0f * 1024.0f) << " MB/s streamed"
+        << ", " << stats.stalls << " stalls"
+        << ", " << m_tile_cache->resident_count() << " resident ("
+        << m_tile_cache->allocated_bytes() / (1024 * 1024) << "/" << m_tile_cache->budget() / (1024 * 1024) << " MB)"
+        << ", " << stats.evictions << " evictions, " << stats.reused_allocations << " reused\n";
+
+    m_tile_report_time = now;
+    m_tile_report_bytes = stats.bytes_streamed;
+}
@@ -2,9 +2,13 @@
 #define SIMULATION_H_
 
 #include <array>
+#include <chrono>
+#include <ctime>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -13,26 +17,75 @@
 
 #include <glm/glm.hpp>
 
-struct Vertex {
-    glm::vec3 pos;
-    glm::vec4 color;
+#include "BindlessTable.h"
+#include "Camera.h"
+#include "CommandSegments.h"
+#include "DeletionQueue.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorLayoutCache.h"
+#include "FrameArena.h"
+#include "FrameCapture.h"
+#include "FrameRecorder.h"
+#include "FrameTimings.h"
+#include "HeightPyramid.h"
+#include "Heightmap.h"
+#include "HiZPyramid.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "MemoryBudget.h"
+#include "MeshCodec.h"
+#include "OcclusionCuller.h"
+#include "PipelineManager.h"
+#include "QueueSync.h"
+#include "RenderGraph.h"
+#include "RenderTypes.h"
+#include "ResolutionController.h"
+#include "SceneDatabase.h"
+#include "SceneFile.h"
+#include "SceneFrame.h"
+#include "TileCache.h"
+#include "TileFile.h"
+#include "TileStreamer.h"
+#include "TransformSystem.h"
 
-    static VkVertexInputBindingDescription binding_desc();
-    static std::array<VkVertexInputAttributeDescription, 2> attrib_desc();
+// Where the terrain's triangles come from: the full resolution heightmap
+// grid for every chunk, hardware tessellation of coarse patches, coarser
+// index lists for distant chunks chosen on the CPU, or the vertex tiles of
+// the tile cache.
+enum class TerrainDetail {
+    Full,
+    Tessellated,
+    CpuLod,
+    Tiles,
 };
 
-struct Uniforms {
-    glm::mat4 perspective;
-    glm::mat4 view;
-    glm::mat4 model;
+const char* terrain_detail_name(TerrainDetail detail);
 
-    static VkDescriptorSetLayoutBinding binding_desc();
-    static VkDescriptorSetLayoutCreateInfo layout_info();
+struct SimulationOptions {
+    // Records every frame's inputs to this file when set.
+    std::string capture_file;
+    // Drives the renderer from a capture instead of the clock and window
+    // input, as fast as presentation allows, and exits at its end.
+    std::string replay_file;
+    // Writes every presented frame to this Y4M video when set.
+    std::string video_file;
+    // Takes the object mesh and the terrain heightmap from this file written
+    // by landscape_bake instead of the built-in ones when set.
+    std::string scene_file;
+    // Views rendered side by side, for stereo displays and split screens;
+    // drawn in one multiview pass unless separate_views asks for one pass
+    // per view, to compare the two.
+    uint32_t views = 1;
+    bool separate_views = false;
+    // Draws frames only when something changed and otherwise blocks waiting
+    // for window events, instead of drawing continuously. The animation
+    // starts paused.
+    bool on_demand = false;
 };
 
 class Simulation {
 public:
-    Simulation();
+    explicit Simulation(const SimulationOptions& options = {});
     ~Simulation();
 
     Simulation(const Simulation& other) = delete;
@@ -50,45 +103,140 @@ private:
     void setup_device();
     void setup_debug_callback();
     void setup_surface();
+    void setup_dynamic_resolution();
+    void setup_views();
+    bool can_blit_to_swapchain() const;
+    void create_frame_queries();
     void setup_framebuffer();
     void setup_render_pass();
     void create_pipeline();
+    PipelineState wireframe_state(const PipelineState& state) const;
+    VkPipeline pipeline_variant(const PipelineState& state);
     void create_framebuffer();
     void create_command_pool();
     void create_command_buffers();
+    void update_command_buffer(std::size_t index);
+    void record_command_buffer(std::size_t index);
+    void push_segment_inputs(std::vector<uint64_t>& inputs, std::size_t index, uint32_t pass) const;
+    void bind_segment_state(VkCommandBuffer command_buffer, std::size_t index, uint32_t pass);
+    void record_object_segment(VkCommandBuffer command_buffer, std::size_t index, uint32_t pass);
+    void record_terrain_segment(VkCommandBuffer command_buffer, std::size_t index, uint32_t pass);
+    std::unique_ptr<RenderGraph> build_frame_graph(std::size_t index);
+    void record_scene_pass(VkCommandBuffer command_buffer, std::size_t index, uint32_t pass);
+    void record_upscale_pass(VkCommandBuffer command_buffer, std::size_t index);
+    void update_render_scale();
     void create_semaphores();
-    void create_descriptor_pool();
-    uint32_t select_memory_type(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    void create_frame_recorder();
+    void create_descriptor_allocators();
+    VkDescriptorSet write_frame_descriptors(std::size_t image, uint32_t pass);
 
     void create_vbo();
     void create_ibo();
     void create_ubo();
-    void create_descriptor_set();
 
+    void create_heightmap();
+    TileCoord terrain_center_chunk() const;
+    ArenaVector<TileCoord> visible_terrain_chunks(FrameArena& arena) const;
+    uint32_t terrain_chunk_lod(TileCoord chunk, TileCoord center) const;
+    uint32_t terrain_chunk_edges(TileCoord chunk, TileCoord center) const;
+    uint64_t record_heightmap_terrain(VkCommandBuffer command_buffer);
+    void create_terrain_queries();
+    void collect_terrain_statistics(uint32_t image);
+    void report_terrain_statistics() const;
+
+    void create_occlusion_culling();
+    void chunk_bounds(TileCoord chunk, glm::vec3& min, glm::vec3& max) const;
+    void cull_occluded_chunks(ArenaVector<TileCoord>& chunks);
+    void report_occlusion_statistics() const;
+
+    void create_tile_streaming();
+    void update_tile_streaming();
+    void replay_tile_streaming();
+    void set_drawn_tiles(const TileCoord* drawn, std::size_t count);
+    void upload_tiles();
+    void report_tile_streaming();
+    void on_memory_pressure(uint32_t heap, MemoryPressure pressure, VkDeviceSize excess);
+
+    FrameArena& frame_arena() { return m_frame_slots[m_frame_slot].arenas.thread(m_jobs->worker_index()); }
+    void count_frame_allocations(uint64_t thread_allocations, uint64_t allocations);
+    void report_frame_allocations() const;
+    bool scene_changed() const;
+    void report_utilization() const;
+
+    bool begin_frame();
+    void end_frame();
+    void handle_key(int key, int action);
+    void pick_terrain();
     void update_ubo();
+    void write_frame_data(std::size_t image);
+    ViewLayout views() const { return {m_view_count, m_separate_views}; }
+    bool renders_to_scene_color() const { return m_resolution || m_view_count > 1; }
+    // Scene passes per frame, and the index of one image's pass in the
+    // per-pass framebuffers and descriptor sets.
+    uint32_t view_passes() const { return m_separate_views ? m_view_count : 1; }
+    std::size_t pass_index(std::size_t image, uint32_t pass) const { return image * view_passes() + pass; }
 
     void rebuild_swapchain();
     VkExtent2D choose_swapchain_extent();
+    VkPresentModeKHR choose_present_mode(const std::vector<VkPresentModeKHR>& present_modes) const;
     static void glfw_resize_callback(GLFWwindow* window, int width, int height);
+    static void glfw_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+    static void glfw_refresh_callback(GLFWwindow* window);
+    static void glfw_mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 
     void draw_frame();
 
     VkPhysicalDevice select_physical_device();
     void make_logical_device();
+    // Buffers written by the transfer queue and read by the graphics queue
+    // are shared between both families.
     std::tuple<VkBuffer, VkDeviceMemory> make_buffer(VkDeviceSize size, VkBufferUsageFlags usage, 
-        VkMemoryPropertyFlags properties);
+        VkMemoryPropertyFlags properties, MemoryCategory category, bool transfer_shared = false);
+    VkDeviceMemory allocate_memory(VkDeviceSize size, uint32_t type_filter, VkMemoryPropertyFlags properties, 
+        MemoryCategory category);
+    void free_memory(VkDeviceMemory memory);
+    template <typename T>
+    DeviceHandle<T> own(T handle) { return DeviceHandle<T>(*m_deletions, handle); }
     void buffer_copy(VkBuffer source, VkBuffer dest, VkDeviceSize size);
-
-    static std::vector<char> load_shader_file(const std::string& filename);
-    VkShaderModule make_shader_module(const std::vector<char>& data);
+    VkCommandBuffer begin_single_use_commands(VkCommandPool pool);
+    // Blocks until the commands have run.
+    void submit_single_use_commands(VkCommandBuffer command_buffer);
 
     std::vector<const char*> get_extension_layers();
     std::vector<const char*> get_instance_extensions();
 
+    SimulationOptions m_options;
+    // Declared first so it outlives everything that runs jobs on it.
+    std::unique_ptr<JobSystem> m_jobs;
+    // Host memory the driver allocates for every Vulkan object. Has to
+    // outlive the instance and device, which the destructor body destroys.
+    HostAllocator m_host_memory;
+    const VkAllocationCallbacks* m_host_allocator;
+    // What a frame uses until the GPU is done with it. run() keeps up to
+    // FRAMES_IN_FLIGHT frames queued, each in its own slot, and waits for
+    // the oldest before its slot is reused.
+    struct FrameSlot {
+        explicit FrameSlot(std::size_t thread_count): arenas(thread_count) { }
+
+        // Transient data of the frame, per job thread.
+        FrameArenas arenas;
+        SemaphoreHandle image_available;
+        SemaphoreHandle render_finished;
+        bool submitted = false;
+        SyncPoint point;
+        uint32_t image = 0;
+        uint64_t frame = 0;
+    };
+    std::vector<FrameSlot> m_frame_slots;
+    std::size_t m_frame_slot = 0;
+    // Frames begun so far, and the last of them the GPU has completed.
+    uint64_t m_frame_number = 0;
+    uint64_t m_completed_frame = 0;
     GLFWwindow* m_window;
 
     uint32_t m_draw_queue_idx;
     uint32_t m_present_queue_idx;
+    uint32_t m_transfer_queue_idx = 0;
     VkFormat m_swapchain_format;
     VkExtent2D m_swapchain_size;
     bool m_was_resized = false;
@@ -101,28 +249,230 @@ private:
     VkSwapchainKHR m_swapchain;
     VkQueue m_queue;
     VkQueue m_present_queue;
-    VkRenderPass m_render_pass;
+    // All submissions go through it.
+    std::unique_ptr<QueueSync> m_sync;
+    uint32_t m_graphics_sync = 0;
+    // Tile uploads run on a queue of a dedicated transfer family when there
+    // is one, and on m_queue otherwise.
+    VkQueue m_transfer_queue = VK_NULL_HANDLE;
+    uint32_t m_transfer_sync = 0;
+    // Destroys the objects behind dropped handles once the frames submitted
+    // before have completed, so nothing waits for the device to idle.
+    std::unique_ptr<DeletionQueue> m_deletions;
+    RenderPassHandle m_render_pass;
+    VkFormat m_depth_format;
+    // Area of the color and depth attachments the scene is rendered to; the
+    // whole view unless dynamic resolution scales it down.
+    VkExtent2D m_render_size = {0, 0};
+
+    // Views side by side across the swapchain image, each rendered to its
+    // layer of the color and depth attachments, m_view_size large. With
+    // m_separate_views every view gets a scene pass of its own instead of a
+    // share of one multiview pass.
+    uint32_t m_view_count = 1;
+    uint32_t m_max_views = 1;
+    bool m_separate_views = false;
+    VkExtent2D m_view_size = {0, 0};
+    float m_timestamp_period = 0.0f;
     VkDescriptorSetLayout m_desc_set_layout;
-    VkPipelineLayout m_pipeline_layout;
-    VkPipeline m_pipeline;
+    PipelineLayoutHandle m_pipeline_layout;
+    std::unique_ptr<PipelineManager> m_pipelines;
+    PipelineState m_scene_state;
+    PipelineState m_terrain_state;
+    // Toggled with W; drawn with variants of the scene and terrain states.
+    bool m_wireframe = false;
+    bool m_wireframe_supported = false;
+    VkShaderStageFlags m_push_constant_stages = VK_SHADER_STAGE_VERTEX_BIT;
     VkCommandPool m_command_pool;
-    VkDescriptorPool m_descriptor_pool;
+    VkCommandPool m_transfer_command_pool = VK_NULL_HANDLE;
+
+    std::unique_ptr<DescriptorLayoutCache> m_layout_cache;
+    std::vector<std::unique_ptr<DescriptorAllocator>> m_frame_descriptors;
+    std::unique_ptr<BindlessTable> m_bindless;
+    bool m_bindless_enabled = false;
+    // The object buffer of each swapchain image, see create_ubo.
+    std::vector<uint32_t> m_object_buffer_slots;
+
+    // Only mapped until its contents are uploaded.
+    std::unique_ptr<SceneFile> m_scene;
+    BufferHandle m_vbo;
+    MemoryHandle m_vbo_mem;
+    BufferHandle m_ibo;
+    MemoryHandle m_ibo_mem;
+    // Both hold a copy per swapchain image, so frames in flight keep
+    // theirs. The uniform buffer has one Uniforms per image and view pass,
+    // in pass_index order and this far apart.
+    BufferHandle m_ubo;
+    MemoryHandle m_ubo_mem;
+    VkDeviceSize m_ubo_stride = 0;
+    BufferHandle m_object_buffer;
+    MemoryHandle m_object_buffer_mem;
+    float* m_object_buffer_ptr = nullptr;
+    // What update_ubo wrote last, and how often. write_frame_data copies
+    // them into an image's part of the buffers when that has an older
+    // revision.
+    std::vector<std::byte> m_uniforms;
+    std::vector<float> m_object_clip;
+    uint64_t m_uniforms_revision = 0;
+    uint64_t m_objects_revision = 0;
+    std::vector<uint64_t> m_image_uniforms_revision;
+    std::vector<uint64_t> m_image_objects_revision;
+
+    Camera m_camera;
+    SceneUpdate m_scene_update;
+    TransformSystem m_transforms;
+    uint32_t m_quad_object;
+    // The part of m_ibo drawn for the object.
+    SceneMeshLod m_quad_lod = {0, 6, 0.0f};
+    uint32_t m_terrain_object;
+    // Placed objects, culled against the camera each frame; the object
+    // segment draws the lanes set in m_object_visibility.
+    SceneDatabase m_scene_objects;
+    std::vector<uint64_t> m_object_visibility;
+
+    std::unique_ptr<MemoryBudget> m_memory_budget;
+
+    std::unique_ptr<CaptureWriter> m_capture;
+    std::unique_ptr<CaptureReader> m_replay;
+    CapturedFrame m_frame;
+    std::vector<InputEvent> m_pending_input;
+    std::vector<TileCoord> m_frame_uploads;
+    std::chrono::steady_clock::time_point m_start_time;
+    std::chrono::steady_clock::time_point m_last_frame_time;
+    FrameTimings m_frame_timings;
+    // Toggled with Space. m_frame.time, which drives the animation, stands
+    // still while it is paused.
+    bool m_animating = true;
+
+    // With on-demand rendering the main thread waits for events until
+    // scene_changed or m_redraw_frames asks for a frame. Tile workers wake it
+    // when they finish.
+    bool m_on_demand = false;
+    // Frames to draw without a change to show: the first one, and those
+    // after the window was uncovered or occlusion culling lagged behind.
+    uint32_t m_redraw_frames = 1;
+    // Process CPU time at the start and wall time spent waiting for events,
+    // for report_utilization.
+    std::clock_t m_start_cpu_time = 0;
+    double m_idle_seconds = 0.0;
+    // Heap allocations of frames past the warm-up, made by the main thread
+    // and by every thread.
+    uint64_t m_steady_frames = 0;
+    uint64_t m_steady_allocating_frames = 0;
+    uint64_t m_steady_thread_allocations = 0;
+    uint64_t m_steady_allocations = 0;
+
+    // LANDSCAPE_TERRAIN=heightmap|tessellated|lod: the terrain is one
+    // heightmap image and a shared grid patch instead of streamed vertex
+    // tiles.
+    bool m_heightmap_terrain = false;
+    TerrainDetail m_terrain_detail = TerrainDetail::Full;
+    // Where the heightmap image's samples lie and how they decode.
+    glm::vec2 m_heightmap_origin = glm::vec2(0.0f);
+    float m_heightmap_spacing = 1.0f;
+    float m_heightmap_scale = 1.0f;
+    float m_heightmap_bias = 0.0f;
+    ImageHandle m_heightmap_image;
+    MemoryHandle m_heightmap_mem;
+    ImageViewHandle m_heightmap_view;
+    SamplerHandle m_heightmap_sampler;
+    BufferHandle m_grid_ibo;
+    MemoryHandle m_grid_ibo_mem;
+    // First index and index count of each level of detail in m_grid_ibo;
+    // only level 0 exists unless m_terrain_detail is CpuLod.
+    std::vector<uint32_t> m_grid_lod_first;
+    std::vector<uint32_t> m_grid_lod_count;
+    TileCoord m_lod_center = {0, 0};
+
+    // Terrain triangle counts: primitives reaching the clipper, counted by
+    // one pipeline statistics query per swapchain image and view when the
+    // device can, otherwise what each command buffer submits.
+    bool m_pipeline_statistics = false;
+    QueryPoolHandle m_terrain_queries;
+    std::vector<uint64_t> m_recorded_terrain_triangles;
+    // Reads back presented frames for the video and F12 screenshots, when
+    // the swapchain images can be copied from.
+    std::unique_ptr<FrameRecorder> m_recorder;
+    bool m_swapchain_readback = false;
+    uint64_t m_terrain_triangles = 0;
+    uint64_t m_terrain_frames = 0;
+
+    // Lowest and highest height of each heightmap chunk, for culling.
+    std::vector<glm::vec2> m_chunk_heights;
+    // The terrain's samples for ray casts, from the heightmap or the
+    // generator the tiles were built with. A left click picks the terrain
+    // point under the cursor.
+    std::unique_ptr<HeightPyramid> m_terrain_pyramid;
+
+    // LANDSCAPE_OCCLUSION=1: terrain chunks are tested against a depth
+    // pyramid of the previous frame before they are drawn. Chunks uncovered
+    // by camera motion therefore show up one frame late.
+    bool m_occlusion_culling = false;
+    std::unique_ptr<HiZPyramid> m_hiz;
+    OcclusionCuller m_occlusion;
+    uint64_t m_occlusion_frames = 0;
+    uint64_t m_occlusion_tested = 0;
+    uint64_t m_occlusion_outside = 0;
+    uint64_t m_occlusion_occluded = 0;
+    double m_occlusion_cpu_ms = 0.0;
+    uint64_t m_occlusion_gpu_frames = 0;
+    double m_occlusion_gpu_ms = 0.0;
 
-    VkBuffer m_vbo;
-    VkDeviceMemory m_vbo_mem;
-    VkBuffer m_ibo;
-    VkDeviceMemory m_ibo_mem;
-    VkBuffer m_ubo;
-    VkDeviceMemory m_ubo_mem;
+    // LANDSCAPE_DYNAMIC_RESOLUTION=<target ms>: the scene is rendered into
+    // the top left m_render_size of a view sized color image, scaled to hold
+    // the GPU frame time measured by timestamps, and blitted to the
+    // swapchain image. Multiple views are rendered through it as well.
+    std::unique_ptr<ResolutionController> m_resolution;
+    VkFilter m_upscale_filter = VK_FILTER_LINEAR;
+    // Two timestamps per swapchain image around its frame's commands, taken
+    // whenever the device supports them, for dynamic resolution and the GPU
+    // time reports.
+    QueryPoolHandle m_frame_queries;
+    FrameTimings m_gpu_timings;
 
-    VkSemaphore m_image_available_semaphore;
-    VkSemaphore m_render_finished_semaphore;
+    std::unique_ptr<TileFile> m_tile_file;
+    std::unique_ptr<TileCache> m_tile_cache;
+    std::unique_ptr<TileStreamer> m_tile_streamer;
+    // Decode LANDSCAPE_TILE_CODEC=1 tiles into the staging buffer, one per
+    // job thread.
+    std::vector<MeshCodec> m_tile_codecs;
+    // Tiles upload_tiles has reserved staging memory for, to be filled in
+    // parallel.
+    std::vector<std::pair<TileCoord, std::byte*>> m_tile_staging_writes;
+    BufferHandle m_tile_staging;
+    MemoryHandle m_tile_staging_mem;
+    std::byte* m_tile_staging_ptr = nullptr;
+    // The last upload, which the next frame waits for and the next upload
+    // waits for before reusing the staging buffer.
+    VkCommandBuffer m_tile_upload_commands = VK_NULL_HANDLE;
+    SyncPoint m_tile_upload_point;
+    std::vector<TileCoord> m_tile_upload_queue;
+    std::vector<TileCoord> m_drawn_tiles;
+    VkDeviceSize m_tile_budget = 0;
+    uint32_t m_tile_heap = 0;
+    std::chrono::steady_clock::time_point m_tile_report_time;
+    uint64_t m_tile_report_bytes = 0;
 
-    std::vector<VkImageView> m_swap_chain_views;
+    std::vector<ImageViewHandle> m_swap_chain_views;
     std::vector<VkImage> m_swap_chain_images;
-    std::vector<VkFramebuffer> m_framebuffers;
+    std::vector<FramebufferHandle> m_framebuffers;
     std::vector<VkCommandBuffer> m_command_buffers;
-    std::vector<VkDescriptorSet> m_descriptor_sets;
+    // The last frame submitted with each swapchain image, which has to
+    // complete before the image's command buffer or data is touched again.
+    std::vector<SyncPoint> m_image_points;
+    // One per swapchain image, all sharing the transients of the first.
+    std::vector<std::unique_ptr<RenderGraph>> m_frame_graphs;
+    // Transient images every frame graph declares in the same order, with
+    // one layer per view.
+    RenderGraph::Resource m_depth_target = 0;
+    RenderGraph::Resource m_scene_color_target = 0;
+    // The scene pass executes one secondary command buffer per segment,
+    // which is only re-recorded when its inputs change. The primaries are
+    // re-recorded with them or when m_command_buffer_dirty says that
+    // something only they use changed.
+    std::unique_ptr<CommandSegments> m_segments;
+    std::vector<VkDescriptorSet> m_frame_sets;
+    std::vector<bool> m_command_buffer_dirty;
 };
 
 #endif
@@ -0,0 +1,23 @@
+#include "StagingPacker.h"
+
+#include <cstring>
+
+
+bool StagingPacker::pack(const void* source, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+    std::byte* destination = allocate(size, alignment, offset);
+    if(!destination) {
+        return false;
+    }
+    std::memcpy(destination, source, size);
+    return true;
+}
+ 
+std::byte* StagingPacker::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset) {
+    VkDeviceSize aligned = alignment > 1 ? (m_used + alignment - 1) / alignment * alignment : m_used;
+    if(aligned + size > m_capacity) {
+        return nullptr;
+    }
+    offset = aligned;
+    m_used = aligned + size;
+    return m_data + aligned;
+}
@@ -0,0 +1,38 @@
+#ifndef STAGING_PACKER_H_
+#define STAGING_PACKER_H_
+
+#include <cstddef>
+
+#include <vulkan/vulkan.h>
+
+// Linear packer over a mapped staging buffer. Each pack() copies a block to
+// the next suitably aligned offset and reports where it went, so callers can
+// turn the packed blocks into VkBufferCopy regions. Nothing is flushed; the
+// staging memory is expected to be host coherent.
+class StagingPacker {
+public:
+    StagingPacker(std::byte* data, VkDeviceSize capacity): m_data(data), m_capacity(capacity) { }
+    ~StagingPacker() = default;
+
+    StagingPacker(const StagingPacker& other) = delete;
+    StagingPacker(StagingPacker&& other) noexcept = delete;
+    StagingPacker& operator =(const StagingPacker& other) = delete;
+    StagingPacker& operator =(StagingPacker&& other) noexcept = delete;
+
+    // Returns false, without copying anything, when size bytes no longer fit.
+    bool pack(const void* source, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+    // Reserves size bytes for the caller to write, e.g. by decoding straight
+    // into them; null when they no longer fit.
+    std::byte* allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+    void reset() { m_used = 0; }
+
+    VkDeviceSize used() const { return m_used; }
+    VkDeviceSize capacity() const { return m_capacity; }
+
+private:
+    std::byte* m_data;
+    VkDeviceSize m_capacity;
+    VkDeviceSize m_used = 0;
+};
+
+#endif
@@ -0,0 +1,144 @@
+#include "TerrainGenerator.h"
+
+#include <cmath>
+#include <stdexcept>
+
+
+TerrainGenerator::TerrainGenerator(uint32_t seed):
+    m_seed(seed)
+{ }
+ 
+float TerrainGenerator::lattice(int32_t x, int32_t y) const {
+    uint32_t hash = static_cast<uint32_t>(x) * 374761393u + static_cast<uint32_t>(y) * 668265263u + m_seed * 2246822519u;
+    hash = (hash ^ (hash >> 13)) * 1274126177u;
+    hash ^= hash >> 16;
+    return static_cast<float>(hash & 0xFFFFFF) / static_cast<float>(0xFFFFFF);
+}
+ 
+float TerrainGenerator::value_noise(float x, float y) const {
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    int32_t ix = static_cast<int32_t>(fx);
+    int32_t iy = static_cast<int32_t>(fy);
+    float tx = x - fx;
+    float ty = y - fy;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    ty = ty * ty * (3.0f - 2.0f * ty);
+
+    float a = lattice(ix, iy);
+    float b = lattice(ix + 1, iy);
+    float c = lattice(ix, iy + 1);
+    float d = lattice(ix + 1, iy + 1);
+    return glm::mix(glm::mix(a, b, tx), glm::mix(c, d, tx), ty);
+}
+ 
+float TerrainGenerator::height(float x, float y) const {
+    float amplitude = 0.5f;
+    float frequency = 0.35f;
+    float total = 0.0f;
+    for(int octave = 0; octave < 5; ++octave) {
+        total += amplitude * value_noise(x * frequency, y * frequency);
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return total - 0.6f;
+}
+ 
+glm::vec4 TerrainGenerator::color(float height) const {
+    const glm::vec4 low = {0.15f, 0.35f, 0.12f, 1.0f};
+    const glm::vec4 mid = {0.45f, 0.38f, 0.25f, 1.0f};
+    const glm::vec4 high = {0.92f, 0.92f, 0.95f, 1.0f};
+
+    float t = glm::clamp((height + 0.6f) / 0.95f, 0.0f, 1.0f);
+    if(t < 0.6f) {
+        return glm::mix(low, mid, t / 0.6f);
+    }
+    return glm::mix(mid, high, (t - 0.6f) / 0.4f);
+}
+ 
+void TerrainGenerator::build_patch(glm::vec2 origin, float extent, uint32_t resolution,
+    std::vector<Vertex>& vertices, std::vector<uint16_t>& indices) const
+{
+    if(resolution < 2 || resolution * resolution > 65536) {
+        throw std::runtime_error("Terrain patch resolution does not fit 16 bit indices!");
+    }
+
+    vertices.clear();
+    vertices.reserve(resolution * resolution);
+
+    float step = extent / static_cast<float>(resolution - 1);
+    for(uint32_t row = 0; row < resolution; ++row) {
+        for(uint32_t col = 0; col < resolution; ++col) {
+            float x = origin.x + step * col;
+            float y = origin.y + step * row;
+            float h = height(x, y);
+            vertices.push_back({{x, y, h}, color(h)});
+        }
+    }
+
+    build_grid_indices(resolution, indices);
+}
+ 
+void TerrainGenerator::build_grid_indices(uint32_t resolution, std::vector<uint16_t>& indices, uint32_t step,
+        uint32_t coarse_edges) {
+    if(resolution < 2 || resolution * resolution > 65536) {
+        throw std::runtime_error("Terrain patch resolution does not fit 16 bit indices!");
+    }
+    if(step == 0 || (resolution - 1) % step != 0) {
+        throw std::runtime_error("Terrain grid step does not divide the patch!");
+    }
+    if(coarse_edges != 0 && (resolution - 1) % (2 * step) != 0) {
+        throw std::runtime_error("Terrain grid edges cannot meet a grid of twice the step!");
+    }
+
+    // Moving a vertex along the patch boundary onto its neighbour keeps the
+    // triangles around it from flipping, as the boundary is straight.
+    uint32_t last = resolution - 1;
+    auto vertex = [&](uint32_t row, uint32_t col) {
+        bool odd_col = (col / step) % 2 == 1;
+        bool odd_row = (row / step) % 2 == 1;
+        if(odd_col && (((coarse_edges & GRID_EDGE_MIN_Y) && row == 0)
+                || ((coarse_edges & GRID_EDGE_MAX_Y) && row == last))) {
+            col -= step;
+        } else if(odd_row && (((coarse_edges & GRID_EDGE_MIN_X) && col == 0)
+                || ((coarse_edges & GRID_EDGE_MAX_X) && col == last))) {
+            row -= step;
+        }
+        return static_cast<uint16_t>(row * resolution + col);
+    };
+    auto add_triangle = [&](uint16_t a, uint16_t b, uint16_t c) {
+        if(a != b && b != c && c != a) {
+            indices.insert(indices.end(), {a, b, c});
+        }
+    };
+
+    uint32_t quads = (resolution - 1) / step;
+    indices.clear();
+    indices.reserve(quads * quads * 6);
+    for(uint32_t row = 0; row + step < resolution; row += step) {
+        for(uint32_t col = 0; col + step < resolution; col += step) {
+            uint16_t i0 = vertex(row, col);
+            uint16_t i1 = vertex(row, col + step);
+            uint16_t i2 = vertex(row + step, col + step);
+            uint16_t i3 = vertex(row + step, col);
+            add_triangle(i0, i1, i2);
+            add_triangle(i2, i3, i0);
+        }
+    }
+}
+ 
+void TerrainGenerator::build_patch_indices(uint32_t resolution, std::vector<uint16_t>& indices) {
+    if(resolution < 2 || resolution * resolution > 65536) {
+        throw std::runtime_error("Terrain patch resolution does not fit 16 bit indices!");
+    }
+
+    indices.clear();
+    indices.reserve((resolution - 1) * (resolution - 1) * 4);
+    for(uint32_t row = 0; row + 1 < resolution; ++row) {
+        for(uint32_t col = 0; col + 1 < resolution; ++col) {
+            uint16_t i0 = static_cast<uint16_t>(row * resolution + col);
+            indices.insert(indices.end(), {i0, static_cast<uint16_t>(i0 + 1), 
+                static_cast<uint16_t>(i0 + resolution + 1), static_cast<uint16_t>(i0 + resolution)});
+        }
+    }
+}
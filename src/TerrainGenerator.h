@@ -0,0 +1,62 @@
+#ifndef TERRAIN_GENERATOR_H_
+#define TERRAIN_GENERATOR_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "RenderTypes.h"
+
+// Edges of a grid patch, local x being the column and y the row.
+enum GridEdges : uint32_t {
+    GRID_EDGE_MIN_X = 1,
+    GRID_EDGE_MAX_X = 2,
+    GRID_EDGE_MIN_Y = 4,
+    GRID_EDGE_MAX_Y = 8,
+};
+static constexpr uint32_t GRID_EDGE_VARIANTS = 16;
+
+// Procedural heightfield used to author terrain data. Heights are in world
+// units along +Z, which is the up axis of the camera set up in update_ubo.
+class TerrainGenerator {
+public:
+    explicit TerrainGenerator(uint32_t seed = 1337);
+    ~TerrainGenerator() = default;
+
+    TerrainGenerator(const TerrainGenerator& other) = default;
+    TerrainGenerator(TerrainGenerator&& other) noexcept = default;
+    TerrainGenerator& operator =(const TerrainGenerator& other) = default;
+    TerrainGenerator& operator =(TerrainGenerator&& other) noexcept = default;
+
+    float height(float x, float y) const;
+    glm::vec4 color(float height) const;
+
+    // Builds a (resolution x resolution) vertex grid covering the square
+    // [origin, origin + extent], wound the same way as the quad in create_vbo
+    // so it survives the pipeline's back face culling.
+    void build_patch(glm::vec2 origin, float extent, uint32_t resolution,
+        std::vector<Vertex>& vertices, std::vector<uint16_t>& indices) const;
+    // Index list of a (resolution x resolution) grid with row-major vertex
+    // numbering, as used by build_patch and by the heightmap terrain, whose
+    // vertex shader derives each vertex's grid position from its index.
+    // A step above one skips vertices for a coarser level of detail of the
+    // same grid; (resolution - 1) has to be a multiple of it. The coarse_edges
+    // (GridEdges) meet a neighbour drawn with twice the step: every other
+    // vertex along them is collapsed onto the one before, so the edge follows
+    // the neighbour's without T-junctions, and the triangles that collapse
+    // are left out.
+    static void build_grid_indices(uint32_t resolution, std::vector<uint16_t>& indices, uint32_t step = 1,
+        uint32_t coarse_edges = 0);
+    // Four corner indices per quad of a (resolution x resolution) grid, in
+    // the order the quad domain of terrain.tese expects.
+    static void build_patch_indices(uint32_t resolution, std::vector<uint16_t>& indices);
+
+private:
+    float lattice(int32_t x, int32_t y) const;
+    float value_noise(float x, float y) const;
+
+    uint32_t m_seed;
+};
+
+#endif
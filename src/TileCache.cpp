@@ -0,0 +1,150 @@
+#include "TileCache.h"
+
+#include <algorithm>
+#include <utility>
+
+
+double TileCacheStats::hit_rate() const {
+    uint64_t lookups = hits + misses;
+    return lookups == 0 ? 1.0 : static_cast<double>(hits) / lookups;
+}
+ 
+TileCache::TileCache(VkDeviceSize budget, AllocateFunction allocate, ReleaseFunction release):
+    m_allocate(std::move(allocate)),
+    m_release(std::move(release)),
+    m_budget(budget)
+{ }
+ 
+TileCache::~TileCache() {
+    for(const auto& tile : m_lru) {
+        m_release(tile.allocation);
+    }
+    for(const auto& allocation : m_free) {
+        m_release(allocation);
+    }
+}
+ 
+const ResidentTile* TileCache::lookup(TileCoord coord) {
+    auto it = m_index.find(coord);
+    if(it == m_index.end()) {
+        m_stats.misses += 1;
+        return nullptr;
+    }
+    m_stats.hits += 1;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    it->second->last_frame = m_frame;
+    return &*it->second;
+}
+ 
+const ResidentTile* TileCache::find(TileCoord coord) const {
+    auto it = m_index.find(coord);
+    return it == m_index.end() ? nullptr : &*it->second;
+}
+ 
+ResidentTile& TileCache::insert(TileCoord coord, VkDeviceSize size) {
+    auto existing = m_index.find(coord);
+    if(existing != m_index.end()) {
+        m_lru.splice(m_lru.begin(), m_lru, existing->second);
+        existing->second->last_frame = m_frame;
+        return *existing->second;
+    }
+
+    TileAllocation allocation;
+    while(true) {
+        if(take_free_allocation(size, allocation)) {
+            m_stats.reused_allocations += 1;
+            break;
+        }
+        if(m_allocated + size <= m_budget || (m_free.empty() && m_lru.empty())) {
+            allocation = m_allocate(size);
+            m_allocated += allocation.capacity;
+            break;
+        }
+        // Nothing on the free list fits: drop those allocations before
+        // sacrificing a resident tile.
+        if(!m_free.empty()) {
+            release_free_allocation();
+        } else {
+            evict_lru();
+        }
+    }
+
+    ResidentTile tile;
+    tile.coord = coord;
+    tile.allocation = allocation;
+    tile.last_frame = m_frame;
+    m_lru.push_front(tile);
+    m_index[coord] = m_lru.begin();
+    m_generation += 1;
+    return m_lru.front();
+}
+ 
+uint64_t TileCache::record_draws(VkCommandBuffer command_buffer, const TileCoord* coords, std::size_t count, 
+        uint32_t instance) const {
+    VkDeviceSize offset = 0;
+    uint64_t triangles = 0;
+    for(std::size_t i = 0; i < count; ++i) {
+        const auto* tile = find(coords[i]);
+        vkCmdBindVertexBuffers(command_buffer, 0, 1, &tile->allocation.buffer, &offset);
+        vkCmdBindIndexBuffer(command_buffer, tile->allocation.buffer, tile->index_offset, VK_INDEX_TYPE_UINT16);
+        vkCmdDrawIndexed(command_buffer, tile->index_count, 1, 0, 0, instance);
+        triangles += tile->index_count / 3;
+    }
+    return triangles;
+}
+ 
+void TileCache::begin_frame(uint64_t frame, uint64_t completed_frame) {
+    m_frame = frame;
+    m_completed_frame = completed_frame;
+}
+ 
+void TileCache::set_budget(VkDeviceSize budget) {
+    m_budget = budget;
+    while(m_allocated > m_budget && !(m_free.empty() && m_lru.empty())) {
+        if(!m_free.empty()) {
+            release_free_allocation();
+        } else {
+            evict_lru();
+        }
+    }
+}
+ 
+bool TileCache::take_free_allocation(VkDeviceSize size, TileAllocation& allocation) {
+    auto best = m_free.end();
+    for(auto it = m_free.begin(); it != m_free.end(); ++it) {
+        if(it->capacity >= size && (best == m_free.end() || it->capacity < best->capacity)) {
+            best = it;
+        }
+    }
+    if(best == m_free.end()) {
+        return false;
+    }
+    allocation = *best;
+    *best = m_free.back();
+    m_free.pop_back();
+    return true;
+}
+ 
+void TileCache::release_free_allocation() {
+    auto largest = std::max_element(m_free.begin(), m_free.end(), 
+        [](const TileAllocation& a, const TileAllocation& b) { return a.capacity < b.capacity; });
+    m_allocated -= largest->capacity;
+    m_release(*largest);
+    *largest = m_free.back();
+    m_free.pop_back();
+}
+ 
+void TileCache::evict_lru() {
+    const auto& victim = m_lru.back();
+    if(victim.last_frame > m_completed_frame) {
+        // A frame still in flight may draw it.
+        m_allocated -= victim.allocation.capacity;
+        m_release(victim.allocation);
+    } else {
+        m_free.push_back(victim.allocation);
+    }
+    m_index.erase(victim.coord);
+    m_lru.pop_back();
+    m_stats.evictions += 1;
+    m_generation += 1;
+}
@@ -0,0 +1,103 @@
+#ifndef TILE_CACHE_H_
+#define TILE_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "TileFile.h"
+
+struct TileAllocation {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize capacity = 0;
+};
+
+struct ResidentTile {
+    TileCoord coord;
+    TileAllocation allocation;
+    VkDeviceSize index_offset = 0;
+    uint32_t index_count = 0;
+    // Frame of the last lookup or insert, see TileCache::begin_frame.
+    uint64_t last_frame = 0;
+};
+
+struct TileCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t stalls = 0;
+    uint64_t evictions = 0;
+    uint64_t reused_allocations = 0;
+    uint64_t bytes_streamed = 0;
+
+    double hit_rate() const;
+};
+
+// LRU cache of device local tile buffers kept under a byte budget. Evicted
+// tiles hand their allocation to a free list that new tiles are served from
+// before any fresh device memory is allocated.
+//
+// The cache does not synchronize with the GPU. Frames that may still be
+// drawing are told by begin_frame(); tiles they looked up are released when
+// evicted instead of being reused, so release has to defer destruction,
+// e.g. to a DeletionQueue.
+class TileCache {
+public:
+    using AllocateFunction = std::function<TileAllocation(VkDeviceSize size)>;
+    using ReleaseFunction = std::function<void(const TileAllocation& allocation)>;
+
+    TileCache(VkDeviceSize budget, AllocateFunction allocate, ReleaseFunction release);
+    ~TileCache();
+
+    TileCache(const TileCache& other) = delete;
+    TileCache(TileCache&& other) noexcept = delete;
+    TileCache& operator =(const TileCache& other) = delete;
+    TileCache& operator =(TileCache&& other) noexcept = delete;
+
+    const ResidentTile* lookup(TileCoord coord);
+    const ResidentTile* find(TileCoord coord) const;
+    bool contains(TileCoord coord) const { return m_index.count(coord) > 0; }
+    ResidentTile& insert(TileCoord coord, VkDeviceSize size);
+    // Numbers the frames whose lookups follow; all frames up to
+    // completed_frame are done with the cache's memory. Without calls every
+    // frame counts as completed.
+    void begin_frame(uint64_t frame, uint64_t completed_frame);
+    // Draws the tiles at coords, which have to be resident, as instance.
+    // Returns the number of triangles drawn.
+    uint64_t record_draws(VkCommandBuffer command_buffer, const TileCoord* coords, std::size_t count, 
+        uint32_t instance) const;
+
+    void set_budget(VkDeviceSize budget);
+    void record_stall() { m_stats.stalls += 1; }
+    void record_streamed(VkDeviceSize bytes) { m_stats.bytes_streamed += bytes; }
+
+    VkDeviceSize budget() const { return m_budget; }
+    VkDeviceSize allocated_bytes() const { return m_allocated; }
+    std::size_t resident_count() const { return m_lru.size(); }
+    uint64_t generation() const { return m_generation; }
+    const TileCacheStats& stats() const { return m_stats; }
+
+private:
+    bool take_free_allocation(VkDeviceSize size, TileAllocation& allocation);
+    void release_free_allocation();
+    void evict_lru();
+
+    AllocateFunction m_allocate;
+    ReleaseFunction m_release;
+    VkDeviceSize m_budget;
+    VkDeviceSize m_allocated = 0;
+    uint64_t m_generation = 0;
+    uint64_t m_frame = 0;
+    uint64_t m_completed_frame = 0;
+
+    std::list<ResidentTile> m_lru;
+    std::unordered_map<TileCoord, std::list<ResidentTile>::iterator, TileCoordHash> m_index;
+    std::vector<TileAllocation> m_free;
+    TileCacheStats m_stats;
+};
+
+#endif
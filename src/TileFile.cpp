@@ -0,0 +1,157 @@
+#include "TileFile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+
+#include "MeshCodec.h"
+
+static const char TILE_FILE_MAGIC[8] = {'L', 'S', 'T', 'I', 'L', 'E', 'S', '\0'};
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+ 
+const char* tile_encoding_name(TileEncoding encoding) {
+    switch(encoding) {
+        case TileEncoding::Raw: return "raw";
+        case TileEncoding::MeshCodec: return "mesh codec";
+        default: return "unknown";
+    }
+}
+ 
+TileFile::TileFile(const std::string& filename):
+    m_file(filename)
+{
+    if(m_file.size() < sizeof(TileFileHeader)) {
+        throw std::runtime_error("Tile file is truncated!");
+    }
+    m_header = reinterpret_cast<const TileFileHeader*>(m_file.data());
+    if(std::memcmp(m_header->magic, TILE_FILE_MAGIC, sizeof(TILE_FILE_MAGIC)) != 0) {
+        throw std::runtime_error("Not a tile file: " + filename);
+    }
+    if(m_header->version < 1 || m_header->version > VERSION) {
+        throw std::runtime_error("Unsupported tile file version!");
+    }
+    if(m_header->page_size % MappedFile::page_size() != 0) {
+        throw std::runtime_error("Tile file pages are not aligned to the system page size!");
+    }
+
+    uint64_t entry_count = uint64_t{m_header->tiles_x} * m_header->tiles_y;
+    if(m_header->directory_offset > m_file.size() 
+        || entry_count > (m_file.size() - m_header->directory_offset) / sizeof(TileEntry)) {
+        throw std::runtime_error("Tile file directory is truncated!");
+    }
+    m_entries = reinterpret_cast<const TileEntry*>(m_file.data() + m_header->directory_offset);
+
+    // tile_data() hands out raw pointers into the mapping, so every entry is
+    // checked once here rather than trusted on each upload.
+    for(uint64_t i = 0; i < entry_count; ++i) {
+        const auto& entry = m_entries[i];
+        if(entry.offset > m_file.size() || entry.size > m_file.size() - entry.offset) {
+            throw std::runtime_error("Tile file entry lies outside of the file!");
+        }
+        if(uint64_t{entry.vertex_count} * sizeof(Vertex) > entry.index_offset) {
+            throw std::runtime_error("Tile file entry overlaps its vertices and indices!");
+        }
+        if(entry.encoding != TileEncoding::MeshCodec && entry.size != entry.uploaded_size()) {
+            throw std::runtime_error("Tile file entry size does not match its vertices and indices!");
+        }
+    }
+}
+ 
+bool TileFile::contains(TileCoord coord) const {
+    return coord.x >= 0 && coord.y >= 0 
+        && static_cast<uint32_t>(coord.x) < m_header->tiles_x 
+        && static_cast<uint32_t>(coord.y) < m_header->tiles_y;
+}
+ 
+const TileEntry& TileFile::entry(TileCoord coord) const {
+    if(!contains(coord)) {
+        throw std::out_of_range("Tile coordinate outside of tile file!");
+    }
+    return m_entries[static_cast<uint32_t>(coord.y) * m_header->tiles_x + static_cast<uint32_t>(coord.x)];
+}
+ 
+const std::byte* TileFile::tile_data(TileCoord coord) const {
+    return m_file.data() + entry(coord).offset;
+}
+ 
+TileCoord TileFile::tile_at(float x, float y) const {
+    return {
+        static_cast<int32_t>(std::floor((x - m_header->origin_x) / m_header->tile_extent)),
+        static_cast<int32_t>(std::floor((y - m_header->origin_y) / m_header->tile_extent)),
+    };
+}
+ 
+void TileFile::write(const std::string& filename, TileFileHeader layout, const TileBuilder& builder,
+        TileEncoding encoding) {
+    std::memcpy(layout.magic, TILE_FILE_MAGIC, sizeof(TILE_FILE_MAGIC));
+    layout.version = VERSION;
+    layout.page_size = static_cast<uint32_t>(std::max<std::size_t>(layout.page_size, MappedFile::page_size()));
+
+    std::ofstream file(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+    if(!file) {
+        throw std::runtime_error("Failed to open " + filename + " for writing!");
+    }
+
+    std::vector<TileEntry> entries(uint64_t{layout.tiles_x} * layout.tiles_y);
+    std::vector<Vertex> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<std::byte> encoded;
+    std::vector<char> padding(layout.page_size, 0);
+    uint64_t offset = align_up(sizeof(TileFileHeader), layout.page_size);
+
+    file.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+    file.write(padding.data(), offset - sizeof(layout));
+
+    for(uint32_t y = 0; y < layout.tiles_y; ++y) {
+        for(uint32_t x = 0; x < layout.tiles_x; ++x) {
+            builder({static_cast<int32_t>(x), static_cast<int32_t>(y)}, vertices, indices);
+
+            auto& entry = entries[y * layout.tiles_x + x];
+            uint64_t vertex_bytes = vertices.size() * sizeof(Vertex);
+            uint64_t index_offset = align_up(vertex_bytes, 4);
+            entry.offset = offset;
+            entry.vertex_count = static_cast<uint32_t>(vertices.size());
+            entry.index_count = static_cast<uint32_t>(indices.size());
+            entry.index_offset = static_cast<uint32_t>(index_offset);
+            entry.size = index_offset + indices.size() * sizeof(uint16_t);
+            entry.min_height = std::numeric_limits<float>::max();
+            entry.max_height = std::numeric_limits<float>::lowest();
+            entry.encoding = encoding;
+            for(const auto& vertex : vertices) {
+                entry.min_height = std::min(entry.min_height, vertex.pos.z);
+                entry.max_height = std::max(entry.max_height, vertex.pos.z);
+            }
+
+            if(encoding == TileEncoding::MeshCodec) {
+                encoded.clear();
+                MeshCodec::encode_mesh(vertices, indices, layout.tile_resolution, encoded);
+                entry.size = encoded.size();
+                file.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            } else {
+                file.write(reinterpret_cast<const char*>(vertices.data()), vertex_bytes);
+                file.write(padding.data(), index_offset - vertex_bytes);
+                file.write(reinterpret_cast<const char*>(indices.data()), indices.size() * sizeof(uint16_t));
+            }
+
+            uint64_t padded_size = align_up(entry.size, layout.page_size);
+            file.write(padding.data(), padded_size - entry.size);
+            offset += padded_size;
+        }
+    }
+
+    layout.directory_offset = offset;
+    file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(TileEntry));
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&layout), sizeof(layout));
+
+    if(!file) {
+        throw std::runtime_error("Failed to write tile file " + filename + "!");
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef TILE_FILE_H_
+#define TILE_FILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "RenderTypes.h"
+
+struct TileCoord {
+    int32_t x;
+    int32_t y;
+
+    bool operator ==(const TileCoord& other) const { return x == other.x && y == other.y; }
+    bool operator !=(const TileCoord& other) const { return !(*this == other); }
+};
+
+struct TileCoordHash {
+    std::size_t operator ()(const TileCoord& coord) const {
+        return (static_cast<std::size_t>(static_cast<uint32_t>(coord.x)) << 32) ^ static_cast<uint32_t>(coord.y);
+    }
+};
+
+// How a tile's bytes are stored. Raw tiles hold the vertices, padding to 4
+// bytes and the indices exactly as uploaded; MeshCodec tiles hold a
+// MeshCodec::encode_mesh blob that decodes to that layout.
+enum class TileEncoding : uint32_t {
+    Raw = 0,
+    MeshCodec = 1,
+};
+
+const char* tile_encoding_name(TileEncoding encoding);
+
+// On-disk layout:
+//   [TileFileHeader][pad to page]
+//   [tile 0: vertices, indices][pad to page] ... [tile N-1][pad to page]
+//   [TileEntry x tiles_x * tiles_y]
+// Every tile starts on a page boundary so it can be faulted in, advised and
+// copied without touching its neighbours. Version 1 files predate
+// TileEntry::encoding and only hold raw tiles.
+struct TileFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint32_t tile_resolution;
+    float tile_extent;
+    float origin_x;
+    float origin_y;
+    uint64_t directory_offset;
+};
+static_assert(sizeof(TileFileHeader) == 48, "TileFileHeader layout is part of the file format");
+
+struct TileEntry {
+    // Stored bytes; the decoded tile takes uploaded_size().
+    uint64_t offset;
+    uint64_t size;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_offset;
+    float min_height;
+    float max_height;
+    TileEncoding encoding;
+
+    uint64_t uploaded_size() const { return index_offset + uint64_t{index_count} * sizeof(uint16_t); }
+};
+static_assert(sizeof(TileEntry) == 40, "TileEntry layout is part of the file format");
+
+class TileFile {
+public:
+    using TileBuilder = std::function<void(TileCoord, std::vector<Vertex>&, std::vector<uint16_t>&)>;
+
+    static constexpr uint32_t VERSION = 2;
+
+    explicit TileFile(const std::string& filename);
+    ~TileFile() = default;
+
+    TileFile(const TileFile& other) = delete;
+    TileFile(TileFile&& other) noexcept = default;
+    TileFile& operator =(const TileFile& other) = delete;
+    TileFile& operator =(TileFile&& other) noexcept = default;
+
+    const TileFileHeader& header() const { return *m_header; }
+    const MappedFile& mapping() const { return m_file; }
+
+    bool contains(TileCoord coord) const;
+    const TileEntry& entry(TileCoord coord) const;
+    const std::byte* tile_data(TileCoord coord) const;
+    TileCoord tile_at(float x, float y) const;
+
+    static void write(const std::string& filename, TileFileHeader layout, const TileBuilder& builder,
+        TileEncoding encoding = TileEncoding::Raw);
+
+private:
+    MappedFile m_file;
+    const TileFileHeader* m_header;
+    const TileEntry* m_entries;
+};
+
+#endif
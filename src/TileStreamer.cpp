@@ -0,0 +1,95 @@
+#include "TileStreamer.h"
+
+#include <algorithm>
+#include <utility>
+
+
+TileStreamer::TileStreamer(const TileFile& file, std::size_t thread_count, std::function<void()> on_ready):
+    m_file(file),
+    m_on_ready(std::move(on_ready))
+{
+    thread_count = std::max<std::size_t>(thread_count, 1);
+    for(std::size_t i = 0; i < thread_count; ++i) {
+        m_workers.emplace_back(&TileStreamer::worker_main, this);
+    }
+}
+ 
+TileStreamer::~TileStreamer() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(auto& worker : m_workers) {
+        worker.join();
+    }
+}
+ 
+void TileStreamer::request(const TileCoord* coords, std::size_t count) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(const auto& coord : m_queue) {
+            m_states.erase(coord);
+        }
+        m_queue.clear();
+
+        for(std::size_t i = 0; i < count; ++i) {
+            const TileCoord& coord = coords[i];
+            if(!m_file.contains(coord) || m_states.count(coord) > 0) {
+                continue;
+            }
+            m_states[coord] = TileState::Queued;
+            m_queue.push_back(coord);
+        }
+    }
+    m_wake.notify_all();
+}
+ 
+std::size_t TileStreamer::take_ready(std::vector<TileCoord>& ready) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(const auto& coord : m_ready) {
+        m_states.erase(coord);
+        ready.push_back(coord);
+    }
+    std::size_t count = m_ready.size();
+    m_ready.clear();
+    return count;
+}
+ 
+std::size_t TileStreamer::queued() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size();
+}
+ 
+std::size_t TileStreamer::ready() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_ready.size();
+}
+ 
+void TileStreamer::worker_main() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true) {
+        m_wake.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+        if(m_stopping) {
+            return;
+        }
+
+        TileCoord coord = m_queue.front();
+        m_queue.pop_front();
+        m_states[coord] = TileState::Loading;
+        lock.unlock();
+
+        const auto& entry = m_file.entry(coord);
+        m_file.mapping().advise_will_need(entry.offset, entry.size);
+        m_file.mapping().fault_in(entry.offset, entry.size);
+
+        lock.lock();
+        m_states[coord] = TileState::Ready;
+        m_ready.push_back(coord);
+        if(m_on_ready) {
+            lock.unlock();
+            m_on_ready();
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef TILE_STREAMER_H_
+#define TILE_STREAMER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "TileFile.h"
+
+// Background prefetcher for a memory mapped TileFile. Workers fault the pages
+// of requested tiles into the page cache so the render thread can copy them
+// into staging memory without blocking on disk.
+class TileStreamer {
+public:
+    // on_ready, if set, is called on a worker thread after each tile becomes
+    // ready, e.g. to wake a render thread that waits for something to draw.
+    TileStreamer(const TileFile& file, std::size_t thread_count, std::function<void()> on_ready = {});
+    ~TileStreamer();
+
+    TileStreamer(const TileStreamer& other) = delete;
+    TileStreamer(TileStreamer&& other) noexcept = delete;
+    TileStreamer& operator =(const TileStreamer& other) = delete;
+    TileStreamer& operator =(TileStreamer&& other) noexcept = delete;
+
+    // Replaces the outstanding request queue. Coordinates are loaded in the
+    // order given; anything queued earlier but not requested again is dropped.
+    void request(const TileCoord* coords, std::size_t count);
+    std::size_t take_ready(std::vector<TileCoord>& ready);
+    std::size_t queued() const;
+    // Tiles take_ready would return.
+    std::size_t ready() const;
+
+private:
+    enum class TileState {
+        Queued,
+        Loading,
+        Ready,
+    };
+
+    void worker_main();
+
+    const TileFile& m_file;
+    std::function<void()> m_on_ready;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<TileCoord> m_queue;
+    std::unordered_map<TileCoord, TileState, TileCoordHash> m_states;
+    std::vector<TileCoord> m_ready;
+    std::vector<std::thread> m_workers;
+    bool m_stopping = false;
+};
+
+#endif
@@ -0,0 +1,232 @@
+#include "TransformSystem.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE 1
+#endif
+
+
+uint32_t TransformSystem::add(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale) {
+    if(m_count == capacity()) {
+        std::size_t new_capacity = capacity() + BATCH_WIDTH;
+        // Padding lanes hold identity transforms so the kernels can always run
+        // on whole blocks.
+        m_pos_x.resize(new_capacity, 0.0f);
+        m_pos_y.resize(new_capacity, 0.0f);
+        m_pos_z.resize(new_capacity, 0.0f);
+        m_rot_x.resize(new_capacity, 0.0f);
+        m_rot_y.resize(new_capacity, 0.0f);
+        m_rot_z.resize(new_capacity, 0.0f);
+        m_rot_w.resize(new_capacity, 1.0f);
+        m_scale_x.resize(new_capacity, 1.0f);
+        m_scale_y.resize(new_capacity, 1.0f);
+        m_scale_z.resize(new_capacity, 1.0f);
+        for(auto& element : m_world) {
+            element.resize(new_capacity, 0.0f);
+        }
+        m_block_flags.resize(new_capacity / BATCH_WIDTH, WORLD_DIRTY | CLIP_DIRTY);
+    }
+
+    uint32_t id = static_cast<uint32_t>(m_count++);
+    m_pos_x[id] = position.x;
+    m_pos_y[id] = position.y;
+    m_pos_z[id] = position.z;
+    m_rot_x[id] = rotation.x;
+    m_rot_y[id] = rotation.y;
+    m_rot_z[id] = rotation.z;
+    m_rot_w[id] = rotation.w;
+    m_scale_x[id] = scale.x;
+    m_scale_y[id] = scale.y;
+    m_scale_z[id] = scale.z;
+    mark_dirty(id);
+    return id;
+}
+ 
+void TransformSystem::reserve(std::size_t count) {
+    std::size_t padded = (count + BATCH_WIDTH - 1) / BATCH_WIDTH * BATCH_WIDTH;
+    for(auto* array : {&m_pos_x, &m_pos_y, &m_pos_z, &m_rot_x, &m_rot_y, &m_rot_z, &m_rot_w, 
+        &m_scale_x, &m_scale_y, &m_scale_z}) {
+        array->reserve(padded);
+    }
+    for(auto& element : m_world) {
+        element.reserve(padded);
+    }
+    m_block_flags.reserve(padded / BATCH_WIDTH);
+}
+ 
+void TransformSystem::clear() {
+    *this = TransformSystem();
+}
+ 
+void TransformSystem::set_position(uint32_t id, const glm::vec3& position) {
+    m_pos_x[id] = position.x;
+    m_pos_y[id] = position.y;
+    m_pos_z[id] = position.z;
+    mark_dirty(id);
+}
+ 
+void TransformSystem::set_rotation(uint32_t id, const glm::quat& rotation) {
+    m_rot_x[id] = rotation.x;
+    m_rot_y[id] = rotation.y;
+    m_rot_z[id] = rotation.z;
+    m_rot_w[id] = rotation.w;
+    mark_dirty(id);
+}
+ 
+void TransformSystem::set_scale(uint32_t id, const glm::vec3& scale) {
+    m_scale_x[id] = scale.x;
+    m_scale_y[id] = scale.y;
+    m_scale_z[id] = scale.z;
+    mark_dirty(id);
+}
+ 
+void TransformSystem::mark_dirty(uint32_t id) {
+    m_block_flags[id / BATCH_WIDTH] |= WORLD_DIRTY | CLIP_DIRTY;
+}
+ 
+void TransformSystem::mark_all_dirty() {
+    for(auto& flags : m_block_flags) {
+        flags |= WORLD_DIRTY | CLIP_DIRTY;
+    }
+}
+ 
+glm::vec3 TransformSystem::position(uint32_t id) const {
+    return {m_pos_x[id], m_pos_y[id], m_pos_z[id]};
+}
+ 
+glm::mat4 TransformSystem::world(uint32_t id) const {
+    if(m_block_flags[id / BATCH_WIDTH] & WORLD_DIRTY) {
+        update_world_block(id - id % BATCH_WIDTH);
+        m_block_flags[id / BATCH_WIDTH] &= ~WORLD_DIRTY;
+    }
+    glm::mat4 world(1.0f);
+    for(int column = 0; column < 4; ++column) {
+        for(int row = 0; row < 3; ++row) {
+            world[column][row] = m_world[column * 3 + row][id];
+        }
+    }
+    return world;
+}
+ 
+std::size_t TransformSystem::update(const glm::mat4& view_projection, bool view_projection_changed, float* clip_out) {
+    std::size_t updated = 0;
+    for(std::size_t block = 0; block < m_block_flags.size(); ++block) {
+        uint8_t& flags = m_block_flags[block];
+        if(flags & WORLD_DIRTY) {
+            update_world_block(block * BATCH_WIDTH);
+        }
+        if((flags & CLIP_DIRTY) || view_projection_changed) {
+            update_clip_block(block * BATCH_WIDTH, view_projection, clip_out);
+            updated += BATCH_WIDTH;
+        }
+        flags = 0;
+    }
+    return updated;
+}
+ 
+#ifdef TRANSFORM_SYSTEM_SSE
+ 
+void TransformSystem::update_world_block(std::size_t first) const {
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+
+    __m128 qx = _mm_loadu_ps(&m_rot_x[first]);
+    __m128 qy = _mm_loadu_ps(&m_rot_y[first]);
+    __m128 qz = _mm_loadu_ps(&m_rot_z[first]);
+    __m128 qw = _mm_loadu_ps(&m_rot_w[first]);
+
+    __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+    __m128 sx = _mm_loadu_ps(&m_scale_x[first]);
+    __m128 sy = _mm_loadu_ps(&m_scale_y[first]);
+    __m128 sz = _mm_loadu_ps(&m_scale_z[first]);
+
+    auto store = [&](int element, __m128 value) { _mm_storeu_ps(&m_world[element][first], value); };
+
+    store(0, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx));
+    store(1, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx));
+    store(2, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx));
+
+    store(3, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy));
+    store(4, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy));
+    store(5, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy));
+
+    store(6, _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz));
+    store(7, _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz));
+    store(8, _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz));
+
+    store(9, _mm_loadu_ps(&m_pos_x[first]));
+    store(10, _mm_loadu_ps(&m_pos_y[first]));
+    store(11, _mm_loadu_ps(&m_pos_z[first]));
+}
+ 
+void TransformSystem::update_clip_block(std::size_t first, const glm::mat4& view_projection, float* clip_out) const {
+    __m128 world[12];
+    for(int element = 0; element < 12; ++element) {
+        world[element] = _mm_loadu_ps(&m_world[element][first]);
+    }
+
+    for(int column = 0; column < 4; ++column) {
+        // Lane i of rows[r] is element (column, r) of object first + i.
+        __m128 rows[4];
+        for(int row = 0; row < 4; ++row) {
+            __m128 sum = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(view_projection[0][row]), world[column * 3 + 0]),
+                    _mm_mul_ps(_mm_set1_ps(view_projection[1][row]), world[column * 3 + 1])),
+                _mm_mul_ps(_mm_set1_ps(view_projection[2][row]), world[column * 3 + 2]));
+            if(column == 3) {
+                sum = _mm_add_ps(sum, _mm_set1_ps(view_projection[3][row]));
+            }
+            rows[row] = sum;
+        }
+        _MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+        for(std::size_t lane = 0; lane < BATCH_WIDTH; ++lane) {
+            _mm_storeu_ps(clip_out + (first + lane) * 16 + column * 4, rows[lane]);
+        }
+    }
+}
+ 
+#else
+ 
+void TransformSystem::update_world_block(std::size_t first) const {
+    for(std::size_t i = first; i < first + BATCH_WIDTH; ++i) {
+        float qx = m_rot_x[i], qy = m_rot_y[i], qz = m_rot_z[i], qw = m_rot_w[i];
+        float xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        float xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        float wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+        m_world[0][i] = (1.0f - 2.0f * (yy + zz)) * m_scale_x[i];
+        m_world[1][i] = 2.0f * (xy + wz) * m_scale_x[i];
+        m_world[2][i] = 2.0f * (xz - wy) * m_scale_x[i];
+        m_world[3][i] = 2.0f * (xy - wz) * m_scale_y[i];
+        m_world[4][i] = (1.0f - 2.0f * (xx + zz)) * m_scale_y[i];
+        m_world[5][i] = 2.0f * (yz + wx) * m_scale_y[i];
+        m_world[6][i] = 2.0f * (xz + wy) * m_scale_z[i];
+        m_world[7][i] = 2.0f * (yz - wx) * m_scale_z[i];
+        m_world[8][i] = (1.0f - 2.0f * (xx + yy)) * m_scale_z[i];
+        m_world[9][i] = m_pos_x[i];
+        m_world[10][i] = m_pos_y[i];
+        m_world[11][i] = m_pos_z[i];
+    }
+}
+ 
+void TransformSystem::update_clip_block(std::size_t first, const glm::mat4& view_projection, float* clip_out) const {
+    for(std::size_t i = first; i < first + BATCH_WIDTH; ++i) {
+        for(int column = 0; column < 4; ++column) {
+            for(int row = 0; row < 4; ++row) {
+                float sum = view_projection[0][row] * m_world[column * 3 + 0][i]
+                    + view_projection[1][row] * m_world[column * 3 + 1][i]
+                    + view_projection[2][row] * m_world[column * 3 + 2][i];
+                if(column == 3) {
+                    sum += view_projection[3][row];
+                }
+                clip_out[i * 16 + column * 4 + row] = sum;
+            }
+        }
+    }
+}
+ 
+#endif
@@ -0,0 +1,75 @@
+#ifndef TRANSFORM_SYSTEM_H_
+#define TRANSFORM_SYSTEM_H_
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Object transforms stored as structure-of-arrays so the batch kernels can
+// process four objects per SSE register. Objects are grouped in blocks of
+// BATCH_WIDTH; all arrays are padded to a whole number of blocks, so callers
+// must size output buffers with capacity() rather than count().
+//
+// update() runs two kernels over dirty blocks only:
+//   1. position/rotation/scale -> affine world matrix (kept SoA)
+//   2. view_projection * world -> clip transform, written as one column-major
+//      mat4 per object for shader.vert to index by gl_InstanceIndex.
+class TransformSystem {
+public:
+    static constexpr std::size_t BATCH_WIDTH = 4;
+
+    TransformSystem() = default;
+    ~TransformSystem() = default;
+
+    TransformSystem(const TransformSystem& other) = default;
+    TransformSystem(TransformSystem&& other) noexcept = default;
+    TransformSystem& operator =(const TransformSystem& other) = default;
+    TransformSystem& operator =(TransformSystem&& other) noexcept = default;
+
+    uint32_t add(const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 
+        const glm::vec3& scale = glm::vec3(1.0f));
+    void reserve(std::size_t count);
+    void clear();
+
+    void set_position(uint32_t id, const glm::vec3& position);
+    void set_rotation(uint32_t id, const glm::quat& rotation);
+    void set_scale(uint32_t id, const glm::vec3& scale);
+    void mark_all_dirty();
+
+    glm::vec3 position(uint32_t id) const;
+    glm::mat4 world(uint32_t id) const;
+
+    std::size_t count() const { return m_count; }
+    std::size_t capacity() const { return m_pos_x.size(); }
+
+    // Writes capacity() * 16 floats to clip_out for every dirty block. Pass
+    // view_projection_changed when the camera moved so every block is redone.
+    // Returns the number of objects whose clip transform was rewritten.
+    std::size_t update(const glm::mat4& view_projection, bool view_projection_changed, float* clip_out);
+
+private:
+    enum BlockFlags : uint8_t {
+        WORLD_DIRTY = 1,
+        CLIP_DIRTY = 2,
+    };
+
+    void mark_dirty(uint32_t id);
+    void update_world_block(std::size_t first) const;
+    void update_clip_block(std::size_t first, const glm::mat4& view_projection, float* clip_out) const;
+
+    std::size_t m_count = 0;
+
+    std::vector<float> m_pos_x, m_pos_y, m_pos_z;
+    std::vector<float> m_rot_x, m_rot_y, m_rot_z, m_rot_w;
+    std::vector<float> m_scale_x, m_scale_y, m_scale_z;
+
+    // Affine world matrices, element [column * 3 + row] of each object.
+    // Refreshed lazily, also by world() const, like the WORLD_DIRTY flags.
+    mutable std::array<std::vector<float>, 12> m_world;
+    mutable std::vector<uint8_t> m_block_flags;
+};
+
+#endif
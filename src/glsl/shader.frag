@@ -5,6 +5,10 @@ layout(location = 0) in vec4 fragColor;
 
 layout(location = 0) out vec4 outColor;
 
+// Picked per pipeline variant: 0 shades with the vertex colour, 1 draws the
+// debug wireframe in one colour.
+layout(constant_id = 0) const uint SHADING_MODE = 0;
+
 void main() {
-    outColor = fragColor;
+    outColor = SHADING_MODE == 1 ? vec4(0.9, 0.9, 0.9, 1.0) : fragColor;
 }
@@ -1,12 +1,17 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
 
 layout(binding = 0) uniform Transformations {
-    mat4 perspective;
-    mat4 view;
-    mat4 model;
+    mat4 view_projection;
+    mat4 view_clip[4];
 } trans;
 
+// Per-object clip space matrices, premultiplied on the CPU by TransformSystem.
+layout(std430, binding = 1) readonly buffer Objects {
+    mat4 clip[];
+} objects;
+
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec4 color;
 layout(location = 0) out vec4 fragColor;
@@ -17,6 +22,6 @@ out gl_PerVertex {
 
 
 void main() {
-    gl_Position = trans.perspective * trans.view * trans.model * vec4(position, 1.0);
+    gl_Position = trans.view_clip[gl_ViewIndex] * objects.clip[gl_InstanceIndex] * vec4(position, 1.0);
     fragColor = color;
 }
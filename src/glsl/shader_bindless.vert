@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+
+// Global descriptor table, see BindlessTable. Draws pick their object
+// buffer by slot through the push constant.
+layout(set = 0, binding = 0) readonly buffer Objects {
+    mat4 clip[];
+} buffers[];
+
+layout(push_constant) uniform DrawSlots {
+    uint object_buffer;
+} slots;
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 color;
+layout(location = 0) out vec4 fragColor;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+
+void main() {
+    gl_Position = buffers[slots.object_buffer].clip[gl_InstanceIndex] * vec4(position, 1.0);
+    fragColor = color;
+}
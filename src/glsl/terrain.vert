@@ -0,0 +1,75 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_EXT_multiview : enable
+
+// Vertex pulling terrain: no vertex buffer, every vertex is found from its
+// index in a shared grid patch and its height fetched from the heightmap.
+// See TerrainPushConstants and Heightmap.
+
+layout(binding = 0) uniform Transformations {
+    mat4 view_projection;
+    mat4 view_clip[4];
+} trans;
+
+layout(std430, binding = 1) readonly buffer Objects {
+    mat4 clip[];
+} objects;
+
+layout(binding = 2) uniform sampler2D heightmap;
+
+layout(push_constant) uniform TerrainParams {
+    vec2 origin;
+    float sample_spacing;
+    float height_scale;
+    float height_bias;
+    uint patch_resolution;
+    uint chunks_x;
+    uint object;
+    vec2 viewport;
+    float edge_pixels;
+    uint patch_step;
+} params;
+
+layout(location = 0) out vec4 fragColor;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+
+float height_at(ivec2 texel) {
+    texel = clamp(texel, ivec2(0), textureSize(heightmap, 0) - 1);
+    return texelFetch(heightmap, texel, 0).r * params.height_scale + params.height_bias;
+}
+
+// Same ramp as TerrainGenerator::color.
+vec3 height_color(float height) {
+    const vec3 low = vec3(0.15, 0.35, 0.12);
+    const vec3 mid = vec3(0.45, 0.38, 0.25);
+    const vec3 high = vec3(0.92, 0.92, 0.95);
+
+    float t = clamp((height + 0.6) / 0.95, 0.0, 1.0);
+    if(t < 0.6) {
+        return mix(low, mid, t / 0.6);
+    }
+    return mix(mid, high, (t - 0.6) / 0.4);
+}
+
+void main() {
+    uint chunk = uint(gl_InstanceIndex);
+    ivec2 chunk_coord = ivec2(chunk % params.chunks_x, chunk / params.chunks_x);
+    uint vertex = uint(gl_VertexIndex);
+    ivec2 local = ivec2(vertex % params.patch_resolution, vertex / params.patch_resolution);
+    ivec2 texel = chunk_coord * int(params.patch_resolution - 1) + local;
+
+    float height = height_at(texel);
+    vec3 position = vec3(params.origin + vec2(texel) * params.sample_spacing, height);
+
+    float dx = height_at(texel + ivec2(1, 0)) - height_at(texel - ivec2(1, 0));
+    float dy = height_at(texel + ivec2(0, 1)) - height_at(texel - ivec2(0, 1));
+    vec3 normal = normalize(vec3(-dx, -dy, 2.0 * params.sample_spacing));
+    float light = 0.35 + 0.65 * max(dot(normal, normalize(vec3(0.4, 0.3, 0.85))), 0.0);
+
+    gl_Position = trans.view_clip[gl_ViewIndex] * objects.clip[params.object] * vec4(position, 1.0);
+    fragColor = vec4(height_color(height) * light, 1.0);
+}
@@ -0,0 +1,31 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Control points of the tessellated terrain: corners of coarse patches,
+// patch_step heightmap samples apart, numbered like terrain.vert's grid.
+// Only the heightmap coordinate is passed on; terrain.tese samples heights.
+
+layout(push_constant) uniform TerrainParams {
+    vec2 origin;
+    float sample_spacing;
+    float height_scale;
+    float height_bias;
+    uint patch_resolution;
+    uint chunks_x;
+    uint object;
+    vec2 viewport;
+    float edge_pixels;
+    uint patch_step;
+} params;
+
+layout(location = 0) out vec2 outTexel;
+
+
+void main() {
+    uint chunk = uint(gl_InstanceIndex);
+    uvec2 chunk_coord = uvec2(chunk % params.chunks_x, chunk / params.chunks_x);
+    uint control_points = (params.patch_resolution - 1) / params.patch_step + 1;
+    uint vertex = uint(gl_VertexIndex);
+    uvec2 local = uvec2(vertex % control_points, vertex / control_points) * params.patch_step;
+    outTexel = vec2(chunk_coord * (params.patch_resolution - 1) + local);
+}
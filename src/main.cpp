@@ -1,9 +1,34 @@
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 #include "Simulation.h"
 
-int main() {
-    Simulation s;
+int main(int argc, char** argv) {
+    SimulationOptions options;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            options.capture_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            options.replay_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            options.video_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            options.scene_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+            options.views = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if(std::strcmp(argv[i], "--separate-views") == 0) {
+            options.separate_views = true;
+        } else if(std::strcmp(argv[i], "--on-demand") == 0) {
+            options.on_demand = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--capture FILE] [--replay FILE] [--record VIDEO.y4m]"
+                << " [--scene SCENE.bin] [--views N [--separate-views]] [--on-demand]\n";
+            return 1;
+        }
+    }
+
+    Simulation s(options);
     s.run();
     return 0;
 }
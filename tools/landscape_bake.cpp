@@ -0,0 +1,327 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Heightmap.h"
+#include "RenderTypes.h"
+#include "SceneFile.h"
+#include "TerrainGenerator.h"
+
+// Coarser levels of detail snap vertices to grids of this many cells along
+// the mesh's longest axis, halving per level.
+static constexpr uint32_t LOD_GRID_CELLS = 64;
+// A level is only kept when it drops at least this share of the indices of
+// the one before.
+static constexpr float LOD_MIN_REDUCTION = 0.1f;
+
+// Defaults are the renderer's terrain layout, which it only accepts
+// heightmaps baked for.
+struct TerrainLayout {
+    uint32_t chunks = TERRAIN_TILES;
+    uint32_t chunk_resolution = TERRAIN_TILE_RESOLUTION;
+    float chunk_extent = TERRAIN_TILE_EXTENT;
+    float origin = TERRAIN_ORIGIN;
+
+    uint32_t samples() const { return chunks * (chunk_resolution - 1) + 1; }
+    float spacing() const { return chunk_extent / (chunk_resolution - 1); }
+};
+
+static void print_usage(const char* program) {
+    std::cerr << "Usage: " << program << " [-o SCENE.bin] [--mesh FILE.obj]... [--heightmap FILE.pgm]"
+        << " [--height-range LOW HIGH] [--no-terrain] [--float-heights]"
+        << " [--chunks N] [--chunk-resolution N] [--chunk-extent SIZE] [--origin X]\n"
+        << "\tWithout meshes the built-in quad is baked, without a heightmap the procedural terrain.\n";
+}
+
+static std::string file_stem(const std::string& path) {
+    std::size_t start = path.find_last_of("/\\");
+    start = start == std::string::npos ? 0 : start + 1;
+    std::size_t end = path.find_last_of('.');
+    return path.substr(start, end == std::string::npos || end < start ? std::string::npos : end - start);
+}
+
+static SceneFile::Mesh builtin_quad() {
+    SceneFile::Mesh mesh;
+    mesh.name = "quad";
+    mesh.vertices = {
+        {{-0.5f, -0.5f, 1.0}, {1.0f, 0.0f, 0.0f, 1.0}},
+        {{0.5f, -0.5f, 1.0}, {0.0f, 1.0f, 0.0f, 1.0}},
+        {{0.5f, 0.5f, 1.0}, {0.0f, 0.0f, 1.0f, 1.0}},
+        {{-0.5f, 0.5f, 1.0}, {1.0f, 1.0f, 1.0f, 1.0}},
+    };
+    mesh.lods.push_back({0, 1, 2, 2, 3, 0});
+    return mesh;
+}
+
+// Positions, optional "v x y z r g b" vertex colours and polygonal faces,
+// which are triangulated as fans. Texture coordinates and normals are
+// ignored since the renderer's Vertex has neither.
+static SceneFile::Mesh read_obj(const std::string& filename) {
+    std::ifstream file(filename);
+    if(!file) {
+        throw std::runtime_error("Failed to open " + filename + "!");
+    }
+
+    SceneFile::Mesh mesh;
+    mesh.name = file_stem(filename);
+    std::vector<uint16_t> indices;
+    std::vector<uint32_t> face;
+    std::string line;
+    while(std::getline(file, line)) {
+        std::istringstream tokens(line);
+        std::string type;
+        tokens >> type;
+        if(type == "v") {
+            Vertex vertex = {glm::vec3(0.0f), glm::vec4(1.0f)};
+            tokens >> vertex.pos.x >> vertex.pos.y >> vertex.pos.z;
+            if(!tokens) {
+                throw std::runtime_error("Malformed vertex in " + filename + ": " + line);
+            }
+            float r, g, b;
+            if(tokens >> r >> g >> b) {
+                vertex.color = glm::vec4(r, g, b, 1.0f);
+            }
+            mesh.vertices.push_back(vertex);
+        } else if(type == "f") {
+            face.clear();
+            std::string corner;
+            while(tokens >> corner) {
+                long index = std::strtol(corner.c_str(), nullptr, 10);
+                long count = static_cast<long>(mesh.vertices.size());
+                index = index < 0 ? count + index : index - 1;
+                if(index < 0 || index >= count) {
+                    throw std::runtime_error("Face refers to a missing vertex in " + filename + ": " + line);
+                }
+                face.push_back(static_cast<uint32_t>(index));
+            }
+            for(std::size_t i = 2; i < face.size(); ++i) {
+                for(uint32_t index : {face[0], face[i - 1], face[i]}) {
+                    if(index > UINT16_MAX) {
+                        throw std::runtime_error(filename + " has too many vertices for 16 bit indices!");
+                    }
+                    indices.push_back(static_cast<uint16_t>(index));
+                }
+            }
+        }
+    }
+    if(indices.empty()) {
+        throw std::runtime_error(filename + " has no faces!");
+    }
+    mesh.lods.push_back(std::move(indices));
+    return mesh;
+}
+
+// Vertex clustering: every vertex is replaced by the first one in its grid
+// cell and triangles that collapse are dropped. Coarser levels keep indexing
+// the original vertices, so the whole mesh shares one vertex buffer.
+static void build_lods(SceneFile::Mesh& mesh) {
+    glm::vec3 low(mesh.vertices[0].pos);
+    glm::vec3 high(low);
+    for(const auto& vertex : mesh.vertices) {
+        low = glm::min(low, vertex.pos);
+        high = glm::max(high, vertex.pos);
+    }
+    glm::vec3 size = high - low;
+    float extent = std::max({size.x, size.y, size.z, 1e-6f});
+
+    mesh.lod_errors.assign(1, 0.0f);
+    std::vector<uint16_t> remap(mesh.vertices.size());
+    std::unordered_map<uint64_t, uint16_t> cells;
+    for(uint32_t cells_per_axis = LOD_GRID_CELLS; mesh.lods.size() < SceneMeshEntry::MAX_LODS && cells_per_axis > 0;
+            cells_per_axis /= 2) {
+        float cell_size = extent / cells_per_axis;
+        cells.clear();
+        float error = 0.0f;
+        for(std::size_t i = 0; i < mesh.vertices.size(); ++i) {
+            glm::vec3 cell = glm::floor((mesh.vertices[i].pos - low) / cell_size);
+            uint64_t key = (static_cast<uint64_t>(cell.x) << 42) ^ (static_cast<uint64_t>(cell.y) << 21)
+                ^ static_cast<uint64_t>(cell.z);
+            auto found = cells.emplace(key, static_cast<uint16_t>(i)).first;
+            remap[i] = found->second;
+            error = std::max(error, glm::length(mesh.vertices[i].pos - mesh.vertices[remap[i]].pos));
+        }
+
+        const auto& finest = mesh.lods.front();
+        std::vector<uint16_t> indices;
+        for(std::size_t i = 0; i + 2 < finest.size(); i += 3) {
+            uint16_t a = remap[finest[i]];
+            uint16_t b = remap[finest[i + 1]];
+            uint16_t c = remap[finest[i + 2]];
+            if(a != b && b != c && c != a) {
+                indices.insert(indices.end(), {a, b, c});
+            }
+        }
+        if(indices.empty()) {
+            break;
+        }
+        if(indices.size() > mesh.lods.back().size() * (1.0f - LOD_MIN_REDUCTION)) {
+            continue;
+        }
+        mesh.lods.push_back(std::move(indices));
+        mesh.lod_errors.push_back(error);
+    }
+}
+
+// Binary PGM (P5) with 8 or 16 bit samples.
+static std::vector<float> read_pgm(const std::string& filename, uint32_t& width, uint32_t& height) {
+    std::ifstream file(filename, std::ios::binary);
+    if(!file) {
+        throw std::runtime_error("Failed to open " + filename + "!");
+    }
+    auto next_token = [&]() {
+        std::string token;
+        while(file >> std::ws && file.peek() == '#') {
+            std::getline(file, token);
+        }
+        file >> token;
+        return token;
+    };
+    if(next_token() != "P5") {
+        throw std::runtime_error(filename + " is not a binary PGM!");
+    }
+    width = static_cast<uint32_t>(std::stoul(next_token()));
+    height = static_cast<uint32_t>(std::stoul(next_token()));
+    uint32_t max_value = static_cast<uint32_t>(std::stoul(next_token()));
+    file.get();
+    if(width < 2 || height < 2 || max_value == 0 || max_value > 65535) {
+        throw std::runtime_error(filename + " has an unsupported size or sample range!");
+    }
+
+    std::size_t sample_size = max_value > 255 ? 2 : 1;
+    std::vector<unsigned char> bytes(std::size_t{width} * height * sample_size);
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    if(!file) {
+        throw std::runtime_error(filename + " is truncated!");
+    }
+    std::vector<float> samples(std::size_t{width} * height);
+    for(std::size_t i = 0; i < samples.size(); ++i) {
+        uint32_t value = sample_size == 2 ? (bytes[2 * i] << 8 | bytes[2 * i + 1]) : bytes[i];
+        samples[i] = static_cast<float>(value) / max_value;
+    }
+    return samples;
+}
+
+// Bilinear resampling of the source image onto the terrain's sample grid;
+// the image covers the whole terrain with its first row at the origin.
+static std::vector<float> resample(const std::vector<float>& source, uint32_t width, uint32_t height,
+        uint32_t samples, float low, float high) {
+    std::vector<float> heights(std::size_t{samples} * samples);
+    for(uint32_t y = 0; y < samples; ++y) {
+        float v = static_cast<float>(y) / (samples - 1) * (height - 1);
+        uint32_t y0 = std::min(static_cast<uint32_t>(v), height - 2);
+        float fy = v - y0;
+        for(uint32_t x = 0; x < samples; ++x) {
+            float u = static_cast<float>(x) / (samples - 1) * (width - 1);
+            uint32_t x0 = std::min(static_cast<uint32_t>(u), width - 2);
+            float fx = u - x0;
+            const float* row0 = source.data() + std::size_t{y0} * width;
+            const float* row1 = row0 + width;
+            float top = row0[x0] + (row0[x0 + 1] - row0[x0]) * fx;
+            float bottom = row1[x0] + (row1[x0 + 1] - row1[x0]) * fx;
+            heights[std::size_t{y} * samples + x] = low + (top + (bottom - top) * fy) * (high - low);
+        }
+    }
+    return heights;
+}
+
+static int bake(int argc, char** argv) {
+    std::string output = "scene.bin";
+    std::vector<std::string> mesh_files;
+    std::string heightmap_file;
+    float height_low = 0.0f;
+    float height_high = 1.0f;
+    bool terrain = true;
+    VkFormat format = VK_FORMAT_R16_UNORM;
+    TerrainLayout layout;
+    for(int i = 1; i < argc; ++i) {
+        if(std::strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if(std::strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            mesh_files.push_back(argv[++i]);
+        } else if(std::strcmp(argv[i], "--heightmap") == 0 && i + 1 < argc) {
+            heightmap_file = argv[++i];
+        } else if(std::strcmp(argv[i], "--height-range") == 0 && i + 2 < argc) {
+            height_low = static_cast<float>(std::atof(argv[++i]));
+            height_high = static_cast<float>(std::atof(argv[++i]));
+        } else if(std::strcmp(argv[i], "--no-terrain") == 0) {
+            terrain = false;
+        } else if(std::strcmp(argv[i], "--float-heights") == 0) {
+            format = VK_FORMAT_R32_SFLOAT;
+        } else if(std::strcmp(argv[i], "--chunks") == 0 && i + 1 < argc) {
+            layout.chunks = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if(std::strcmp(argv[i], "--chunk-resolution") == 0 && i + 1 < argc) {
+            layout.chunk_resolution = static_cast<uint32_t>(std::atoi(argv[++i]));
+        } else if(std::strcmp(argv[i], "--chunk-extent") == 0 && i + 1 < argc) {
+            layout.chunk_extent = static_cast<float>(std::atof(argv[++i]));
+        } else if(std::strcmp(argv[i], "--origin") == 0 && i + 1 < argc) {
+            layout.origin = static_cast<float>(std::atof(argv[++i]));
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if(layout.chunks == 0 || layout.chunk_resolution < 2 || layout.chunk_extent <= 0.0f) {
+        throw std::runtime_error("Invalid terrain layout!");
+    }
+
+    std::vector<SceneFile::Mesh> meshes;
+    if(mesh_files.empty()) {
+        meshes.push_back(builtin_quad());
+    }
+    for(const auto& mesh_file : mesh_files) {
+        meshes.push_back(read_obj(mesh_file));
+    }
+    for(auto& mesh : meshes) {
+        build_lods(mesh);
+        std::cout << "Mesh " << mesh.name << ": " << mesh.vertices.size() << " vertices\n";
+        for(std::size_t lod = 0; lod < mesh.lods.size(); ++lod) {
+            std::cout << "\t|> level " << lod << ": " << mesh.lods[lod].size() / 3 << " triangles, error "
+                << mesh.lod_errors[lod] << "\n";
+        }
+    }
+
+    std::vector<Heightmap> heightmaps;
+    uint32_t samples = layout.samples();
+    glm::vec2 origin(layout.origin);
+    if(terrain && !heightmap_file.empty()) {
+        uint32_t width, height;
+        std::vector<float> source = read_pgm(heightmap_file, width, height);
+        heightmaps.emplace_back(resample(source, width, height, samples, height_low, height_high), origin,
+            layout.spacing(), samples, samples, format);
+        std::cout << "Heightmap " << heightmap_file << ": " << width << "x" << height << " resampled to "
+            << samples << "x" << samples << "\n";
+    } else if(terrain) {
+        TerrainGenerator generator;
+        heightmaps.emplace_back(generator, origin, layout.spacing(), samples, samples, format);
+        std::cout << "Heightmap: procedural terrain, " << samples << "x" << samples << "\n";
+    }
+
+    std::vector<SceneFile::Terrain> terrains;
+    for(const auto& heightmap : heightmaps) {
+        terrains.push_back({&heightmap, layout.chunk_resolution});
+    }
+    SceneFile::write(output, meshes, terrains);
+    std::cout << "Wrote " << output << "\n";
+    return 0;
+}
+
+
+int main(int argc, char** argv) {
+    try {
+        return bake(argc, argv);
+    } catch(const std::exception& error) {
+        std::cerr << error.what() << "\n";
+        return 1;
+    }
+}